@@ -20,9 +20,14 @@
 
 #include	<types_lib.h>
 #include	<bwt_lib.h>
+#include	<xbwt_lib.h>
 #include	<huff_lib.h>
 #include	<mtf_lib.h>
 #include	<rle_lib.h>
+#include	<compress_lib.h>
+#include	<dedup_lib.h>
+#include	<stream_lib.h>
+#include	<crc32_lib.h>
 
 
 
@@ -221,6 +226,68 @@ testBWT (char * filename)
 }
 /* }}}1 */
 
+/* {{{1 BWT ON DISK */
+/*
+ * with the least memory there is, everything but the smallest files is
+ * sorted in scratch files and goes through more than one merge pass
+ */
+static bool
+testXBWT (char * filename)
+{
+	struct testInfo	ti;
+	unsigned char		* check;
+	unsigned long		check_size;
+	int ret;
+
+
+	if ( false == startTest (&ti, filename) )
+		return false;
+
+	ret = xbwt_encode (ti.input, ti.input_size, &ti.output, &ti.output_size, XBWT_MIN_MEMORY);
+	if ( XBWT_RET_SUCCESS != ret )
+	{
+		if ( XBWT_RET_SCRATCH == ret )
+			puts("*** couldn't use scratch files while encoding");
+		else
+			puts("*** out of memory while encoding");
+
+		free (ti.input);
+		return true;
+	}
+
+	/* the block is the one made in memory */
+	if ( 1 == bwt_encode (ti.input, ti.input_size, &check, &check_size) )
+	{
+		ret = check_size == ti.output_size && 0 == memcmp (check, ti.output, check_size);
+		free (check);
+
+		if ( 0 == ret )
+		{
+			puts("*** differs from the in memory encoding");
+			free (ti.input);
+			free (ti.output);
+			return true;
+		}
+	}
+
+	if ( false == saveCompress (&ti) )
+		return false;
+
+	ret = bwt_decode (ti.input, ti.input_size, &ti.output, &ti.output_size);
+	if ( 1 == ret )
+	{
+		if ( false == saveDecompress (&ti) )
+			return false;
+	}
+	else
+	{
+		puts("*** out of memory while decoding");
+	}
+
+	return true;
+}
+/* }}}1 */
+
 /* {{{1 HUFFMAN ENCODER */
 #define HUFF_PRE_PADDING	1;
 
@@ -382,12 +449,519 @@ testRLE (char * filename)
 }
 /* }}}1 */
 
+/* {{{1 STREAM */
+/*
+ * feed the stream with awkwardly sized chunks of input and collect the
+ * output through a small buffer. the result should be identical to the
+ * one-shot compressor's
+ */
+#define STREAM_BLOCK_SIZE		204800
+#define STREAM_IN_CHUNK			7919
+#define STREAM_OUT_CHUNK		4096
+
+static bool
+testStream (char * filename)
+{
+	struct testInfo	ti;
+	struct compStream	strm;
+	int ret;
+
+	unsigned char	* oneshot;
+	unsigned long	oneshot_size,
+								bound,
+								n;
+
+
+	if ( false == startTest (&ti, filename) )
+		return false;
+
+	bound = strm_compressBound (ti.input_size, STREAM_BLOCK_SIZE);
+
+	ti.output = malloc (bound);
+	oneshot = malloc (bound);
+	if ( NULL == ti.output || NULL == oneshot )
+	{
+		puts("*** out of memory");
+		free (ti.output);
+		free (oneshot);
+		free (ti.input);
+		return false;
+	}
+
+	if ( COMP_RET_OKAY != strm_init (&strm, STREAM_BLOCK_SIZE) )
+	{
+		puts("*** couldn't initialise stream");
+		free (ti.output);
+		free (oneshot);
+		free (ti.input);
+		return false;
+	}
+
+	strm.errorHook = NULL;
+	strm.next_in = ti.input;
+	strm.next_out = ti.output;
+	strm.avail_in = strm.avail_out = 0;
+
+	do
+	{
+		/* top up input and output */
+		if ( 0 == strm.avail_in )
+		{
+			n = ti.input_size - strm.total_in;
+			strm.avail_in = n < STREAM_IN_CHUNK ? n : STREAM_IN_CHUNK;
+		}
+
+		n = bound - strm.total_out;
+		strm.avail_out = n < STREAM_OUT_CHUNK ? n : STREAM_OUT_CHUNK;
+
+		if ( strm.total_in + strm.avail_in < ti.input_size )
+			ret = strm_update (&strm);
+		else
+			ret = strm_finish (&strm);
+	}
+	while ( COMP_RET_OKAY == ret );
+
+	ti.output_size = strm.total_out;
+	strm_end (&strm);
+
+	if ( COMP_RET_STREAMEND != ret )
+	{
+		puts("*** error while compressing stream");
+		free (ti.output);
+		free (oneshot);
+		free (ti.input);
+		return true;
+	}
+
+	oneshot_size = bound;
+	ret = strm_compressBuffer (ti.input, ti.input_size, oneshot, &oneshot_size, STREAM_BLOCK_SIZE);
+	if ( COMP_RET_OKAY != ret || oneshot_size != ti.output_size || 0 != memcmp (oneshot, ti.output, oneshot_size) )
+	{
+		puts("*** stream and one-shot compression differ");
+		free (ti.output);
+		free (oneshot);
+		free (ti.input);
+		return true;
+	}
+	free (oneshot);
+
+	n = ti.input_size;
+
+	if ( false == saveCompress (&ti) )
+		return false;
+
+	ti.output_size = n;
+	ti.output = malloc (n);
+	if ( NULL == ti.output )
+	{
+		puts("*** out of memory");
+		free (ti.input);
+		return false;
+	}
+
+	ret = strm_decompressBuffer (ti.input, ti.input_size, ti.output, &ti.output_size);
+	if ( COMP_RET_OKAY != ret || n != ti.output_size )
+	{
+		puts("*** error while decompressing");
+		free (ti.output);
+		free (ti.input);
+		return true;
+	}
+
+	if ( false == saveDecompress (&ti) )
+		return false;
+
+	return true;
+}
+/* }}}1 */
+
+/* {{{1 BATCH */
+/*
+ * cut the input into small records, train a shared table on some of them
+ * and compress the lot as a batch. the table is passed to a fresh context
+ * through its code lengths, as a decompressor elsewhere would get it
+ */
+#define BATCH_RECORD_SIZE		4096
+#define BATCH_TRAIN_RECORDS	16
+
+static void
+batchRoundTrip (struct testInfo * ti, unsigned char ** records, unsigned long * record_sizes, unsigned long * comp_sizes, unsigned long count)
+{
+	struct compContext	* context,
+											* dcontext;
+	unsigned char				code_lens[COMP_TABLE_LEN];
+	unsigned long				k;
+	int									ret;
+
+	context = comp_newContext (NULL);
+	dcontext = comp_newContext (NULL);
+	if ( NULL == context || NULL == dcontext )
+	{
+		puts("*** out of memory");
+		comp_freeContext (context);
+		comp_freeContext (dcontext);
+		return;
+	}
+
+	ret = comp_trainTable (context, 0, records, record_sizes, count < BATCH_TRAIN_RECORDS ? count : BATCH_TRAIN_RECORDS);
+	if ( COMP_RET_OKAY == ret )
+		ret = comp_compressBatch (context, records, record_sizes, count, &ti->output, comp_sizes);
+
+	if ( COMP_RET_OKAY != ret )
+		puts("*** error while compressing");
+	else
+	if ( COMP_RET_OKAY != comp_getTable (context, 0, code_lens) || COMP_RET_OKAY != comp_setTable (dcontext, 0, code_lens) )
+	{
+		puts("*** table didn't survive its code lengths");
+		free (ti->output);
+	}
+	else
+	{
+		for ( ti->output_size = 0, k = 0; k < count; ++ k )
+			ti->output_size += comp_sizes[k];
+
+		if ( true == saveCompress (ti) )
+		{
+			ret = comp_decompressBatch (dcontext, ti->input, comp_sizes, count, &ti->output, record_sizes);
+			if ( COMP_RET_OKAY != ret )
+				puts("*** error while decompressing");
+			else
+			{
+				for ( ti->output_size = 0, k = 0; k < count; ++ k )
+					ti->output_size += record_sizes[k];
+
+				saveDecompress (ti);
+			}
+		}
+	}
+
+	comp_freeContext (context);
+	comp_freeContext (dcontext);
+}
+
+static bool
+testBatch (char * filename)
+{
+	struct testInfo	ti;
+	unsigned char		** records;
+	unsigned long		* record_sizes,
+									* comp_sizes,
+									count, k;
+
+
+	if ( false == startTest (&ti, filename) )
+		return false;
+
+	count = (ti.input_size + BATCH_RECORD_SIZE - 1) / BATCH_RECORD_SIZE;
+
+	records = malloc (count * sizeof *records);
+	record_sizes = malloc (count * sizeof *record_sizes);
+	comp_sizes = malloc (count * sizeof *comp_sizes);
+	if ( 0 == count || NULL == records || NULL == record_sizes || NULL == comp_sizes )
+	{
+		puts("*** out of memory");
+		free (records);
+		free (record_sizes);
+		free (comp_sizes);
+		free (ti.input);
+		return false;
+	}
+
+	for ( k = 0; k < count; ++ k )
+	{
+		records[k] = ti.input + k * BATCH_RECORD_SIZE;
+		record_sizes[k] = k < count - 1 ? BATCH_RECORD_SIZE : ti.input_size - k * BATCH_RECORD_SIZE;
+	}
+
+	batchRoundTrip (&ti, records, record_sizes, comp_sizes, count);
+
+	free (records);
+	free (record_sizes);
+	free (comp_sizes);
+	free (ti.input);
+
+	return true;
+}
+/* }}}1 */
+
+/* {{{1 DEDUP */
+/*
+ * compress the file twice through one dedup index, as two files in one run
+ * would be. the second copy should be nothing but repeats of the first.
+ * the blocks are then put back together, repeats being copied from the
+ * output so far as a container would do it
+ */
+#define DEDUP_TEST_MEMORY		(1024UL * 1024)
+
+struct dedupBlock
+{
+	unsigned char					* data;
+	unsigned long						size;
+	struct compBlockInfo		info;
+};
+
+struct dedupTest
+{
+	struct dedupBlock	* blocks;
+	unsigned long				num_blocks;
+	unsigned long				max_blocks;
+};
+
+static bool
+dedupHook (unsigned char * output, unsigned long output_size, struct compBlockInfo * block_info, void * callback_data)
+{
+	struct dedupTest	* dt = (struct dedupTest *) callback_data;
+	struct dedupBlock	* tmp;
+	unsigned long				max;
+
+	if ( dt->num_blocks == dt->max_blocks )
+	{
+		max = 0 == dt->max_blocks ? 16 : dt->max_blocks * 2;
+		tmp = realloc (dt->blocks, max * sizeof *dt->blocks);
+		if ( NULL == tmp )
+			return false;
+
+		dt->blocks = tmp;
+		dt->max_blocks = max;
+	}
+
+	tmp = &dt->blocks[dt->num_blocks];
+	tmp->data = NULL;
+	tmp->size = output_size;
+	tmp->info = *block_info;
+
+	if ( output_size > 0 )
+	{
+		tmp->data = malloc (output_size);
+		if ( NULL == tmp->data )
+			return false;
+
+		memcpy (tmp->data, output, output_size);
+	}
+
+	++ dt->num_blocks;
+
+	return true;
+}
+
+/* put the blocks back together into ti->output. false if they don't fit together */
+static bool
+dedupRebuild (struct testInfo * ti, struct dedupTest * dt, unsigned long size)
+{
+	struct dedupBlock	* block;
+	unsigned char			* output;
+	unsigned long				output_size,
+											b;
+
+	ti->output = malloc (size + 1);
+	if ( NULL == ti->output )
+		return false;
+
+	for ( ti->output_size = 0, b = 0; b < dt->num_blocks; ++ b )
+	{
+		block = &dt->blocks[b];
+
+		if ( block->info.uncompressed_size > size - ti->output_size )
+			return false;
+
+		if ( true == block->info.repeat )
+		{
+			if ( block->info.repeat_offset > ti->output_size || block->info.uncompressed_size > ti->output_size - block->info.repeat_offset )
+				return false;
+
+			memcpy (ti->output + ti->output_size, ti->output + block->info.repeat_offset, block->info.uncompressed_size);
+		}
+		else
+		{
+			if ( COMP_RET_OKAY != comp_decompressBlock (NULL, block->data, block->size, &output, &output_size) )
+				return false;
+
+			if ( output_size != block->info.uncompressed_size )
+			{
+				free (output);
+				return false;
+			}
+
+			memcpy (ti->output + ti->output_size, output, output_size);
+			free (output);
+		}
+
+		if ( crc_generate (ti->output + ti->output_size, block->info.uncompressed_size) != block->info.crc )
+			return false;
+
+		ti->output_size += block->info.uncompressed_size;
+	}
+
+	return ti->output_size == size;
+}
+
+static bool
+testDedup (char * filename)
+{
+	struct testInfo			ti;
+	struct compressInfo	info;
+	struct dedupTest		dt;
+	FILE							* f;
+	unsigned long				first = 0,
+											b;
+	int									pass,
+											ret = COMP_RET_OKAY;
+
+
+	if ( false == startTest (&ti, filename) )
+		return false;
+
+	memset (&dt, 0, sizeof dt);
+	memset (&info, 0, sizeof info);
+	info.compressHook = dedupHook;
+	info.compressHook_data = &dt;
+
+	info.dedup = dedup_newIndex (DEDUP_TEST_MEMORY);
+	if ( NULL == info.dedup )
+	{
+		puts("*** out of memory");
+		free (ti.input);
+		return false;
+	}
+
+	for ( pass = 0; pass < 2 && COMP_RET_OKAY == ret; ++ pass )
+	{
+		f = fopen (filename, "rb");
+		if ( NULL == f )
+		{
+			perror (filename);
+			ret = COMP_RET_READ;
+			break; /* for loop */
+		}
+
+		ret = comp_compressFile (&info, f, comp_levelBlockSize (COMP_LEVEL_DEFAULT));
+		fclose (f);
+
+		if ( 0 == pass )
+			first = dt.num_blocks;
+	}
+
+	dedup_freeIndex (info.dedup);
+
+	if ( COMP_RET_OKAY != ret )
+		puts("*** error while compressing");
+	else
+	{
+		for ( b = first; b < dt.num_blocks; ++ b )
+			if ( false == dt.blocks[b].info.repeat )
+				break; /* for loop */
+
+		if ( b < dt.num_blocks )
+			puts("*** second copy wasn't deduplicated");
+		else
+		if ( false == dedupRebuild (&ti, &dt, 2 * ti.input_size) )
+		{
+			puts("*** error while decompressing");
+			free (ti.output);
+			ti.output = NULL;
+		}
+		else
+		if ( 0 != memcmp (ti.output, ti.output + ti.input_size, ti.input_size) )
+		{
+			puts("*** second copy differs from the first");
+			free (ti.output);
+			ti.output = NULL;
+		}
+		else
+		{
+			/* one copy to compare with the file */
+			ti.output_size = ti.input_size;
+			saveDecompress (&ti);
+		}
+	}
+
+	for ( b = 0; b < dt.num_blocks; ++ b )
+		free (dt.blocks[b].data);
+	free (dt.blocks);
+	free (ti.input);
+
+	return true;
+}
+/* }}}1 */
+
+/* {{{1 CRC */
+/* one bit at a time, straight from the definition */
+static unsigned long
+slowCRC (unsigned char * data, unsigned long size)
+{
+	unsigned long	crc = CRC_INIT;
+	int						k;
+
+	for (; size; --size, ++data)
+	{
+		crc ^= *data;
+		for ( k = 0; k < 8; ++ k )
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320UL : crc >> 1;
+	}
+
+	return crc;
+}
+
+static bool
+testCRC (char * filename)
+{
+	struct testInfo	ti;
+	unsigned long		crc,
+									split,
+									step;
+
+
+	if ( false == startTest (&ti, filename) )
+		return false;
+
+	crc = crc_generate (ti.input, ti.input_size);
+	if ( crc != slowCRC (ti.input, ti.input_size) )
+	{
+		puts("*** crc differs from reference");
+		free (ti.input);
+		return true;
+	}
+
+	/* split at odd places so that every alignment and tail length is tried */
+	step = ti.input_size / 7 + 1;
+	for ( split = 0; split <= ti.input_size; split += step )
+	{
+		if ( crc != crc_update (crc_generate (ti.input, split), ti.input + split, ti.input_size - split) )
+		{
+			printf("*** crc_update differs at %lu\n", split);
+			free (ti.input);
+			return true;
+		}
+
+		if ( crc != crc_combine (crc_generate (ti.input, split), crc_generate (ti.input + split, ti.input_size - split), ti.input_size - split) )
+		{
+			printf("*** crc_combine differs at %lu\n", split);
+			free (ti.input);
+			return true;
+		}
+	}
+
+	/* nothing is transformed -- pass the input through as a success */
+	ti.output = ti.input;
+	ti.output_size = ti.input_size;
+	ti.input = NULL;
+
+	if ( false == saveDecompress (&ti) )
+		return false;
+
+	return true;
+}
+/* }}}1 */
+
 static int
 mainTest (char * filename, char * library)
 {
 	if ( 0 == strcmp (library, "bwt") )
 		return testBWT (filename);
 	else
+	if ( 0 == strcmp (library, "xbwt") )
+		return testXBWT (filename);
+	else
 	if ( 0 == strcmp (library, "huff") )
 		return testHuff (filename);
 	else
@@ -397,6 +971,18 @@ mainTest (char * filename, char * library)
 	if ( 0 == strcmp (library, "rle") )
 		return testRLE (filename);
 	else
+	if ( 0 == strcmp (library, "stream") )
+		return testStream (filename);
+	else
+	if ( 0 == strcmp (library, "crc") )
+		return testCRC (filename);
+	else
+	if ( 0 == strcmp (library, "batch") )
+		return testBatch (filename);
+	else
+	if ( 0 == strcmp (library, "dedup") )
+		return testDedup (filename);
+	else
 	{
 		/* ... */
 	}
@@ -20,12 +20,19 @@
 #include	<getopt.h>
 
 #include	<compress_lib.h>
+#include	<dedup_lib.h>
+#include	<flk_lib.h>
+#include	<reader_lib.h>
 #include	<types_lib.h>
 
 
 #define FILE_EXTENSION			".flk"
 #define FILE_EXTENSION_LEN	4
 
+/* decompressing a range of the file */
+#define RANGE_CACHE_BLOCKS	4
+#define RANGE_CHUNK					65536
+
 struct flickInfo
 {
 	struct compressInfo	 compress_info;
@@ -37,6 +44,25 @@ struct flickInfo
 
 	bool					decrunch;
 	unsigned long	block_size;
+	bool					block_size_set;		/* by -b rather than the level */
+
+	/* check every block without writing anything */
+	bool					test;
+
+	/* records of the blocks written so far */
+	struct flkIndex	* index;
+
+	/* memory for the fingerprints of chunks seen, or 0 not to deduplicate */
+	unsigned long	dedup_memory;
+
+	/* run compression stages on their own threads */
+	bool					pipelined;
+	unsigned int	stage_threads[COMP_STAGE_COUNT];
+
+	/* only decompress range_length bytes from range_offset */
+	bool					range;
+	unsigned long	range_offset;
+	unsigned long	range_length;
 };
 
 
@@ -45,20 +71,154 @@ usage (char * progname)
 {
 	printf("\nUsage: %s [flags and then input]\n\
 	-h  help\n\
+	-b  block size, up to 1G (eg. 64M) -- larger blocks take more memory\n\
 	-d  decompress\n\
+	-m  memory for the bwt of each block (eg. 256M) -- a block needing more is sorted on disk\n\
 	-o  output file\n\
-	-1 .. -9 (block size from 100k to 900k)\n\
+	-p  pipeline stages on threads (pre-rle,bwt,mtf,huffman threads eg. 1,4,1,1)\n\
+	-r  decompress only a range of bytes (offset,length)\n\
+	-t  test integrity of a compressed file\n\
+	-1 .. -9 compression level (block size from 100k to 900k, -1 doesn't use the bwt)\n\
+	--target-rate=rate  compress at around rate (eg. 20MB/s), using levels up to the one given\n\
+	--dedup=memory  store data seen before as a reference to it, remembering memory's worth (eg. 64M)\n\
 	\n", progname);
 }
 
+/* parse comma separated list of thread counts for each compression stage */
+static bool
+parseStageThreads (struct flickInfo * info, char * arg)
+{
+	char	* end;
+	int		s;
+
+	for ( s = 0; s < COMP_STAGE_COUNT; ++ s )
+		info->stage_threads[s] = 1;
+
+	for ( s = 0; s < COMP_STAGE_COUNT && '\0' != *arg; ++ s )
+	{
+		info->stage_threads[s] = strtoul (arg, &end, 10);
+		if ( end == arg || 0 == info->stage_threads[s] || (',' != *end && '\0' != *end) )
+			return false;
+
+		arg = ',' == *end ? end + 1 : end;
+	}
+
+	return '\0' == *arg;
+}
+
+/* parse a number with an optional k, M or G. end is left just after it */
+static bool
+parseSize (char * arg, unsigned long * size, char ** end)
+{
+	*size = strtoul (arg, end, 10);
+	if ( *end == arg || 0 == *size )
+		return false;
+
+	switch ( **end )
+	{
+	case 'k': case 'K':
+		*size *= 1024UL;
+		++ *end;
+		break;
+	case 'm': case 'M':
+		*size *= 1024UL * 1024;
+		++ *end;
+		break;
+	case 'g': case 'G':
+		*size *= 1024UL * 1024 * 1024;
+		++ *end;
+		break;
+	}
+
+	return true;
+}
+
+/* parse a block size in bytes, with an optional k, M or G */
+static bool
+parseBlockSize (struct flickInfo * info, char * arg)
+{
+	char	* end;
+
+	if ( false == parseSize (arg, &info->block_size, &end) )
+		return false;
+
+	return '\0' == *end && info->block_size <= COMP_BLOCK_MAX;
+}
+
+/* parse the memory the bwt may take, with an optional k, M or G */
+static bool
+parseMemory (struct flickInfo * info, char * arg)
+{
+	char	* end;
+
+	if ( false == parseSize (arg, &info->compress_info.bwt_memory, &end) )
+		return false;
+
+	return '\0' == *end;
+}
+
+/* parse the memory the dedup index may take, with an optional k, M or G */
+static bool
+parseDedup (struct flickInfo * info, char * arg)
+{
+	char	* end;
+
+	if ( false == parseSize (arg, &info->dedup_memory, &end) )
+		return false;
+
+	return '\0' == *end;
+}
+
+/* parse a rate in bytes a second, with an optional k, M or G and B/s */
+static bool
+parseRate (struct flickInfo * info, char * arg)
+{
+	char	* end;
+
+	if ( false == parseSize (arg, &info->compress_info.target_rate, &end) )
+		return false;
+
+	if ( 'B' == *end )
+		++ end;
+
+	if ( 0 == strcmp (end, "/s") )
+		end += 2;
+
+	return '\0' == *end;
+}
+
+/* parse offset,length pair */
+static bool
+parseRange (struct flickInfo * info, char * arg)
+{
+	char	* end;
+
+	info->range_offset = strtoul (arg, &end, 10);
+	if ( end == arg || ',' != *end )
+		return false;
+
+	arg = end + 1;
+	info->range_length = strtoul (arg, &end, 10);
+	if ( end == arg || '\0' != *end )
+		return false;
+
+	return true;
+}
+
 static bool
 parseArgs (struct flickInfo * info, int argc, char ** argv)
 {
+	static struct option	long_options[] = {
+		{ "target-rate", required_argument, NULL, 'R' },
+		{ "dedup", required_argument, NULL, 'D' },
+		{ NULL, 0, NULL, 0 }
+	};
+
 	int             op;
 
 	opterr = 0;
 
-	while ((op = getopt (argc, argv, "hdo:123456789")) != EOF)
+	while ((op = getopt_long (argc, argv, "hb:dm:o:p:r:t123456789", long_options, NULL)) != EOF)
 	{
 		switch (op)
 		{
@@ -66,10 +226,27 @@ parseArgs (struct flickInfo * info, int argc, char ** argv)
 			usage (argv[0]);
 			return false;
 
+		case 'b':
+			if ( false == parseBlockSize (info, optarg) )
+			{
+				fputs("*** bad block size\n", stderr);
+				return false;
+			}
+			info->block_size_set = true;
+			break;
+
 		case 'd':
 			info->decrunch = true;
 			break;
 
+		case 'm':
+			if ( false == parseMemory (info, optarg) )
+			{
+				fputs("*** bad bwt memory\n", stderr);
+				return false;
+			}
+			break;
+
 		case 'o':
 			free (info->output_name);
 			info->output_name = malloc ((strlen (optarg) + 1) * sizeof *info->output);
@@ -81,33 +258,52 @@ parseArgs (struct flickInfo * info, int argc, char ** argv)
 			strcpy (info->output_name, optarg);
 			break;
 
-		/* change block size */
-		case '1':
-			info->block_size = 102400;
-			break;
-		case '2':
-			info->block_size = 204800;
-			break;
-		case '3':
-			info->block_size = 307200;
-			break;
-		case '4':
-			info->block_size = 409600;
+		case 'p':
+			if ( false == parseStageThreads (info, optarg) )
+			{
+				fputs("*** bad stage thread list\n", stderr);
+				return false;
+			}
+			info->pipelined = true;
 			break;
-		case '5':
-			info->block_size = 512000;
+
+		case 'r':
+			if ( false == parseRange (info, optarg) )
+			{
+				fputs("*** bad range\n", stderr);
+				return false;
+			}
+			info->range = true;
+			info->decrunch = true;
 			break;
-		case '6':
-			info->block_size = 614400;
+
+		case 't':
+			info->test = true;
 			break;
-		case '7':
-			info->block_size = 716800;
+
+		case 'R':
+			if ( false == parseRate (info, optarg) )
+			{
+				fputs("*** bad target rate\n", stderr);
+				return false;
+			}
 			break;
-		case '8':
-			info->block_size = 819200;
+
+		case 'D':
+			if ( false == parseDedup (info, optarg) )
+			{
+				fputs("*** bad dedup memory\n", stderr);
+				return false;
+			}
 			break;
-		case '9':
-			info->block_size = 921600;
+
+		/* compression level, which sets the block size too unless it's been given */
+		case '1': case '2': case '3':
+		case '4': case '5': case '6':
+		case '7': case '8': case '9':
+			info->compress_info.level = op - '0';
+			if ( false == info->block_size_set )
+				info->block_size = comp_levelBlockSize (info->compress_info.level);
 			break;
 
 		default:
@@ -134,46 +330,280 @@ errorHook (char * error, void * callback_data)
 }
 
 static bool
-compressHook (unsigned char * output, unsigned long output_size, void * callback_data)
+compressHook (unsigned char * output, unsigned long output_size, struct compBlockInfo * block_info, void * callback_data)
 {
 	struct flickInfo	* info = (struct flickInfo *)callback_data;
+	unsigned char			record[FLK_RECORD_LEN + FLK_REPEAT_LEN];
 
-	/* write out block size in big endian format */
-	fputc ((output_size >> 24) & 0xff, info->output);
-	fputc ((output_size >> 16) & 0xff, info->output);
-	fputc ((output_size >> 8) & 0xff, info->output);
-	fputc (output_size & 0xff, info->output);
+	if ( COMP_RET_OKAY != flk_addBlock (info->index, output_size, block_info, record) )
+		return false;
+
+	/* a repeat's data is written along with its record */
+	if ( true == block_info->repeat )
+	{
+		output = record + FLK_RECORD_LEN;
+		output_size = FLK_REPEAT_LEN;
+	}
+
+	/* write block record and then output data */
+	if ( fwrite (record, sizeof *record, FLK_RECORD_LEN, info->output) != FLK_RECORD_LEN )
+		return false;
 
-	/* write output data */
 	if ( fwrite (output, sizeof *output, output_size, info->output) != output_size )
 		return false;
 
 	return true;
 }
 
+
+/* a block size too large for the memory there is comes down to one that fits */
 static bool
-decompressStartHook (FILE * f, unsigned long * block_size, void * callback_data)
+fitBlockSize (struct flickInfo * info)
 {
-	*block_size = fgetc (f) << 24;
-	*block_size |= fgetc (f) << 16;
-	*block_size |= fgetc (f) << 8;
-	*block_size |= fgetc (f);
+	unsigned long	blocks = 1,
+								block_size;
+	int						s;
+
+	/* every stage thread can be holding a block */
+	if ( true == info->pipelined )
+	{
+		for ( blocks = 0, s = 0; s < COMP_STAGE_COUNT; ++ s )
+			blocks += info->stage_threads[s];
+	}
+
+	block_size = comp_fitBlockSize (info->block_size, blocks, info->compress_info.bwt_memory);
+	if ( 0 == block_size )
+	{
+		fputs ("*** not enough memory to compress\n", stderr);
+		return false;
+	}
+
+	if ( block_size < info->block_size )
+	{
+		fprintf (stderr, "*** block size reduced to %lu bytes to fit in memory\n", block_size);
+		info->block_size = block_size;
+	}
 
 	return true;
 }
 
+/* compress to a version 2 file -- header, blocks and then the index */
 static bool
-decompressEndHook (unsigned char * output, unsigned long output_size, void * callback_data)
+compressFile (struct flickInfo * info)
 {
-	struct flickInfo	* info = (struct flickInfo *)callback_data;
+	unsigned char	header[FLK_HEADER_LEN];
+	unsigned char	* trailer;
+	int						ret;
 
-	/* write output data */
-	if ( fwrite (output, sizeof *output, output_size, info->output) != output_size )
+	if ( false == fitBlockSize (info) )
 		return false;
 
+	if ( 0 != info->dedup_memory )
+	{
+		info->compress_info.dedup = dedup_newIndex (info->dedup_memory);
+		if ( NULL == info->compress_info.dedup )
+		{
+			fputs ("*** out of memory\n", stderr);
+			return false;
+		}
+	}
+
+	info->index = flk_newIndex (info->block_size, NULL != info->compress_info.dedup);
+	if ( NULL == info->index )
+	{
+		fputs ("*** out of memory\n", stderr);
+		return false;
+	}
+
+	flk_writeHeader (info->index, header);
+	if ( FLK_HEADER_LEN != fwrite (header, sizeof *header, FLK_HEADER_LEN, info->output) )
+	{
+		fputs ("*** error writing output file\n", stderr);
+		return false;
+	}
+
+	if ( true == info->pipelined )
+		ret = comp_compressFilePipelined (&info->compress_info, info->input, info->block_size, info->stage_threads);
+	else
+		ret = comp_compressFile (&info->compress_info, info->input, info->block_size);
+
+	if ( COMP_RET_OKAY != ret )
+		return false;
+
+	trailer = malloc (flk_indexLen (info->index));
+	if ( NULL == trailer )
+	{
+		fputs ("*** out of memory\n", stderr);
+		return false;
+	}
+
+	flk_writeIndex (info->index, trailer);
+	if ( flk_indexLen (info->index) != fwrite (trailer, sizeof *trailer, flk_indexLen (info->index), info->output) )
+	{
+		fputs ("*** error writing output file\n", stderr);
+		free (trailer);
+		return false;
+	}
+
+	free (trailer);
+
 	return true;
 }
 
+static void
+decompressError (int ret)
+{
+	if ( COMP_RET_VERSION == ret )
+		fputs ("*** file was made by an incompatible version of flick\n", stderr);
+	else
+	if ( COMP_RET_NOMEM == ret )
+		fputs ("*** out of memory\n", stderr);
+	else
+		fputs ("*** not a valid flick file\n", stderr);
+}
+
+/* decompress a file of either version, block by block */
+static bool
+decompressFile (struct flickInfo * info)
+{
+	unsigned char	* buffer = NULL,
+								* output;
+	unsigned long		buffer_size = 0,
+									output_size,
+									b;
+	int							ret;
+
+	ret = flk_readIndex (info->input, &info->index);
+	if ( COMP_RET_OKAY != ret )
+	{
+		decompressError (ret);
+		return false;
+	}
+
+	for ( b = 0; b < info->index->num_blocks; ++ b )
+	{
+		ret = flk_readBlock (info->input, info->index, b, &buffer, &buffer_size, &output, &output_size);
+		if ( COMP_RET_OKAY != ret )
+		{
+			if ( COMP_RET_CHECKSUM == ret || COMP_RET_COMP == ret || COMP_RET_MALFORMED == ret )
+				fprintf (stderr, "*** block %lu is corrupt\n", b);
+			else
+				decompressError (ret);
+
+			free (buffer);
+			return false;
+		}
+
+		if ( output_size != fwrite (output, sizeof *output, output_size, info->output) )
+		{
+			fputs ("*** error writing output file\n", stderr);
+			free (output);
+			free (buffer);
+			return false;
+		}
+
+		free (output);
+	}
+
+	free (buffer);
+
+	return true;
+}
+
+
+/* decode every block on as many threads as there are cpus and report the first that is bad */
+static bool
+testFile (struct flickInfo * info)
+{
+	struct flkBlock	* block;
+	unsigned long			b;
+	int								ret;
+
+	ret = flk_readIndex (info->input, &info->index);
+	if ( COMP_RET_OKAY != ret )
+	{
+		decompressError (ret);
+		return false;
+	}
+
+	ret = flk_verify (info->input, info->index, 0, &b);
+	if ( COMP_RET_OKAY == ret )
+		return true;
+
+	if ( COMP_RET_CHECKSUM == ret || COMP_RET_COMP == ret || COMP_RET_MALFORMED == ret )
+	{
+		block = &info->index->blocks[b];
+
+		if ( 1 == info->index->version )
+			fprintf (stderr, "*** block %lu at file offset %lu is corrupt\n", b, block->offset);
+		else
+			fprintf (stderr, "*** block %lu at file offset %lu (uncompressed offset %lu) is corrupt\n", b, block->offset, block->uncomp_offset);
+	}
+	else
+		decompressError (ret);
+
+	return false;
+}
+
+/* decompress just the requested range through a random access reader */
+static bool
+decompressRange (struct flickInfo * info)
+{
+	struct flkReader	* reader;
+	unsigned char			* buffer;
+	unsigned long				n,
+											got;
+	int									ret;
+
+	ret = rdr_open (info->input, RANGE_CACHE_BLOCKS, &reader);
+	if ( COMP_RET_OKAY != ret )
+	{
+		decompressError (ret);
+		return false;
+	}
+
+	buffer = malloc (RANGE_CHUNK);
+	if ( NULL == buffer )
+	{
+		fputs ("*** out of memory\n", stderr);
+		rdr_close (reader);
+		return false;
+	}
+
+	while ( info->range_length > 0 )
+	{
+		n = info->range_length < RANGE_CHUNK ? info->range_length : RANGE_CHUNK;
+
+		ret = rdr_read (reader, info->range_offset, buffer, n, &got);
+		if ( COMP_RET_OKAY != ret )
+		{
+			fputs ("*** error decompressing range\n", stderr);
+			free (buffer);
+			rdr_close (reader);
+			return false;
+		}
+
+		if ( got != fwrite (buffer, sizeof *buffer, got, info->output) )
+		{
+			fputs ("*** error writing output file\n", stderr);
+			free (buffer);
+			rdr_close (reader);
+			return false;
+		}
+
+		/* end of data */
+		if ( got < n )
+			break; /* while loop */
+
+		info->range_offset += got;
+		info->range_length -= got;
+	}
+
+	free (buffer);
+	rdr_close (reader);
+
+	return true;
+}
 
 static void
 initFlickInfo (struct flickInfo * info)
@@ -186,12 +616,8 @@ initFlickInfo (struct flickInfo * info)
 	info->compress_info.compressHook = compressHook;
 	info->compress_info.compressHook_data = info;
 
-	info->compress_info.decompressStartHook = decompressStartHook;
-	info->compress_info.decompressEndHook = decompressEndHook;
-	info->compress_info.decompressHook_data = info;
-
 	info->decrunch = false;
-	info->block_size = 921600;
+	info->block_size = comp_levelBlockSize (COMP_LEVEL_DEFAULT);
 }
 
 static void
@@ -207,6 +633,12 @@ cleanFlickInfo (struct flickInfo * info)
 
 	free (info->output_name);
 	info->output_name = NULL;
+
+	flk_freeIndex (info->index);
+	info->index = NULL;
+
+	dedup_freeIndex (info->compress_info.dedup);
+	info->compress_info.dedup = NULL;
 }
 
 int
@@ -229,6 +661,19 @@ main (int argc, char ** argv)
 		return EXIT_FAILURE;
 	}
 
+	/* testing needs no output file */
+	if ( true == info.test )
+	{
+		if ( false == testFile (&info) )
+		{
+			cleanFlickInfo (&info);
+			return EXIT_FAILURE;
+		}
+
+		cleanFlickInfo (&info);
+		return EXIT_SUCCESS;
+	}
+
 	/*
 	 * if no output name has been specified on the command line
 	 * prepare output filename depending on whether the file is to
@@ -293,10 +738,20 @@ main (int argc, char ** argv)
 		return EXIT_FAILURE;
 	}
 
+	/* decrunch a range... */
+	if ( true == info.range )
+	{
+		if ( false == decompressRange (&info) )
+		{
+			cleanFlickInfo (&info);
+			return EXIT_FAILURE;
+		}
+	}
+	else
 	/* decrunch... */
 	if ( true == info.decrunch )
 	{
-		if ( COMP_RET_OKAY != comp_decompressFile (&info.compress_info, info.input, true, 0) )
+		if ( false == decompressFile (&info) )
 		{
 			cleanFlickInfo (&info);
 			return EXIT_FAILURE;
@@ -304,7 +759,7 @@ main (int argc, char ** argv)
 	}
 	else
 	/* ...or crunch */
-	if ( COMP_RET_OKAY != comp_compressFile (&info.compress_info, info.input, info.block_size) )
+	if ( false == compressFile (&info) )
 	{
 		cleanFlickInfo (&info);
 		return EXIT_FAILURE;
@@ -238,29 +238,87 @@ bitq_freeStream (struct bitqStream * stream)
 int
 bitq_writeStream (struct bitqStream * stream, unsigned int data, unsigned char data_len)
 {
+	struct bitqState	* state = stream->state;
 	int	ret;
-	unsigned char output_c;
 
-	ret = bitq_push (stream->state, data, data_len);
+	ret = bitq_push (state, data, data_len);
 
 	if ( BITQ_TOO_MUCH == ret )
 		return BITQ_TOO_MUCH;
 
-	if ( BITQ_POP_READY == ret )
+	/* the same bytes bitq_popChar() would give, taken straight from the buffer */
+	while ( state->buffer_used >= CHAR_BIT )
 	{
-		do
+		state->buffer_used -= CHAR_BIT;
+
+		stream->stream[*stream->len] = (state->buffer >> state->buffer_used) & 0xff;
+		++ *stream->len;
+		if ( *stream->len == stream->size )
+			return BITQ_TOO_MUCH;
+	}
+
+	state->buffer &= (1UL << state->buffer_used) - 1;
+
+	return BITQ_CONTINUE;
+}
+
+int
+bitq_writeStreamCodes (struct bitqStream * stream, unsigned char * input, unsigned long input_size, unsigned int * codes, unsigned char * code_lens)
+{
+	/* kept in locals -- writing through stream->stream would make the compiler reload everything else */
+	unsigned char	* output = stream->stream;
+	unsigned long		len = *stream->len,
+									size = stream->size,
+									buffer = stream->state->buffer;
+	unsigned char		buffer_used = stream->state->buffer_used,
+									code_len;
+	unsigned long		i;
+	int							ret = BITQ_CONTINUE;
+
+	for ( i = 0; i < input_size; ++ i )
+	{
+		code_len = code_lens[input[i]];
+
+		/* as bitq_push() */
+		if ( code_len > CHAR_BIT * 3 && (code_len - (CHAR_BIT * 3)) < buffer_used )
 		{
-			ret = bitq_popChar (stream->state, &output_c);
+			ret = BITQ_TOO_MUCH;
+			break; /* for loop */
+		}
 
-			stream->stream[*stream->len] = output_c;
-			++ *stream->len;
-			if ( *stream->len == stream->size )
-				return BITQ_TOO_MUCH;
+		/* the buffer never holds more bytes than it has room for */
+		if ( len + sizeof buffer >= size )
+		{
+			ret = BITQ_TOO_MUCH;
+			break; /* for loop */
+		}
+
+		buffer = (buffer << code_len) | codes[input[i]];
+		buffer_used += code_len;
+
+		/* empty the buffer only when the next code might not fit */
+		if ( buffer_used > sizeof buffer * CHAR_BIT - 32 )
+		{
+			while ( buffer_used >= CHAR_BIT )
+			{
+				buffer_used -= CHAR_BIT;
+				output[len ++] = (buffer >> buffer_used) & 0xff;
+			}
 		}
-		while ( BITQ_POP_READY == ret );
 	}
 
-	return BITQ_CONTINUE;
+	/* the state is left holding less than a byte, as bitq_writeStream() leaves it */
+	while ( BITQ_CONTINUE == ret && buffer_used >= CHAR_BIT )
+	{
+		buffer_used -= CHAR_BIT;
+		output[len ++] = (buffer >> buffer_used) & 0xff;
+	}
+
+	*stream->len = len;
+	stream->state->buffer = buffer & ((1UL << buffer_used) - 1);
+	stream->state->buffer_used = buffer_used;
+
+	return ret;
 }
 
 int
@@ -307,4 +365,34 @@ bitq_readStream (struct bitqStream * stream, unsigned char * data, unsigned char
 
 	return ret;
 }
+
+unsigned char
+bitq_peekStream (struct bitqStream * stream, unsigned int * data, unsigned char data_len)
+{
+	struct bitqState	* state = stream->state;
+	unsigned char			avail;
+
+	/* top up the buffer a byte at a time, leaving room for another */
+	while ( state->buffer_used <= 3*CHAR_BIT && *stream->len < stream->size )
+	{
+		bitq_push (state, stream->stream[*stream->len], CHAR_BIT);
+		++ *stream->len;
+	}
+
+	avail = state->buffer_used < data_len ? state->buffer_used : data_len;
+
+	*data = (state->buffer >> (state->buffer_used - avail)) & ((1UL << avail) - 1);
+	*data <<= data_len - avail;
+
+	return avail;
+}
+
+void
+bitq_skipStream (struct bitqStream * stream, unsigned char data_len)
+{
+	struct bitqState	* state = stream->state;
+
+	state->buffer_used -= data_len;
+	state->buffer &= (1UL << state->buffer_used) - 1;
+}
 /* }}}1 */
@@ -121,6 +121,12 @@ void bitq_freeStream (struct bitqStream *);
  */
 int bitq_writeStream (struct bitqStream *, unsigned int data, unsigned char data_len);
 
+/*
+ * as bitq_writeStream() for codes[input[i]], code_lens[input[i]] of every
+ * byte of input, without a call for each
+ */
+int bitq_writeStreamCodes (struct bitqStream *, unsigned char * input, unsigned long input_size, unsigned int * codes, unsigned char * code_lens);
+
 /*
  * empties bitq into stream
  *
@@ -139,5 +145,18 @@ int bitq_flushWriteStream (struct bitqStream *);
  */
 unsigned char bitq_readStream (struct bitqStream * stream, unsigned char * data, unsigned char data_len);
 
+/*
+ * look at the next data_len (no more than 24) bits of stream without
+ * reading them. bits past the end of the stream are zero.
+ *
+ * returns the number of bits that are really there, up to data_len
+ */
+unsigned char bitq_peekStream (struct bitqStream * stream, unsigned int * data, unsigned char data_len);
+
+/*
+ * drop data_len bits, no more than bitq_peekStream() said were there
+ */
+void bitq_skipStream (struct bitqStream * stream, unsigned char data_len);
+
 #endif /* BITQLIB_H */
 
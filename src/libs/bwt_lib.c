@@ -29,7 +29,13 @@
 /* sorting algorithm to use for encoder -- defaults to shell sort */
 //#define BWT_RADIX 1
 //#define BWT_QUICK 1
-#define	BWT_MULTI_QUICK 1
+//#define	BWT_MULTI_QUICK 1
+
+/*
+ * sort the rotations by prefix doubling instead of sorting a matrix of
+ * them -- takes precedence over the above
+ */
+#define BWT_DOUBLING 1
 
 /*** END OF user definable sections ***/
 
@@ -38,6 +44,9 @@
 #include	<stdlib.h>
 #include	<string.h>
 #include	<limits.h>
+#include	<stdint.h>
+
+#include	"bwt_lib.h"
 
 #ifdef BWT_ASSERTIONS
 #include <assert.h>
@@ -62,9 +71,37 @@
  */
 #define BWT_HEADERLEN	 4
 
+/*
+ * each byte of the input barrel holds the byte plus one, so that no
+ * symbol is zero. a short is all that needs and keeps the barrel, which
+ * is twice the size of the input, small for large blocks
+ */
+typedef unsigned short	symbolT;
+
 /* {{{1 SUPPORT FUNCTIONS */
+static void
+putIndex (unsigned char * p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+/* unsigned long throughout -- a top byte over 0x7f must not reach the sign bit of an int */
+static unsigned long
+getIndex (unsigned char * p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+#ifndef min
+#define min(a, b) ((a)<=(b) ? (a) : (b))
+#endif
+
+#ifndef BWT_DOUBLING
 static long
-bwt_memcmp (unsigned int *s1, unsigned int *s2, unsigned int *o, unsigned int *e, unsigned long n)
+bwt_memcmp (symbolT *s1, symbolT *s2, symbolT *o, symbolT *e, unsigned long n)
 {
 	/*
 	 * s1 = memory vector 1
@@ -92,16 +129,12 @@ bwt_memcmp (unsigned int *s1, unsigned int *s2, unsigned int *o, unsigned int *e
 	return 0;
 }
 
-#define swap(a,b)	{ unsigned int *t; t = *a; *a = *b; *b = t; }
-
-#ifndef min
-#define min(a, b) ((a)<=(b) ? (a) : (b))
-#endif
+#define swap(a,b)	{ symbolT *t; t = *a; *a = *b; *b = t; }
 
 #ifdef BWT_PRINT_MATRIX
 /* print matrix digest */
 static void
-matrixPrint(unsigned int ** matrix, unsigned long input_size) {
+matrixPrint(symbolT ** matrix, unsigned long input_size) {
 #ifdef BWT_ENCODER_INPUT_BARREL
 	int detail_i, detail_j;
 
@@ -129,7 +162,7 @@ matrixPrint(unsigned int ** matrix, unsigned long input_size) {
 
 /* {{{1 SHELL SORT */
 static void
-shellsort (unsigned int **matrix, unsigned long range, unsigned long len, unsigned int *o, unsigned int *e)
+shellsort (symbolT **matrix, unsigned long range, unsigned long len, symbolT *o, symbolT *e)
 {
 	unsigned long gap, i;
 	long j;
@@ -166,7 +199,7 @@ shellsort (unsigned int **matrix, unsigned long range, unsigned long len, unsign
 /* {{{1 QUICKSORT ROUTINES */
 #ifdef BWT_QUICK
 static unsigned long
-partition (unsigned int **matrix, unsigned long n, unsigned int *o, unsigned int *e, unsigned long l, unsigned long r)
+partition (symbolT **matrix, unsigned long n, symbolT *o, symbolT *e, unsigned long l, unsigned long r)
 {
 	/*
 	 * partition a[l],... a[r] around pivot a[l] 
@@ -174,7 +207,7 @@ partition (unsigned int **matrix, unsigned long n, unsigned int *o, unsigned int
 	 * return index at which pivot ends 
 	 */
 
-	unsigned int *pivot = matrix[l];
+	symbolT *pivot = matrix[l];
 	unsigned long left = l,
 								right = r;
 
@@ -202,11 +235,11 @@ partition (unsigned int **matrix, unsigned long n, unsigned int *o, unsigned int
 }
 
 static void
-qksort (unsigned int **matrix, unsigned long n, unsigned long len, unsigned int *o, unsigned int *e, unsigned long l, unsigned long r)
+qksort (symbolT **matrix, unsigned long n, unsigned long len, symbolT *o, symbolT *e, unsigned long l, unsigned long r)
 {
 	unsigned long k,
 								i;
-	unsigned int *v;
+	symbolT *v;
 
 
 	if (l >= r)
@@ -270,7 +303,7 @@ qksort (unsigned int **matrix, unsigned long n, unsigned long len, unsigned int
 /// MULTIKEY QUICKSORT
 #ifdef BWT_MULTI_QUICK
 static void
-vecswap (int i, int j, int n, unsigned int **matrix)
+vecswap (unsigned long i, unsigned long j, unsigned long n, symbolT **matrix)
 {
 	while (n -- > 0)
 	{
@@ -280,75 +313,92 @@ vecswap (int i, int j, int n, unsigned int **matrix)
 	}
 }
 
+/* rand() may give no more than 15 bits, which won't reach far into a large block */
+static unsigned long
+randomIndex (unsigned long n)
+{
+	unsigned long	r = 0;
+	int						i;
+
+	for ( i = 0; i < 4; ++ i )
+		r = (r << 15) ^ (unsigned long) rand ();
+
+	return r % n;
+}
+
 static void
-multiqksort (unsigned int **matrix, unsigned long n, unsigned long len, unsigned int *o, unsigned int *e, int depth)
+multiqksort (symbolT **matrix, unsigned long n, unsigned long len, symbolT *o, symbolT *e, unsigned long depth)
 {
-	int     a,
-	        b,
-	        c,
-	        d,
-	        r,
-	        v;
-
-	if (n <= 1)
-		return;
+	unsigned long	a,
+								b,
+								c,
+								d,
+								r;
+	int						diff,
+								v;
 
-	if ( n <= 16 )
+	/*
+	 * the partition that agrees on one more byte is sorted by going round
+	 * again rather than by recursing. a long repeat in the block would
+	 * otherwise recurse once for every byte of it
+	 */
+	while (n > 1)
 	{
-		shellsort (matrix, n, len, o, e);
-		return;
-	}
+		if ( n <= 16 )
+		{
+			shellsort (matrix, n, len, o, e);
+			return;
+		}
 
-	a = rand () % n;
-	swap (&matrix[0], &matrix[a]);
-	v =	matrix[0][depth];
-	a = b = 1;
-	c = d = n - 1;
-	for (;;)
-	{
-		while (b <= c && (r = matrix[b][depth] - v) <= 0)
+		/* rotations that agree on every byte are the same -- only a periodic block gets here */
+		if ( depth >= len )
+			return;
+
+		a = randomIndex (n);
+		swap (&matrix[0], &matrix[a]);
+		v =	matrix[0][depth];
+		a = b = 1;
+		c = d = n - 1;
+		for (;;)
 		{
-			if (r == 0)
+			while (b <= c && (diff = matrix[b][depth] - v) <= 0)
 			{
-				swap (&matrix[a], &matrix[b]);
-				++ a;
+				if (diff == 0)
+				{
+					swap (&matrix[a], &matrix[b]);
+					++ a;
+				}
+				++ b;
 			}
-			++ b;
-		}
-		while (b <= c && (r = matrix[c][depth] - v) >= 0)
-		{
-			if (r == 0)
+			while (b <= c && (diff = matrix[c][depth] - v) >= 0)
 			{
-				swap (&matrix[c], &matrix[d]);
-				-- d;
+				if (diff == 0)
+				{
+					swap (&matrix[c], &matrix[d]);
+					-- d;
+				}
+				-- c;
 			}
+			if (b > c)
+				break;
+			swap (&matrix[b], &matrix[c]);
+			++ b;
 			-- c;
 		}
-		if (b > c)
-			break;
-		swap (&matrix[b], &matrix[c]);
-		++ b;
-		-- c;
+		r = min (a, b - a);
+		vecswap (0, b - r, r, matrix);
+		r = min (d - c, n - d - 1);
+		vecswap (b, n - r, r, matrix);
+
+		/* the smaller and greater partitions */
+		multiqksort (matrix, b - a, len, o, e, depth);
+		multiqksort (matrix + n - (d - c), d - c, len, o, e, depth);
+
+		/* and round again for the partition equal to the pivot */
+		matrix += b - a;
+		n = a + n - d - 1;
+		++ depth;
 	}
-	r = min (a, b - a);
-	vecswap (0, b - r, r, matrix);
-	r = min (d - c, (int) n - d - 1);
-	vecswap (b, n - r, r, matrix);
-	r = b - a;
-	multiqksort (matrix, r, len, o, e, depth);
-
-	/*
-	 * recurse if we  haven't reached end of string
-	 * alternative is to check for NUL char
-	 *
-	 *	if ( 0 != matrix[r][depth] )
-	 *
-	 * but this obviously doesn't work for binary streams
-	 */
-	if ( a + n - d - 1 != len )
-		multiqksort (matrix + r, a + n - d - 1, len, o, e, depth + 1);
-	r = d - c;
-	multiqksort (matrix + n - r, r, len, o, e, depth);
 }
 #endif /* BWT_MULTI_QUICK */
 /* }}} */
@@ -365,7 +415,7 @@ multiqksort (unsigned int **matrix, unsigned long n, unsigned long len, unsigned
 
 struct rs_stack
 {
-	unsigned int	**sa;
+	symbolT	**sa;
 	unsigned long sn;
 	unsigned long si;
 };
@@ -375,23 +425,25 @@ struct rs_stack
 #define rs_empty()		 (sp <= stack+1)
 
 static void
-radixsort (unsigned int **a, unsigned long n, unsigned int *o, unsigned int *e)
+radixsort (symbolT **a, unsigned long n, symbolT *o, symbolT *e)
 {
 	struct rs_stack stack[RS_STACK_SIZE+1],
 									*sp = stack + 1;
 
-	unsigned int	**pile[UCHAR_MAX+2],
+	symbolT	**pile[UCHAR_MAX+2],
 								**an,		/* last string in current array */
 								**ak,		/* current string */
 								 *r;
 
 	int	c,
 			cmax,
-			*cp,			/* count array pointer */
-			count[UCHAR_MAX+2],
 			cmin,			/* minimum character value -- lowest non 0 element in count array */
 			nc = 0;		/* total chacter count -- how many non 0 elements in count array */
 
+	/* a pile can hold more strings than an int can count */
+	unsigned long	*cp,			/* count array pointer */
+								count[UCHAR_MAX+2];
+
 	/*
 	 * used for shell sort -- n is the number of "rows" in the matrix
 	 * to be sorted whereas len is the number of "columns"
@@ -441,7 +493,7 @@ radixsort (unsigned int **a, unsigned long n, unsigned int *o, unsigned int *e)
 #ifdef BWT_ENCODER_INPUT_BARREL
 			c = *((*ak++) + b);
 #else
-			unsigned int *check = (*ak++) + b;
+			symbolT *check = (*ak++) + b;
 
 			if (check > e)
 				c = *(o + (check - e) - 1);
@@ -509,7 +561,7 @@ radixsort (unsigned int **a, unsigned long n, unsigned int *o, unsigned int *e)
 #else
 			for (;;)
 			{
-				unsigned int *check = r + b;
+				symbolT *check = r + b;
 
 				if (check > e)
 					c = *(o + (check - e) - 1);
@@ -538,7 +590,7 @@ radixsort (unsigned int **a, unsigned long n, unsigned int *o, unsigned int *e)
 	e --> end point of master string
 */
 static void
-sortMatrix (unsigned int **matrix, unsigned long len, unsigned int *o, unsigned int *e)
+sortMatrix (symbolT **matrix, unsigned long len, symbolT *o, symbolT *e)
 {
 #ifdef BWT_QUICK
 /* {{{2 DEBUG CODE */
@@ -572,16 +624,347 @@ sortMatrix (unsigned int **matrix, unsigned long len, unsigned int *o, unsigned
 }
 /* }}}1 */
 
+#else /* BWT_DOUBLING */
+
+/* {{{1 PREFIX DOUBLING */
+/*
+ * Larsson and Sadakane's qsufsort, on rotations rather than suffixes. the
+ * sorts above compare rotations a byte at a time, so a block with a long
+ * repeat in it costs the length of the repeat for every rotation in it.
+ * here the rotations are first grouped by their first byte and each pass
+ * sorts them on twice as many bytes as the last, by comparing the groups
+ * of the rotations h bytes further on. however long the repeats, there
+ * are only as many passes as the log2 of the longest.
+ *
+ * I holds the rotations in sorted order and V the group of each rotation,
+ * which is the position in I of the last rotation of the group. a run of
+ * groups of one rotation, which need no more sorting, is marked in I by
+ * its length negated.
+ */
+struct doubling
+{
+	int32_t				* I;
+	int32_t				* V;
+	unsigned long		n;
+	unsigned long		h;
+};
+
+/* the group of the rotation h bytes on from the one at p */
+#define DBL_KEY(d, p)		((d)->V[(unsigned long) *(p) + (d)->h >= (d)->n ? *(p) + (d)->h - (d)->n : *(p) + (d)->h])
+
+#define dblSwap(a,b)		{ int32_t t; t = *(a); *(a) = *(b); *(b) = t; }
+
+/* the rotations from pl to pm are one group */
+static void
+dblUpdateGroup (struct doubling * d, int32_t * pl, int32_t * pm)
+{
+	int32_t		g = pm - d->I;
+
+	d->V[*pl] = g;
+	if ( pl == pm )
+	{
+		*pl = -1;
+		return;
+	}
+
+	do
+		d->V[*++pl] = g;
+	while ( pl < pm );
+}
+
+/* small groups are split by repeatedly picking out the rotations with the least key */
+static void
+dblSelectSortSplit (struct doubling * d, int32_t * p, long n)
+{
+	int32_t	* pa, * pb, * pi, * pn;
+	int32_t		f, v;
+
+	pa = p;
+	pn = p + n - 1;
+
+	while ( pa < pn )
+	{
+		for ( pi = pb = pa + 1, f = DBL_KEY (d, pa); pi <= pn; ++ pi )
+		{
+			if ( (v = DBL_KEY (d, pi)) < f )
+			{
+				f = v;
+				dblSwap (pi, pa);
+				pb = pa + 1;
+			}
+			else
+			if ( v == f )
+			{
+				dblSwap (pi, pb);
+				++ pb;
+			}
+		}
+
+		dblUpdateGroup (d, pa, pb - 1);
+		pa = pb;
+	}
+
+	if ( pa == pn )
+	{
+		d->V[*pa] = pa - d->I;
+		*pa = -1;
+	}
+}
+
+static int32_t *
+dblMed3 (struct doubling * d, int32_t * a, int32_t * b, int32_t * c)
+{
+	int32_t	ka = DBL_KEY (d, a),
+					kb = DBL_KEY (d, b),
+					kc = DBL_KEY (d, c);
+
+	if ( ka < kb )
+		return kb < kc ? b : (ka < kc ? c : a);
+
+	return kb > kc ? b : (ka > kc ? c : a);
+}
+
+static int32_t
+dblPivot (struct doubling * d, int32_t * p, long n)
+{
+	int32_t	* pl = p,
+					* pm = p + n / 2,
+					* pn = p + n - 1;
+	long			s;
+
+	if ( n > 40 )
+	{
+		s = n / 8;
+		pl = dblMed3 (d, pl, pl + s, pl + 2 * s);
+		pm = dblMed3 (d, pm - s, pm, pm + s);
+		pn = dblMed3 (d, pn - 2 * s, pn - s, pn);
+	}
+
+	return DBL_KEY (d, dblMed3 (d, pl, pm, pn));
+}
+
+/* a ternary split on the keys, the middle partition becoming a group */
+static void
+dblSortSplit (struct doubling * d, int32_t * p, long n)
+{
+	int32_t	* pa, * pb, * pc, * pd, * pl, * pm, * pn;
+	int32_t		f, v;
+	long			s, t;
+
+	if ( n < 7 )
+	{
+		dblSelectSortSplit (d, p, n);
+		return;
+	}
+
+	v = dblPivot (d, p, n);
+	pa = pb = p;
+	pc = pd = p + n - 1;
+
+	for (;;)
+	{
+		while ( pb <= pc && (f = DBL_KEY (d, pb)) <= v )
+		{
+			if ( f == v )
+			{
+				dblSwap (pa, pb);
+				++ pa;
+			}
+			++ pb;
+		}
+		while ( pc >= pb && (f = DBL_KEY (d, pc)) >= v )
+		{
+			if ( f == v )
+			{
+				dblSwap (pc, pd);
+				-- pd;
+			}
+			-- pc;
+		}
+		if ( pb > pc )
+			break; /* for loop */
+		dblSwap (pb, pc);
+		++ pb;
+		-- pc;
+	}
+
+	pn = p + n;
+	s = min (pa - p, pb - pa);
+	for ( pl = p, pm = pb - s; s > 0; -- s, ++ pl, ++ pm )
+		dblSwap (pl, pm);
+	s = min (pd - pc, pn - pd - 1);
+	for ( pl = pb, pm = pn - s; s > 0; -- s, ++ pl, ++ pm )
+		dblSwap (pl, pm);
+
+	s = pb - pa;
+	t = pd - pc;
+	if ( s > 0 )
+		dblSortSplit (d, p, s);
+	dblUpdateGroup (d, p + s, p + n - t - 1);
+	if ( t > 0 )
+		dblSortSplit (d, p + n - t, t);
+}
+
+/* once h reaches n the rotations left in a group are the same -- any order will do */
+static void
+dblSettle (struct doubling * d)
+{
+	int32_t	* pi = d->I,
+					* pk;
+
+	while ( pi < d->I + d->n )
+	{
+		if ( *pi < 0 )
+		{
+			pi -= *pi;
+			continue; /* while loop */
+		}
+
+		for ( pk = d->I + d->V[*pi] + 1; pi < pk; ++ pi )
+			d->V[*pi] = pi - d->I;
+	}
+}
+
+/* leaves the rotations of input in sorted order in I. V is work space */
+static void
+doublingSort (unsigned char * input, unsigned long n, int32_t * I, int32_t * V)
+{
+	struct doubling	d;
+	unsigned long			start[UCHAR_MAX + 1] = {0},
+										size[UCHAR_MAX + 1] = {0},
+										i;
+	int32_t					* pi, * pk,
+										s, sl;
+	int								c;
+
+	d.I = I;
+	d.V = V;
+	d.n = n;
+
+	/* group by the first byte */
+	for ( i = 0; i < n; ++ i )
+		++ size[input[i]];
+
+	for ( c = 1; c <= UCHAR_MAX; ++ c )
+		start[c] = start[c-1] + size[c-1];
+
+	for ( i = 0; i < n; ++ i )
+		I[start[input[i]] ++] = i;
+
+	/* start is now one past the end of each group */
+	for ( i = 0; i < n; ++ i )
+		V[i] = start[input[i]] - 1;
+
+	for ( c = 0; c <= UCHAR_MAX; ++ c )
+		if ( 1 == size[c] )
+			I[start[c] - 1] = -1;
+
+	for ( d.h = 1; I[0] > -(int32_t) n; d.h *= 2 )
+	{
+		if ( d.h >= n )
+		{
+			dblSettle (&d);
+			break; /* for loop */
+		}
+
+		pi = I;
+		sl = 0;
+
+		do
+		{
+			if ( (s = *pi) < 0 )
+			{
+				/* skip and combine sorted groups */
+				pi -= s;
+				sl += s;
+			}
+			else
+			{
+				if ( 0 != sl )
+				{
+					*(pi + sl) = sl;
+					sl = 0;
+				}
+
+				pk = I + V[s] + 1;
+				dblSortSplit (&d, pi, pk - pi);
+				pi = pk;
+			}
+		}
+		while ( pi < I + n );
+
+		if ( 0 != sl )
+			*(pi + sl) = sl;
+	}
+
+	/* every rotation's group is now its place in the order */
+	for ( i = 0; i < n; ++ i )
+		I[V[i]] = i;
+}
+
+static int
+doublingEncode (unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size)
+{
+	int32_t				* I,
+								* V;
+	unsigned long		i,
+									r;
+
+	I = malloc (input_size * sizeof *I);
+	if ( NULL == I )
+		return 0;
+
+	V = malloc (input_size * sizeof *V);
+	if ( NULL == V )
+	{
+		free (I);
+		return 0;
+	}
+
+	*output_size = BWT_HEADERLEN + input_size;
+	*output = malloc (*output_size);
+	if ( NULL == *output )
+	{
+		free (V);
+		free (I);
+		return 0;
+	}
+
+	doublingSort (input, input_size, I, V);
+
+	/* the last column is the byte before each rotation */
+	for ( i = 0; i < input_size; ++ i )
+	{
+		r = I[i];
+		if ( 0 == r )
+		{
+			putIndex (*output, i);
+			r = input_size;
+		}
+
+		(*output)[BWT_HEADERLEN + i] = input[r - 1];
+	}
+
+	free (V);
+	free (I);
+
+	return 1;
+}
+/* }}} */
+
+#endif /* BWT_DOUBLING */
+
 /* {{{1 ENCODER */
-int
-bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size)
+#ifndef BWT_DOUBLING
+static int
+matrixEncode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size)
 {
 	unsigned long i,
 								orig_index;
 
-	unsigned int	**matrix;
+	symbolT	**matrix;
 
-	unsigned int	*input_barrel;
+	symbolT	*input_barrel;
 
 
 /* {{{2 DEBUG CODE */
@@ -592,9 +975,6 @@ bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **outp
 #endif
 /* }}} */
 
-	if ( 0 == input_size )
-		return 0;
-
 	/*
 	 * allocate memory for input barrel 
 	 */
@@ -685,18 +1065,19 @@ bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **outp
 #endif
 /* }}} */
 
-	/* find orignal input in matrix */
+	/*
+	 * find orignal input in matrix -- the rotation starting at the front
+	 * of the barrel. comparing the rotations themselves would cost as much
+	 * again as the sort on a block with long repeats
+	 */
 	for (orig_index = 0; orig_index < input_size; ++(orig_index))
 	{
-		if (0 == bwt_memcmp (matrix[orig_index], input_barrel, input_barrel, input_barrel + input_size - 1, input_size * sizeof *input))
+		if (matrix[orig_index] == input_barrel)
 		{
 			/*
 			 * first 4 bytes of output indicate location of original index
 			 */
-			(*output)[0] = (orig_index >> 24) & 0xff;
-			(*output)[1] = (orig_index >> 16) & 0xff;
-			(*output)[2] = (orig_index >> 8) & 0xff;
-			(*output)[3] = orig_index & 0xff;
+			putIndex (*output, orig_index);
 
 /* {{{2 DEBUG CODE */
 #ifdef BWT_DEBUG
@@ -760,6 +1141,44 @@ bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **outp
 
 	return 1;
 }
+#endif /* BWT_DOUBLING */
+
+int
+bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size)
+{
+	/* the header can't record an index any larger */
+	if ( 0 == input_size || input_size > BWT_MAX_INPUT )
+		return 0;
+
+#ifdef BWT_DOUBLING
+	return doublingEncode (input, input_size, output, output_size);
+#else
+	return matrixEncode (input, input_size, output, output_size);
+#endif
+}
+/* }}} */
+
+/* {{{1 MEMORY */
+unsigned long
+bwt_encodeMemory (unsigned long input_size)
+{
+#ifdef BWT_DOUBLING
+	/* the order and groups of the rotations, then the output */
+	return 2 * input_size * sizeof (int32_t) + BWT_HEADERLEN + input_size;
+#elif BWT_ENCODER_INPUT_BARREL
+	/* the input barrel and the matrix of rotations, then the output */
+	return 2 * input_size * sizeof (symbolT) + input_size * sizeof (symbolT *) + BWT_HEADERLEN + input_size;
+#else
+	/* the input and the matrix of rotations, then the output */
+	return input_size * sizeof (symbolT) + input_size * sizeof (symbolT *) + BWT_HEADERLEN + input_size;
+#endif
+}
+
+unsigned long
+bwt_decodeMemory (unsigned long input_size)
+{
+	return input_size * sizeof (uint32_t) + input_size;
+}
 /* }}} */
 
 /* {{{1 DECODER */
@@ -769,7 +1188,9 @@ bwt_decode (unsigned char *input, unsigned long input_size, unsigned char **outp
 	unsigned long	i, j, sum, orig_index;
 	
 	unsigned long C[UCHAR_MAX + 1] = {0};
-	unsigned long	*P;
+
+	/* an index of the block, which is never more than BWT_MAX_INPUT */
+	uint32_t	*P;
 
 /* {{{2 DEBUG CODE */
 #ifdef BWT_DEBUG
@@ -779,11 +1200,13 @@ bwt_decode (unsigned char *input, unsigned long input_size, unsigned char **outp
 #endif
 /* }}} */
 
+	if ( input_size <= BWT_HEADERLEN )
+		return 0;
+
 	/* parse header */
-	orig_index = input[0] << 24;
-	orig_index |= input[1] << 16;
-	orig_index |= input[2] << 8;
-	orig_index |= input[3];
+	orig_index = getIndex (input);
+	if ( orig_index >= input_size - BWT_HEADERLEN )
+		return 0;
 
 /* {{{2 DEBUG CODE */
 #ifdef BWT_DEBUG
@@ -822,7 +1245,7 @@ bwt_decode (unsigned char *input, unsigned long input_size, unsigned char **outp
 	printf("       P=");
 	for ( i = 0; i < input_size; ++ i )
 	{
-		printf("%ld,", P[i]);
+		printf("%lu,", (unsigned long) P[i]);
 	}
 	puts("");
 	printf("       C=");
@@ -16,7 +16,21 @@
 #ifndef BWTLIB_H
 #define BWTLIB_H
 
+/*
+ * the encoded block begins with the index of the original input as a 4
+ * byte big endian integer and the encoder orders the rotations in 32 bit
+ * signed integers, so input can be no longer than BWT_MAX_INPUT
+ */
+#define BWT_MAX_INPUT		0x7fffffffUL
+
 int bwt_encode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size);
 int bwt_decode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size);
 
+/*
+ * the memory, in bytes, the encoder and decoder allocate for input_size
+ * bytes of input, output included
+ */
+unsigned long bwt_encodeMemory (unsigned long input_size);
+unsigned long bwt_decodeMemory (unsigned long input_size);
+
 #endif /* BWT_H */
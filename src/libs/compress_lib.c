@@ -13,41 +13,108 @@
 // You should have received a copy of the GNU General Public License
 // along with Lick.  If not, see <https://www.gnu.org/licenses/>.
 
+#define _POSIX_C_SOURCE 200112L
+
 #include	<stdlib.h>
 #include	<stdio.h>
+#include	<string.h>
+#include	<limits.h>
+#include	<stdint.h>
+#include	<time.h>
+#include	<unistd.h>
+#include	<sched.h>
+#include	<pthread.h>
 
 #include	<bwt_lib.h>
+#include	<xbwt_lib.h>
 #include	<mtf_lib.h>
 #include	<rle_lib.h>
 #include	<huff_lib.h>
+#include	<crc32_lib.h>
+#include	<spsc_lib.h>
 #include	<types_lib.h>
 
 #include	"compress_lib.h"
 
 
-/*
- *	perform an rle on input data before bwt stage tends to improve block sorting times
- *	with poor sort routines, but damages compression rates
- */
-#define PRE_RLE
+enum COMPRESS_MODES
+{
+	RLE_AFTER_BWT = 0x1,		/* blocks without a pipeline byte only */
+	STORED_BLOCK = 0x2,			/* the rest of the block is the uncompressed data */
+	FILL_BLOCK = 0x4,				/* the block is one byte repeated -- byte then length follow */
+	ZERO_RUNS = 0x8,				/* a table of zero runs cut out of the block follows */
+	PIPELINE_BYTE = 0x10,		/* the pipeline byte follows */
+	LONG_MATCHES = 0x20			/* a table of repeats cut out of the block follows */
+};
 
-/*
- * perform an rle after bwt stage. for some entropy encoders this tends to improve
- * performance with regards to entropy reduction but not with others
- */
-#define POST_RLE
+/* every compressed block begins with its compress mode */
+#define COMP_MODE_LEN		1
 
 /*
- * what MTF model to use
+ * the pipeline
+ * ------------
+ *
+ * the transforms a block goes through are chosen for each block and
+ * recorded in a pipeline byte after the compress mode
+ *
+ *	bit 0			basic rle before the bwt. it shortens the runs that are the
+ *						worst case of the multikey sort but damages compression a
+ *						little, so it is only used on blocks with long runs
+ *	bits 1-2	the mtf model
+ *	bits 3-4	the rle after the mtf -- POST_RLE_METHODS
+ *	bits 5-6	the entropy coder -- ENTROPY_CODERS. a block coded with a shared
+ *						huffman table has the table's id after the pipeline byte
+ *	bit 7			no bwt, and so no mtf or post rle either
+ *
+ * blocks written before the pipeline was chosen at runtime have no pipeline
+ * byte. they were all pre rle'd and mtf-1'd, and packbits'd if their
+ * compress mode has RLE_AFTER_BWT.
  */
-#define	MTF_TYPE	MTF1
+#define PIPE_PRE_RLE				0x1
+#define PIPE_MTF(p)					(((p) >> 1) & 0x3)
+#define PIPE_POST_RLE(p)		(((p) >> 3) & 0x3)
+#define PIPE_ENTROPY(p)			(((p) >> 5) & 0x3)
+#define PIPE_ENTROPY_MASK		0x60
+#define PIPE_NO_BWT					0x80
 
+#define MAKE_PIPE(mtf, post_rle, entropy)		(((mtf) << 1) | ((post_rle) << 3) | ((entropy) << 5))
 
-enum COMPRESS_MODES
+enum POST_RLE_METHODS
+{
+	POST_RLE_NONE,
+	POST_RLE_PACKBITS,
+	POST_RLE_BASIC
+};
+
+enum ENTROPY_CODERS
 {
-	RLE_AFTER_BWT = 0x1,
+	ENTROPY_HUFF,
+	ENTROPY_HUFF_TABLE
 };
 
+#define PIPELINE_LEN		1
+#define TABLE_ID_LEN		1
+
+#define FILL_LEN				(COMP_MODE_LEN + 1 + 4)
+
+/*
+ * zero runs at least this long are cut out of a block before it is
+ * transformed. the table is a count followed by an offset and length for
+ * each run, all 4 byte big endian
+ */
+#define ZERO_RUN_MIN		4096
+#define ZERO_RUN_LEN		8
+
+/*
+ * repeats at least LONG_MATCH_MIN long are cut out of a block after the
+ * zero runs. the table, after the zero run table, is a count followed by
+ * the offset, length and distance back to the earlier copy of each repeat,
+ * all 4 byte big endian. offsets are in the block with the zero runs cut
+ * out but the repeats still in.
+ */
+#define LONG_MATCH_MIN		1024
+#define LONG_MATCH_LEN		12
+
 
 static void
 stub_errorHook (char * error, void * callback_data)
@@ -55,7 +122,7 @@ stub_errorHook (char * error, void * callback_data)
 }
 
 static bool
-stub_compressHook (unsigned char * output, unsigned long output_size, void * callback_data)
+stub_compressHook (unsigned char * output, unsigned long output_size, struct compBlockInfo * block_info, void * callback_data)
 {
 	return true;
 }
@@ -73,267 +140,2286 @@ stub_decompressEndHook (unsigned char * output, unsigned long output_size, void
 }
 
 
-static int
-compress (unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+static unsigned long long
+nanoseconds (void)
 {
-	unsigned char	*a, *b;
-	unsigned long	l, m;
+	struct timespec	ts;
 
-	int		ret;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
 
-	unsigned char	compress_mode = 0;
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
+/*
+ * a block as it passes through the compression stages. each stage consumes
+ * data and replaces it with its own output. the uncompressed input is kept
+ * alongside until the block is finished, in case it turns out that the
+ * block is better stored -- it is only freed if it is owned, the input to
+ * compress() belongs to the caller.
+ */
+struct compBlock
+{
+	unsigned char	* input;
+	unsigned long	input_size;
+	bool	input_owned;
 
-#ifdef PRE_RLE
-	ret = rle_basic_compress (input, input_size, &a, &l, false, false);
-	if ( RLE_RET_SUCCESS != ret )
-	{
-		if ( RLE_RET_NOMEM == ret )
-		{
-			errorHook ("out of memory while run length encoding", errorHook_data);
-			return COMP_RET_NOMEM;
-		}
-		else
-			errorHook ("unexpected response from run length encoder!!", errorHook_data);
+	/* output of the last stage -- the same as input before the first */
+	unsigned char	* data;
+	unsigned long	size;
 
-		return COMP_RET_COMP;
-	}
-#else
-	a = input;
-	l = input_size;
-#endif /* PRE_RLE */
+	unsigned char	compress_mode;
+	unsigned char	pipeline;
 
-	ret = bwt_encode (a, l, &b, &m);
-	if ( 0 == ret )
-	{
-#ifdef PRE_RLE
-		free (a);
-#endif /* PRE_RLE */
-		errorHook ("out of memory while burrows-wheeler transforming", errorHook_data);
-		return COMP_RET_NOMEM;
-	}
-#ifdef PRE_RLE
-	free (a);
-#endif /* PRE_RLE */
+	int						level;
 
-	ret = mtf_encode (b, m, MTF_TYPE);
-	if ( 0 == ret )
+	/* the most memory the bwt may take before it goes to disk, or 0 */
+	unsigned long	bwt_memory;
+
+	/* offset and length pairs of the zero runs cut out of the input */
+	unsigned long	* zero_runs;
+	unsigned long	num_zero_runs;
+
+	/* offset, length and distance triples of the repeats cut out after them */
+	unsigned long	* long_matches;
+	unsigned long	num_long_matches;
+
+	/* nanoseconds spent in each stage */
+	unsigned long long	stage_ns[COMP_STAGE_COUNT];
+
+	/* the shared tables the block may be coded with, or NULL -- and the one it is */
+	struct compContext	* context;
+	unsigned char				table;
+};
+
+/*
+ * a context keeps what is worth keeping between the compression of many
+ * small buffers -- the shared huffman tables, and the level and error hook
+ * so that they needn't be passed every time
+ */
+struct compContext
+{
+	int						level;
+	errorHookT		errorHook;
+	void				* errorHook_data;
+
+	/* by id, NULL where there isn't one */
+	struct huffTable	* tables[COMP_TABLE_IDS];
+	unsigned int				num_tables;
+};
+
+typedef	int (*compressStageT) (struct compBlock *, errorHookT, void *);
+
+static void
+initBlock (struct compBlock * block, unsigned char * input, unsigned long input_size, bool owned, int level)
+{
+	block->input = block->data = input;
+	block->input_size = block->size = input_size;
+	block->input_owned = owned;
+	block->compress_mode = 0;
+	block->pipeline = 0;
+	memset (block->stage_ns, 0, sizeof block->stage_ns);
+	block->level = level;
+	block->bwt_memory = 0;
+	block->zero_runs = NULL;
+	block->num_zero_runs = 0;
+	block->long_matches = NULL;
+	block->num_long_matches = 0;
+	block->context = NULL;
+	block->table = 0;
+}
+
+static void
+put32 (unsigned char * p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static unsigned long
+get32 (unsigned char * p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+/* the compress mode, pipeline byte, table id, zero run and long match tables, as the block has them */
+static unsigned long
+headerLen (struct compBlock * block)
+{
+	unsigned long	l = COMP_MODE_LEN;
+
+	if ( PIPELINE_BYTE == (block->compress_mode & PIPELINE_BYTE) )
 	{
-		free (b);
-		errorHook ("error during mtf encode", errorHook_data);
-		return COMP_RET_COMP;
+		l += PIPELINE_LEN;
+
+		if ( ENTROPY_HUFF_TABLE == PIPE_ENTROPY (block->pipeline) )
+			l += TABLE_ID_LEN;
 	}
 
-	/* try to rle compress again to see if it has any effect */
-#ifdef POST_RLE
-	ret = rle_packbits_compress (b, m, &a, &l, true);
-	if ( RLE_RET_TOOBIG != ret )
+	if ( 0 != block->num_zero_runs )
+		l += 4 + block->num_zero_runs * ZERO_RUN_LEN;
+
+	if ( 0 != block->num_long_matches )
+		l += 4 + block->num_long_matches * LONG_MATCH_LEN;
+
+	return l;
+}
+
+/* the size of the block were it stored */
+static unsigned long
+storedLen (struct compBlock * block)
+{
+	unsigned long	l = COMP_MODE_LEN + block->input_size;
+
+	if ( 0 != block->num_zero_runs )
+		l += 4 + block->num_zero_runs * ZERO_RUN_LEN;
+
+	if ( 0 != block->num_long_matches )
+		l += 4 + block->num_long_matches * LONG_MATCH_LEN;
+
+	return l;
+}
+
+static void
+writeHeader (struct compBlock * block, unsigned char * output)
+{
+	unsigned long	r;
+
+	*output++ = block->compress_mode & 0xff;
+
+	if ( PIPELINE_BYTE == (block->compress_mode & PIPELINE_BYTE) )
 	{
-		free (b);
-		compress_mode |= RLE_AFTER_BWT;
+		*output++ = block->pipeline;
+
+		if ( ENTROPY_HUFF_TABLE == PIPE_ENTROPY (block->pipeline) )
+			*output++ = block->table;
 	}
-	else
-#endif /* POST_RLE */
+
+	if ( 0 != block->num_zero_runs )
 	{
-		a = b;
-		l = m;
+		put32 (output, block->num_zero_runs);
+		output += 4;
+
+		for ( r = 0; r < block->num_zero_runs; ++ r, output += ZERO_RUN_LEN )
+		{
+			put32 (output, block->zero_runs[2*r]);
+			put32 (output + 4, block->zero_runs[2*r + 1]);
+		}
 	}
 
-	/* encode with a pre padding space of sizeof compress_mode */
-	ret = huff_encode (a, l, output, output_size, sizeof compress_mode);
-	if ( HUFF_RET_SUCCESS != ret )
+	if ( 0 != block->num_long_matches )
 	{
-		free (a);
+		put32 (output, block->num_long_matches);
+		output += 4;
 
-		if ( HUFF_RET_NOMEM == ret )
+		for ( r = 0; r < block->num_long_matches; ++ r, output += LONG_MATCH_LEN )
 		{
-			errorHook ("out of memory while huffman encoding", errorHook_data);
-			return COMP_RET_NOMEM;
+			put32 (output, block->long_matches[3*r]);
+			put32 (output + 4, block->long_matches[3*r + 1]);
+			put32 (output + 8, block->long_matches[3*r + 2]);
 		}
-		else if ( HUFF_RET_TOOBIG == ret )
-			errorHook ("compressed data would be bigger than original", errorHook_data);
-		else
-			errorHook ("unexpected response from huffman encoder!!", errorHook_data);
-
-		return COMP_RET_COMP;
 	}
+}
+
+/* the tables of zero runs and repeats go with whatever they were cut from */
+static void
+dropCuts (struct compBlock * block)
+{
+	free (block->zero_runs);
+	block->zero_runs = NULL;
+	block->num_zero_runs = 0;
+	block->compress_mode &= ~ZERO_RUNS;
+
+	free (block->long_matches);
+	block->long_matches = NULL;
+	block->num_long_matches = 0;
+	block->compress_mode &= ~LONG_MATCHES;
+}
 
+/* the input is no longer needed once a block is finished */
+static void
+releaseInput (struct compBlock * block)
+{
+	if ( true == block->input_owned && block->input != block->data )
+		free (block->input);
 
-	/* copy compress mode to first byte of output */
-	**output = compress_mode & 0xff;
+	block->input = NULL;
+	block->input_owned = false;
+}
 
-	free (a);
+static void
+freeBlock (struct compBlock * block)
+{
+	if ( block->data != block->input || true == block->input_owned )
+		free (block->data);
 
-	return COMP_RET_OKAY;
+	releaseInput (block);
+	dropCuts (block);
+
+	block->data = NULL;
+	block->size = 0;
+}
+
+static void
+replaceBlock (struct compBlock * block, unsigned char * data, unsigned long size)
+{
+	if ( block->data != block->input )
+		free (block->data);
+
+	block->data = data;
+	block->size = size;
 }
 
+/*
+ * replace whatever the stages have done with a copy of the input. zero
+ * runs and repeats that have been cut out of the input stay out of it.
+ */
 static int
-decompress (unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+storeBlock (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
 {
-	unsigned char	*a, *b;
-	unsigned long	l, m;
+	unsigned char	* a;
+	unsigned long	l;
 
-	int		ret;
+	block->compress_mode = STORED_BLOCK | (block->compress_mode & (ZERO_RUNS | LONG_MATCHES));
+	l = headerLen (block) + block->input_size;
 
-	unsigned char	compress_mode;
+	a = malloc (l);
+	if ( NULL == a )
+	{
+		errorHook ("out of memory while storing block", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
 
+	writeHeader (block, a);
+	memcpy (a + headerLen (block), block->input, block->input_size);
 
-	compress_mode = *input & 0xff;
+	replaceBlock (block, a, l);
+	releaseInput (block);
 
-	ret = huff_decode (input, input_size, &a, &l, sizeof compress_mode);
-	if ( HUFF_RET_SUCCESS != ret )
+	return COMP_RET_OKAY;
+}
+
+/*
+ * incompressible data
+ * -------------------
+ *
+ * before any real work is done on a block, its order-0 and order-1 entropy
+ * is estimated from a sample. the order-1 contexts are the top four bits of
+ * the previous byte, which keeps the counts few enough to be reliable for
+ * the size of the sample. if neither estimate gets below INCOMPRESSIBLE_BITS
+ * per byte the block is stored. the estimate can't see repeats further
+ * apart than a byte, so a block that slips through is still stored if the
+ * huffman stage can't shrink it.
+ */
+#define SAMPLE_CHUNKS				16
+#define SAMPLE_CHUNK_LEN		4096
+#define SAMPLE_MIN_LEN			1024
+
+#define ORDER1_CONTEXTS			16
+#define ORDER1_SHIFT				4
+
+/* in 16.16 fixed point -- 7.9 bits per byte */
+#define FIXED_ONE						65536UL
+#define INCOMPRESSIBLE_BITS	(79 * FIXED_ONE / 10)
+
+/* log2 (x) in 16.16 fixed point, for x > 0 */
+static unsigned long
+log2Fixed (unsigned long x)
+{
+	unsigned long long	y;
+	unsigned long				r = 0;
+	int									i;
+
+	/* integer part */
+	while ( x >> (r + 1) )
+		++ r;
+
+	/* normalise to [1, 2) and square out the fraction a bit at a time */
+	y = ((unsigned long long) x << 16) >> r;
+	r <<= 16;
+
+	for ( i = 15; i >= 0; -- i )
 	{
-		if ( HUFF_RET_NOMEM == ret )
+		y = (y * y) >> 16;
+		if ( y >= 2 * FIXED_ONE )
 		{
-			errorHook ("out of memory while huffman decoding", errorHook_data);
-			return COMP_RET_NOMEM;
+			y >>= 1;
+			r |= 1UL << i;
 		}
-		else
-		if ( HUFF_RET_MALFORMED == ret )
-			errorHook ("input data has confused the huffman decoder", errorHook_data);
-		else
-			errorHook ("unexpected response from huffman decoder!!", errorHook_data);
-
-		return COMP_RET_COMP;
 	}
 
-#ifdef POST_RLE
-	if ( RLE_AFTER_BWT == (compress_mode & RLE_AFTER_BWT) )
-	{
-		ret = rle_packbits_decompress (a, l, &b, &m);
-		if ( RLE_RET_SUCCESS != ret )
-		{
-			free (a);
-			if ( RLE_RET_NOMEM == ret )
-			{
-				errorHook ("out of memory while run length decoding", errorHook_data);
-				return COMP_RET_NOMEM;
-			}
-			else
-			if ( RLE_RET_MALFORMED == ret )
-				errorHook ("input data has confused the run length decoder", errorHook_data);
-			else
-				errorHook ("unexpected response from run length decoder!!", errorHook_data);
+	return r;
+}
 
-			return COMP_RET_COMP;
-		}
+/* entropy in bits per byte (16.16) of a set of counts totalling n */
+static unsigned long
+entropyFixed (unsigned long * counts, unsigned long n)
+{
+	unsigned long long	sum = 0;
+	int									c;
 
-		free (a);
+	for ( c = 0; c < 256; ++ c )
+		if ( counts[c] > 1 )
+			sum += (unsigned long long) counts[c] * log2Fixed (counts[c]);
+
+	return log2Fixed (n) - sum / n;
+}
+
+/* a sample is the whole block if it's small, otherwise chunks spread evenly through it */
+static void
+sampleChunks (unsigned long size, unsigned long max_chunks, unsigned long max_chunk_len, unsigned long * chunks, unsigned long * chunk_len)
+{
+	if ( size <= max_chunks * max_chunk_len )
+	{
+		*chunks = 1;
+		*chunk_len = size;
 	}
 	else
-#endif /* POST_RLE */
 	{
-		b = a;
-		m = l;
+		*chunks = max_chunks;
+		*chunk_len = max_chunk_len;
 	}
+}
 
-	ret = mtf_decode (b, m, MTF_TYPE);
-	if ( 0 == ret )
-	{
-		errorHook ("error during mtf decode", errorHook_data);
-		free (b);
-		return COMP_RET_COMP;
-	}
+static unsigned long
+sampleOffset (unsigned long size, unsigned long chunks, unsigned long chunk_len, unsigned long k)
+{
+	return 1 == chunks ? 0 : k * ((size - chunk_len) / (chunks - 1));
+}
 
-	ret = bwt_decode (b, m, &a, &l);
-	if ( 0 == ret )
-	{
-		errorHook ("out of memory while reversing burrows-wheeler transform", errorHook_data);
-		free (b);
-		return COMP_RET_NOMEM;
-	}
-	free (b);
+static bool
+looksIncompressible (unsigned char * data, unsigned long size)
+{
+	unsigned long	order0[256],
+								order1[ORDER1_CONTEXTS][256],
+								context_n[ORDER1_CONTEXTS],
+								chunks, chunk_len, offset,
+								n = 0, h0, h1 = 0,
+								i, k;
+	unsigned char	prev;
+	int						c;
 
-#ifdef PRE_RLE
-	ret = rle_basic_decompress (a, l, output, output_size, false);
-	if ( RLE_RET_SUCCESS != ret )
+	if ( size < SAMPLE_MIN_LEN )
+		return false;
+
+	memset (order0, 0, sizeof order0);
+	memset (order1, 0, sizeof order1);
+	memset (context_n, 0, sizeof context_n);
+
+	sampleChunks (size, SAMPLE_CHUNKS, SAMPLE_CHUNK_LEN, &chunks, &chunk_len);
+
+	for ( k = 0; k < chunks; ++ k )
 	{
-		free (a);
+		offset = sampleOffset (size, chunks, chunk_len, k);
+		prev = 0;
 
-		if ( RLE_RET_NOMEM == ret )
+		for ( i = offset; i < offset + chunk_len; ++ i )
 		{
-			errorHook ("out of memory while run length decoding", errorHook_data);
-			return COMP_RET_NOMEM;
+			++ order0[data[i]];
+			++ order1[prev >> ORDER1_SHIFT][data[i]];
+			++ context_n[prev >> ORDER1_SHIFT];
+			prev = data[i];
 		}
-		else
-		if ( RLE_RET_MALFORMED == ret )
-			errorHook ("input data has confused the run length decoder", errorHook_data);
-		else
-			errorHook ("unexpected response from run length decoder!!", errorHook_data);
 
-		return COMP_RET_COMP;
+		n += chunk_len;
 	}
 
-	free (a);
-#else
-	*output = a;
-	*output_size = l;
-#endif /* POST_RLE */
+	h0 = entropyFixed (order0, n);
+	if ( h0 < INCOMPRESSIBLE_BITS )
+		return false;
 
-	return COMP_RET_OKAY;
+	/*
+	 * weight each context by how often it occurs. a few counts spread over
+	 * many symbols look more ordered than they are, so add the miller-madow
+	 * correction of (symbols seen - 1) / (2 n ln 2) for each context
+	 */
+	for ( k = 0; k < ORDER1_CONTEXTS; ++ k )
+	{
+		if ( 0 == context_n[k] )
+			continue; /* for loop */
+
+		h1 += (unsigned long long) entropyFixed (order1[k], context_n[k]) * context_n[k] / n;
+
+		for ( i = 0, c = 0; c < 256; ++ c )
+			if ( order1[k][c] > 0 )
+				++ i;
+
+		h1 += (i - 1) * (FIXED_ONE * 1000 / 1386) / n;
+	}
+
+	return h1 >= INCOMPRESSIBLE_BITS;
 }
 
 
+/*
+ * choosing the pipeline
+ * ---------------------
+ *
+ * pre rle is decided on the input. the multikey sort compares the suffixes
+ * in a run of length L about L * L times between them, so the block is pre
+ * rle'd if the squares of its run lengths add up to more than PRE_RLE_WORK
+ * per byte.
+ *
+ * the mtf model and post rle are decided after the bwt. each model is run
+ * over a sample of the bwt output and the huffman cost of the result with
+ * each post rle method is estimated from the order-0 entropy of the symbols
+ * the method would emit. the sample is counted, never encoded, and the
+ * cheapest combination is used for the whole block. levels below
+ * CHOOSE_LEVEL don't sample and use mtf-0 with basic rle, which is what
+ * the sample picks for most data.
+ *
+ * at COMP_LEVEL_MIN there is no bwt and the block is rle'd only if the
+ * symbols basic rle would emit from a sample of it look cheaper to code.
+ */
+#define CHOOSE_LEVEL				5
 
-int
-comp_compressFile (struct compressInfo * info, FILE * inputf, unsigned long max_block)
-{
-	unsigned char	*input,
-								*output;
+#define PRE_RLE_MIN_RUN			4
+#define PRE_RLE_WORK				64
 
-	unsigned long input_size,
-								output_size;
+#define PIPE_SAMPLE_CHUNKS		4
+#define PIPE_SAMPLE_CHUNK_LEN	16384
 
-	int		compress_ret;
+/* packbits and basic rle limits */
+#define PACKBITS_MAX_RUN		127
+#define BASIC_MAX_COUNT			255
 
+static bool
+wantPreRLE (unsigned char * data, unsigned long size)
+{
+	unsigned long long	work = 0;
+	unsigned long				i, j;
 
-	/* stubify callback hooks if necessary */
-	compressHookT		compressHook;
-	errorHookT			errorHook;
-	
-	if ( NULL != info )
+	for ( i = 0; i < size; i = j )
 	{
-		if ( NULL == info->compressHook )
-			compressHook = stub_compressHook;
-		else
-			compressHook = info->compressHook;
+		for ( j = i + 1; j < size && data[j] == data[i]; ++ j )
+			;
 
-		if ( NULL == info->errorHook )
-			errorHook = stub_errorHook;
-		else
-			errorHook = info->errorHook;
+		if ( j - i >= PRE_RLE_MIN_RUN )
+			work += (unsigned long long) (j - i) * (j - i);
 	}
 
+	return work > (unsigned long long) size * PRE_RLE_WORK;
+}
 
-	/* allocate enough memory for input data */
-	input = malloc (max_block * sizeof *input);
-	if ( NULL == input )
+/* length of the run starting at data[i], up to max */
+static unsigned long
+runLength (unsigned char * data, unsigned long size, unsigned long i, unsigned long max)
+{
+	unsigned long	j;
+
+	for ( j = i + 1; j < size && j - i < max && data[j] == data[i]; ++ j )
+		;
+
+	return j - i;
+}
+
+/* the symbols rle_packbits_compress() would emit */
+static void
+countPackbits (unsigned char * data, unsigned long size, unsigned long * counts, unsigned long * n)
+{
+	unsigned long	i, l,
+								literals = 0;
+
+	for ( i = 0; i < size; i += l )
+	{
+		l = runLength (data, size, i, PACKBITS_MAX_RUN);
+
+		if ( l < 2 )
+		{
+			++ counts[data[i]];
+			++ *n;
+
+			/* a length byte for each group of literals */
+			if ( 0 == literals ++ % PACKBITS_MAX_RUN )
+			{
+				++ counts[2];
+				++ *n;
+			}
+
+			continue; /* for loop */
+		}
+
+		literals = 0;
+		++ counts[(unsigned char) -l];
+		++ counts[data[i]];
+		*n += 2;
+	}
+}
+
+/* the symbols rle_basic_compress() would emit -- two of the run then a count of the rest */
+static void
+countBasic (unsigned char * data, unsigned long size, unsigned long * counts, unsigned long * n)
+{
+	unsigned long	i, l, r, k;
+
+	for ( i = 0; i < size; i += l )
+	{
+		l = runLength (data, size, i, size);
+
+		for ( r = l; r > 1; r -= 2 + k )
+		{
+			k = r - 2 < BASIC_MAX_COUNT ? r - 2 : BASIC_MAX_COUNT;
+
+			counts[data[i]] += 2;
+			++ counts[k];
+			*n += 3;
+		}
+
+		if ( 1 == r )
+		{
+			++ counts[data[i]];
+			++ *n;
+		}
+	}
+}
+
+/* estimated size in bits (16.16) of huffman coding counts, including a code length for each symbol */
+static unsigned long long
+huffCost (unsigned long * counts, unsigned long n)
+{
+	unsigned long	symbols = 0;
+	int						c;
+
+	if ( 0 == n )
+		return 0;
+
+	for ( c = 0; c < 256; ++ c )
+		if ( counts[c] > 0 )
+			++ symbols;
+
+	return (unsigned long long) entropyFixed (counts, n) * n + symbols * 8 * FIXED_ONE;
+}
+
+/* the mtf model and post rle method for a block that has been through the bwt */
+static unsigned char
+choosePipeline (unsigned char * data, unsigned long size)
+{
+	static const int	models[] = { MTF0, MTF1, MTF2 };
+
+	unsigned char			sample[PIPE_SAMPLE_CHUNKS * PIPE_SAMPLE_CHUNK_LEN],
+										* chunk;
+	unsigned long			counts[256],
+										chunks, chunk_len, offset,
+										n, k;
+	unsigned long long	cost,
+										best_cost = 0;
+	unsigned char			best = MAKE_PIPE (MTF1, POST_RLE_NONE, ENTROPY_HUFF);
+	int								m, post;
+
+	if ( size < SAMPLE_MIN_LEN )
+		return best;
+
+	sampleChunks (size, PIPE_SAMPLE_CHUNKS, PIPE_SAMPLE_CHUNK_LEN, &chunks, &chunk_len);
+
+	for ( m = 0; m < (int) (sizeof models / sizeof *models); ++ m )
+	{
+		for ( k = 0; k < chunks; ++ k )
+		{
+			offset = sampleOffset (size, chunks, chunk_len, k);
+			chunk = sample + k * chunk_len;
+
+			memcpy (chunk, data + offset, chunk_len);
+			mtf_encode (chunk, chunk_len, models[m]);
+		}
+
+		for ( post = POST_RLE_NONE; post <= POST_RLE_BASIC; ++ post )
+		{
+			memset (counts, 0, sizeof counts);
+			n = 0;
+
+			for ( k = 0; k < chunks; ++ k )
+			{
+				chunk = sample + k * chunk_len;
+
+				if ( POST_RLE_PACKBITS == post )
+					countPackbits (chunk, chunk_len, counts, &n);
+				else
+				if ( POST_RLE_BASIC == post )
+					countBasic (chunk, chunk_len, counts, &n);
+				else
+				{
+					for ( offset = 0; offset < chunk_len; ++ offset )
+						++ counts[chunk[offset]];
+					n += chunk_len;
+				}
+			}
+
+			cost = huffCost (counts, n);
+			if ( 0 == best_cost || cost < best_cost )
+			{
+				best_cost = cost;
+				best = MAKE_PIPE (models[m], post, ENTROPY_HUFF);
+			}
+		}
+	}
+
+	return best;
+}
+
+/* whether basic rle makes a block cheaper to huffman code */
+static bool
+rleHelps (unsigned char * data, unsigned long size)
+{
+	unsigned long	raw[256],
+								rle[256],
+								chunks, chunk_len, offset,
+								raw_n = 0, rle_n = 0,
+								i, k;
+
+	memset (raw, 0, sizeof raw);
+	memset (rle, 0, sizeof rle);
+
+	sampleChunks (size, PIPE_SAMPLE_CHUNKS, PIPE_SAMPLE_CHUNK_LEN, &chunks, &chunk_len);
+
+	for ( k = 0; k < chunks; ++ k )
+	{
+		offset = sampleOffset (size, chunks, chunk_len, k);
+
+		for ( i = offset; i < offset + chunk_len; ++ i )
+			++ raw[data[i]];
+		raw_n += chunk_len;
+
+		countBasic (data + offset, chunk_len, rle, &rle_n);
+	}
+
+	return huffCost (rle, rle_n) < huffCost (raw, raw_n);
+}
+
+/*
+ * trivial blocks
+ * --------------
+ *
+ * a block of one byte repeated is written as that byte and the length. zero
+ * runs of at least ZERO_RUN_MIN bytes are cut out of other blocks so that
+ * the transforms never see them -- they cost nothing to compress but a
+ * great deal to sort.
+ */
+static bool
+isConstant (unsigned char * data, unsigned long size)
+{
+	return 0 == memcmp (data, data + 1, size - 1);
+}
+
+static int
+fillBlock (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+
+	a = malloc (FILL_LEN);
+	if ( NULL == a )
+	{
+		errorHook ("out of memory while filling block", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	block->compress_mode = FILL_BLOCK;
+	a[0] = block->compress_mode;
+	a[1] = block->input[0];
+	put32 (a + 2, block->input_size);
+
+	replaceBlock (block, a, FILL_LEN);
+	releaseInput (block);
+
+	return COMP_RET_OKAY;
+}
+
+static int
+cutZeroRuns (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* data = block->data,
+								* a;
+	unsigned long	* runs = NULL,
+								* tmp,
+								max_runs = 0,
+								num_runs = 0,
+								run_total = 0,
+								i, j, l, r;
+
+	for ( i = 0; i < block->size; i = j + 1 )
+	{
+		j = i;
+		if ( 0 != data[i] )
+			continue; /* for loop */
+
+		while ( j < block->size && 0 == data[j] )
+			++ j;
+
+		if ( j - i < ZERO_RUN_MIN )
+			continue; /* for loop */
+
+		if ( num_runs == max_runs )
+		{
+			max_runs = 0 == max_runs ? 16 : max_runs * 2;
+			tmp = realloc (runs, 2 * max_runs * sizeof *runs);
+			if ( NULL == tmp )
+			{
+				free (runs);
+				errorHook ("out of memory while looking for zero runs", errorHook_data);
+				return COMP_RET_NOMEM;
+			}
+			runs = tmp;
+		}
+
+		runs[2*num_runs] = i;
+		runs[2*num_runs + 1] = j - i;
+		run_total += j - i;
+		++ num_runs;
+	}
+
+	if ( 0 == num_runs )
+		return COMP_RET_OKAY;
+
+	a = malloc (block->size - run_total);
+	if ( NULL == a )
+	{
+		free (runs);
+		errorHook ("out of memory while cutting zero runs", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	/* copy everything between the runs */
+	for ( i = 0, l = 0, r = 0; r <= num_runs; ++ r )
+	{
+		j = r < num_runs ? runs[2*r] : block->size;
+		memcpy (a + l, data + i, j - i);
+		l += j - i;
+
+		if ( r < num_runs )
+			i = j + runs[2*r + 1];
+	}
+
+	/* what's left becomes the input, so that a stored block is stored without the runs */
+	if ( true == block->input_owned )
+		free (block->input);
+
+	block->input = block->data = a;
+	block->input_size = block->size = l;
+	block->input_owned = true;
+
+	block->zero_runs = runs;
+	block->num_zero_runs = num_runs;
+	block->compress_mode |= ZERO_RUNS;
+
+	return COMP_RET_OKAY;
+}
+
+/*
+ * long matches
+ * ------------
+ *
+ * the bwt only sees repeats within a block and even then every copy costs
+ * something, as well as lengthening the sort. repeats of LONG_MATCH_MIN or
+ * more are found with a rolling hash of the LONG_MATCH_HASHED bytes at
+ * each position. positions whose hash has its top LONG_MATCH_SAMPLE_BITS
+ * clear go into a table, so that a repeat is found from any one of the
+ * dozens of such positions in it while the table stays small. each match
+ * is checked byte for byte and extended both ways before it is cut.
+ */
+#define LONG_MATCH_HASHED				64
+#define LONG_MATCH_SAMPLE_BITS	5
+#define LONG_MATCH_TABLE_BITS		22
+#define LONG_MATCH_EMPTY				0xffffffffUL
+#define LONG_MATCH_PRIME				0x01000193UL
+
+static unsigned long
+matchSlot (uint32_t hash, unsigned int bits)
+{
+	return (uint32_t) (hash * 0x9e3779b1UL) >> (32 - bits);
+}
+
+static int
+cutLongMatches (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* data = block->data,
+								* a;
+	uint32_t			* table,
+								hash = 0,
+								out_factor = 1;
+	unsigned long	* matches = NULL,
+								* tmp,
+								max_matches = 0,
+								num_matches = 0,
+								match_total = 0,
+								n = block->size,
+								literal = 0,
+								i, j, k, l, m,
+								slot,
+								back, len;
+	unsigned int	bits;
+
+	if ( n < 2 * LONG_MATCH_MIN )
+		return COMP_RET_OKAY;
+
+	/* a slot for every sampled position, up to the limit */
+	for ( bits = 10; bits < LONG_MATCH_TABLE_BITS && (1UL << bits) < (n >> LONG_MATCH_SAMPLE_BITS); ++ bits )
+		;
+
+	table = malloc ((1UL << bits) * sizeof *table);
+	if ( NULL == table )
+	{
+		errorHook ("out of memory while looking for long matches", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	memset (table, 0xff, (1UL << bits) * sizeof *table);
+
+	for ( k = 0; k < LONG_MATCH_HASHED; ++ k )
+	{
+		hash = hash * LONG_MATCH_PRIME + data[k];
+		if ( k > 0 )
+			out_factor *= LONG_MATCH_PRIME;
+	}
+
+	for ( i = 0; i + LONG_MATCH_HASHED <= n; )
+	{
+		if ( 0 == hash >> (32 - LONG_MATCH_SAMPLE_BITS) )
+		{
+			slot = matchSlot (hash, bits);
+			j = table[slot];
+			table[slot] = i;
+
+			if ( LONG_MATCH_EMPTY != j && 0 == memcmp (data + j, data + i, LONG_MATCH_HASHED) )
+			{
+				for ( len = LONG_MATCH_HASHED; i + len < n && data[j + len] == data[i + len]; ++ len )
+					;
+				for ( back = 0; i - back > literal && j > back && data[j - back - 1] == data[i - back - 1]; ++ back )
+					;
+
+				if ( len + back >= LONG_MATCH_MIN )
+				{
+					if ( num_matches == max_matches )
+					{
+						max_matches = 0 == max_matches ? 16 : max_matches * 2;
+						tmp = realloc (matches, 3 * max_matches * sizeof *matches);
+						if ( NULL == tmp )
+						{
+							free (matches);
+							free (table);
+							errorHook ("out of memory while looking for long matches", errorHook_data);
+							return COMP_RET_NOMEM;
+						}
+						matches = tmp;
+					}
+
+					matches[3*num_matches] = i - back;
+					matches[3*num_matches + 1] = len + back;
+					matches[3*num_matches + 2] = i - j;
+					match_total += len + back;
+					++ num_matches;
+
+					/* start hashing again after the match */
+					literal = i = i + len;
+					if ( i + LONG_MATCH_HASHED > n )
+						break; /* for loop */
+
+					for ( hash = 0, k = 0; k < LONG_MATCH_HASHED; ++ k )
+						hash = hash * LONG_MATCH_PRIME + data[i + k];
+
+					continue; /* for loop */
+				}
+			}
+		}
+
+		if ( i + LONG_MATCH_HASHED == n )
+			break; /* for loop */
+
+		hash = (hash - data[i] * out_factor) * LONG_MATCH_PRIME + data[i + LONG_MATCH_HASHED];
+		++ i;
+	}
+
+	free (table);
+
+	if ( 0 == num_matches )
+		return COMP_RET_OKAY;
+
+	a = malloc (n - match_total);
+	if ( NULL == a )
+	{
+		free (matches);
+		errorHook ("out of memory while cutting long matches", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	/* copy everything between the matches */
+	for ( i = 0, l = 0, m = 0; m <= num_matches; ++ m )
+	{
+		j = m < num_matches ? matches[3*m] : n;
+		memcpy (a + l, data + i, j - i);
+		l += j - i;
+
+		if ( m < num_matches )
+			i = j + matches[3*m + 1];
+	}
+
+	/* as with the zero runs, what's left becomes the input */
+	if ( true == block->input_owned )
+		free (block->input);
+
+	block->input = block->data = a;
+	block->input_size = block->size = l;
+	block->input_owned = true;
+
+	block->long_matches = matches;
+	block->num_long_matches = num_matches;
+	block->compress_mode |= LONG_MATCHES;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+stage_preRLE (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	l;
+
+	int		ret;
+
+
+	if ( block->size > 0 && true == isConstant (block->data, block->size) )
+	{
+		/* a run too short to fill would otherwise reach the huffman coder as a single symbol */
+		if ( block->size < FILL_LEN )
+			return storeBlock (block, errorHook, errorHook_data);
+
+		return fillBlock (block, errorHook, errorHook_data);
+	}
+
+	ret = cutZeroRuns (block, errorHook, errorHook_data);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	ret = cutLongMatches (block, errorHook, errorHook_data);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	/* don't spend any time on a block that won't compress */
+	if ( true == looksIncompressible (block->data, block->size) )
+		return storeBlock (block, errorHook, errorHook_data);
+
+	block->compress_mode |= PIPELINE_BYTE;
+
+	if ( COMP_LEVEL_MIN == block->level )
+	{
+		block->pipeline = PIPE_NO_BWT;
+
+		if ( false == rleHelps (block->data, block->size) )
+			return COMP_RET_OKAY;
+	}
+	else
+	if ( false == wantPreRLE (block->data, block->size) )
+		return COMP_RET_OKAY;
+
+	ret = rle_basic_compress (block->data, block->size, &a, &l, false, false);
+	if ( RLE_RET_SUCCESS != ret )
+	{
+		if ( RLE_RET_NOMEM == ret )
+		{
+			errorHook ("out of memory while run length encoding", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+		else
+			errorHook ("unexpected response from run length encoder!!", errorHook_data);
+
+		return COMP_RET_COMP;
+	}
+
+	replaceBlock (block, a, l);
+	block->pipeline |= PIPE_PRE_RLE;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+stage_bwt (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* b;
+	unsigned long	m;
+
+	int		ret;
+
+
+	if ( PIPE_NO_BWT == (block->pipeline & PIPE_NO_BWT) )
+		return COMP_RET_OKAY;
+
+	if ( 0 != block->bwt_memory )
+	{
+		ret = xbwt_encode (block->data, block->size, &b, &m, block->bwt_memory);
+		if ( XBWT_RET_SCRATCH == ret )
+		{
+			errorHook ("couldn't use scratch files while burrows-wheeler transforming", errorHook_data);
+			return COMP_RET_SCRATCH;
+		}
+		else
+		if ( XBWT_RET_SUCCESS != ret )
+		{
+			errorHook ("out of memory while burrows-wheeler transforming", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+	}
+	else
+	if ( 0 == bwt_encode (block->data, block->size, &b, &m) )
+	{
+		errorHook ("out of memory while burrows-wheeler transforming", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	replaceBlock (block, b, m);
+
+	return COMP_RET_OKAY;
+}
+
+static int
+stage_mtf (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	l;
+
+	int		ret;
+
+
+	if ( PIPE_NO_BWT == (block->pipeline & PIPE_NO_BWT) )
+		return COMP_RET_OKAY;
+
+	if ( block->level < CHOOSE_LEVEL )
+		block->pipeline |= MAKE_PIPE (MTF0, POST_RLE_BASIC, ENTROPY_HUFF);
+	else
+		block->pipeline |= choosePipeline (block->data, block->size);
+
+	/* mtf is done in place -- the bwt stage always leaves a block of its own */
+	ret = mtf_encode (block->data, block->size, PIPE_MTF (block->pipeline));
+	if ( 0 == ret )
+	{
+		errorHook ("error during mtf encode", errorHook_data);
+		return COMP_RET_COMP;
+	}
+
+	if ( POST_RLE_PACKBITS == PIPE_POST_RLE (block->pipeline) )
+		ret = rle_packbits_compress (block->data, block->size, &a, &l, true);
+	else
+	if ( POST_RLE_BASIC == PIPE_POST_RLE (block->pipeline) )
+		ret = rle_basic_compress (block->data, block->size, &a, &l, true, false);
+	else
+		return COMP_RET_OKAY;
+
+	if ( RLE_RET_SUCCESS == ret )
+		replaceBlock (block, a, l);
+	else
+	if ( RLE_RET_TOOBIG == ret )
+	{
+		/* the sample was wrong about the rest of the block */
+		block->pipeline = MAKE_PIPE (PIPE_MTF (block->pipeline), POST_RLE_NONE, ENTROPY_HUFF) | (block->pipeline & PIPE_PRE_RLE);
+	}
+	else
+	if ( RLE_RET_NOMEM == ret )
+	{
+		errorHook ("out of memory while run length encoding", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+	else
+	{
+		errorHook ("unexpected response from run length encoder!!", errorHook_data);
+		return COMP_RET_COMP;
+	}
+
+	return COMP_RET_OKAY;
+}
+
+/* whether one of the context's shared tables should code the block, and which */
+static bool
+chooseTable (struct compBlock * block, unsigned char * id)
+{
+	struct huffTable	* table;
+	unsigned long				counts[256],
+											i;
+	unsigned long long	cost,
+											best_cost;
+	int									t, c;
+	bool								found = false;
+
+	if ( NULL == block->context || 0 == block->context->num_tables )
+		return false;
+
+	memset (counts, 0, sizeof counts);
+	for ( i = 0; i < block->size; ++ i )
+		++ counts[block->data[i]];
+
+	/* against the block's own codes and dictionary */
+	best_cost = huffCost (counts, block->size);
+
+	for ( t = 0; t < COMP_TABLE_IDS; ++ t )
+	{
+		table = block->context->tables[t];
+		if ( NULL == table )
+			continue; /* for loop */
+
+		cost = TABLE_ID_LEN * CHAR_BIT;
+		for ( c = 0; c < 256; ++ c )
+			cost += (unsigned long long) counts[c] * table->code_lens[c];
+		cost *= FIXED_ONE;
+
+		if ( cost < best_cost )
+		{
+			best_cost = cost;
+			*id = t;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static int
+stage_huff (struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	l;
+
+	int		ret;
+
+
+	/* encode with a pre padding space for the header */
+	if ( true == chooseTable (block, &block->table) )
+	{
+		block->pipeline = (block->pipeline & ~PIPE_ENTROPY_MASK) | MAKE_PIPE (0, 0, ENTROPY_HUFF_TABLE);
+		ret = huff_encodeTable (block->context->tables[block->table], block->data, block->size, &a, &l, headerLen (block));
+	}
+	else
+		ret = huff_encode (block->data, block->size, &a, &l, headerLen (block));
+	if ( HUFF_RET_SUCCESS != ret )
+	{
+		/* the block didn't compress after all */
+		if ( HUFF_RET_TOOBIG == ret )
+			return storeBlock (block, errorHook, errorHook_data);
+
+		if ( HUFF_RET_NOMEM == ret )
+		{
+			errorHook ("out of memory while huffman encoding", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+		else
+			errorHook ("unexpected response from huffman encoder!!", errorHook_data);
+
+		return COMP_RET_COMP;
+	}
+
+	/* huffman encoding shrank it but not by enough to make up for the other stages */
+	if ( l >= storedLen (block) )
+	{
+		free (a);
+		return storeBlock (block, errorHook, errorHook_data);
+	}
+
+	writeHeader (block, a);
+
+	replaceBlock (block, a, l);
+	releaseInput (block);
+
+	return COMP_RET_OKAY;
+}
+
+/* the stages in the order compress() chains them */
+static compressStageT compress_stages[COMP_STAGE_COUNT] =
+{
+	stage_preRLE,
+	stage_bwt,
+	stage_mtf,
+	stage_huff
+};
+
+/* a stored or filled block is already finished and skips any stages still to come */
+static int
+runStage (int s, struct compBlock * block, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned long long	start;
+	int									ret;
+
+	if ( 0 != (block->compress_mode & (STORED_BLOCK | FILL_BLOCK)) )
+		return COMP_RET_OKAY;
+
+	start = nanoseconds ();
+	ret = compress_stages[s] (block, errorHook, errorHook_data);
+	block->stage_ns[s] = nanoseconds () - start;
+
+	return ret;
+}
+
+static int
+compress (unsigned char * input, unsigned long input_size, int level, unsigned long bwt_memory, struct compContext * context, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+{
+	struct compBlock	block;
+	int		ret;
+	int		s;
+
+
+	initBlock (&block, input, input_size, false, level);
+	block.bwt_memory = bwt_memory;
+	block.context = context;
+
+	for ( s = 0; s < COMP_STAGE_COUNT; ++ s )
+	{
+		ret = runStage (s, &block, errorHook, errorHook_data);
+		if ( COMP_RET_OKAY != ret )
+		{
+			freeBlock (&block);
+			return ret;
+		}
+	}
+
+	*output = block.data;
+	*output_size = block.size;
+
+	return COMP_RET_OKAY;
+}
+
+/* reverse the post rle, mtf and bwt of pipeline. data is replaced by the result */
+static int
+untransformBWT (unsigned char ** data, unsigned long * size, unsigned char pipeline, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	*a = *data, *b;
+	unsigned long	l = *size, m;
+
+	int		ret;
+
+
+	if ( POST_RLE_NONE != PIPE_POST_RLE (pipeline) )
+	{
+		if ( POST_RLE_PACKBITS == PIPE_POST_RLE (pipeline) )
+			ret = rle_packbits_decompress (a, l, &b, &m);
+		else
+			ret = rle_basic_decompress (a, l, &b, &m, false);
+
+		if ( RLE_RET_SUCCESS != ret )
+		{
+			free (a);
+			if ( RLE_RET_NOMEM == ret )
+			{
+				errorHook ("out of memory while run length decoding", errorHook_data);
+				return COMP_RET_NOMEM;
+			}
+			else
+			if ( RLE_RET_MALFORMED == ret )
+				errorHook ("input data has confused the run length decoder", errorHook_data);
+			else
+				errorHook ("unexpected response from run length decoder!!", errorHook_data);
+
+			return COMP_RET_COMP;
+		}
+
+		free (a);
+	}
+	else
+	{
+		b = a;
+		m = l;
+	}
+
+	ret = mtf_decode (b, m, PIPE_MTF (pipeline));
+	if ( 0 == ret )
+	{
+		errorHook ("error during mtf decode", errorHook_data);
+		free (b);
+		return COMP_RET_COMP;
+	}
+
+	ret = bwt_decode (b, m, &a, &l);
+	if ( 0 == ret )
+	{
+		errorHook ("out of memory while reversing burrows-wheeler transform", errorHook_data);
+		free (b);
+		return COMP_RET_NOMEM;
+	}
+	free (b);
+
+	*data = a;
+	*size = l;
+
+	return COMP_RET_OKAY;
+}
+
+/*
+ * reverse the transforms of pipeline on a block whose header is header_len
+ * bytes long. table is the shared table it was coded with, if it was
+ */
+static int
+untransform (unsigned char * input, unsigned long input_size, unsigned long header_len, unsigned char pipeline, struct huffTable * table, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	l;
+
+	int		ret;
+
+
+	if ( NULL != table )
+		ret = huff_decodeTable (table, input, input_size, &a, &l, header_len);
+	else
+		ret = huff_decode (input, input_size, &a, &l, header_len);
+	if ( HUFF_RET_SUCCESS != ret )
+	{
+		if ( HUFF_RET_NOMEM == ret )
+		{
+			errorHook ("out of memory while huffman decoding", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+		else
+		if ( HUFF_RET_MALFORMED == ret )
+			errorHook ("input data has confused the huffman decoder", errorHook_data);
+		else
+			errorHook ("unexpected response from huffman decoder!!", errorHook_data);
+
+		return COMP_RET_COMP;
+	}
+
+	if ( PIPE_NO_BWT != (pipeline & PIPE_NO_BWT) )
+	{
+		ret = untransformBWT (&a, &l, pipeline, errorHook, errorHook_data);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+	}
+
+	if ( 0 == (pipeline & PIPE_PRE_RLE) )
+	{
+		*output = a;
+		*output_size = l;
+		return COMP_RET_OKAY;
+	}
+
+	ret = rle_basic_decompress (a, l, output, output_size, false);
+	if ( RLE_RET_SUCCESS != ret )
+	{
+		free (a);
+
+		if ( RLE_RET_NOMEM == ret )
+		{
+			errorHook ("out of memory while run length decoding", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+		else
+		if ( RLE_RET_MALFORMED == ret )
+			errorHook ("input data has confused the run length decoder", errorHook_data);
+		else
+			errorHook ("unexpected response from run length decoder!!", errorHook_data);
+
+		return COMP_RET_COMP;
+	}
+
+	free (a);
+
+	return COMP_RET_OKAY;
+}
+
+/* put the zero runs back between the pieces of rest */
+static int
+restoreZeroRuns (unsigned char * table, unsigned long num_runs, unsigned char * rest, unsigned long rest_size, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	size = rest_size,
+								offset, length,
+								i = 0, o = 0,
+								r;
+
+	for ( r = 0; r < num_runs; ++ r )
+		size += get32 (table + r * ZERO_RUN_LEN + 4);
+
+	a = malloc (size);
+	if ( NULL == a )
+	{
+		errorHook ("out of memory while restoring zero runs", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	for ( r = 0; r < num_runs; ++ r )
+	{
+		offset = get32 (table + r * ZERO_RUN_LEN);
+		length = get32 (table + r * ZERO_RUN_LEN + 4);
+
+		if ( offset < o || offset - o > rest_size - i || length > size - offset )
+		{
+			free (a);
+			errorHook ("zero run table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		memcpy (a + o, rest + i, offset - o);
+		i += offset - o;
+		memset (a + offset, 0, length);
+		o = offset + length;
+	}
+
+	if ( size - o != rest_size - i )
+	{
+		free (a);
+		errorHook ("zero run table is malformed", errorHook_data);
+		return COMP_RET_COMP;
+	}
+
+	memcpy (a + o, rest + i, size - o);
+
+	*output = a;
+	*output_size = size;
+
+	return COMP_RET_OKAY;
+}
+
+/* put the repeats back between the pieces of rest, copying each from earlier in the output */
+static int
+restoreLongMatches (unsigned char * table, unsigned long num_matches, unsigned char * rest, unsigned long rest_size, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+{
+	unsigned char	* a;
+	unsigned long	size = rest_size,
+								offset, length, distance,
+								i = 0, o = 0,
+								k, m;
+
+	for ( m = 0; m < num_matches; ++ m )
+	{
+		length = get32 (table + m * LONG_MATCH_LEN + 4);
+		if ( length > COMP_BLOCK_MAX )
+		{
+			errorHook ("long match table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		size += length;
+	}
+
+	a = malloc (size);
+	if ( NULL == a )
+	{
+		errorHook ("out of memory while restoring long matches", errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	for ( m = 0; m < num_matches; ++ m )
+	{
+		offset = get32 (table + m * LONG_MATCH_LEN);
+		length = get32 (table + m * LONG_MATCH_LEN + 4);
+		distance = get32 (table + m * LONG_MATCH_LEN + 8);
+
+		if ( offset < o || offset - o > rest_size - i || length > size - offset || 0 == distance || distance > offset )
+		{
+			free (a);
+			errorHook ("long match table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		memcpy (a + o, rest + i, offset - o);
+		i += offset - o;
+
+		/* a byte at a time -- the copy can overlap what it copies */
+		for ( k = offset; k < offset + length; ++ k )
+			a[k] = a[k - distance];
+
+		o = offset + length;
+	}
+
+	if ( size - o != rest_size - i )
+	{
+		free (a);
+		errorHook ("long match table is malformed", errorHook_data);
+		return COMP_RET_COMP;
+	}
+
+	memcpy (a + o, rest + i, size - o);
+
+	*output = a;
+	*output_size = size;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+decompress (unsigned char * input, unsigned long input_size, struct compContext * context, unsigned char ** output, unsigned long * output_size, errorHookT errorHook, void * errorHook_data)
+{
+	struct huffTable	* huff_table = NULL;
+
+	unsigned char	* a,
+								* b,
+								* table = NULL,
+								* match_table = NULL;
+	unsigned long	l,
+								m,
+								header_len = COMP_MODE_LEN,
+								num_runs = 0,
+								num_matches = 0;
+
+	int		ret;
+
+	unsigned char	compress_mode,
+								pipeline;
+
+
+	compress_mode = *input & 0xff;
+
+	if ( FILL_BLOCK == (compress_mode & FILL_BLOCK) )
+	{
+		if ( FILL_LEN != input_size || 0 == get32 (input + 2) )
+		{
+			errorHook ("fill block is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		*output_size = get32 (input + 2);
+		*output = malloc (*output_size);
+		if ( NULL == *output )
+		{
+			errorHook ("out of memory while filling block", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+
+		memset (*output, input[1], *output_size);
+
+		return COMP_RET_OKAY;
+	}
+
+	if ( PIPELINE_BYTE == (compress_mode & PIPELINE_BYTE) )
+	{
+		if ( input_size <= COMP_MODE_LEN + PIPELINE_LEN )
+		{
+			errorHook ("block is too short for its pipeline", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		pipeline = input[COMP_MODE_LEN];
+		header_len += PIPELINE_LEN;
+
+		if ( PIPE_MTF (pipeline) > MTF2 || PIPE_POST_RLE (pipeline) > POST_RLE_BASIC || PIPE_ENTROPY (pipeline) > ENTROPY_HUFF_TABLE
+				|| (PIPE_NO_BWT == (pipeline & PIPE_NO_BWT) && (MTF0 != PIPE_MTF (pipeline) || POST_RLE_NONE != PIPE_POST_RLE (pipeline))) )
+		{
+			errorHook ("block uses a pipeline this version doesn't know", errorHook_data);
+			return COMP_RET_VERSION;
+		}
+
+		if ( ENTROPY_HUFF_TABLE == PIPE_ENTROPY (pipeline) )
+		{
+			if ( input_size <= header_len + TABLE_ID_LEN )
+			{
+				errorHook ("block is too short for its pipeline", errorHook_data);
+				return COMP_RET_COMP;
+			}
+
+			if ( NULL == context || NULL == context->tables[input[header_len]] )
+			{
+				errorHook ("block needs a shared table that hasn't been loaded", errorHook_data);
+				return COMP_RET_NOTABLE;
+			}
+
+			huff_table = context->tables[input[header_len]];
+			header_len += TABLE_ID_LEN;
+		}
+	}
+	else
+		pipeline = PIPE_PRE_RLE | MAKE_PIPE (MTF1, RLE_AFTER_BWT == (compress_mode & RLE_AFTER_BWT) ? POST_RLE_PACKBITS : POST_RLE_NONE, ENTROPY_HUFF);
+
+	if ( ZERO_RUNS == (compress_mode & ZERO_RUNS) )
+	{
+		if ( input_size < header_len + 4 )
+		{
+			errorHook ("zero run table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		num_runs = get32 (input + header_len);
+		table = input + header_len + 4;
+
+		if ( num_runs > (input_size - header_len - 4) / ZERO_RUN_LEN )
+		{
+			errorHook ("zero run table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		header_len += 4 + num_runs * ZERO_RUN_LEN;
+	}
+
+	if ( LONG_MATCHES == (compress_mode & LONG_MATCHES) )
+	{
+		if ( input_size < header_len + 4 )
+		{
+			errorHook ("long match table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		num_matches = get32 (input + header_len);
+		match_table = input + header_len + 4;
+
+		if ( num_matches > (input_size - header_len - 4) / LONG_MATCH_LEN )
+		{
+			errorHook ("long match table is malformed", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		header_len += 4 + num_matches * LONG_MATCH_LEN;
+	}
+
+	if ( STORED_BLOCK == (compress_mode & STORED_BLOCK) )
+	{
+		if ( input_size <= header_len )
+		{
+			errorHook ("stored block is empty", errorHook_data);
+			return COMP_RET_COMP;
+		}
+
+		l = input_size - header_len;
+		a = malloc (l);
+		if ( NULL == a )
+		{
+			errorHook ("out of memory while copying stored block", errorHook_data);
+			return COMP_RET_NOMEM;
+		}
+
+		memcpy (a, input + header_len, l);
+	}
+	else
+	{
+		ret = untransform (input, input_size, header_len, pipeline, huff_table, &a, &l, errorHook, errorHook_data);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+	}
+
+	if ( 0 != num_matches )
+	{
+		ret = restoreLongMatches (match_table, num_matches, a, l, &b, &m, errorHook, errorHook_data);
+		free (a);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+
+		a = b;
+		l = m;
+	}
+
+	if ( 0 == num_runs )
+	{
+		*output = a;
+		*output_size = l;
+		return COMP_RET_OKAY;
+	}
+
+	ret = restoreZeroRuns (table, num_runs, a, l, output, output_size, errorHook, errorHook_data);
+	free (a);
+
+	return ret;
+}
+
+static void
+describeBlock (struct compBlockInfo * block_info, unsigned char * data, unsigned long size)
+{
+	block_info->uncompressed_size = size;
+	block_info->crc = crc_generate (data, size);
+	block_info->repeat = false;
+	block_info->repeat_offset = 0;
+}
+
+/* the next block of input, through the dedup index when there is one. input_size is 0 at the end */
+static int
+readBlock (struct dedupIndex * dedup, FILE * inputf, unsigned char * input, unsigned long read_size, unsigned long * input_size, bool * repeat, unsigned long * repeat_offset)
+{
+	if ( NULL != dedup )
+	{
+		if ( DEDUP_RET_SUCCESS != dedup_read (dedup, inputf, input, read_size, input_size, repeat, repeat_offset) )
+			return COMP_RET_READ;
+
+		return COMP_RET_OKAY;
+	}
+
+	*repeat = false;
+	*repeat_offset = 0;
+
+	*input_size = fread (input, sizeof *input, read_size, inputf);
+	if ( 0 == *input_size && 0 != ferror (inputf) )
+		return COMP_RET_READ;
+
+	return COMP_RET_OKAY;
+}
+
+unsigned char
+comp_pipelineFlags (void)
+{
+	return COMP_PIPE_PER_BLOCK;
+}
+
+/* blocks without a pipeline byte are decoded with the fixed pipeline */
+bool
+comp_pipelineSupported (unsigned char flags)
+{
+	return COMP_PIPE_PER_BLOCK == flags || COMP_PIPE_FIXED == flags;
+}
+
+static errorHookT
+infoErrorHook (struct compressInfo * info)
+{
+	if ( NULL == info || NULL == info->errorHook )
+		return stub_errorHook;
+
+	return info->errorHook;
+}
+
+static int
+infoLevel (struct compressInfo * info)
+{
+	if ( NULL == info || 0 == info->level )
+		return COMP_LEVEL_DEFAULT;
+
+	return info->level;
+}
+
+static bool
+badLevel (struct compressInfo * info)
+{
+	return NULL != info && 0 != info->level && (info->level < COMP_LEVEL_MIN || info->level > COMP_LEVEL_MAX);
+}
+
+unsigned long
+comp_levelBlockSize (int level)
+{
+	if ( level < COMP_LEVEL_MIN || level > COMP_LEVEL_MAX )
+		level = COMP_LEVEL_DEFAULT;
+
+	return level * 102400;
+}
+
+unsigned long
+comp_blockMemory (unsigned long block_size, unsigned long bwt_memory)
+{
+	unsigned long	bwt = bwt_encodeMemory (block_size);
+
+	/* on disk the bwt takes its memory and the output */
+	if ( 0 != bwt_memory && bwt > bwt_memory + block_size )
+		bwt = bwt_memory + block_size;
+
+	/* the input and the copies the zero runs and pre rle leave, with the bwt's own */
+	return 3 * block_size + bwt;
+}
+
+unsigned long
+comp_fitBlockSize (unsigned long block_size, unsigned long blocks, unsigned long bwt_memory)
+{
+	unsigned long long	memory;
+	long								pages,
+											page_size;
+
+	if ( block_size > COMP_BLOCK_MAX )
+		block_size = COMP_BLOCK_MAX;
+
+	if ( 0 == blocks )
+		blocks = 1;
+
+	pages = sysconf (_SC_PHYS_PAGES);
+	page_size = sysconf (_SC_PAGESIZE);
+
+	/* without knowing, assume it fits */
+	if ( 0 >= pages || 0 >= page_size )
+		return block_size;
+
+	/* a quarter is left for everything else */
+	memory = (unsigned long long) pages * page_size / 4 * 3;
+
+	while ( block_size > comp_levelBlockSize (COMP_LEVEL_MIN) && (unsigned long long) comp_blockMemory (block_size, bwt_memory) * blocks > memory )
+		block_size /= 2;
+
+	if ( (unsigned long long) comp_blockMemory (block_size, bwt_memory) * blocks > memory )
+		return 0;
+
+	return block_size;
+}
+
+
+/*
+ * rate control
+ * ------------
+ *
+ * with a target rate, the level and so the block size is chosen afresh for
+ * every block. the speed of each level is measured as its blocks are
+ * compressed and the next block gets the highest level that has been
+ * keeping up with the target. when that level has time to spare, a level
+ * halfway up to the lowest one known to be too slow is tried -- so a short
+ * input isn't spent climbing one level at a time. the slow levels are
+ * forgotten after RATE_RETRY blocks at one level so that the choice can
+ * follow the data as it becomes easier.
+ */
+
+/* a level at least this much faster than the target (in percent) tries the next level up */
+#define RATE_HEADROOM		125
+#define RATE_RETRY			16
+
+struct rateControl
+{
+	unsigned long	target;			/* bytes a second */
+	int						max_level;
+	int						level;			/* for the next block */
+
+	/* bytes a second, or 0 if not yet measured */
+	unsigned long	speed[COMP_LEVEL_MAX + 1];
+
+	unsigned long	steady;			/* blocks since the level last changed */
+};
+
+static void
+initRate (struct rateControl * rate, struct compressInfo * info)
+{
+	memset (rate, 0, sizeof *rate);
+
+	rate->target = NULL == info ? 0 : info->target_rate;
+	rate->max_level = infoLevel (info);
+
+	/* with no measurements, start fast and work up */
+	rate->level = 0 == rate->target ? rate->max_level : COMP_LEVEL_MIN;
+}
+
+/* bytes to read for the next block -- all of max_block when there is no target */
+static unsigned long
+rateBlockSize (struct rateControl * rate, int level, unsigned long max_block)
+{
+	unsigned long	block_size = comp_levelBlockSize (level);
+
+	if ( 0 == rate->target )
+		return max_block;
+
+	return block_size < max_block ? block_size : max_block;
+}
+
+/* record that size bytes were compressed at level in ns nanoseconds and choose the next level */
+static void
+rateUpdate (struct rateControl * rate, int level, unsigned long size, unsigned long long ns)
+{
+	unsigned long	speed;
+	int						l, up;
+
+	if ( 0 == rate->target )
+		return;
+
+	if ( 0 == ns )
+		ns = 1;
+
+	speed = (unsigned long long) size * 1000000000ULL / ns;
+
+	/* smooth over the blocks at a level */
+	if ( 0 == rate->speed[level] )
+		rate->speed[level] = speed;
+	else
+		rate->speed[level] = (rate->speed[level] + speed) / 2;
+
+	/* the highest level known to keep up -- the fastest when none does */
+	for ( l = rate->max_level; l > COMP_LEVEL_MIN; -- l )
+		if ( rate->speed[l] >= rate->target )
+			break; /* for loop */
+
+	if ( l == rate->level )
+		++ rate->steady;
+	else
+		rate->steady = 0;
+
+	/* with time to spare, try halfway up to the lowest level known to be too slow */
+	if ( l < rate->max_level && (unsigned long long) rate->speed[l] * 100 >= (unsigned long long) rate->target * RATE_HEADROOM )
+	{
+		if ( rate->steady >= RATE_RETRY )
+		{
+			for ( up = l + 1; up <= rate->max_level; ++ up )
+				rate->speed[up] = 0;
+			rate->steady = 0;
+		}
+
+		for ( up = l + 1; up <= rate->max_level && 0 == rate->speed[up]; ++ up )
+			;
+
+		if ( up > l + 1 )
+		{
+			l = (l + up + 1) / 2;
+			if ( l >= up )
+				l = up - 1;
+		}
+	}
+
+	rate->level = l;
+}
+
+int
+comp_compressBlock (struct compressInfo * info, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size)
+{
+	if ( NULL == input || 0 == input_size || input_size > COMP_BLOCK_MAX || NULL == output || NULL == output_size || true == badLevel (info) )
+		return COMP_RET_BADARGS;
+
+	return compress (input, input_size, infoLevel (info), NULL == info ? 0 : info->bwt_memory, NULL, output, output_size, infoErrorHook (info), info?info->errorHook_data:NULL);
+}
+
+int
+comp_decompressBlock (struct compressInfo * info, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size)
+{
+	if ( NULL == input || 0 == input_size || NULL == output || NULL == output_size )
+		return COMP_RET_BADARGS;
+
+	return decompress (input, input_size, NULL, output, output_size, infoErrorHook (info), info?info->errorHook_data:NULL);
+}
+
+unsigned long
+comp_blockBound (unsigned long input_size)
+{
+	/* any block that would come out bigger is stored */
+	return COMP_MODE_LEN + input_size;
+}
+
+/*
+ * contexts
+ * --------
+ *
+ * training runs the samples through every stage but the huffman coder and
+ * builds a table from the bytes that reach it. when a context has tables,
+ * each block is coded with whichever of them -- or its own dictionary --
+ * looks cheapest.
+ */
+struct compContext *
+comp_newContext (struct compressInfo * info)
+{
+	struct compContext	* context;
+
+	if ( true == badLevel (info) )
+		return NULL;
+
+	/* every table starts out NULL */
+	context = calloc (1, sizeof *context);
+	if ( NULL == context )
+		return NULL;
+
+	context->level = infoLevel (info);
+	context->errorHook = infoErrorHook (info);
+	context->errorHook_data = NULL == info ? NULL : info->errorHook_data;
+
+	return context;
+}
+
+void
+comp_freeContext (struct compContext * context)
+{
+	int		t;
+
+	if ( NULL == context )
+		return;
+
+	for ( t = 0; t < COMP_TABLE_IDS; ++ t )
+		free (context->tables[t]);
+
+	free (context);
+}
+
+/* put table in the context under id, in place of any table already there */
+static void
+putTable (struct compContext * context, unsigned int id, struct huffTable * table)
+{
+	if ( NULL == context->tables[id] )
+		++ context->num_tables;
+	else
+		free (context->tables[id]);
+
+	context->tables[id] = table;
+}
+
+int
+comp_trainTable (struct compContext * context, unsigned int id, unsigned char ** samples, unsigned long * sample_sizes, unsigned long count)
+{
+	struct compBlock	block;
+	struct huffTable	* table;
+	unsigned long			counts[256],
+										i, k;
+	int								s, ret;
+
+	if ( NULL == context || id >= COMP_TABLE_IDS || NULL == samples || NULL == sample_sizes || 0 == count )
+		return COMP_RET_BADARGS;
+
+	memset (counts, 0, sizeof counts);
+
+	for ( k = 0; k < count; ++ k )
+	{
+		if ( NULL == samples[k] || 0 == sample_sizes[k] )
+			return COMP_RET_BADARGS;
+
+		initBlock (&block, samples[k], sample_sizes[k], false, context->level);
+
+		for ( s = 0; s < COMP_STAGE_HUFF; ++ s )
+		{
+			ret = runStage (s, &block, context->errorHook, context->errorHook_data);
+			if ( COMP_RET_OKAY != ret )
+			{
+				freeBlock (&block);
+				return ret;
+			}
+		}
+
+		/* stored and filled blocks never reach the huffman coder */
+		if ( 0 == (block.compress_mode & (STORED_BLOCK | FILL_BLOCK)) )
+		{
+			for ( i = 0; i < block.size; ++ i )
+				++ counts[block.data[i]];
+		}
+
+		freeBlock (&block);
+	}
+
+	table = malloc (sizeof *table);
+	if ( NULL == table || HUFF_RET_SUCCESS != huff_buildTable (counts, table) )
+	{
+		free (table);
+		context->errorHook ("out of memory while building table", context->errorHook_data);
+		return COMP_RET_NOMEM;
+	}
+
+	putTable (context, id, table);
+
+	return COMP_RET_OKAY;
+}
+
+int
+comp_getTable (struct compContext * context, unsigned int id, unsigned char * code_lens)
+{
+	if ( NULL == context || id >= COMP_TABLE_IDS || NULL == context->tables[id] || NULL == code_lens )
+		return COMP_RET_BADARGS;
+
+	memcpy (code_lens, context->tables[id]->code_lens, COMP_TABLE_LEN);
+
+	return COMP_RET_OKAY;
+}
+
+int
+comp_setTable (struct compContext * context, unsigned int id, unsigned char * code_lens)
+{
+	struct huffTable	* table;
+	int								ret;
+
+	if ( NULL == context || id >= COMP_TABLE_IDS || NULL == code_lens )
+		return COMP_RET_BADARGS;
+
+	table = malloc (sizeof *table);
+	if ( NULL == table )
+		return COMP_RET_NOMEM;
+
+	ret = huff_loadTable (code_lens, table);
+	if ( HUFF_RET_SUCCESS != ret )
+	{
+		free (table);
+		return HUFF_RET_NOMEM == ret ? COMP_RET_NOMEM : COMP_RET_BADARGS;
+	}
+
+	putTable (context, id, table);
+
+	return COMP_RET_OKAY;
+}
+
+int
+comp_compressContext (struct compContext * context, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size)
+{
+	if ( NULL == context || NULL == input || 0 == input_size || input_size > COMP_BLOCK_MAX || NULL == output || NULL == output_size )
+		return COMP_RET_BADARGS;
+
+	return compress (input, input_size, context->level, 0, context, output, output_size, context->errorHook, context->errorHook_data);
+}
+
+int
+comp_decompressContext (struct compContext * context, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size)
+{
+	if ( NULL == context || NULL == input || 0 == input_size || NULL == output || NULL == output_size )
+		return COMP_RET_BADARGS;
+
+	return decompress (input, input_size, context, output, output_size, context->errorHook, context->errorHook_data);
+}
+
+int
+comp_compressBatch (struct compContext * context, unsigned char ** inputs, unsigned long * input_sizes, unsigned long count, unsigned char ** output, unsigned long * output_sizes)
+{
+	unsigned char	* buffer,
+								* block,
+								* tmp;
+	unsigned long	size = 0,
+								used = 0,
+								block_size,
+								k;
+	int						ret;
+
+	if ( NULL == context || NULL == inputs || NULL == input_sizes || 0 == count || NULL == output || NULL == output_sizes )
+		return COMP_RET_BADARGS;
+
+	for ( k = 0; k < count; ++ k )
+	{
+		if ( NULL == inputs[k] || 0 == input_sizes[k] || input_sizes[k] > COMP_BLOCK_MAX )
+			return COMP_RET_BADARGS;
+
+		size += comp_blockBound (input_sizes[k]);
+	}
+
+	/* room for every block at its largest, so there's only the one allocation */
+	buffer = malloc (size);
+	if ( NULL == buffer )
+		return COMP_RET_NOMEM;
+
+	for ( k = 0; k < count; ++ k )
+	{
+		ret = compress (inputs[k], input_sizes[k], context->level, 0, context, &block, &block_size, context->errorHook, context->errorHook_data);
+		if ( COMP_RET_OKAY != ret )
+		{
+			free (buffer);
+			return ret;
+		}
+
+		memcpy (buffer + used, block, block_size);
+		used += block_size;
+		output_sizes[k] = block_size;
+
+		free (block);
+	}
+
+	tmp = realloc (buffer, used);
+	if ( NULL != tmp )
+		buffer = tmp;
+
+	*output = buffer;
+
+	return COMP_RET_OKAY;
+}
+
+int
+comp_decompressBatch (struct compContext * context, unsigned char * input, unsigned long * input_sizes, unsigned long count, unsigned char ** output, unsigned long * output_sizes)
+{
+	unsigned char	* buffer = NULL,
+								* block,
+								* tmp;
+	unsigned long	size = 0,
+								used = 0,
+								block_size,
+								k;
+	int						ret;
+
+	if ( NULL == context || NULL == input || NULL == input_sizes || 0 == count || NULL == output || NULL == output_sizes )
+		return COMP_RET_BADARGS;
+
+	for ( k = 0; k < count; ++ k )
+	{
+		if ( 0 == input_sizes[k] )
+		{
+			free (buffer);
+			return COMP_RET_BADARGS;
+		}
+
+		ret = decompress (input, input_sizes[k], context, &block, &block_size, context->errorHook, context->errorHook_data);
+		if ( COMP_RET_OKAY != ret )
+		{
+			free (buffer);
+			return ret;
+		}
+
+		/* grow by doubling so that many blocks make few allocations */
+		if ( used + block_size > size )
+		{
+			size = 2 * (used + block_size);
+
+			tmp = realloc (buffer, size);
+			if ( NULL == tmp )
+			{
+				free (block);
+				free (buffer);
+				return COMP_RET_NOMEM;
+			}
+			buffer = tmp;
+		}
+
+		memcpy (buffer + used, block, block_size);
+		used += block_size;
+		output_sizes[k] = block_size;
+
+		free (block);
+		input += input_sizes[k];
+	}
+
+	*output = buffer;
+
+	return COMP_RET_OKAY;
+}
+
+int
+comp_compressFile (struct compressInfo * info, FILE * inputf, unsigned long max_block)
+{
+	unsigned char	*input,
+								*output;
+
+	unsigned long input_size,
+								read_size,
+								output_size,
+								repeat_offset;
+
+	struct compBlockInfo	block_info;
+	struct rateControl		rate;
+	struct dedupIndex		* dedup = NULL == info ? NULL : info->dedup;
+	unsigned long long		start;
+	bool									repeat;
+
+	int		compress_ret;
+
+
+	/* stubify callback hooks if necessary */
+	compressHookT		compressHook;
+	errorHookT			errorHook;
+	
+	if ( NULL != info )
+	{
+		if ( NULL == info->compressHook )
+			compressHook = stub_compressHook;
+		else
+			compressHook = info->compressHook;
+
+		if ( NULL == info->errorHook )
+			errorHook = stub_errorHook;
+		else
+			errorHook = info->errorHook;
+	}
+
+	if ( 0 == max_block || max_block > COMP_BLOCK_MAX || true == badLevel (info) )
+		return COMP_RET_BADARGS;
+
+	initRate (&rate, info);
+
+	/* allocate enough memory for input data */
+	input = malloc (max_block * sizeof *input);
+	if ( NULL == input )
 		return COMP_RET_NOMEM;
 
 	/* loop until end of file is reached */
 	do
 	{
-		input_size = fread (input, sizeof *input, max_block, inputf);
-		if ( 0 == input_size )
+		read_size = rateBlockSize (&rate, rate.level, max_block);
+
+		compress_ret = readBlock (dedup, inputf, input, read_size, &input_size, &repeat, &repeat_offset);
+		if ( COMP_RET_OKAY != compress_ret || 0 == input_size )
 		{
 			free (input);
+			return compress_ret;
+		}
 
-			if ( 0 != feof (inputf) )
-				return COMP_RET_READ;
+		describeBlock (&block_info, input, input_size);
 
-			return COMP_RET_OKAY;
+		/* a repeat of earlier input is only recorded */
+		if ( true == repeat )
+		{
+			block_info.repeat = true;
+			block_info.repeat_offset = repeat_offset;
+
+			if ( false == compressHook (NULL, 0, &block_info, info?info->compressHook_data:NULL) )
+			{
+				free (input);
+				return COMP_RET_HOOKEND;
+			}
+
+			continue; /* do loop */
 		}
 
 		/* do compression */
-		compress_ret = compress (input, input_size, &output, &output_size, errorHook, info?info->errorHook_data:NULL);
+		start = nanoseconds ();
+		compress_ret = compress (input, input_size, rate.level, NULL == info ? 0 : info->bwt_memory, NULL, &output, &output_size, errorHook, info?info->errorHook_data:NULL);
 		if ( COMP_RET_OKAY != compress_ret )
 		{
 			free (input);
 			return compress_ret;
 		}
 
+		rateUpdate (&rate, rate.level, input_size, nanoseconds () - start);
+
 		/* call compression hook */
-		if ( false == compressHook (output, output_size, info?info->compressHook_data:NULL) )
+		if ( false == compressHook (output, output_size, &block_info, info?info->compressHook_data:NULL) )
 		{
 			free (output);
 			free (input);
@@ -342,7 +2428,7 @@ comp_compressFile (struct compressInfo * info, FILE * inputf, unsigned long max_
 
 		free (output);
 	}
-	while ( input_size == max_block );
+	while ( NULL != dedup || input_size == read_size );
 
 	free (input);
 
@@ -350,6 +2436,564 @@ comp_compressFile (struct compressInfo * info, FILE * inputf, unsigned long max_
 }
 
 
+/*
+ * pipelined compression
+ * ---------------------
+ *
+ * the reader, each of the compress_stages[] and the writer run on their own
+ * threads. a stage with n threads gives block i to thread (i % n), and every
+ * thread of a stage has a queue to every thread of the next stage. so each
+ * queue has exactly one producer and one consumer, and a thread always knows
+ * which queue its next block will arrive on -- block order is kept without
+ * any locking.
+ *
+ * when the input is exhausted the reader sends end markers down the pipe in
+ * place of blocks; one for every thread of the widest stage, so that every
+ * thread receives at least one. a thread stops once it has passed on the
+ * last marker that will be sent its way.
+ */
+
+/* reader + compress stages + writer */
+#define PIPE_STAGE_COUNT	(COMP_STAGE_COUNT + 2)
+#define PIPE_READER				0
+#define PIPE_WRITER				(PIPE_STAGE_COUNT - 1)
+
+/* number of blocks that can wait between any two threads */
+#define PIPE_QUEUE_LEN		2
+
+/* how many times to spin on a queue before sleeping */
+#define PIPE_SPIN					64
+#define PIPE_SLEEP_NS			50000
+
+struct pipeItem
+{
+	struct compBlock	block;
+	unsigned long			index;
+
+	/* filled in by the first stage */
+	struct compBlockInfo	block_info;
+
+	/* a repeat goes through the stages untouched */
+	bool							repeat;
+	unsigned long			repeat_offset;
+
+	/* end marker -- total is the number of data blocks in the input */
+	bool							end;
+	unsigned long			total;
+};
+
+struct pipeline
+{
+	unsigned int				threads[PIPE_STAGE_COUNT];
+
+	/*
+	 * queues[s] connects stage s with stage s+1. the queue from thread a
+	 * to thread b is at queues[s][a * threads[s+1] + b]
+	 */
+	struct spscQueue	** queues[PIPE_STAGE_COUNT - 1];
+
+	unsigned long				end_markers;
+
+	/* first error to occur -- accessed atomically */
+	int									ret;
+
+	FILE							* inputf;
+	unsigned long				max_block;
+	unsigned long				bwt_memory;
+	struct dedupIndex		* dedup;
+
+	/*
+	 * level of the next block read -- accessed atomically. the writer
+	 * chooses it from the stage timings of the blocks it receives
+	 */
+	int									level;
+	struct rateControl	rate;
+	unsigned long				cpus;
+
+	errorHookT					errorHook;
+	void							* errorHook_data;
+};
+
+struct pipeThread
+{
+	struct pipeline		* pipe;
+	unsigned int				stage;
+	unsigned int				thread;
+	pthread_t						id;
+};
+
+static bool
+pipe_failed (struct pipeline * pipe)
+{
+	return COMP_RET_OKAY != __atomic_load_n (&pipe->ret, __ATOMIC_ACQUIRE);
+}
+
+static void
+pipe_fail (struct pipeline * pipe, int ret)
+{
+	int	okay = COMP_RET_OKAY;
+
+	/* only the first error is recorded */
+	__atomic_compare_exchange_n (&pipe->ret, &okay, ret, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void
+pipe_wait (unsigned int * spins)
+{
+	struct timespec	ts = { 0, PIPE_SLEEP_NS };
+
+	if ( ++ *spins < PIPE_SPIN )
+		sched_yield ();
+	else
+		nanosleep (&ts, NULL);
+}
+
+/* returns NULL if the pipeline has failed */
+static struct pipeItem *
+pipe_pop (struct pipeline * pipe, struct spscQueue * q)
+{
+	void	* item;
+	unsigned int	spins = 0;
+
+	while ( false == spsc_pop (q, &item) )
+	{
+		if ( true == pipe_failed (pipe) )
+			return NULL;
+		pipe_wait (&spins);
+	}
+
+	return (struct pipeItem *) item;
+}
+
+/* returns false if the pipeline has failed -- item still belongs to the caller */
+static bool
+pipe_push (struct pipeline * pipe, struct spscQueue * q, struct pipeItem * item)
+{
+	unsigned int	spins = 0;
+
+	while ( false == spsc_push (q, item) )
+	{
+		if ( true == pipe_failed (pipe) )
+			return false;
+		pipe_wait (&spins);
+	}
+
+	return true;
+}
+
+static void
+pipe_freeItem (struct pipeItem * item)
+{
+	freeBlock (&item->block);
+	free (item);
+}
+
+static struct spscQueue *
+pipe_inQueue (struct pipeline * pipe, unsigned int stage, unsigned int thread, unsigned long index)
+{
+	return pipe->queues[stage-1][(index % pipe->threads[stage-1]) * pipe->threads[stage] + thread];
+}
+
+static struct spscQueue *
+pipe_outQueue (struct pipeline * pipe, unsigned int stage, unsigned int thread, unsigned long index)
+{
+	return pipe->queues[stage][thread * pipe->threads[stage+1] + (index % pipe->threads[stage+1])];
+}
+
+/* true if this is the last item thread will see */
+static bool
+pipe_lastItem (struct pipeline * pipe, unsigned int stage, struct pipeItem * item)
+{
+	return true == item->end && item->index + pipe->threads[stage] >= item->total + pipe->end_markers;
+}
+
+static void *
+pipe_reader (void * arg)
+{
+	struct pipeThread	* t = (struct pipeThread *) arg;
+	struct pipeline		* pipe = t->pipe;
+	struct pipeItem		* item;
+
+	unsigned char	* input;
+	unsigned long	input_size,
+								read_size,
+								repeat_offset;
+	unsigned long	i = 0,
+								j;
+	bool					repeat;
+	int						level,
+								ret;
+
+
+	/* read blocks until end of file is reached */
+	for (;;)
+	{
+		level = __atomic_load_n (&pipe->level, __ATOMIC_ACQUIRE);
+		read_size = rateBlockSize (&pipe->rate, level, pipe->max_block);
+
+		input = malloc (read_size * sizeof *input);
+		if ( NULL == input )
+		{
+			pipe_fail (pipe, COMP_RET_NOMEM);
+			return NULL;
+		}
+
+		ret = readBlock (pipe->dedup, pipe->inputf, input, read_size, &input_size, &repeat, &repeat_offset);
+		if ( COMP_RET_OKAY != ret || 0 == input_size )
+		{
+			free (input);
+
+			if ( COMP_RET_OKAY != ret )
+			{
+				pipe_fail (pipe, ret);
+				return NULL;
+			}
+
+			break; /* for loop */
+		}
+
+		item = malloc (sizeof *item);
+		if ( NULL == item )
+		{
+			free (input);
+			pipe_fail (pipe, COMP_RET_NOMEM);
+			return NULL;
+		}
+
+		initBlock (&item->block, input, input_size, true, level);
+		item->block.bwt_memory = pipe->bwt_memory;
+		item->index = i;
+		item->repeat = repeat;
+		item->repeat_offset = repeat_offset;
+		item->end = false;
+		item->total = 0;
+
+		if ( false == pipe_push (pipe, pipe_outQueue (pipe, PIPE_READER, 0, i), item) )
+		{
+			pipe_freeItem (item);
+			return NULL;
+		}
+
+		++ i;
+
+		if ( NULL == pipe->dedup && input_size != read_size )
+			break; /* for loop */
+	}
+
+	/* send end markers */
+	for ( j = 0; j < pipe->end_markers; ++ j )
+	{
+		item = malloc (sizeof *item);
+		if ( NULL == item )
+		{
+			pipe_fail (pipe, COMP_RET_NOMEM);
+			return NULL;
+		}
+
+		initBlock (&item->block, NULL, 0, false, level);
+		item->index = i + j;
+		item->repeat = false;
+		item->end = true;
+		item->total = i;
+
+		if ( false == pipe_push (pipe, pipe_outQueue (pipe, PIPE_READER, 0, i + j), item) )
+		{
+			free (item);
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+static void *
+pipe_stage (void * arg)
+{
+	struct pipeThread	* t = (struct pipeThread *) arg;
+	struct pipeline		* pipe = t->pipe;
+	struct pipeItem		* item;
+
+	unsigned long	i;
+	bool					last;
+	int						ret;
+
+
+	for ( i = t->thread; ; i += pipe->threads[t->stage] )
+	{
+		item = pipe_pop (pipe, pipe_inQueue (pipe, t->stage, t->thread, i));
+		if ( NULL == item )
+			break; /* for loop */
+
+		if ( false == item->end )
+		{
+			/* checksum on the first stage rather than the reader so that it can be spread over threads */
+			if ( 1 == t->stage )
+			{
+				describeBlock (&item->block_info, item->block.data, item->block.size);
+				item->block_info.repeat = item->repeat;
+				item->block_info.repeat_offset = item->repeat_offset;
+			}
+
+			ret = true == item->repeat ? COMP_RET_OKAY : runStage (t->stage - 1, &item->block, pipe->errorHook, pipe->errorHook_data);
+			if ( COMP_RET_OKAY != ret )
+			{
+				pipe_freeItem (item);
+				pipe_fail (pipe, ret);
+				break; /* for loop */
+			}
+		}
+
+		last = pipe_lastItem (pipe, t->stage, item);
+
+		if ( false == pipe_push (pipe, pipe_outQueue (pipe, t->stage, t->thread, i), item) )
+		{
+			pipe_freeItem (item);
+			break; /* for loop */
+		}
+
+		if ( true == last )
+			break; /* for loop */
+	}
+
+	return NULL;
+}
+
+/*
+ * the time the pipeline as a whole takes over a block -- that of the slowest
+ * stage given its threads, unless there aren't the cpus to run every stage
+ * at once
+ */
+static unsigned long long
+pipe_blockTime (struct pipeline * pipe, struct compBlock * block)
+{
+	unsigned long long	total = 0,
+										slowest = 0,
+										ns;
+	int									s;
+
+	for ( s = 0; s < COMP_STAGE_COUNT; ++ s )
+	{
+		total += block->stage_ns[s];
+
+		ns = block->stage_ns[s] / pipe->threads[s+1];
+		if ( ns > slowest )
+			slowest = ns;
+	}
+
+	total /= pipe->cpus;
+
+	return total > slowest ? total : slowest;
+}
+
+static void
+pipe_writer (struct pipeline * pipe, compressHookT compressHook, void * compressHook_data)
+{
+	struct pipeItem	* item;
+	unsigned long		i;
+	bool						last;
+
+
+	for ( i = 0; ; ++ i )
+	{
+		item = pipe_pop (pipe, pipe_inQueue (pipe, PIPE_WRITER, 0, i));
+		if ( NULL == item )
+			break; /* for loop */
+
+		if ( true == item->repeat )
+		{
+			if ( false == compressHook (NULL, 0, &item->block_info, compressHook_data) )
+			{
+				pipe_freeItem (item);
+				pipe_fail (pipe, COMP_RET_HOOKEND);
+				break; /* for loop */
+			}
+		}
+		else
+		if ( false == item->end )
+		{
+			if ( false == compressHook (item->block.data, item->block.size, &item->block_info, compressHook_data) )
+			{
+				pipe_freeItem (item);
+				pipe_fail (pipe, COMP_RET_HOOKEND);
+				break; /* for loop */
+			}
+
+			rateUpdate (&pipe->rate, item->block.level, item->block_info.uncompressed_size, pipe_blockTime (pipe, &item->block));
+			__atomic_store_n (&pipe->level, pipe->rate.level, __ATOMIC_RELEASE);
+		}
+
+		last = pipe_lastItem (pipe, PIPE_WRITER, item);
+		pipe_freeItem (item);
+
+		if ( true == last )
+			break; /* for loop */
+	}
+}
+
+/* free queues and any items left in them */
+static void
+pipe_freeQueues (struct pipeline * pipe)
+{
+	unsigned int	s;
+	unsigned long	q;
+	void				* item;
+
+	for ( s = 0; s < PIPE_STAGE_COUNT - 1; ++ s )
+	{
+		if ( NULL == pipe->queues[s] )
+			continue;
+
+		for ( q = 0; q < pipe->threads[s] * pipe->threads[s+1]; ++ q )
+		{
+			if ( NULL == pipe->queues[s][q] )
+				continue;
+
+			while ( true == spsc_pop (pipe->queues[s][q], &item) )
+				pipe_freeItem ((struct pipeItem *) item);
+
+			spsc_freeQueue (pipe->queues[s][q]);
+		}
+
+		free (pipe->queues[s]);
+		pipe->queues[s] = NULL;
+	}
+}
+
+static bool
+pipe_newQueues (struct pipeline * pipe)
+{
+	unsigned int	s;
+	unsigned long	q, n;
+
+	for ( s = 0; s < PIPE_STAGE_COUNT - 1; ++ s )
+		pipe->queues[s] = NULL;
+
+	for ( s = 0; s < PIPE_STAGE_COUNT - 1; ++ s )
+	{
+		n = pipe->threads[s] * pipe->threads[s+1];
+
+		pipe->queues[s] = calloc (n, sizeof *pipe->queues[s]);
+		if ( NULL == pipe->queues[s] )
+		{
+			pipe_freeQueues (pipe);
+			return false;
+		}
+
+		for ( q = 0; q < n; ++ q )
+		{
+			pipe->queues[s][q] = spsc_newQueue (PIPE_QUEUE_LEN);
+			if ( NULL == pipe->queues[s][q] )
+			{
+				pipe_freeQueues (pipe);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int
+comp_compressFilePipelined (struct compressInfo * info, FILE * inputf, unsigned long max_block, const unsigned int * stage_threads)
+{
+	struct pipeline			pipe;
+	struct pipeThread	* threads;
+
+	unsigned int	s, t;
+	unsigned long	num_threads = 0,
+								started = 0;
+
+	compressHookT		compressHook = stub_compressHook;
+	void					* compressHook_data = NULL;
+
+
+	if ( NULL == inputf || 0 == max_block || max_block > COMP_BLOCK_MAX || true == badLevel (info) )
+		return COMP_RET_BADARGS;
+
+	pipe.errorHook = stub_errorHook;
+	pipe.errorHook_data = NULL;
+
+	if ( NULL != info )
+	{
+		if ( NULL != info->compressHook )
+			compressHook = info->compressHook;
+		compressHook_data = info->compressHook_data;
+
+		if ( NULL != info->errorHook )
+			pipe.errorHook = info->errorHook;
+		pipe.errorHook_data = info->errorHook_data;
+	}
+
+	pipe.inputf = inputf;
+	pipe.max_block = max_block;
+	pipe.bwt_memory = NULL == info ? 0 : info->bwt_memory;
+	pipe.dedup = NULL == info ? NULL : info->dedup;
+	initRate (&pipe.rate, info);
+	pipe.level = pipe.rate.level;
+	pipe.cpus = sysconf (_SC_NPROCESSORS_ONLN) > 0 ? sysconf (_SC_NPROCESSORS_ONLN) : 1;
+	pipe.ret = COMP_RET_OKAY;
+
+	/* thread counts */
+	pipe.threads[PIPE_READER] = pipe.threads[PIPE_WRITER] = 1;
+	pipe.end_markers = 1;
+	for ( s = 0; s < COMP_STAGE_COUNT; ++ s )
+	{
+		pipe.threads[s+1] = (NULL == stage_threads || 0 == stage_threads[s]) ? 1 : stage_threads[s];
+
+		if ( pipe.threads[s+1] > pipe.end_markers )
+			pipe.end_markers = pipe.threads[s+1];
+	}
+
+	if ( false == pipe_newQueues (&pipe) )
+		return COMP_RET_NOMEM;
+
+	/* the writer runs on the calling thread */
+	for ( s = PIPE_READER; s < PIPE_WRITER; ++ s )
+		num_threads += pipe.threads[s];
+
+	threads = malloc (num_threads * sizeof *threads);
+	if ( NULL == threads )
+	{
+		pipe_freeQueues (&pipe);
+		return COMP_RET_NOMEM;
+	}
+
+	/* start threads */
+	for ( s = PIPE_READER; s < PIPE_WRITER; ++ s )
+	{
+		for ( t = 0; t < pipe.threads[s]; ++ t )
+		{
+			threads[started].pipe = &pipe;
+			threads[started].stage = s;
+			threads[started].thread = t;
+
+			if ( 0 != pthread_create (&threads[started].id, NULL,
+						PIPE_READER == s ? pipe_reader : pipe_stage, &threads[started]) )
+			{
+				pipe_fail (&pipe, COMP_RET_NOMEM);
+				break; /* for loop */
+			}
+
+			++ started;
+		}
+
+		if ( true == pipe_failed (&pipe) )
+			break; /* for loop */
+	}
+
+	if ( false == pipe_failed (&pipe) )
+		pipe_writer (&pipe, compressHook, compressHook_data);
+
+	while ( started > 0 )
+		pthread_join (threads[-- started].id, NULL);
+
+	free (threads);
+	pipe_freeQueues (&pipe);
+
+	return pipe.ret;
+}
+
+
 int
 comp_decompressFile (struct compressInfo * info, FILE * inputf, bool until_eof, unsigned long data_length)
 {
@@ -424,8 +3068,7 @@ comp_decompressFile (struct compressInfo * info, FILE * inputf, bool until_eof,
 		{
 			free (input);
 
-			/* return read error if eof has not been reached */
-			if ( 0 != feof (inputf) )
+			if ( 0 != ferror (inputf) )
 				return COMP_RET_READ;
 
 			return COMP_RET_OKAY;
@@ -439,8 +3082,7 @@ comp_decompressFile (struct compressInfo * info, FILE * inputf, bool until_eof,
 		{
 			free (input);
 
-			/* return read error if eof has not been reached */
-			if ( 0 != feof (inputf) )
+			if ( 0 != ferror (inputf) )
 				return COMP_RET_READ;
 
 			/* eof has been reached but it wasn't expected */
@@ -448,7 +3090,7 @@ comp_decompressFile (struct compressInfo * info, FILE * inputf, bool until_eof,
 		}
 
 		/* do decompression */
-		decompress_ret = decompress (input, input_size, &output, &output_size, errorHook, info?info->errorHook_data:NULL);
+		decompress_ret = decompress (input, input_size, NULL, &output, &output_size, errorHook, info?info->errorHook_data:NULL);
 		if ( COMP_RET_OKAY != decompress_ret )
 		{
 			free (input);
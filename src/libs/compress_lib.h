@@ -16,11 +16,28 @@
 #ifndef COMPRESS_LIB_H
 #define COMPRESS_LIB_H
 
+#include	<stdio.h>
+
 #include	<types_lib.h>
+#include	<dedup_lib.h>
+
 
 
+/* the uncompressed data a compressed block was made from */
+struct compBlockInfo
+{
+	unsigned long		uncompressed_size;
+	unsigned long		crc;		/* as returned by crc_generate() */
+
+	/*
+	 * the data is a repeat of that at repeat_offset of the input, found by
+	 * deduplication. a repeat is passed to the compress hook with no output
+	 */
+	bool						repeat;
+	unsigned long		repeat_offset;
+};
 
-typedef	bool (*compressHookT) (unsigned char * output, unsigned long output_size, void * callback_data);
+typedef	bool (*compressHookT) (unsigned char * output, unsigned long output_size, struct compBlockInfo * block_info, void * callback_data);
 typedef	bool (*decompressStartHookT) (FILE * input, unsigned long * block_size, void * callback_data);
 typedef	bool (*decompressEndHookT) (unsigned char * output, unsigned long output_size, void * callback_data);
 typedef	void (*errorHookT) (char * error, void * callback_data);
@@ -38,8 +55,70 @@ struct compressInfo
 	/* error hook can be NULL */
 	void * errorHook_data;
 	errorHookT	errorHook;
+
+	/* COMP_LEVEL_MIN to COMP_LEVEL_MAX, or 0 for COMP_LEVEL_DEFAULT */
+	int		level;
+
+	/* bytes a second to keep up, or 0 to compress every block at level */
+	unsigned long		target_rate;
+
+	/*
+	 * the most memory the bwt of each block may take, or 0 for no limit. a
+	 * block whose bwt would take more is sorted on disk -- see xbwt_lib.h
+	 */
+	unsigned long		bwt_memory;
+
+	/*
+	 * the chunks of input already seen, or NULL. when given, input is read
+	 * through it and only new data is compressed -- see dedup_lib.h. the
+	 * caller makes and frees it, and can keep it for more than one file
+	 */
+	struct dedupIndex	* dedup;
 };
 
+/*
+ * compression levels trade speed for ratio. level 1 doesn't use the bwt at
+ * all -- blocks are rle'd if it helps and huffman coded. levels 2 to 4 use
+ * the bwt with a fixed mtf and post rle, and the higher levels choose them
+ * for each block. every block records its own transforms so the level
+ * isn't needed to decompress.
+ *
+ * comp_levelBlockSize() gives the block size suggested for a level.
+ *
+ * given a target_rate, comp_compressFile() and comp_compressFilePipelined()
+ * time the blocks as they go and choose a level for each block, up to
+ * level, that keeps the rate near the target. blocks are then of the size
+ * suggested for their level, up to max_block.
+ */
+#define COMP_LEVEL_MIN			1
+#define COMP_LEVEL_MAX			9
+#define COMP_LEVEL_DEFAULT	9
+
+unsigned long	comp_levelBlockSize (int level);
+
+/*
+ * large blocks
+ * ------------
+ *
+ * a block can be of any size up to COMP_BLOCK_MAX, well beyond the block
+ * sizes of the levels. sizes inside a block are recorded in 4 bytes and the
+ * bwt takes no more than BWT_MAX_INPUT; COMP_BLOCK_MAX leaves room under
+ * both for however much the pre rle grows a block.
+ *
+ * the bwt of a block takes many times its size in memory, unless it is
+ * limited to bwt_memory (see compressInfo). comp_blockMemory() gives
+ * roughly the most memory compressing a block of block_size bytes can
+ * take, and comp_fitBlockSize() the largest block size, no more than
+ * block_size, with which a number of blocks given by blocks can be
+ * compressed at once in the physical memory of the machine. it gives 0
+ * if not even the smallest level's blocks fit. bwt_memory is 0 for no
+ * limit.
+ */
+#define COMP_BLOCK_MAX			(1UL << 30)
+
+unsigned long	comp_blockMemory (unsigned long block_size, unsigned long bwt_memory);
+unsigned long	comp_fitBlockSize (unsigned long block_size, unsigned long blocks, unsigned long bwt_memory);
+
 
 enum COMP_RET_CODES
 {
@@ -52,12 +131,134 @@ enum COMP_RET_CODES
 
 	/* the following are returned only by comp_decompressFile() */
 	COMP_RET_UNEXPECTEDEND,	 /* unexpected end of data when reading input */
-	COMP_RET_MALFORMED
+	COMP_RET_MALFORMED,
+
+	/* the following are returned only by the stream_lib functions */
+	COMP_RET_STREAMEND,	/* all output has been produced */
+	COMP_RET_BUFFER,		/* output buffer is too small */
+
+	/* the following are returned only when reading .flk files */
+	COMP_RET_CHECKSUM,	/* decompressed data doesn't match its crc */
+	COMP_RET_VERSION,		/* file needs a different version or pipeline */
+
+	/* the following is returned only when decompressing with a context */
+	COMP_RET_NOTABLE,		/* block was coded with a shared table the context doesn't have */
+
+	/* the following is returned only when the bwt is limited to bwt_memory */
+	COMP_RET_SCRATCH		/* scratch file for the bwt couldn't be made, written or read */
+};
+
+/*
+ * the transforms of compressed data. every block of COMP_PIPE_PER_BLOCK
+ * data records the transforms chosen for it. earlier builds used the same
+ * transforms for every block and said which with the other flags, though
+ * only COMP_PIPE_FIXED was ever written.
+ *
+ * comp_pipelineFlags() gives the flags of data compressed by this build and
+ * comp_pipelineSupported() whether data with flags can be decompressed.
+ */
+enum COMP_PIPELINE_FLAGS
+{
+	COMP_PIPE_PRERLE = 0x1,
+	COMP_PIPE_POSTRLE = 0x2,
+	COMP_PIPE_MTF_MASK = 0xc,		/* mtf model type in bits 2 and 3 */
+	COMP_PIPE_PER_BLOCK = 0x10
 };
 
+/* pre rle, post rle and mtf-1 */
+#define COMP_PIPE_FIXED		(COMP_PIPE_PRERLE | COMP_PIPE_POSTRLE | 0x4)
+
+unsigned char	comp_pipelineFlags (void);
+bool					comp_pipelineSupported (unsigned char flags);
+
 
 int	comp_compressFile (struct compressInfo *, FILE * inputf, unsigned long max_block);
 
+/*
+ * compress or decompress a single block held in memory. output is allocated
+ * by the function and must be freed by the caller. only the error hook and
+ * level of the compressInfo structure are used and the structure can be
+ * NULL.
+ */
+int	comp_compressBlock (struct compressInfo *, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size);
+int	comp_decompressBlock (struct compressInfo *, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size);
+
+/*
+ * the largest output comp_compressBlock() can produce for input_size bytes
+ */
+unsigned long	comp_blockBound (unsigned long input_size);
+
+/*
+ * contexts, for many small buffers
+ * --------------------------------
+ *
+ * a context holds the level and error hook of the compressInfo it was made
+ * with, along with any shared huffman tables. a small buffer spends much of
+ * its compressed size on its huffman dictionary; a block coded with a shared
+ * table carries only the table's id, but it can then only be decompressed
+ * with a context that has the same table under the same id.
+ *
+ * comp_trainTable() builds table id from sample buffers like those to be
+ * compressed. comp_getTable() gives the COMP_TABLE_LEN code lengths of a
+ * table so that it can be kept, and comp_setTable() puts them back into a
+ * context, which is how a decompressing context comes by the tables.
+ *
+ * comp_compressBatch() compresses count buffers into one allocation of
+ * *output, the blocks lying back to back with output_sizes[i] giving the
+ * size of each. comp_decompressBatch() undoes it.
+ *
+ * a context must not be used by more than one thread at a time.
+ */
+#define COMP_TABLE_IDS		256
+#define COMP_TABLE_LEN		256
+
+struct compContext;
+
+struct compContext	* comp_newContext (struct compressInfo *);
+void									comp_freeContext (struct compContext *);
+
+int	comp_trainTable (struct compContext *, unsigned int id, unsigned char ** samples, unsigned long * sample_sizes, unsigned long count);
+int	comp_getTable (struct compContext *, unsigned int id, unsigned char * code_lens);
+int	comp_setTable (struct compContext *, unsigned int id, unsigned char * code_lens);
+
+int	comp_compressContext (struct compContext *, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size);
+int	comp_decompressContext (struct compContext *, unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size);
+
+int	comp_compressBatch (struct compContext *, unsigned char ** inputs, unsigned long * input_sizes, unsigned long count, unsigned char ** output, unsigned long * output_sizes);
+int	comp_decompressBatch (struct compContext *, unsigned char * input, unsigned long * input_sizes, unsigned long count, unsigned char ** output, unsigned long * output_sizes);
+
+/*
+ * the transform stages every block passes through, in order
+ */
+enum COMP_STAGES
+{
+	COMP_STAGE_PRERLE = 0,
+	COMP_STAGE_BWT,
+	COMP_STAGE_MTF,			/* mtf and post-rle */
+	COMP_STAGE_HUFF,
+
+	COMP_STAGE_COUNT
+};
+
+/*
+ * as comp_compressFile() but with each stage running on dedicated threads
+ * and blocks handed between stages through lock-free queues. with a
+ * target_rate of 0 the output is identical to that of comp_compressFile().
+ * with a target_rate, the level of each block depends on how long the
+ * blocks before it took, so the output of neither is the same from one
+ * run to the next.
+ *
+ * stage_threads[] gives the number of threads for each of the COMP_STAGES
+ * (a value of 0 is taken to be 1). it can be NULL, in which case every stage
+ * gets one thread. input is read on a thread of its own and compressHook is
+ * always called from the calling thread, in block order. errorHook may be
+ * called from any stage thread.
+ *
+ * only one block is ever being transformed by a stage thread, so memory use
+ * is bounded by the number of threads rather than the size of the input.
+ */
+int	comp_compressFilePipelined (struct compressInfo *, FILE * inputf, unsigned long max_block, const unsigned int * stage_threads);
+
 /*
  * the `until_eof` argument instructs the decompressFile function to
  * read data until the end of the file if set to true. If it is set to
@@ -13,70 +13,302 @@
 // You should have received a copy of the GNU General Public License
 // along with Lick.  If not, see <https://www.gnu.org/licenses/>.
 
+#define _POSIX_C_SOURCE 200112L
+
 #include	<stdlib.h>
+#include	<stdint.h>
+#include	<pthread.h>
+
+#include	"crc32_lib.h"
+
+/*
+ * crc engine
+ * ----------
+ *
+ * the register is kept the way crc_generate() has always returned it --
+ * started at 0xFFFFFFFF and never inverted at the end.
+ *
+ * the bulk of the data is done 16 bytes at a time with sixteen tables
+ * (slicing-by-16), each table giving the effect of a byte at that distance
+ * from the end of the slice. on x86-64 cpus with the carry-less multiply
+ * instruction the data is instead folded 64 bytes at a time, as described
+ * in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction". either way the remaining bytes go through the first table.
+ */
+
+/* reflected crc-32 polynomial */
+#define CRC_POLY				0xedb88320UL
+
+#define SLICE_LEN				16
+
+static uint32_t	crc_tables[SLICE_LEN][256];
+
+static pthread_once_t	crc_once = PTHREAD_ONCE_INIT;
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_CLMUL
+#include	<immintrin.h>
+
+/* folding needs at least four 16 byte lanes */
+#define CLMUL_MIN_LEN		64
+
+static bool	crc_clmul = false;
+#endif
+
+
+static void
+initTables (void)
+{
+	uint32_t	c;
+	int				b, k, s;
+
+	for ( b = 0; b < 256; ++ b )
+	{
+		c = b;
+		for ( k = 0; k < 8; ++ k )
+			c = c & 1 ? (c >> 1) ^ CRC_POLY : c >> 1;
+
+		crc_tables[0][b] = c;
+	}
+
+	for ( s = 1; s < SLICE_LEN; ++ s )
+		for ( b = 0; b < 256; ++ b )
+			crc_tables[s][b] = (crc_tables[s-1][b] >> 8) ^ crc_tables[0][crc_tables[s-1][b] & 0xff];
+
+#ifdef HAVE_CLMUL
+	__builtin_cpu_init ();
+	crc_clmul = __builtin_cpu_supports ("pclmul") && __builtin_cpu_supports ("sse4.1");
+#endif
+}
+
+/* {{{1 TABLES */
+static uint32_t
+load32 (const unsigned char * p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t
+crcTables (uint32_t crc, const unsigned char * buff, unsigned long buff_len)
+{
+	uint32_t	a, b, c, d;
+
+	while ( buff_len >= SLICE_LEN )
+	{
+		a = load32 (buff) ^ crc;
+		b = load32 (buff + 4);
+		c = load32 (buff + 8);
+		d = load32 (buff + 12);
+
+		crc = crc_tables[15][a & 0xff] ^ crc_tables[14][(a >> 8) & 0xff]
+				^ crc_tables[13][(a >> 16) & 0xff] ^ crc_tables[12][a >> 24]
+				^ crc_tables[11][b & 0xff] ^ crc_tables[10][(b >> 8) & 0xff]
+				^ crc_tables[9][(b >> 16) & 0xff] ^ crc_tables[8][b >> 24]
+				^ crc_tables[7][c & 0xff] ^ crc_tables[6][(c >> 8) & 0xff]
+				^ crc_tables[5][(c >> 16) & 0xff] ^ crc_tables[4][c >> 24]
+				^ crc_tables[3][d & 0xff] ^ crc_tables[2][(d >> 8) & 0xff]
+				^ crc_tables[1][(d >> 16) & 0xff] ^ crc_tables[0][d >> 24];
+
+		buff += SLICE_LEN;
+		buff_len -= SLICE_LEN;
+	}
+
+	for (; buff_len; --buff_len, ++buff)
+		crc = crc_tables[0][(crc ^ *buff) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+/* }}}1 */
+
+/* {{{1 CARRY-LESS MULTIPLY */
+#ifdef HAVE_CLMUL
+/*
+ * buff_len must be a multiple of 16 and at least CLMUL_MIN_LEN. the
+ * constants are powers of x modulo the polynomial, bit reflected, from the
+ * end of the Intel paper.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+crcClmul (uint32_t crc, const unsigned char * buff, unsigned long buff_len)
+{
+	const __m128i	k1k2 = _mm_set_epi64x (0x01c6e41596LL, 0x0154442bd4LL),
+								k3k4 = _mm_set_epi64x (0x00ccaa009eLL, 0x01751997d0LL),
+								k5 = _mm_set_epi64x (0, 0x0163cd6124LL),
+								poly = _mm_set_epi64x (0x01f7011641LL, 0x01db710641LL),
+								mask = _mm_setr_epi32 (~0, 0, ~0, 0);
+
+	__m128i	x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128 ((const __m128i *) buff);
+	x2 = _mm_loadu_si128 ((const __m128i *) (buff + 16));
+	x3 = _mm_loadu_si128 ((const __m128i *) (buff + 32));
+	x4 = _mm_loadu_si128 ((const __m128i *) (buff + 48));
+
+	x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 (crc));
+
+	buff += 64;
+	buff_len -= 64;
 
-static unsigned long crc_32_tab[] =
-{				/* CRC polynomial 0xedb88320 */
-  0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-  0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-  0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-  0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-  0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-  0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-  0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
-  0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-  0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-  0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-  0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
-  0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-  0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-  0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-  0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-  0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-  0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-  0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-  0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-  0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-  0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-  0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-  0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-  0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-  0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-  0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-  0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-  0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-  0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-  0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-  0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-  0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-  0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-  0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-  0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-  0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-  0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-  0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-  0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-  0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-  0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-  0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-  0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
-};
-
-#define UPDC32(octet,crc) (crc_32_tab[((crc) ^ ((unsigned char)octet)) & 0xff] ^ ((crc) >> 8))
+	/* fold four lanes forward 64 bytes at a time */
+	while ( buff_len >= 64 )
+	{
+		x5 = _mm_clmulepi64_si128 (x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128 (x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128 (x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128 (x4, k1k2, 0x00);
 
+		x1 = _mm_clmulepi64_si128 (x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128 (x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128 (x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128 (x4, k1k2, 0x11);
 
+		x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), _mm_loadu_si128 ((const __m128i *) buff));
+		x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), _mm_loadu_si128 ((const __m128i *) (buff + 16)));
+		x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), _mm_loadu_si128 ((const __m128i *) (buff + 32)));
+		x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), _mm_loadu_si128 ((const __m128i *) (buff + 48)));
+
+		buff += 64;
+		buff_len -= 64;
+	}
+
+	/* fold the four lanes into one */
+	x5 = _mm_clmulepi64_si128 (x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128 (x1, k3k4, 0x11);
+	x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128 (x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128 (x1, k3k4, 0x11);
+	x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128 (x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128 (x1, k3k4, 0x11);
+	x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+	/* then any 16 byte lanes left over */
+	while ( buff_len >= 16 )
+	{
+		x5 = _mm_clmulepi64_si128 (x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128 (x1, k3k4, 0x11);
+		x1 = _mm_xor_si128 (_mm_xor_si128 (x1, _mm_loadu_si128 ((const __m128i *) buff)), x5);
+
+		buff += 16;
+		buff_len -= 16;
+	}
+
+	/* fold 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128 (x1, k3k4, 0x10);
+	x1 = _mm_xor_si128 (_mm_srli_si128 (x1, 8), x2);
+
+	x2 = _mm_srli_si128 (x1, 4);
+	x1 = _mm_and_si128 (x1, mask);
+	x1 = _mm_clmulepi64_si128 (x1, k5, 0x00);
+	x1 = _mm_xor_si128 (x1, x2);
+
+	/* barrett reduction to 32 bits */
+	x0 = _mm_and_si128 (x1, mask);
+	x0 = _mm_clmulepi64_si128 (x0, poly, 0x10);
+	x0 = _mm_and_si128 (x0, mask);
+	x0 = _mm_clmulepi64_si128 (x0, poly, 0x00);
+	x1 = _mm_xor_si128 (x1, x0);
+
+	return _mm_extract_epi32 (x1, 1);
+}
+#endif /* HAVE_CLMUL */
+/* }}}1 */
+
+unsigned long
+crc_update (unsigned long crc, unsigned char * buff, unsigned long buff_len)
+{
+	uint32_t	c = crc & 0xffffffffUL;
+
+#ifdef HAVE_CLMUL
+	unsigned long	l;
+#endif
+
+	pthread_once (&crc_once, initTables);
+
+#ifdef HAVE_CLMUL
+	if ( true == crc_clmul && buff_len >= CLMUL_MIN_LEN )
+	{
+		l = buff_len & ~15UL;
+		c = crcClmul (c, buff, l);
+		buff += l;
+		buff_len -= l;
+	}
+#endif
+
+	return crcTables (c, buff, buff_len);
+}
 
 unsigned long
-crc_generate (unsigned char *buff, unsigned long buff_len)
+crc_generate (unsigned char * buff, unsigned long buff_len)
 {
-  unsigned long oldcrc = 0xFFFFFFFF;
+	return crc_update (CRC_INIT, buff, buff_len);
+}
 
+/* {{{1 COMBINE */
+/*
+ * appending len zero bytes to the data multiplies the register by
+ * x^(8*len) modulo the polynomial, so that is done with polynomial
+ * arithmetic (as zlib's crc32_combine does) rather than byte by byte.
+ */
+
+/* a * b modulo the polynomial, everything bit reflected */
+static uint32_t
+multModP (uint32_t a, uint32_t b)
+{
+	uint32_t	m = 0x80000000UL,
+						p = 0;
 
-  for (; buff_len; --buff_len, ++buff)
-    oldcrc = UPDC32 (*buff, oldcrc);
+	for (;;)
+	{
+		if ( a & m )
+		{
+			p ^= b;
+			if ( 0 == (a & (m - 1)) )
+				break; /* for loop */
+		}
 
-  return oldcrc;
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ CRC_POLY : b >> 1;
+	}
+
+	return p;
+}
+
+/* x^(n * 2^k) modulo the polynomial */
+static uint32_t
+xPowModP (unsigned long n, unsigned int k)
+{
+	uint32_t	p = 0x80000000UL,			/* x^0 */
+						x2k = 0x40000000UL;			/* x^1, squared k times below */
+
+	for (; k > 0; -- k )
+		x2k = multModP (x2k, x2k);
+
+	while ( n )
+	{
+		if ( n & 1 )
+			p = multModP (x2k, p);
+
+		n >>= 1;
+		x2k = multModP (x2k, x2k);
+	}
+
+	return p;
+}
+
+unsigned long
+crc_combine (unsigned long crc1, unsigned long crc2, unsigned long len2)
+{
+	/*
+	 * crc2 was started from CRC_INIT rather than from crc1, and the
+	 * difference between the two, carried through len2 bytes, is all
+	 * that separates crc2 from the crc of the joined data
+	 */
+	return crc2 ^ multModP (xPowModP (len2, 3), (crc1 ^ CRC_INIT) & 0xffffffffUL);
 }
+/* }}}1 */
 
 
 void
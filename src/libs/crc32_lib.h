@@ -16,7 +16,25 @@
 #ifndef CRC32LIB_H
 #define CRC32LIB_H
 
+#include	<types_lib.h>
+
+/* the register crc_generate() starts from */
+#define CRC_INIT	0xFFFFFFFFUL
+
 unsigned long crc_generate (unsigned char *buff, unsigned long buff_len);
 void 					crc_toString (unsigned long crc, char *crc_string);
 
+/*
+ * continue a crc over more data. crc_generate() is crc_update() from
+ * CRC_INIT, so a crc can be built up piece by piece.
+ */
+unsigned long	crc_update (unsigned long crc, unsigned char *buff, unsigned long buff_len);
+
+/*
+ * the crc of two pieces of data joined together, from the crc_generate()
+ * of each piece and the length of the second. pieces can be checksummed on
+ * different threads and combined afterwards.
+ */
+unsigned long	crc_combine (unsigned long crc1, unsigned long crc2, unsigned long len2);
+
 #endif /* CRC32_H */
@@ -0,0 +1,378 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdint.h>
+
+#include	<types_lib.h>
+#include	"dedup_lib.h"
+
+/* bytes the rolling hash depends on -- one for each bit shifted out of it */
+#define HASH_WINDOW			64
+
+/* input is read ahead by at least a chunk, into a buffer of this many */
+#define PENDING_LEN			(4 * DEDUP_CHUNK_MAX)
+
+/* slots looked at for a fingerprint before the oldest is given up */
+#define INDEX_PROBES		4
+
+struct dedupEntry
+{
+	uint64_t				fingerprint[2];
+	unsigned long		offset;			/* of the chunk in the input */
+	unsigned long		block;			/* the block of new data it went into */
+	unsigned long		size;				/* 0 for an empty slot */
+};
+
+struct dedupIndex
+{
+	uint64_t						gear[256];
+
+	struct dedupEntry	* entries;
+	unsigned long				num_entries;		/* a power of two */
+
+	/* input read but not yet given out, the first of it at offset in the input */
+	unsigned char			* pending;
+	unsigned long				pending_start;
+	unsigned long				pending_end;
+	unsigned long				offset;
+	bool								eof;
+
+	/* the chunk at the front of pending, once it has been found */
+	unsigned long				chunk_size;			/* 0 when it hasn't */
+	uint64_t						chunk_fingerprint[2];
+	bool								chunk_seen;
+	struct dedupEntry		seen;
+
+	/* blocks of new data given out so far */
+	unsigned long				blocks;
+};
+
+
+/* {{{1 HASHING */
+static uint64_t
+splitMix (uint64_t * state)
+{
+	uint64_t	z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static uint64_t
+rotl64 (uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t
+fmix64 (uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+/* the 128 bit hash of murmurhash3, 16 bytes at a time with the tail padded out with zeros */
+static void
+fingerprint (unsigned char * data, unsigned long size, uint64_t * fp)
+{
+	const uint64_t	c1 = 0x87c37b91114253d5ULL,
+									c2 = 0x4cf5ad432745937fULL;
+	unsigned char		tail[16];
+	uint64_t				h1 = 0,
+									h2 = 0,
+									k1, k2;
+	unsigned long		i;
+
+	for ( i = 0; i < size; i += 16 )
+	{
+		if ( size - i >= 16 )
+		{
+			memcpy (&k1, data + i, 8);
+			memcpy (&k2, data + i + 8, 8);
+		}
+		else
+		{
+			memset (tail, 0, sizeof tail);
+			memcpy (tail, data + i, size - i);
+			memcpy (&k1, tail, 8);
+			memcpy (&k2, tail + 8, 8);
+		}
+
+		k1 *= c1; k1 = rotl64 (k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64 (h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64 (k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64 (h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	h1 ^= size;
+	h2 ^= size;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64 (h1);
+	h2 = fmix64 (h2);
+	h1 += h2;
+	h2 += h1;
+
+	fp[0] = h1;
+	fp[1] = h2;
+}
+/* }}}1 */
+
+/* {{{1 INDEX */
+struct dedupIndex *
+dedup_newIndex (unsigned long memory)
+{
+	struct dedupIndex	* index;
+	uint64_t						state = 0;
+	int									k;
+
+	if ( memory < DEDUP_MIN_MEMORY )
+		memory = DEDUP_MIN_MEMORY;
+
+	index = calloc (1, sizeof *index);
+	if ( NULL == index )
+		return NULL;
+
+	for ( index->num_entries = 1; 2 * index->num_entries * sizeof *index->entries <= memory; index->num_entries *= 2 )
+		;
+
+	index->entries = calloc (index->num_entries, sizeof *index->entries);
+	index->pending = malloc (PENDING_LEN);
+	if ( NULL == index->entries || NULL == index->pending )
+	{
+		dedup_freeIndex (index);
+		return NULL;
+	}
+
+	for ( k = 0; k < 256; ++ k )
+		index->gear[k] = splitMix (&state);
+
+	return index;
+}
+
+void
+dedup_freeIndex (struct dedupIndex * index)
+{
+	if ( NULL == index )
+		return;
+
+	free (index->entries);
+	free (index->pending);
+	free (index);
+}
+
+static bool
+lookup (struct dedupIndex * index, uint64_t * fp, unsigned long size, struct dedupEntry * found)
+{
+	struct dedupEntry	* e;
+	unsigned long				p;
+
+	for ( p = 0; p < INDEX_PROBES; ++ p )
+	{
+		e = &index->entries[(fp[0] + p) & (index->num_entries - 1)];
+
+		if ( size == e->size && fp[0] == e->fingerprint[0] && fp[1] == e->fingerprint[1] )
+		{
+			*found = *e;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* into an empty slot if there is one, otherwise over the oldest chunk */
+static void
+insert (struct dedupIndex * index, uint64_t * fp, unsigned long size)
+{
+	struct dedupEntry	* e,
+											* oldest = NULL;
+	unsigned long				p;
+
+	for ( p = 0; p < INDEX_PROBES; ++ p )
+	{
+		e = &index->entries[(fp[0] + p) & (index->num_entries - 1)];
+
+		if ( 0 == e->size )
+		{
+			oldest = e;
+			break; /* for loop */
+		}
+
+		if ( NULL == oldest || e->offset < oldest->offset )
+			oldest = e;
+	}
+
+	oldest->fingerprint[0] = fp[0];
+	oldest->fingerprint[1] = fp[1];
+	oldest->offset = index->offset;
+	oldest->block = index->blocks;
+	oldest->size = size;
+}
+/* }}}1 */
+
+/* {{{1 CHUNKING */
+/* keep at least a chunk's worth of input pending, unless the input has run out */
+static int
+fillPending (struct dedupIndex * index, FILE * inputf)
+{
+	unsigned long	want,
+								n;
+
+	if ( true == index->eof || index->pending_end - index->pending_start >= DEDUP_CHUNK_MAX )
+		return DEDUP_RET_SUCCESS;
+
+	memmove (index->pending, index->pending + index->pending_start, index->pending_end - index->pending_start);
+	index->pending_end -= index->pending_start;
+	index->pending_start = 0;
+
+	want = PENDING_LEN - index->pending_end;
+	n = fread (index->pending + index->pending_end, sizeof *index->pending, want, inputf);
+	index->pending_end += n;
+
+	if ( n < want )
+	{
+		if ( 0 != ferror (inputf) )
+			return DEDUP_RET_READ;
+
+		index->eof = true;
+	}
+
+	return DEDUP_RET_SUCCESS;
+}
+
+/*
+ * the chunk ends after a byte whose hash has its top DEDUP_CHUNK_BITS
+ * clear. hashing starts HASH_WINDOW bytes before the shortest chunk could
+ * end, so that where a chunk ends depends on nothing but the bytes there
+ */
+static void
+findChunk (struct dedupIndex * index)
+{
+	unsigned char	* p = index->pending + index->pending_start;
+	unsigned long		avail = index->pending_end - index->pending_start,
+									limit = avail < DEDUP_CHUNK_MAX ? avail : DEDUP_CHUNK_MAX,
+									i;
+	uint64_t				h = 0;
+
+	index->chunk_size = limit;
+
+	for ( i = DEDUP_CHUNK_MIN - HASH_WINDOW; i < limit; ++ i )
+	{
+		h = (h << 1) + index->gear[p[i]];
+
+		if ( i + 1 >= DEDUP_CHUNK_MIN && 0 == h >> (64 - DEDUP_CHUNK_BITS) )
+		{
+			index->chunk_size = i + 1;
+			break; /* for loop */
+		}
+	}
+
+	fingerprint (p, index->chunk_size, index->chunk_fingerprint);
+	index->chunk_seen = lookup (index, index->chunk_fingerprint, index->chunk_size, &index->seen);
+}
+
+/* give n bytes of the front of pending to the block */
+static void
+take (struct dedupIndex * index, unsigned char * buffer, unsigned long * size, unsigned long n)
+{
+	memcpy (buffer + *size, index->pending + index->pending_start, n);
+	*size += n;
+
+	index->pending_start += n;
+	index->offset += n;
+	index->chunk_size = 0;
+}
+/* }}}1 */
+
+int
+dedup_read (struct dedupIndex * index, FILE * inputf, unsigned char * buffer, unsigned long max, unsigned long * size, bool * repeat, unsigned long * repeat_offset)
+{
+	unsigned long	block = 0;
+	int						ret;
+
+	*size = 0;
+	*repeat = false;
+	*repeat_offset = 0;
+
+	while ( *size < max )
+	{
+		ret = fillPending (index, inputf);
+		if ( DEDUP_RET_SUCCESS != ret )
+			return ret;
+
+		/* end of the input -- the next read starts another */
+		if ( index->pending_start == index->pending_end )
+		{
+			if ( 0 == *size )
+				index->eof = false;
+
+			break; /* while loop */
+		}
+
+		if ( 0 == index->chunk_size )
+			findChunk (index);
+
+		if ( true == index->chunk_seen )
+		{
+			/* a repeat carries on only while its chunks follow on from each other in the one block */
+			if ( *size > 0 && (false == *repeat || index->seen.block != block || index->seen.offset != *repeat_offset + *size) )
+				break; /* while loop */
+
+			if ( 0 == *size )
+			{
+				*repeat = true;
+				*repeat_offset = index->seen.offset;
+				block = index->seen.block;
+			}
+
+			/* a chunk longer than the block can still repeat the start of its earlier copy */
+			take (index, buffer, size, index->chunk_size < max - *size ? index->chunk_size : max - *size);
+			continue; /* while loop */
+		}
+
+		if ( true == *repeat )
+			break; /* while loop */
+
+		if ( index->chunk_size > max - *size )
+		{
+			if ( *size > 0 )
+				break; /* while loop */
+
+			/* a chunk longer than the block is cut, and not remembered */
+			take (index, buffer, size, max);
+			break; /* while loop */
+		}
+
+		insert (index, index->chunk_fingerprint, index->chunk_size);
+		take (index, buffer, size, index->chunk_size);
+	}
+
+	if ( *size > 0 && false == *repeat )
+		++ index->blocks;
+
+	return DEDUP_RET_SUCCESS;
+}
@@ -0,0 +1,72 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DEDUPLIB_H
+#define DEDUPLIB_H
+
+#include	<stdio.h>
+
+#include	<types_lib.h>
+
+/*
+ * deduplication
+ * -------------
+ *
+ * dedup_read() reads input in blocks, as fread() would, but cuts it into
+ * chunks where a rolling hash of the last 64 bytes says so -- so the same
+ * content is cut the same way wherever it turns up. each chunk is
+ * fingerprinted and the fingerprints kept in an index of a fixed size.
+ *
+ * a block is either new data, ending at a chunk boundary where it can, or
+ * a run of chunks that have all been seen before, one after the other
+ * within one earlier block of new data. a repeat is given the offset of
+ * the earlier data, counted from the start of the first input read
+ * through the index. an index can be used for any number of files in
+ * turn, so repeats are found across files that are laid end to end. the
+ * data of a repeat is put in the buffer too, so that it can be checked.
+ *
+ * chunks are taken to be the same when their 128 bit fingerprints are.
+ * the fingerprint isn't cryptographic, so deliberately made collisions
+ * could fool it, which is why the data of a repeat should be checksummed.
+ *
+ * the index takes no more than memory bytes, DEDUP_MIN_MEMORY at least.
+ * when it is full a new chunk takes the place of an older one, which is
+ * then only found again if it comes round a second time.
+ */
+#define DEDUP_CHUNK_MIN			4096
+#define DEDUP_CHUNK_MAX			65536
+#define DEDUP_CHUNK_BITS		14			/* an average chunk of 16k */
+
+#define DEDUP_MIN_MEMORY		(64UL * 1024)
+
+enum DEDUP_RET_CODES
+{
+	DEDUP_RET_SUCCESS,
+	DEDUP_RET_NOMEM,
+	DEDUP_RET_READ
+};
+
+struct dedupIndex;
+
+struct dedupIndex	* dedup_newIndex (unsigned long memory);
+void								dedup_freeIndex (struct dedupIndex *);
+
+/*
+ * read the next block of no more than max bytes into buffer. size is 0 at
+ * the end of the input, after which the next read starts a new input.
+ */
+int		dedup_read (struct dedupIndex *, FILE * inputf, unsigned char * buffer, unsigned long max, unsigned long * size, bool * repeat, unsigned long * repeat_offset);
+
+#endif /* DEDUPLIB_H */
@@ -0,0 +1,885 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+#include	<crc32_lib.h>
+#include	"flk_lib.h"
+
+#define HEADER_MAGIC	"\x89" "FLK"
+#define FOOTER_MAGIC	"FLKX"
+#define MAGIC_LEN			4
+
+/* version 1 blocks are preceded by their size */
+#define V1_PREFIX_LEN	4
+
+/* set in the compressed size of a repeat */
+#define REPEAT_FLAG		0x80000000UL
+
+
+/* {{{1 BYTE ORDER */
+static void
+put32 (unsigned char * p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static unsigned long
+get32 (unsigned char * p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+/* the high word is shifted in two steps in case unsigned long is only 32 bits */
+static void
+put64 (unsigned char * p, unsigned long v)
+{
+	put32 (p, (v >> 16) >> 16);
+	put32 (p + 4, v & 0xffffffffUL);
+}
+
+static unsigned long
+get64 (unsigned char * p)
+{
+	return ((get32 (p) << 16) << 16) | get32 (p + 4);
+}
+/* }}}1 */
+
+/* {{{1 INDEX */
+static struct flkIndex *
+allocIndex (unsigned int version)
+{
+	struct flkIndex	* index;
+
+	index = calloc (1, sizeof *index);
+	if ( NULL == index )
+		return NULL;
+
+	index->version = version;
+
+	return index;
+}
+
+void
+flk_freeIndex (struct flkIndex * index)
+{
+	if ( NULL == index )
+		return;
+
+	free (index->blocks);
+	free (index);
+}
+
+static struct flkBlock *
+appendBlock (struct flkIndex * index)
+{
+	struct flkBlock	* tmp;
+	unsigned long			max;
+
+	if ( index->num_blocks == index->max_blocks )
+	{
+		max = 0 == index->max_blocks ? 64 : index->max_blocks * 2;
+		tmp = realloc (index->blocks, max * sizeof *index->blocks);
+		if ( NULL == tmp )
+			return NULL;
+
+		index->blocks = tmp;
+		index->max_blocks = max;
+	}
+
+	tmp = &index->blocks[index->num_blocks ++];
+	memset (tmp, 0, sizeof *tmp);
+
+	return tmp;
+}
+
+/* file offset just past the data of the last block */
+static unsigned long
+dataEnd (struct flkIndex * index)
+{
+	struct flkBlock	* last;
+
+	if ( 0 == index->num_blocks )
+		return FLK_HEADER_LEN;
+
+	last = &index->blocks[index->num_blocks - 1];
+
+	return last->offset + last->comp_size;
+}
+/* }}}1 */
+
+/* {{{1 WRITING */
+struct flkIndex *
+flk_newIndex (unsigned long block_size, bool repeats)
+{
+	struct flkIndex	* index;
+
+	index = allocIndex (true == repeats ? FLK_VERSION_REPEATS : FLK_VERSION);
+	if ( NULL == index )
+		return NULL;
+
+	index->flags = comp_pipelineFlags ();
+	index->block_size = block_size;
+
+	return index;
+}
+
+void
+flk_writeHeader (struct flkIndex * index, unsigned char * header)
+{
+	memcpy (header, HEADER_MAGIC, MAGIC_LEN);
+	header[4] = index->version;
+	header[5] = index->flags;
+	put32 (header + 6, index->block_size);
+}
+
+static void
+writeRecord (struct flkBlock * block, unsigned char * record)
+{
+	put32 (record, true == block->repeat ? block->comp_size | REPEAT_FLAG : block->comp_size);
+	put32 (record + 4, block->uncomp_size);
+	put32 (record + 8, block->crc);
+}
+
+int
+flk_addBlock (struct flkIndex * index, unsigned long comp_size, struct compBlockInfo * block_info, unsigned char * record)
+{
+	struct flkBlock	* block;
+	unsigned long			offset,
+										uncomp_offset = 0;
+
+	if ( NULL == index || NULL == block_info )
+		return COMP_RET_BADARGS;
+
+	if ( true == block_info->repeat )
+	{
+		if ( FLK_VERSION_REPEATS != index->version )
+			return COMP_RET_BADARGS;
+
+		comp_size = FLK_REPEAT_LEN;
+	}
+
+	offset = dataEnd (index) + FLK_RECORD_LEN;
+	if ( index->num_blocks > 0 )
+		uncomp_offset = index->blocks[index->num_blocks - 1].uncomp_offset + index->blocks[index->num_blocks - 1].uncomp_size;
+
+	block = appendBlock (index);
+	if ( NULL == block )
+		return COMP_RET_NOMEM;
+
+	block->offset = offset;
+	block->comp_size = comp_size;
+	block->uncomp_offset = uncomp_offset;
+	block->uncomp_size = block_info->uncompressed_size;
+	block->crc = block_info->crc;
+	block->repeat = block_info->repeat;
+
+	if ( NULL != record )
+	{
+		writeRecord (block, record);
+
+		if ( true == block->repeat )
+			put64 (record + FLK_RECORD_LEN, block_info->repeat_offset);
+	}
+
+	return COMP_RET_OKAY;
+}
+
+unsigned long
+flk_indexLen (struct flkIndex * index)
+{
+	return index->num_blocks * FLK_RECORD_LEN + FLK_FOOTER_LEN;
+}
+
+void
+flk_writeIndex (struct flkIndex * index, unsigned char * output)
+{
+	unsigned long	b;
+
+	for ( b = 0; b < index->num_blocks; ++ b )
+	{
+		writeRecord (&index->blocks[b], output);
+		output += FLK_RECORD_LEN;
+	}
+
+	put64 (output, dataEnd (index));
+	put32 (output + 8, index->num_blocks);
+	memcpy (output + 12, FOOTER_MAGIC, MAGIC_LEN);
+}
+/* }}}1 */
+
+/* {{{1 READING */
+static bool
+isVersion2 (unsigned char * header, unsigned long header_size)
+{
+	return header_size >= MAGIC_LEN && 0 == memcmp (header, HEADER_MAGIC, MAGIC_LEN);
+}
+
+static int
+parseHeader (struct flkIndex * index, unsigned char * header, unsigned long header_size)
+{
+	if ( FLK_HEADER_LEN > header_size )
+		return COMP_RET_UNEXPECTEDEND;
+
+	if ( (FLK_VERSION != header[4] && FLK_VERSION_REPEATS != header[4]) || false == comp_pipelineSupported (header[5]) )
+		return COMP_RET_VERSION;
+
+	index->version = header[4];
+	index->flags = header[5];
+	index->block_size = get32 (header + 6);
+
+	return COMP_RET_OKAY;
+}
+
+/* check the footer against the size of the file. index_offset is where the records start */
+static int
+parseFooter (unsigned char * footer, unsigned long file_size, unsigned long * index_offset, unsigned long * num_blocks)
+{
+	if ( 0 != memcmp (footer + 12, FOOTER_MAGIC, MAGIC_LEN) )
+		return COMP_RET_MALFORMED;
+
+	*index_offset = get64 (footer);
+	*num_blocks = get32 (footer + 8);
+
+	if ( *index_offset < FLK_HEADER_LEN || *index_offset > file_size - FLK_FOOTER_LEN
+			|| *num_blocks != (file_size - FLK_FOOTER_LEN - *index_offset) / FLK_RECORD_LEN
+			|| 0 != (file_size - FLK_FOOTER_LEN - *index_offset) % FLK_RECORD_LEN )
+		return COMP_RET_MALFORMED;
+
+	return COMP_RET_OKAY;
+}
+
+/* fill in the blocks from the index records, which must account for every byte before them */
+static int
+parseRecords (struct flkIndex * index, unsigned char * records, unsigned long num_blocks, unsigned long index_offset)
+{
+	struct flkBlock	* block;
+	unsigned long			offset = FLK_HEADER_LEN,
+										uncomp_offset = 0,
+										b;
+
+	for ( b = 0; b < num_blocks; ++ b )
+	{
+		block = appendBlock (index);
+		if ( NULL == block )
+			return COMP_RET_NOMEM;
+
+		block->comp_size = get32 (records);
+		block->uncomp_size = get32 (records + 4);
+		block->crc = get32 (records + 8);
+		records += FLK_RECORD_LEN;
+
+		if ( 0 != (block->comp_size & REPEAT_FLAG) )
+		{
+			block->comp_size &= ~REPEAT_FLAG;
+			block->repeat = true;
+
+			if ( FLK_VERSION_REPEATS != index->version || FLK_REPEAT_LEN != block->comp_size )
+				return COMP_RET_MALFORMED;
+		}
+
+		offset += FLK_RECORD_LEN;
+		if ( 0 == block->comp_size || offset > index_offset || block->comp_size > index_offset - offset )
+			return COMP_RET_MALFORMED;
+
+		block->offset = offset;
+		block->uncomp_offset = uncomp_offset;
+
+		offset += block->comp_size;
+		uncomp_offset += block->uncomp_size;
+	}
+
+	if ( offset != index_offset )
+		return COMP_RET_MALFORMED;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+addV1Block (struct flkIndex * index, unsigned long offset, unsigned long comp_size, unsigned long file_size)
+{
+	struct flkBlock	* block;
+
+	if ( 0 == comp_size || offset > file_size || file_size - offset < comp_size )
+		return COMP_RET_UNEXPECTEDEND;
+
+	block = appendBlock (index);
+	if ( NULL == block )
+		return COMP_RET_NOMEM;
+
+	block->offset = offset;
+	block->comp_size = comp_size;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+readV1Index (FILE * inputf, struct flkIndex * index, unsigned long file_size)
+{
+	unsigned char	prefix[V1_PREFIX_LEN];
+	unsigned long	offset = 0;
+	size_t				n;
+	int						ret;
+
+	rewind (inputf);
+
+	for (;;)
+	{
+		n = fread (prefix, sizeof *prefix, V1_PREFIX_LEN, inputf);
+		if ( 0 == n && 0 != feof (inputf) )
+			return COMP_RET_OKAY;
+
+		if ( V1_PREFIX_LEN != n )
+			return 0 != ferror (inputf) ? COMP_RET_READ : COMP_RET_UNEXPECTEDEND;
+
+		offset += V1_PREFIX_LEN;
+
+		ret = addV1Block (index, offset, get32 (prefix), file_size);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+
+		offset += get32 (prefix);
+
+		if ( 0 != fseek (inputf, offset, SEEK_SET) )
+			return COMP_RET_READ;
+	}
+}
+
+static int
+readV2Index (FILE * inputf, struct flkIndex * index, unsigned char * header, unsigned long header_size, unsigned long file_size)
+{
+	unsigned char		footer[FLK_FOOTER_LEN];
+	unsigned char	* records;
+	unsigned long		index_offset,
+									num_blocks;
+	int							ret;
+
+	ret = parseHeader (index, header, header_size);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	if ( FLK_HEADER_LEN + FLK_FOOTER_LEN > file_size )
+		return COMP_RET_UNEXPECTEDEND;
+
+	if ( 0 != fseek (inputf, file_size - FLK_FOOTER_LEN, SEEK_SET) )
+		return COMP_RET_READ;
+
+	if ( FLK_FOOTER_LEN != fread (footer, sizeof *footer, FLK_FOOTER_LEN, inputf) )
+		return 0 != ferror (inputf) ? COMP_RET_READ : COMP_RET_UNEXPECTEDEND;
+
+	ret = parseFooter (footer, file_size, &index_offset, &num_blocks);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	if ( 0 == num_blocks )
+		return parseRecords (index, NULL, 0, index_offset);
+
+	records = malloc (num_blocks * FLK_RECORD_LEN);
+	if ( NULL == records )
+		return COMP_RET_NOMEM;
+
+	if ( 0 != fseek (inputf, index_offset, SEEK_SET) )
+	{
+		free (records);
+		return COMP_RET_READ;
+	}
+
+	if ( num_blocks * FLK_RECORD_LEN != fread (records, sizeof *records, num_blocks * FLK_RECORD_LEN, inputf) )
+	{
+		free (records);
+		return 0 != ferror (inputf) ? COMP_RET_READ : COMP_RET_UNEXPECTEDEND;
+	}
+
+	ret = parseRecords (index, records, num_blocks, index_offset);
+	free (records);
+
+	return ret;
+}
+
+int
+flk_readIndex (FILE * inputf, struct flkIndex ** index)
+{
+	struct flkIndex	* idx;
+	unsigned char			header[FLK_HEADER_LEN];
+	unsigned long			file_size;
+	long							l;
+	size_t						n;
+	int								ret;
+
+	if ( NULL == inputf || NULL == index )
+		return COMP_RET_BADARGS;
+
+	if ( 0 != fseek (inputf, 0, SEEK_END) )
+		return COMP_RET_READ;
+
+	l = ftell (inputf);
+	if ( 0 > l )
+		return COMP_RET_READ;
+	file_size = l;
+
+	rewind (inputf);
+	n = fread (header, sizeof *header, FLK_HEADER_LEN, inputf);
+	if ( 0 != ferror (inputf) )
+		return COMP_RET_READ;
+
+	idx = allocIndex (isVersion2 (header, n) ? FLK_VERSION : 1);
+	if ( NULL == idx )
+		return COMP_RET_NOMEM;
+
+	if ( 1 == idx->version )
+		ret = readV1Index (inputf, idx, file_size);
+	else
+		ret = readV2Index (inputf, idx, header, n, file_size);
+
+	if ( COMP_RET_OKAY != ret )
+	{
+		flk_freeIndex (idx);
+		return ret;
+	}
+
+	*index = idx;
+
+	return COMP_RET_OKAY;
+}
+
+int
+flk_parseIndex (unsigned char * input, unsigned long input_size, struct flkIndex ** index)
+{
+	struct flkIndex	* idx;
+	unsigned long			offset = 0,
+										index_offset,
+										num_blocks;
+	int								ret;
+
+	if ( NULL == input || NULL == index )
+		return COMP_RET_BADARGS;
+
+	idx = allocIndex (isVersion2 (input, input_size) ? FLK_VERSION : 1);
+	if ( NULL == idx )
+		return COMP_RET_NOMEM;
+
+	if ( 1 == idx->version )
+	{
+		ret = COMP_RET_OKAY;
+
+		while ( COMP_RET_OKAY == ret && offset < input_size )
+		{
+			if ( input_size - offset < V1_PREFIX_LEN )
+			{
+				ret = COMP_RET_UNEXPECTEDEND;
+				break; /* while loop */
+			}
+
+			ret = addV1Block (idx, offset + V1_PREFIX_LEN, get32 (input + offset), input_size);
+			offset += V1_PREFIX_LEN + get32 (input + offset);
+		}
+	}
+	else
+	{
+		ret = parseHeader (idx, input, input_size);
+
+		if ( COMP_RET_OKAY == ret && FLK_HEADER_LEN + FLK_FOOTER_LEN > input_size )
+			ret = COMP_RET_UNEXPECTEDEND;
+
+		if ( COMP_RET_OKAY == ret )
+			ret = parseFooter (input + input_size - FLK_FOOTER_LEN, input_size, &index_offset, &num_blocks);
+
+		if ( COMP_RET_OKAY == ret )
+			ret = parseRecords (idx, input + index_offset, num_blocks, index_offset);
+	}
+
+	if ( COMP_RET_OKAY != ret )
+	{
+		flk_freeIndex (idx);
+		return ret;
+	}
+
+	*index = idx;
+
+	return COMP_RET_OKAY;
+}
+/* }}}1 */
+
+/* {{{1 REPEATS */
+/* the block holding uncompressed offset */
+static unsigned long
+findBlock (struct flkIndex * index, unsigned long offset)
+{
+	unsigned long	lo = 0,
+								hi = index->num_blocks - 1,
+								mid;
+
+	while ( lo < hi )
+	{
+		mid = lo + (hi - lo + 1) / 2;
+
+		if ( index->blocks[mid].uncomp_offset <= offset )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/* the earlier block that repeat b repeats and where in it the data starts, from the repeat's data */
+static int
+repeatSource (struct flkIndex * index, unsigned long b, unsigned char * comp_data, unsigned long * s, unsigned long * start)
+{
+	struct flkBlock	* block = &index->blocks[b],
+									* source;
+	unsigned long			offset = get64 (comp_data);
+
+	if ( 0 == block->uncomp_size || offset >= block->uncomp_offset )
+		return COMP_RET_MALFORMED;
+
+	*s = findBlock (index, offset);
+	source = &index->blocks[*s];
+	*start = offset - source->uncomp_offset;
+
+	if ( true == source->repeat || *start >= source->uncomp_size || block->uncomp_size > source->uncomp_size - *start )
+		return COMP_RET_MALFORMED;
+
+	return COMP_RET_OKAY;
+}
+
+/* repeat b's data out of the decoded block it repeats, checked against its crc */
+static int
+copyRepeat (struct flkIndex * index, unsigned long b, unsigned char * source, unsigned long start, unsigned char ** output, unsigned long * output_size)
+{
+	struct flkBlock	* block = &index->blocks[b];
+
+	*output = malloc (block->uncomp_size);
+	if ( NULL == *output )
+		return COMP_RET_NOMEM;
+
+	memcpy (*output, source + start, block->uncomp_size);
+	*output_size = block->uncomp_size;
+
+	if ( crc_generate (*output, *output_size) != block->crc )
+	{
+		free (*output);
+		*output = NULL;
+		return COMP_RET_CHECKSUM;
+	}
+
+	return COMP_RET_OKAY;
+}
+
+/* *buffer holds the data of repeat b. the block it repeats is read through the same buffer */
+static int
+readRepeat (FILE * inputf, struct flkIndex * index, unsigned long b, unsigned char ** buffer, unsigned long * buffer_size, unsigned char ** output, unsigned long * output_size)
+{
+	unsigned char	* source;
+	unsigned long		source_size,
+									start,
+									s;
+	int							ret;
+
+	ret = repeatSource (index, b, *buffer, &s, &start);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	ret = flk_readBlock (inputf, index, s, buffer, buffer_size, &source, &source_size);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	ret = copyRepeat (index, b, source, start, output, output_size);
+	free (source);
+
+	return ret;
+}
+/* }}}1 */
+
+/* {{{1 BLOCKS */
+int
+flk_decodeBlock (struct flkIndex * index, unsigned long b, unsigned char * comp_data, unsigned char ** output, unsigned long * output_size)
+{
+	struct flkBlock	* block;
+	int								ret;
+
+	if ( NULL == index || b >= index->num_blocks || NULL == comp_data )
+		return COMP_RET_BADARGS;
+
+	block = &index->blocks[b];
+	if ( true == block->repeat )
+		return COMP_RET_BADARGS;
+
+	ret = comp_decompressBlock (NULL, comp_data, block->comp_size, output, output_size);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	if ( 1 == index->version )
+		return COMP_RET_OKAY;
+
+	if ( *output_size != block->uncomp_size )
+		ret = COMP_RET_MALFORMED;
+	else
+	if ( crc_generate (*output, *output_size) != block->crc )
+		ret = COMP_RET_CHECKSUM;
+
+	if ( COMP_RET_OKAY != ret )
+	{
+		free (*output);
+		*output = NULL;
+	}
+
+	return ret;
+}
+
+int
+flk_readBlock (FILE * inputf, struct flkIndex * index, unsigned long b, unsigned char ** buffer, unsigned long * buffer_size, unsigned char ** output, unsigned long * output_size)
+{
+	struct flkBlock	* block;
+	unsigned char		* tmp;
+
+	if ( NULL == inputf || NULL == index || b >= index->num_blocks || NULL == buffer || NULL == buffer_size )
+		return COMP_RET_BADARGS;
+
+	block = &index->blocks[b];
+
+	if ( block->comp_size > *buffer_size )
+	{
+		tmp = realloc (*buffer, block->comp_size);
+		if ( NULL == tmp )
+			return COMP_RET_NOMEM;
+
+		*buffer = tmp;
+		*buffer_size = block->comp_size;
+	}
+
+	if ( 0 != fseek (inputf, block->offset, SEEK_SET) )
+		return COMP_RET_READ;
+
+	if ( block->comp_size != fread (*buffer, sizeof **buffer, block->comp_size, inputf) )
+		return 0 != ferror (inputf) ? COMP_RET_READ : COMP_RET_UNEXPECTEDEND;
+
+	if ( true == block->repeat )
+		return readRepeat (inputf, index, b, buffer, buffer_size, output, output_size);
+
+	return flk_decodeBlock (index, b, *buffer, output, output_size);
+}
+/* }}}1 */
+
+/* {{{1 VERIFYING */
+struct verifyState
+{
+	int									fd;
+	struct flkIndex		* index;
+
+	/* next block to be checked -- accessed atomically */
+	unsigned long				next;
+
+	/* lowest numbered block found to be bad so far, and why */
+	pthread_mutex_t			lock;
+	unsigned long				bad_block;
+	int									ret;
+};
+
+static void
+verifyFailed (struct verifyState * v, unsigned long b, int ret)
+{
+	pthread_mutex_lock (&v->lock);
+
+	if ( b < v->bad_block )
+	{
+		v->bad_block = b;
+		v->ret = ret;
+	}
+
+	pthread_mutex_unlock (&v->lock);
+}
+
+static bool
+verifyWanted (struct verifyState * v, unsigned long b)
+{
+	bool	wanted;
+
+	pthread_mutex_lock (&v->lock);
+	wanted = b < v->bad_block;
+	pthread_mutex_unlock (&v->lock);
+
+	return wanted;
+}
+
+/* the compressed data of block b into *buffer, growing it as needed */
+static int
+verifyRead (struct verifyState * v, unsigned long b, unsigned char ** buffer, unsigned long * buffer_size)
+{
+	struct flkBlock	* block = &v->index->blocks[b];
+	unsigned char		* tmp;
+	unsigned long			got;
+	ssize_t						n;
+
+	if ( block->comp_size > *buffer_size )
+	{
+		tmp = realloc (*buffer, block->comp_size);
+		if ( NULL == tmp )
+			return COMP_RET_NOMEM;
+
+		*buffer = tmp;
+		*buffer_size = block->comp_size;
+	}
+
+	/* pread() leaves the file position alone so every thread can share the descriptor */
+	for ( got = 0; got < block->comp_size; got += n )
+	{
+		n = pread (v->fd, *buffer + got, block->comp_size - got, block->offset + got);
+		if ( 0 > n )
+			return COMP_RET_READ;
+		if ( 0 == n )
+			return COMP_RET_UNEXPECTEDEND;
+	}
+
+	return COMP_RET_OKAY;
+}
+
+static int
+verifyBlock (struct verifyState * v, unsigned long b, unsigned char ** buffer, unsigned long * buffer_size)
+{
+	unsigned char	* output,
+								* source;
+	unsigned long		output_size,
+									source_size,
+									start,
+									s;
+	int							ret;
+
+	ret = verifyRead (v, b, buffer, buffer_size);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	/* a repeat is checked by decoding the block it repeats again */
+	if ( true == v->index->blocks[b].repeat )
+	{
+		ret = repeatSource (v->index, b, *buffer, &s, &start);
+		if ( COMP_RET_OKAY == ret )
+			ret = verifyRead (v, s, buffer, buffer_size);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+
+		ret = flk_decodeBlock (v->index, s, *buffer, &source, &source_size);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+
+		ret = copyRepeat (v->index, b, source, start, &output, &output_size);
+		free (source);
+	}
+	else
+		ret = flk_decodeBlock (v->index, b, *buffer, &output, &output_size);
+
+	if ( COMP_RET_OKAY == ret )
+		free (output);
+
+	return ret;
+}
+
+static void *
+verifyThread (void * arg)
+{
+	struct verifyState	* v = (struct verifyState *) arg;
+	unsigned char				* buffer = NULL;
+	unsigned long					buffer_size = 0,
+												b;
+	int										ret;
+
+	for (;;)
+	{
+		b = __atomic_fetch_add (&v->next, 1, __ATOMIC_RELAXED);
+
+		/* no point going on past a block already known to be bad */
+		if ( b >= v->index->num_blocks || false == verifyWanted (v, b) )
+			break; /* for loop */
+
+		ret = verifyBlock (v, b, &buffer, &buffer_size);
+		if ( COMP_RET_OKAY != ret )
+			verifyFailed (v, b, ret);
+	}
+
+	free (buffer);
+
+	return NULL;
+}
+
+int
+flk_verify (FILE * inputf, struct flkIndex * index, unsigned int threads, unsigned long * bad_block)
+{
+	struct verifyState	v;
+	pthread_t					* ids;
+	unsigned int					started = 0,
+												t;
+	long									cpus;
+
+	if ( NULL == inputf || NULL == index || NULL == bad_block )
+		return COMP_RET_BADARGS;
+
+	if ( 0 == threads )
+	{
+		cpus = sysconf (_SC_NPROCESSORS_ONLN);
+		threads = 0 < cpus ? cpus : 1;
+	}
+
+	if ( threads > index->num_blocks )
+		threads = 0 == index->num_blocks ? 1 : index->num_blocks;
+
+	v.fd = fileno (inputf);
+	v.index = index;
+	v.next = 0;
+	v.bad_block = index->num_blocks;
+	v.ret = COMP_RET_OKAY;
+
+	if ( 0 != pthread_mutex_init (&v.lock, NULL) )
+		return COMP_RET_NOMEM;
+
+	ids = malloc (threads * sizeof *ids);
+	if ( NULL == ids )
+	{
+		pthread_mutex_destroy (&v.lock);
+		return COMP_RET_NOMEM;
+	}
+
+	/* the calling thread makes up the numbers if some can't be started */
+	for ( t = 1; t < threads; ++ t )
+	{
+		if ( 0 != pthread_create (&ids[started], NULL, verifyThread, &v) )
+			break; /* for loop */
+
+		++ started;
+	}
+
+	verifyThread (&v);
+
+	while ( started > 0 )
+		pthread_join (ids[-- started], NULL);
+
+	free (ids);
+	pthread_mutex_destroy (&v.lock);
+
+	*bad_block = v.bad_block;
+
+	return v.ret;
+}
+/* }}}1 */
@@ -0,0 +1,132 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FLKLIB_H
+#define FLKLIB_H
+
+#include	<stdio.h>
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+
+/*
+ * the .flk container
+ * ------------------
+ *
+ * version 1 files are nothing but a sequence of compressed blocks, each
+ * preceded by its size.
+ *
+ * version 2 files are laid out as
+ *
+ *	header	magic "\x89FLK" (4), version (1), pipeline flags (1),
+ *					block size (4)
+ *	blocks	a record of compressed size (4), uncompressed size (4) and
+ *					crc of the uncompressed data (4), then the compressed data
+ *	index		the records of every block again, in order
+ *	footer	offset of the index (8), number of blocks (4), magic "FLKX" (4)
+ *
+ * all integers are big endian. the footer is of a fixed size so the index
+ * is found with one seek from the end of the file. a version 1 file begins
+ * with the top byte of a block size, which is never 0x89, so the two
+ * versions can't be mistaken for each other.
+ *
+ * version 3 files are version 2 files that can hold repeats, blocks that
+ * are the same as data earlier in the file (see dedup_lib.h). the top bit
+ * of a repeat's compressed size is set and its data is the uncompressed
+ * offset (8) of the data it repeats, which must lie within one earlier
+ * block that isn't itself a repeat. builds that only know version 2 turn
+ * these files away rather than misread them.
+ *
+ * return values are from COMP_RET_CODES
+ */
+
+#define FLK_VERSION			2
+#define FLK_VERSION_REPEATS	3
+
+#define FLK_HEADER_LEN	10
+#define FLK_RECORD_LEN	12
+#define FLK_FOOTER_LEN	16
+#define FLK_REPEAT_LEN	8
+
+struct flkBlock
+{
+	unsigned long		offset;					/* of the compressed data in the file */
+	unsigned long		comp_size;
+	bool						repeat;					/* version 3 only */
+
+	/* zero for version 1 files */
+	unsigned long		uncomp_offset;	/* of the block in the uncompressed data */
+	unsigned long		uncomp_size;
+	unsigned long		crc;
+};
+
+struct flkIndex
+{
+	unsigned int			version;
+	unsigned char			flags;				/* COMP_PIPELINE_FLAGS -- version 2 and 3 only */
+	unsigned long			block_size;		/* version 2 and 3 only */
+
+	struct flkBlock	* blocks;
+	unsigned long			num_blocks;
+	unsigned long			max_blocks;
+};
+
+/*
+ * writing. a new index describes an empty version 2 file using this build's
+ * pipeline flags, or a version 3 file if it is to take repeats.
+ * flk_addBlock() writes the record to go in front of the block's data and
+ * flk_writeIndex() writes the index and footer, which take flk_indexLen()
+ * bytes. a repeat (block_info->repeat) has no compressed data; its record
+ * is followed by the FLK_REPEAT_LEN bytes that stand in for it, so record
+ * must have room for FLK_RECORD_LEN + FLK_REPEAT_LEN.
+ */
+struct flkIndex	* flk_newIndex (unsigned long block_size, bool repeats);
+void							flk_freeIndex (struct flkIndex *);
+
+void						flk_writeHeader (struct flkIndex *, unsigned char * header);
+int							flk_addBlock (struct flkIndex *, unsigned long comp_size, struct compBlockInfo *, unsigned char * record);
+unsigned long		flk_indexLen (struct flkIndex *);
+void						flk_writeIndex (struct flkIndex *, unsigned char * output);
+
+/*
+ * reading, of either version. a version 2 index is read from the trailer
+ * and a version 1 index is built by walking the size prefixes. files made
+ * with a pipeline comp_pipelineSupported() rejects give COMP_RET_VERSION.
+ */
+int		flk_readIndex (FILE * inputf, struct flkIndex ** index);
+int		flk_parseIndex (unsigned char * input, unsigned long input_size, struct flkIndex ** index);
+
+/*
+ * decompress block b from its compressed data, checking its size and crc
+ * when the index has them. flk_readBlock() first reads the data from the
+ * file into *buffer, growing it as needed. a repeat needs the block it
+ * repeats as well, so only flk_readBlock() decodes them --
+ * flk_decodeBlock() gives COMP_RET_BADARGS.
+ */
+int		flk_decodeBlock (struct flkIndex *, unsigned long b, unsigned char * comp_data, unsigned char ** output, unsigned long * output_size);
+int		flk_readBlock (FILE * inputf, struct flkIndex *, unsigned long b, unsigned char ** buffer, unsigned long * buffer_size, unsigned char ** output, unsigned long * output_size);
+
+/*
+ * decode every block and throw the output away, spreading the blocks over
+ * threads (0 for one per cpu). blocks of a version 2 file are checked
+ * against their crc; a version 1 file can only fail to decode. on failure
+ * bad_block is set to the first block in the file that is bad, otherwise
+ * to the number of blocks.
+ *
+ * inputf is read with pread() so its position is left alone.
+ */
+int		flk_verify (FILE * inputf, struct flkIndex *, unsigned int threads, unsigned long * bad_block);
+
+#endif /* FLKLIB_H */
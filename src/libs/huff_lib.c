@@ -33,6 +33,25 @@
  */
 #define DICT_SIZE				256
 
+/*
+ * the bit queue takes a code of up to this many bits whatever it already
+ * holds. a byte seen once in a block of many megabytes would otherwise get
+ * a longer code, and the block be stored for want of a way to write it
+ */
+#define MAX_CODE_LEN		24
+
+/*
+ * codes of up to this many bits are decoded with one table lookup rather
+ * than a walk down the tree
+ */
+#define DECODE_TABLE_BITS	10
+
+struct decodeEntry
+{
+	unsigned char	out;
+	unsigned char	len;		/* 0 if no code this short starts with these bits */
+};
+
 /* DEBUGGING FUNCTIONS {{{1 */
 #ifdef HUFF_DEBUG
 static void
@@ -82,27 +101,26 @@ struct tree_node
 	unsigned char     out;
 };
 
-static void
-killTree (struct tree_node * root)
+/*
+ * the nodes of a tree all come from one pool. a tree of DICT_SIZE leaves
+ * has fewer than 2 * DICT_SIZE nodes, so running out means the code lengths
+ * were nonsense
+ */
+struct tree_pool
 {
-	if ( NULL != root->left )
-		killTree (root->left);
-	
-	if ( NULL != root->right )
-		killTree (root->right);
-
-	free (root);
-}
+	struct tree_node	nodes[2 * DICT_SIZE];
+	unsigned int			used;
+};
 
 static struct tree_node *
-newTreeNode (void)
+newTreeNode (struct tree_pool * pool)
 {
 	struct tree_node	* node;
-	
-	node = malloc (sizeof *node);
-	if ( NULL == node )
+
+	if ( pool->used == sizeof pool->nodes / sizeof *pool->nodes )
 		return NULL;
 
+	node = &pool->nodes[pool->used ++];
 	node->left = node->right = NULL;
 	node->out = 0;
 
@@ -110,7 +128,7 @@ newTreeNode (void)
 }
 
 static int
-addCodeToTree (struct tree_node * root, unsigned char out, unsigned long code, unsigned int code_len)
+addCodeToTree (struct tree_pool * pool, struct tree_node * root, unsigned char out, unsigned long code, unsigned int code_len)
 {
 	struct tree_node	*walk = root;
 	unsigned long		 	code_play = code;
@@ -129,9 +147,9 @@ addCodeToTree (struct tree_node * root, unsigned char out, unsigned long code, u
 			/* go left */
 			if ( NULL == walk->left )
 			{
-				walk->left = newTreeNode ();
+				walk->left = newTreeNode (pool);
 				if ( NULL == walk->left )
-					return HUFF_RET_NOMEM;
+					return HUFF_RET_MALFORMED;
 			}
 			walk = walk->left;
 		}
@@ -140,9 +158,9 @@ addCodeToTree (struct tree_node * root, unsigned char out, unsigned long code, u
 			/* go right */
 			if ( NULL == walk->right )
 			{
-				walk->right = newTreeNode ();
+				walk->right = newTreeNode (pool);
 				if ( NULL == walk->right )
-					return HUFF_RET_NOMEM;
+					return HUFF_RET_MALFORMED;
 			}
 			walk = walk->right;
 		}
@@ -159,59 +177,61 @@ addCodeToTree (struct tree_node * root, unsigned char out, unsigned long code, u
 }
 /* }}}1 */
 
-/* COUNTSORT {{{1 */
+/* SORT {{{1 */
 /*
- * from "Mastering Algorithms With C"
- * Kyle Loudon, O'Reilly
+ * sort the DICT_SIZE counts into ascending order, recording where each
+ * entry went in idx and where each came from in rev_idx. equal counts end
+ * up in descending order of entry, as the count sort that was here before
+ * left them -- the order decides the codes, so it mustn't change.
+ *
+ * a merge sort of the entries needs no more memory than the stack and no
+ * more time than the count sort, which had to allocate room for every
+ * count up to the largest.
  */
-static int
-countSort (unsigned long ** data, unsigned long max,
-		unsigned char * idx, unsigned char * rev_idx)
+static void
+sortCounts (unsigned long * data, unsigned char * idx, unsigned char * rev_idx)
 {
-	unsigned long *counts,
-								*tmp,
-								i, j;
-
-	/* alloc counts array */
-	counts = malloc ((max+1) * sizeof *counts);
-	if (NULL == counts)
-		return 0;
-
-	/* alloc working space */
-	tmp = malloc (DICT_SIZE * sizeof *tmp);
-	if (NULL == tmp)
+	unsigned char	order[DICT_SIZE],
+								tmp[DICT_SIZE],
+								* from = order,
+								* to = tmp,
+								* swap;
+	unsigned long	sorted[DICT_SIZE];
+	unsigned int	width, lo, mid, hi,
+								a, b, k;
+
+	for ( k = 0; k < DICT_SIZE; ++ k )
+		order[k] = DICT_SIZE - 1 - k;
+
+	for ( width = 1; width < DICT_SIZE; width *= 2 )
 	{
-		free (counts);
-		return 0;
-	}
-
-	/* init counts array */
-	for (i = 0; i <= max; ++ i)
-		counts[i] = 0;
+		for ( lo = 0; lo < DICT_SIZE; lo += 2 * width )
+		{
+			mid = lo + width;
+			hi = lo + 2 * width;
 
-	/* accumulate frequencies */
-	for (i = 0; i < DICT_SIZE; ++ i)
-		++ counts[(*data)[i]];
+			for ( a = lo, b = mid, k = lo; k < hi; ++ k )
+			{
+				if ( b >= hi || (a < mid && data[from[a]] <= data[from[b]]) )
+					to[k] = from[a ++];
+				else
+					to[k] = from[b ++];
+			}
+		}
 
-	/* accumulate totals */
-	for (i = 1; i <= max; ++ i)
-		counts[i] += counts[i - 1];
+		swap = from;
+		from = to;
+		to = swap;
+	}
 
-	for ( i = 0; i < DICT_SIZE; ++ i)
+	for ( k = 0; k < DICT_SIZE; ++ k )
 	{
-		tmp[counts[(*data)[i]] - 1] = (*data)[i];
-		counts[(*data)[i]] = counts[(*data)[i]] - 1;
-
-		/* update index */
-		rev_idx[counts[(*data)[i]]] = i;
-		idx[i] = counts[(*data)[i]];
+		sorted[k] = data[from[k]];
+		rev_idx[k] = from[k];
+		idx[from[k]] = k;
 	}
 
-	free (counts);
-	free (*data);
-	*data = tmp;
-
-	return 1;
+	memcpy (data, sorted, sizeof sorted);
 }
 /* }}}1 */
 
@@ -224,16 +244,16 @@ struct huffDict
 	 * dict[i] points to code_lens entry for
 	 * character i in the stream
 	 */
-	unsigned char	* dict;
+	unsigned char	dict[DICT_SIZE];
 
-	unsigned long	* code_lens;
-	unsigned long * codes;
+	unsigned long	code_lens[DICT_SIZE];
+	unsigned long codes[DICT_SIZE];
 
 	/* 
 	 * rev_dict[i] points to the dict
 	 * entry that points to code_lens[i]
 	 */
-	unsigned char	* rev_dict;
+	unsigned char	rev_dict[DICT_SIZE];
 
 	/*
 	 * must be set to 0 in order for
@@ -255,46 +275,11 @@ newDictionary (unsigned int num_entries)
 	 * if the num_entries value is 0 then make the assumption that this
 	 * is a complete dictionary of 256 entries
 	 */
-	if ( 0 == num_entries )
+	if ( 0 == num_entries || num_entries > DICT_SIZE )
 		dict->num_entries = DICT_SIZE;
 	else
 		dict->num_entries = num_entries;
 
-	dict->codes = malloc (dict->num_entries * sizeof *dict->codes);
-	if ( NULL == dict->codes )
-	{
-		free (dict);
-		return NULL;
-	}
-
-	dict->dict = malloc (dict->num_entries * sizeof *dict->dict);
-	if ( NULL == dict->dict )
-	{
-		free (dict->codes);
-		free (dict);
-		return NULL;
-	}
-
-	dict->code_lens = malloc (dict->num_entries * sizeof *dict->code_lens);
-	if ( NULL == dict->code_lens )
-	{
-		free (dict->dict);
-		free (dict->codes);
-		free (dict);
-		return NULL;
-	}
-
-	dict->rev_dict = malloc (dict->num_entries * sizeof *dict->rev_dict);
-	if ( NULL == dict->rev_dict )
-	{
-		free (dict->code_lens);
-		free (dict->dict);
-		free (dict->codes);
-		free (dict);
-		return NULL;
-	}
-
-
 	dict->dict_offset = 0;
 
 	return dict;
@@ -303,10 +288,6 @@ newDictionary (unsigned int num_entries)
 void
 killDictionary (struct huffDict * dict)
 {
-	free (dict->rev_dict);
-	free (dict->code_lens);
-	free (dict->dict);
-	free (dict->codes);
 	free (dict);
 }
 /* }}}1 */
@@ -337,10 +318,11 @@ calcMinRedn (struct huffDict * dict)
 	if (0 == dict->num_entries)
 		return 0;
 
+	/* a lone entry still needs a bit to say it's there */
 	if (1 == dict->num_entries)
 	{
-		code_lens[0] = 0;
-		return 0;
+		code_lens[0] = 1;
+		return 1;
 	}
 
 	/* first pass, left to right, setting parent pointers */
@@ -418,7 +400,7 @@ codeConstruct (struct huffDict * dict)
 							
 	/* first code length is special case, it is always 00000...000 */
 	*codes = last_start_code;	/* 0 in otherwords */
-	for ( j = 1 ; j < DICT_SIZE; ++ j )
+	for ( j = 1 ; j < dict->num_entries; ++ j )
 	{
 		*(codes+j) = *(codes+j-1) + 1;
 
@@ -454,11 +436,21 @@ codeConstruct (struct huffDict * dict)
 	/* max this can be is 6, so output 3 bits only */
 #define CODELEN_INDICATOR_WIDTH	3
 
+/*
+ * a dictionary of few entries lists them rather than marking every byte
+ * as used or not. the list is flagged by a code length width of 0, which
+ * is never otherwise written, and is followed by the real width, the
+ * number of entries less one and then the byte and code length of each
+ */
+#define SPARSE_INDICATOR				0
+#define SPARSE_COUNT_WIDTH			8
+
 static int
 writeDictionary (struct bitqStream * stream, struct huffDict	* dict)
 {
 	int		i, j, ret;
 	unsigned char	k;
+	bool	sparse;
 
 
 	/*
@@ -476,10 +468,42 @@ writeDictionary (struct bitqStream * stream, struct huffDict	* dict)
 	else
 		k = 2;
 
+	sparse = CODELEN_INDICATOR_WIDTH + SPARSE_COUNT_WIDTH + dict->num_entries * CHAR_BIT < DICT_SIZE;
+
+	if ( true == sparse )
+	{
+		ret = bitq_writeStream (stream, SPARSE_INDICATOR, CODELEN_INDICATOR_WIDTH);
+		if ( BITQ_CONTINUE != ret )
+			return ret;
+	}
+
 	ret = bitq_writeStream (stream, k, CODELEN_INDICATOR_WIDTH); 
 	if ( BITQ_CONTINUE != ret )
 		return ret;
 
+	if ( true == sparse )
+	{
+		ret = bitq_writeStream (stream, dict->num_entries - 1, SPARSE_COUNT_WIDTH);
+		if ( BITQ_CONTINUE != ret )
+			return ret;
+
+		for ( i = 0; i < DICT_SIZE; ++ i )
+		{
+			if ( dict->dict[i] < dict->dict_offset )
+				continue; /* for loop */
+
+			ret = bitq_writeStream (stream, i, CHAR_BIT);
+			if ( BITQ_CONTINUE != ret )
+				return ret;
+
+			ret = bitq_writeStream (stream, dict->code_lens[dict->dict[i]], k);
+			if ( BITQ_CONTINUE != ret )
+				return ret;
+		}
+
+		return BITQ_CONTINUE;
+	}
+
 	/* add dictionary to output */
 	for ( i = 0, j = DICT_SIZE-1; i < DICT_SIZE; ++ i, -- j )
 	{
@@ -508,56 +532,30 @@ writeDictionary (struct bitqStream * stream, struct huffDict	* dict)
 	return BITQ_CONTINUE;
 }
 
-static struct huffDict * 
-readDictionary (struct bitqStream * stream)
+/*
+ * with code_lens indexed by byte, sort the dictionary and construct the
+ * codes -- the same codes the encoder constructed from the same lengths.
+ * returns false if no byte has a code.
+ */
+static bool
+sortDictionary (struct huffDict * dict)
 {
-	struct huffDict * dict; 
-	int							i, j;
-
 	unsigned long	s;
-	unsigned char	t, codelen;
-
-	unsigned long		count_max = 0;
-
-	dict = newDictionary (DICT_SIZE);
-	if ( NULL == dict )
-		return NULL;
-
-	/* how many bits are used per codelen */
-	bitq_readStream (stream, &codelen, CODELEN_INDICATOR_WIDTH);
+	unsigned char	t;
+	int						i, j;
 
-	/* read code lengths when appropriate */
 	for ( i = 0; i < DICT_SIZE; ++ i )
-	{
-		dict->dict[i] = i;
-		dict->rev_dict[i] = i;
-		
-		bitq_readStream (stream, &t, 1);
-		if ( 1 == t )
-		{
-			bitq_readStream (stream, &t, codelen);
-			dict->code_lens[i] = t;
-
-			if ( dict->code_lens[i] > count_max )
-				count_max = dict->code_lens[i];
-		}
-		else
-		{
-			dict->code_lens[i] = 0;
-		}
-	}
+		dict->dict[i] = dict->rev_dict[i] = i;
 
-	/* sort dictionary */
-	if (0 == countSort (&dict->code_lens, count_max, dict->dict, dict->rev_dict))
-	{
-		killDictionary (dict);
-		return NULL;
-	}
+	sortCounts (dict->code_lens, dict->dict, dict->rev_dict);
 
 	/* find dictionary offset (first non zero element) in dict */
-	for ( dict->dict_offset = 0; 0 == dict->code_lens[dict->dict_offset]; ++ dict->dict_offset )
+	for ( dict->dict_offset = 0; dict->dict_offset < DICT_SIZE && 0 == dict->code_lens[dict->dict_offset]; ++ dict->dict_offset )
 		;
 
+	if ( DICT_SIZE == dict->dict_offset )
+		return false;
+
 	/* ignore first dict_offset entries */
 	dict->num_entries = DICT_SIZE - dict->dict_offset;
 
@@ -576,7 +574,64 @@ readDictionary (struct bitqStream * stream)
 	/* recreate dictionary */
 	codeConstruct (dict);
 
-	return dict;
+	return true;
+}
+
+static int
+readDictionary (struct bitqStream * stream, struct huffDict ** dict)
+{
+	int							i;
+
+	unsigned char	t, codelen, count, len;
+	bool					sparse;
+
+	*dict = newDictionary (DICT_SIZE);
+	if ( NULL == *dict )
+		return HUFF_RET_NOMEM;
+
+	/* how many bits are used per codelen */
+	bitq_readStream (stream, &codelen, CODELEN_INDICATOR_WIDTH);
+
+	sparse = SPARSE_INDICATOR == codelen;
+	if ( true == sparse )
+		bitq_readStream (stream, &codelen, CODELEN_INDICATOR_WIDTH);
+
+	for ( i = 0; i < DICT_SIZE; ++ i )
+		(*dict)->code_lens[i] = 0;
+
+	if ( true == sparse )
+	{
+		/* read the listed bytes and their code lengths */
+		bitq_readStream (stream, &count, SPARSE_COUNT_WIDTH);
+
+		for ( i = 0; i <= count; ++ i )
+		{
+			bitq_readStream (stream, &t, CHAR_BIT);
+			bitq_readStream (stream, &len, codelen);
+			(*dict)->code_lens[t] = len;
+		}
+	}
+	else
+	{
+		/* read code lengths when appropriate */
+		for ( i = 0; i < DICT_SIZE; ++ i )
+		{
+			bitq_readStream (stream, &t, 1);
+			if ( 1 == t )
+			{
+				bitq_readStream (stream, &t, codelen);
+				(*dict)->code_lens[i] = t;
+			}
+		}
+	}
+
+	if ( false == sortDictionary (*dict) )
+	{
+		killDictionary (*dict);
+		return HUFF_RET_MALFORMED;
+	}
+
+	return HUFF_RET_SUCCESS;
 }
 /* }}}1 */
 
@@ -623,18 +678,80 @@ void sortRevDict (struct huffDict * dict)
 	}
 }
 
+/* the output of either encoder begins with the input size and is no bigger than the input */
+static int
+startOutput (unsigned long input_size, unsigned long pre_padding, unsigned char ** output, unsigned long * output_size, struct bitqStream ** stream)
+{
+	unsigned long	stream_size;
+
+	/* calculate max length of output */
+	stream_size = (input_size + pre_padding) * sizeof **output;
+
+	/* allocate memory for output */
+	*output = malloc (stream_size);
+	if ( NULL == *output )
+		return HUFF_RET_NOMEM;
+
+	/* initialise bitq stream */
+	*stream = bitq_newStream (*output, stream_size, output_size);
+	if ( NULL == *stream )
+	{
+		free (*output);
+		return HUFF_RET_NOMEM;
+	}
+
+	/* don't touch the pre-padding */
+	*output_size = pre_padding;
+
+	/* write input size to output */
+	bitq_writeStream (*stream, input_size, CHAR_BIT * 4);
+
+	return HUFF_RET_SUCCESS;
+}
+
+/* code the input with codes indexed by byte and trim the output */
+static int
+finishOutput (struct bitqStream * stream, unsigned char * input, unsigned long input_size, unsigned int * codes, unsigned char * code_lens, unsigned char ** output, unsigned long * output_size)
+{
+	unsigned char	* tmp;
+
+	if ( BITQ_CONTINUE != bitq_writeStreamCodes (stream, input, input_size, codes, code_lens) )
+	{
+		bitq_freeStream (stream);
+		free (*output);
+		return HUFF_RET_TOOBIG;
+	}
+
+	/* output leftovers */
+	bitq_flushWriteStream (stream);
+	bitq_freeStream (stream);
+
+	/* trim output memory */
+	tmp = realloc (*output, *output_size);
+	if ( NULL == tmp )
+	{
+		free (*output);
+		return HUFF_RET_NOMEM;
+	}
+	*output = tmp;
+
+	return HUFF_RET_SUCCESS;
+}
+
 int
 huff_encode (unsigned char *input, unsigned long input_size, unsigned char **output,
 							unsigned long *output_size, unsigned long pre_padding)
 {
 	unsigned long i;
-	unsigned char	*tmp;
+	int						ret;
 
 	struct huffDict	*dict;
-	unsigned long		count_max = 0;
 
 	struct bitqStream	* stream;
-	unsigned long			stream_size;
+
+	unsigned int			byte_codes[DICT_SIZE];
+	unsigned char			byte_code_lens[DICT_SIZE];
+	unsigned long			counts[DICT_SIZE];
 
 /* DEBUG CODE {{{ */
 #ifdef HUFF_DEBUG
@@ -649,68 +766,62 @@ puts ("\n\nHUFFMAN ENCODER\n----");
 	if ( dict == NULL )
 		return HUFF_RET_NOMEM;
 
-	/*
-	 * we use dict->code_lens for frequency
-	 * accumulation and sorting
-	 */
+	/* build frequencies */
 	for ( i = 0; i < DICT_SIZE; ++ i )
-		dict->code_lens[i] = 0;
-
-	/*
-	 * initialize forward and reverse dictionary index
-	 * -- set each element to value of it's position
-	 */
-	for (i = 0; i < DICT_SIZE; ++ i)
-		dict->dict[i] = dict->rev_dict[i] = i;
+		counts[i] = 0;
 
-	/* build frequencies */
 	for (i = 0; i < input_size; ++ i)
-	{
-		++ dict->code_lens[input[i]];
+		++ counts[input[i]];
 
-		/*
-		 * remember maximum value in input stream
-		 * -- used for count sort later
-		 */
-		if ( dict->code_lens[input[i]] > count_max )
-			count_max = dict->code_lens[input[i]];
-	}
+	for (;;)
+	{
+		/* we use dict->code_lens for sorting */
+		for ( i = 0; i < DICT_SIZE; ++ i )
+			dict->code_lens[i] = counts[i];
 
 /* DEBUG CODE {{{ */
 #ifdef HUFF_DEBUG
-	puts ("\nUnsorted Frequencies\n---");
-	for (i = 0; i < DICT_SIZE; ++ i)
-		printf ("%d -> %ld\n", dict->dict[i], dict->code_lens[i]);
+		puts ("\nUnsorted Frequencies\n---");
+		for (i = 0; i < DICT_SIZE; ++ i)
+			printf ("%ld -> %ld\n", i, dict->code_lens[i]);
 #endif
 /* }}} */
 
-	/* sort dictionary */
-	if (0 == countSort (&dict->code_lens, count_max, dict->dict, dict->rev_dict))
-	{
-		killDictionary (dict);
-		return HUFF_RET_NOMEM;
-	}
+		/*
+		 * sort dictionary, initializing the forward and reverse
+		 * dictionary index as it goes
+		 */
+		sortCounts (dict->code_lens, dict->dict, dict->rev_dict);
 
-	/* find dictionary offset (first non zero element) in dict */
-	for ( dict->dict_offset = 0; 0 == dict->code_lens[dict->dict_offset]; ++ dict->dict_offset )
-		;
+		/* find dictionary offset (first non zero element) in dict */
+		for ( dict->dict_offset = 0; 0 == dict->code_lens[dict->dict_offset]; ++ dict->dict_offset )
+			;
 
-	/* ignore first dict_offset entries */
-	dict->num_entries = DICT_SIZE - dict->dict_offset;
+		/* ignore first dict_offset entries */
+		dict->num_entries = DICT_SIZE - dict->dict_offset;
 
 /* DEBUG CODE {{{ */
 #ifdef HUFF_DEBUG
-	puts ("\nSorted Frequencies\n---");
-	for (i = DICT_SIZE - dict->num_entries; i < DICT_SIZE; ++ i)
-		printf ("%d(%d) -> %ld\n", dict->rev_dict[i], dict->dict[i], dict->code_lens[i]);
+		puts ("\nSorted Frequencies\n---");
+		for (i = DICT_SIZE - dict->num_entries; i < DICT_SIZE; ++ i)
+			printf ("%d(%d) -> %ld\n", dict->rev_dict[i], dict->dict[i], dict->code_lens[i]);
 #endif
 /* }}} */
 
-	/* calculate minimum redundancy */
-	if ( 0 == calcMinRedn (dict) )
-	{
-		killDictionary (dict);
-		return HUFF_RET_NOMEM;
+		/* calculate minimum redundancy */
+		if ( 0 == calcMinRedn (dict) )
+		{
+			killDictionary (dict);
+			return HUFF_RET_NOMEM;
+		}
+
+		/* the rarest byte has the longest code */
+		if ( dict->code_lens[dict->dict_offset] <= MAX_CODE_LEN )
+			break; /* for loop */
+
+		/* flatten the counts, keeping every byte that occurs, until the codes are short enough */
+		for ( i = 0; i < DICT_SIZE; ++ i )
+			counts[i] = (counts[i] + 1) / 2;
 	}
 
 	sortRevDict (dict);
@@ -719,7 +830,7 @@ puts ("\n\nHUFFMAN ENCODER\n----");
 #ifdef HUFF_DEBUG
 	puts ("\nCodeword Lengths\n---");
 	for (i = dict->dict_offset; i < DICT_SIZE; ++ i)
-		printf ("%d. %d -> %ld\n", i, dict->rev_dict[i], dict->code_lens[i]);
+		printf ("%ld. %d -> %ld\n", i, dict->rev_dict[i], dict->code_lens[i]);
 #endif
 /* }}} */
 
@@ -748,31 +859,13 @@ puts ("\n\nHUFFMAN ENCODER\n----");
 #endif
 /* }}} */
 
-	/* calculate max length of output */
-	stream_size = (input_size + pre_padding) * sizeof **output;
-
-	/* allocate memory for output */
-	*output = malloc (stream_size);
-	if ( NULL == *output )
-	{
-		killDictionary (dict);
-		return HUFF_RET_NOMEM;
-	}
-
-	/* initialise bitq stream */
-	stream = bitq_newStream (*output, stream_size, output_size);
-	if ( NULL == stream )
+	ret = startOutput (input_size, pre_padding, output, output_size, &stream);
+	if ( HUFF_RET_SUCCESS != ret )
 	{
 		killDictionary (dict);
-		return HUFF_RET_NOMEM;
+		return ret;
 	}
 
-	/* don't touch the pre-padding */
-	*output_size = pre_padding;
-
-	/* write input size to output */
-	bitq_writeStream (stream, input_size, CHAR_BIT * 4);
-
 	/* write dictionary to output stream */
 	if ( BITQ_CONTINUE != writeDictionary (stream, dict) )
 	{
@@ -782,49 +875,39 @@ puts ("\n\nHUFFMAN ENCODER\n----");
 		return HUFF_RET_TOOBIG;
 	}
 
-	/* do actual encoding */
-	for ( i = 0; i < input_size; ++ i )
+	/* index the codes by byte value */
+	for ( i = 0; i < DICT_SIZE; ++ i )
 	{
-/* DEBUG CODE {{{ */
-#ifdef HUFF_DEBUG
-	printf("(%x) - ", input[i]);
-	printIntBinary ( dict->codes[dict->dict[input[i]]] );
-	printf("(%ld) \n", dict->code_lens[dict->dict[input[i]]]);
-#endif
-/* }}} */
-
-		if ( BITQ_CONTINUE != bitq_writeStream (stream,
-			dict->codes[dict->dict[input[i]]],
-			dict->code_lens[dict->dict[input[i]]]) )
-		{
-			bitq_freeStream (stream);
-			free (*output);
-			killDictionary (dict);
-			return HUFF_RET_TOOBIG;
-		}
+		/* bytes that aren't in the input have no code */
+		byte_code_lens[i] = dict->code_lens[dict->dict[i]];
+		byte_codes[i] = 0 == byte_code_lens[i] ? 0 : dict->codes[dict->dict[i]];
 	}
 
-	/* output leftovers */
-	bitq_flushWriteStream (stream);
-
-	/* free memory */
-	bitq_freeStream (stream);
 	killDictionary (dict);
 
-	/* trim output memory */
-	tmp = realloc (*output, *output_size);
-	if ( NULL == tmp )
+	/* and do actual encoding */
+	return finishOutput (stream, input, input_size, byte_codes, byte_code_lens, output, output_size);
+}
+/* }}}1 */
+
+/* DECODER {{{1 */
+/* the output size that begins the input of either decoder */
+static unsigned long
+readSize (struct bitqStream * stream)
+{
+	unsigned long	size = 0;
+	unsigned char	d;
+	int						i;
+
+	for ( i = 0; i < 4; ++ i )
 	{
-		free (*output);
-		return HUFF_RET_NOMEM;
+		bitq_readStream (stream, &d, CHAR_BIT);
+		size = (size << CHAR_BIT) | d;
 	}
-	*output = tmp;
 
-	return HUFF_RET_SUCCESS;
+	return size;
 }
-/* }}}1 */
 
-/* DECODER {{{1 */
 int
 huff_decode (unsigned char *input, unsigned long input_size, unsigned char **output,
 								unsigned long *output_size, unsigned long pre_padding)
@@ -836,13 +919,17 @@ huff_decode (unsigned char *input, unsigned long input_size, unsigned char **out
 	unsigned long	output_i = 0;			/* offset into the ouput */
 
 	struct huffDict		* dict;
+	struct tree_pool		pool;
 	struct tree_node	* root;
 	struct tree_node	* walk;
 
 	unsigned char	c;	/* output character */
 
 	struct bitqStream	* stream;
-	unsigned char	d;
+
+	struct decodeEntry	table[1 << DECODE_TABLE_BITS];
+	unsigned int				bits;
+	unsigned char				avail;
 
 
 	/* make sure we ignore any padding bytes */
@@ -854,14 +941,7 @@ huff_decode (unsigned char *input, unsigned long input_size, unsigned char **out
 		return HUFF_RET_NOMEM;
 
 	/* read in original size */
-	bitq_readStream (stream, &d, CHAR_BIT);
-	*output_size = d << 24;
-	bitq_readStream (stream, &d, CHAR_BIT);
-	*output_size |= d << 16;
-	bitq_readStream (stream, &d, CHAR_BIT);
-	*output_size |= d << 8;
-	bitq_readStream (stream, &d, CHAR_BIT);
-	*output_size |= d;
+	*output_size = readSize (stream);
 
 	/* allocate output memory */
 	*output = malloc (*output_size * sizeof ** output);
@@ -872,28 +952,22 @@ huff_decode (unsigned char *input, unsigned long input_size, unsigned char **out
 	}
 
 	/* read dictionary from input and construct tree */
-	dict = readDictionary (stream);
-	if ( NULL == dict )
+	ret = readDictionary (stream, &dict);
+	if ( HUFF_RET_SUCCESS != ret )
 	{
 		free (*output);
 		bitq_freeStream (stream);
-		return HUFF_RET_NOMEM;
+		return ret;
 	}
 
 	/* prepare new instance of tree */
-	root = newTreeNode ();
-	if ( NULL == root )
-	{
-		killDictionary (dict);
-		free (*output);
-		bitq_freeStream (stream);
-		return HUFF_RET_NOMEM;
-	}
+	pool.used = 0;
+	root = newTreeNode (&pool);
 
 	/* build tree */
 	for ( i = dict->dict_offset; i < DICT_SIZE; ++ i )
 	{
-		ret = addCodeToTree (root, dict->rev_dict[i], dict->codes[i], dict->code_lens[i]);
+		ret = addCodeToTree (&pool, root, dict->rev_dict[i], dict->codes[i], dict->code_lens[i]);
 		if ( HUFF_RET_SUCCESS != ret )
 		{
 			killDictionary (dict);
@@ -903,6 +977,23 @@ huff_decode (unsigned char *input, unsigned long input_size, unsigned char **out
 		}
 	}
 
+	/* and the table of short codes */
+	memset (table, 0, sizeof table);
+	for ( i = dict->dict_offset; i < DICT_SIZE; ++ i )
+	{
+		unsigned long	first, j;
+
+		if ( 0 == dict->code_lens[i] || dict->code_lens[i] > DECODE_TABLE_BITS )
+			continue; /* for loop */
+
+		first = dict->codes[i] << (DECODE_TABLE_BITS - dict->code_lens[i]);
+		for ( j = 0; j < 1UL << (DECODE_TABLE_BITS - dict->code_lens[i]); ++ j )
+		{
+			table[first + j].out = dict->rev_dict[i];
+			table[first + j].len = dict->code_lens[i];
+		}
+	}
+
 	/* once tree is built, dictionary is no longer needed */
 	killDictionary (dict);
 
@@ -917,8 +1008,28 @@ puts("bits\n---");
 #endif
 /* }}} */
 
-	while ( 1 == bitq_readStream (stream, &c, 1) )
+	for ( ;; )
 	{
+		/* look up a short code in one go when we're at the top of the tree */
+		if ( walk == root )
+		{
+			avail = bitq_peekStream (stream, &bits, DECODE_TABLE_BITS);
+			if ( 0 != table[bits].len && table[bits].len <= avail )
+			{
+				*(*output+output_i) = table[bits].out;
+				++ output_i;
+				bitq_skipStream (stream, table[bits].len);
+
+				if ( output_i == *output_size )
+					break; /* read stream loop */
+
+				continue; /* read stream loop */
+			}
+		}
+
+		if ( 1 != bitq_readStream (stream, &c, 1) )
+			break; /* read stream loop */
+
 		/* if bit is a one... */
 		if ( (c & 0x01) == 1 )
 		{
@@ -956,7 +1067,6 @@ printf ("\n%c\n", walk->out);
 			}
 			else
 			{
-				killTree (root);
 				free (*output);
 				bitq_freeStream (stream);
 /* DEBUG CODE {{{ */
@@ -995,7 +1105,6 @@ printf ("\n%c\n", walk->out);
 			}
 			else
 			{
-				killTree (root);
 				free (*output);
 				bitq_freeStream (stream);
 /* DEBUG CODE {{{ */
@@ -1008,7 +1117,167 @@ puts("");
 		}	/* bit is zero */
 	} /* read stream loop */
 
-	killTree (root);
+	bitq_freeStream (stream);
+
+	return HUFF_RET_SUCCESS;
+}
+/* }}}1 */
+
+/* SHARED TABLES {{{1 */
+int
+huff_buildTable (unsigned long * counts, struct huffTable * table)
+{
+	struct huffDict	* dict;
+	unsigned long		scaled[DICT_SIZE];
+	unsigned char		code_lens[DICT_SIZE];
+	int							i;
+
+	/* every byte gets a code, however rare */
+	for ( i = 0; i < DICT_SIZE; ++ i )
+		scaled[i] = counts[i] + 1;
+
+	dict = newDictionary (DICT_SIZE);
+	if ( NULL == dict )
+		return HUFF_RET_NOMEM;
+
+	for (;;)
+	{
+		for ( i = 0; i < DICT_SIZE; ++ i )
+			dict->code_lens[i] = scaled[i];
+
+		sortCounts (dict->code_lens, dict->dict, dict->rev_dict);
+		calcMinRedn (dict);
+
+		/* the rarest byte has the longest code */
+		if ( dict->code_lens[0] <= HUFF_TABLE_BITS )
+			break; /* for loop */
+
+		/* flatten the counts until every code fits the table */
+		for ( i = 0; i < DICT_SIZE; ++ i )
+			scaled[i] = (scaled[i] + 1) / 2;
+	}
+
+	for ( i = 0; i < DICT_SIZE; ++ i )
+		code_lens[dict->rev_dict[i]] = dict->code_lens[i];
+
+	killDictionary (dict);
+
+	return huff_loadTable (code_lens, table);
+}
+
+int
+huff_loadTable (unsigned char * code_lens, struct huffTable * table)
+{
+	struct huffDict	* dict;
+	unsigned long		space = 0,
+									first, j;
+	unsigned char		c, len;
+	int							i;
+
+	/* every byte needs a code, and the codes must fit the table */
+	for ( i = 0; i < DICT_SIZE; ++ i )
+	{
+		if ( 0 == code_lens[i] || code_lens[i] > HUFF_TABLE_BITS )
+			return HUFF_RET_MALFORMED;
+
+		space += 1UL << (HUFF_TABLE_BITS - code_lens[i]);
+	}
+
+	if ( space > 1UL << HUFF_TABLE_BITS )
+		return HUFF_RET_MALFORMED;
+
+	dict = newDictionary (DICT_SIZE);
+	if ( NULL == dict )
+		return HUFF_RET_NOMEM;
+
+	for ( i = 0; i < DICT_SIZE; ++ i )
+		dict->code_lens[i] = code_lens[i];
+
+	/* the codes come from the lengths alone, as a decoder makes them */
+	sortDictionary (dict);
+
+	memset (table, 0, sizeof *table);
+
+	for ( i = dict->dict_offset; i < DICT_SIZE; ++ i )
+	{
+		c = dict->rev_dict[i];
+		len = dict->code_lens[i];
+
+		table->code_lens[c] = len;
+		table->codes[c] = dict->codes[i];
+
+		first = dict->codes[i] << (HUFF_TABLE_BITS - len);
+		for ( j = 0; j < 1UL << (HUFF_TABLE_BITS - len); ++ j )
+		{
+			table->decode_out[first + j] = c;
+			table->decode_len[first + j] = len;
+		}
+	}
+
+	killDictionary (dict);
+
+	return HUFF_RET_SUCCESS;
+}
+
+int
+huff_encodeTable (struct huffTable * table, unsigned char *input, unsigned long input_size, unsigned char **output,
+							unsigned long *output_size, unsigned long pre_padding)
+{
+	struct bitqStream	* stream;
+	int								ret;
+
+	if ( 0 == input_size )
+		return HUFF_RET_EMPTY_INPUT;
+
+	ret = startOutput (input_size, pre_padding, output, output_size, &stream);
+	if ( HUFF_RET_SUCCESS != ret )
+		return ret;
+
+	return finishOutput (stream, input, input_size, table->codes, table->code_lens, output, output_size);
+}
+
+int
+huff_decodeTable (struct huffTable * table, unsigned char *input, unsigned long input_size, unsigned char **output,
+								unsigned long *output_size, unsigned long pre_padding)
+{
+	struct bitqStream	* stream;
+	unsigned long			input_i = 0,
+										output_i;
+	unsigned int			bits;
+	unsigned char			avail;
+
+	/* make sure we ignore any padding bytes */
+	input += pre_padding;
+	input_size -= pre_padding;
+
+	stream = bitq_newStream (input, input_size, &input_i);
+	if ( NULL == stream )
+		return HUFF_RET_NOMEM;
+
+	*output_size = readSize (stream);
+
+	*output = malloc (*output_size * sizeof ** output);
+	if ( NULL == *output )
+	{
+		bitq_freeStream (stream);
+		return HUFF_RET_NOMEM;
+	}
+
+	/* every code is in the table, so one lookup decodes each byte */
+	for ( output_i = 0; output_i < *output_size; ++ output_i )
+	{
+		avail = bitq_peekStream (stream, &bits, HUFF_TABLE_BITS);
+		if ( 0 == table->decode_len[bits] || table->decode_len[bits] > avail )
+		{
+			free (*output);
+			bitq_freeStream (stream);
+			return HUFF_RET_MALFORMED;
+		}
+
+		*(*output+output_i) = table->decode_out[bits];
+		bitq_skipStream (stream, table->decode_len[bits]);
+	}
+
 	bitq_freeStream (stream);
 
 	return HUFF_RET_SUCCESS;
@@ -21,11 +21,14 @@
  * --------------
  *
  * . 4 byte, big endian integer indicating expecting output size
- * . 1 byte indicating dictionary size -- 256 entries in the dictionary
- *   means that this byte will be 0x0
  * . dictionary
- *   . 1 byte entry
- *   . 1 byte code length
+ *   . 3 bits giving the width of a code length
+ *   . a bit for each of the 256 bytes, followed by its code length when
+ *     the bit is set
+ *   or, when that would be shorter
+ *   . 3 zero bits then 3 bits giving the width of a code length
+ *   . 8 bits giving the number of bytes listed, less one
+ *   . each byte listed and its code length
  * . huffman encoded input
  */
 
@@ -45,4 +48,33 @@ enum HUFF_RET_CODES
 int huff_encode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size, unsigned long pre_padding);
 int huff_decode (unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size, unsigned long pre_padding);
 
+/*
+ * shared tables
+ * -------------
+ *
+ * a table gives every byte a code of no more than HUFF_TABLE_BITS bits,
+ * so that many small inputs can be coded without each carrying its own
+ * dictionary. huff_buildTable() makes a table from byte counts and
+ * huff_loadTable() from code lengths indexed by byte, such as those of a
+ * table built earlier. data coded with a table is the output size followed
+ * by the codes, and can only be decoded with the same table.
+ */
+#define HUFF_TABLE_BITS		12
+
+struct huffTable
+{
+	unsigned char		code_lens[256];
+	unsigned int		codes[256];
+
+	/* indexed by the next HUFF_TABLE_BITS bits of input */
+	unsigned char		decode_out[1 << HUFF_TABLE_BITS];
+	unsigned char		decode_len[1 << HUFF_TABLE_BITS];
+};
+
+int huff_buildTable (unsigned long * counts, struct huffTable * table);
+int huff_loadTable (unsigned char * code_lens, struct huffTable * table);
+
+int huff_encodeTable (struct huffTable * table, unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size, unsigned long pre_padding);
+int huff_decodeTable (struct huffTable * table, unsigned char *input, unsigned long input_size, unsigned char **output, unsigned long *output_size, unsigned long pre_padding);
+
 #endif /* HUFFLIB_H */
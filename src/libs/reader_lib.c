@@ -0,0 +1,378 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+#include	<flk_lib.h>
+#include	"reader_lib.h"
+
+#define NO_SLOT		-1
+
+/* cache slots are kept in a list, most recently used first */
+struct rdrSlot
+{
+	unsigned long		block;
+	unsigned char	* data;
+	unsigned long		size;
+
+	long						prev;
+	long						next;
+};
+
+struct flkReader
+{
+	FILE						* f;
+
+	struct flkIndex	* index;
+
+	/* cache slot holding each decoded block */
+	long						* block_slot;
+
+	/* a version 1 index doesn't know the size of the last block until it's decoded */
+	bool							last_known;
+
+	/* reused to hold compressed data while it is decoded */
+	unsigned char		* comp_buffer;
+	unsigned long			comp_buffer_size;
+
+	struct rdrSlot		* slots;
+	unsigned long			num_slots;
+	unsigned long			used_slots;
+	long							mru;
+	long							lru;
+};
+
+
+/* {{{1 CACHE */
+static void
+unlinkSlot (struct flkReader * r, long s)
+{
+	if ( NO_SLOT != r->slots[s].prev )
+		r->slots[r->slots[s].prev].next = r->slots[s].next;
+	else
+		r->mru = r->slots[s].next;
+
+	if ( NO_SLOT != r->slots[s].next )
+		r->slots[r->slots[s].next].prev = r->slots[s].prev;
+	else
+		r->lru = r->slots[s].prev;
+}
+
+static void
+linkSlotFirst (struct flkReader * r, long s)
+{
+	r->slots[s].prev = NO_SLOT;
+	r->slots[s].next = r->mru;
+
+	if ( NO_SLOT != r->mru )
+		r->slots[r->mru].prev = s;
+	else
+		r->lru = s;
+
+	r->mru = s;
+}
+
+/* find a slot for a newly decoded block, evicting the least recently used if need be */
+static long
+claimSlot (struct flkReader * r)
+{
+	long	s;
+
+	if ( r->used_slots < r->num_slots )
+		s = r->used_slots ++;
+	else
+	{
+		s = r->lru;
+		unlinkSlot (r, s);
+
+		r->block_slot[r->slots[s].block] = NO_SLOT;
+		free (r->slots[s].data);
+		r->slots[s].data = NULL;
+	}
+
+	linkSlotFirst (r, s);
+
+	return s;
+}
+/* }}}1 */
+
+/* {{{1 BLOCK DECODING */
+static int
+decodeBlock (struct flkReader * r, unsigned long b, struct rdrSlot ** slot)
+{
+	struct flkIndex	* index = r->index;
+	unsigned char		* data;
+	unsigned long			size;
+	long							s;
+	int								ret;
+
+	/* cache hit */
+	if ( NO_SLOT != r->block_slot[b] )
+	{
+		if ( r->mru != r->block_slot[b] )
+		{
+			unlinkSlot (r, r->block_slot[b]);
+			linkSlotFirst (r, r->block_slot[b]);
+		}
+
+		*slot = &r->slots[r->block_slot[b]];
+		return COMP_RET_OKAY;
+	}
+
+	ret = flk_readBlock (r->f, index, b, &r->comp_buffer, &r->comp_buffer_size, &data, &size);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	/* version 1 blocks are all full but the last, which we learn the size of now */
+	if ( 1 == index->version && b > 0 )
+	{
+		if ( b == index->num_blocks - 1 ? size > index->block_size : size != index->block_size )
+		{
+			free (data);
+			return COMP_RET_MALFORMED;
+		}
+
+		if ( b == index->num_blocks - 1 )
+		{
+			index->blocks[b].uncomp_size = size;
+			r->last_known = true;
+		}
+	}
+
+	s = claimSlot (r);
+	r->slots[s].block = b;
+	r->slots[s].data = data;
+	r->slots[s].size = size;
+	r->block_slot[b] = s;
+
+	*slot = &r->slots[s];
+
+	return COMP_RET_OKAY;
+}
+
+/* the block holding uncompressed offset. blocks can be of any size in a version 2 file */
+static unsigned long
+findBlock (struct flkReader * r, unsigned long offset)
+{
+	struct flkBlock	* blocks = r->index->blocks;
+	unsigned long			lo = 0,
+										hi = r->index->num_blocks - 1,
+										mid;
+
+	while ( lo < hi )
+	{
+		mid = lo + (hi - lo + 1) / 2;
+
+		if ( blocks[mid].uncomp_offset <= offset )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+/* }}}1 */
+
+/* {{{1 OPEN/CLOSE */
+/* a version 1 index only has the compressed sizes -- the first block tells us the rest */
+static int
+completeV1Index (struct flkReader * r)
+{
+	struct flkIndex	* index = r->index;
+	struct rdrSlot		* slot;
+	unsigned long			b;
+	int								ret;
+
+	if ( 0 == index->num_blocks )
+		return COMP_RET_OKAY;
+
+	r->last_known = false;
+
+	ret = decodeBlock (r, 0, &slot);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	index->block_size = slot->size;
+
+	for ( b = 0; b < index->num_blocks; ++ b )
+	{
+		index->blocks[b].uncomp_offset = b * index->block_size;
+		index->blocks[b].uncomp_size = index->block_size;
+	}
+
+	if ( 1 == index->num_blocks )
+		r->last_known = true;
+
+	return COMP_RET_OKAY;
+}
+
+int
+rdr_open (FILE * inputf, unsigned long cache_blocks, struct flkReader ** reader)
+{
+	struct flkReader	* r;
+	unsigned long			b;
+	int									ret;
+
+	if ( NULL == inputf || NULL == reader || 0 == cache_blocks )
+		return COMP_RET_BADARGS;
+
+	r = calloc (1, sizeof *r);
+	if ( NULL == r )
+		return COMP_RET_NOMEM;
+
+	r->f = inputf;
+	r->num_slots = cache_blocks;
+	r->mru = r->lru = NO_SLOT;
+	r->last_known = true;
+
+	r->slots = calloc (cache_blocks, sizeof *r->slots);
+	if ( NULL == r->slots )
+	{
+		rdr_close (r);
+		return COMP_RET_NOMEM;
+	}
+
+	ret = flk_readIndex (inputf, &r->index);
+	if ( COMP_RET_OKAY != ret )
+	{
+		rdr_close (r);
+		return ret;
+	}
+
+	r->block_slot = malloc ((r->index->num_blocks + 1) * sizeof *r->block_slot);
+	if ( NULL == r->block_slot )
+	{
+		rdr_close (r);
+		return COMP_RET_NOMEM;
+	}
+
+	for ( b = 0; b < r->index->num_blocks; ++ b )
+		r->block_slot[b] = NO_SLOT;
+
+	if ( 1 == r->index->version )
+	{
+		ret = completeV1Index (r);
+		if ( COMP_RET_OKAY != ret )
+		{
+			rdr_close (r);
+			return ret;
+		}
+	}
+
+	*reader = r;
+
+	return COMP_RET_OKAY;
+}
+
+void
+rdr_close (struct flkReader * r)
+{
+	unsigned long	s;
+
+	if ( NULL == r )
+		return;
+
+	for ( s = 0; s < r->used_slots; ++ s )
+		free (r->slots[s].data);
+
+	free (r->slots);
+	free (r->block_slot);
+	flk_freeIndex (r->index);
+	free (r->comp_buffer);
+	free (r);
+}
+/* }}}1 */
+
+/* {{{1 READING */
+int
+rdr_size (struct flkReader * r, unsigned long * size)
+{
+	struct flkBlock	* last;
+	struct rdrSlot	* slot;
+	int							ret;
+
+	if ( NULL == r || NULL == size )
+		return COMP_RET_BADARGS;
+
+	if ( 0 == r->index->num_blocks )
+	{
+		*size = 0;
+		return COMP_RET_OKAY;
+	}
+
+	if ( false == r->last_known )
+	{
+		ret = decodeBlock (r, r->index->num_blocks - 1, &slot);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+	}
+
+	last = &r->index->blocks[r->index->num_blocks - 1];
+	*size = last->uncomp_offset + last->uncomp_size;
+
+	return COMP_RET_OKAY;
+}
+
+int
+rdr_read (struct flkReader * r, unsigned long offset, unsigned char * buffer, unsigned long length, unsigned long * bytes_read)
+{
+	struct rdrSlot	* slot;
+	unsigned long		b,
+									block_offset,
+									n;
+	int							ret;
+
+	if ( NULL == r || NULL == buffer || NULL == bytes_read )
+		return COMP_RET_BADARGS;
+
+	*bytes_read = 0;
+
+	if ( 0 == r->index->num_blocks )
+		return COMP_RET_OKAY;
+
+	b = findBlock (r, offset);
+	block_offset = offset - r->index->blocks[b].uncomp_offset;
+
+	while ( length > 0 && b < r->index->num_blocks )
+	{
+		ret = decodeBlock (r, b, &slot);
+		if ( COMP_RET_OKAY != ret )
+			return ret;
+
+		/* offset is past the end of the last block */
+		if ( block_offset >= slot->size )
+			break; /* while loop */
+
+		n = slot->size - block_offset;
+		if ( n > length )
+			n = length;
+
+		memcpy (buffer, slot->data + block_offset, n);
+
+		buffer += n;
+		length -= n;
+		*bytes_read += n;
+
+		block_offset = 0;
+		++ b;
+	}
+
+	return COMP_RET_OKAY;
+}
+/* }}}1 */
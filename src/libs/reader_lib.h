@@ -0,0 +1,62 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef READERLIB_H
+#define READERLIB_H
+
+#include	<stdio.h>
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+
+/*
+ * random access to the uncompressed contents of a .flk file
+ * ---------------------------------------------------------
+ *
+ * rdr_open() reads the block index from the trailer of a version 2 file.
+ * for a version 1 file it walks the size prefix of every block instead and
+ * decodes the first block (every block except the last decodes to the same
+ * size, so the first block tells us where all the others begin in the
+ * uncompressed data).
+ *
+ * rdr_read() then decodes only the blocks covering the requested range.
+ * decoded blocks are kept in a cache of cache_blocks entries, the least
+ * recently used being dropped to make room. blocks of a version 2 file are
+ * checked against their crc as they are decoded.
+ *
+ * the reader keeps using the FILE given to rdr_open() but doesn't close it.
+ * a reader must not be used by more than one thread at a time.
+ *
+ * return values are from COMP_RET_CODES
+ */
+
+struct flkReader;
+
+int		rdr_open (FILE * inputf, unsigned long cache_blocks, struct flkReader ** reader);
+void	rdr_close (struct flkReader *);
+
+/*
+ * read up to length bytes starting at uncompressed offset. bytes_read is
+ * set to the number of bytes placed in buffer, which is less than length
+ * only if the end of the data was reached.
+ */
+int		rdr_read (struct flkReader *, unsigned long offset, unsigned char * buffer, unsigned long length, unsigned long * bytes_read);
+
+/*
+ * total uncompressed size. the last block is decoded if it hasn't been yet.
+ */
+int		rdr_size (struct flkReader *, unsigned long * size);
+
+#endif /* READERLIB_H */
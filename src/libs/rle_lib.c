@@ -26,6 +26,27 @@
 /* dump relevent data during encoding/decoding */
 //#define RLE_DEBUG_DUMP 1
 
+/* length of the output size header both methods begin with */
+#define RLE_HEADERLEN	4
+
+/* {{{1 SIZE HEADER */
+static void
+putSize (unsigned char * p, unsigned long size)
+{
+	p[0] = (size >> 24) & 0xff;
+	p[1] = (size >> 16) & 0xff;
+	p[2] = (size >> 8) & 0xff;
+	p[3] = size & 0xff;
+}
+
+/* unsigned long throughout -- a top byte over 0x7f must not reach the sign bit of an int */
+static unsigned long
+getSize (unsigned char * p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+/* }}}1 */
+
 /* {{{1 OUTPUT SIZE HANDLER */
 static inline int
 outputSizeCheck (bool check, unsigned long grow_size,
@@ -96,17 +117,15 @@ printf("RLE Compression\n-----\ninput size -> %ld\n", input_size);
 #endif
 /* }}} */
 
-	max_output_size = input_size;
+	/* always leave room for the size header, however small the input */
+	max_output_size = input_size < RLE_HEADERLEN + 2 ? RLE_HEADERLEN + 2 : input_size;
 	*output = malloc ( max_output_size * sizeof **output );
 	if ( NULL == *output )
 		return RLE_RET_NOMEM;
 
 	/* write input size to output */
-	(*output)[0]= (input_size >> 24) & 0xff;
-	(*output)[1]= (input_size >> 16) & 0xff;
-	(*output)[2]= (input_size >> 8) & 0xff;
-	(*output)[3]= (input_size) & 0xff;
-	output_i += 4;
+	putSize (*output, input_size);
+	output_i += RLE_HEADERLEN;
 
 	for ( ;; )
 	{
@@ -163,7 +182,8 @@ printf("repeated %d times\n", i);
 			if ( RLE_RET_SUCCESS != res )
 				return res;
 
-			if ( i != 255 )
+			/* the character that ended the run, unless it was part of it */
+			if ( c != last )
 			{
 /* {{{2 DEBUG_CODE */
 #ifdef RLE_DEBUG_DUMP
@@ -181,6 +201,13 @@ printf("%c\n", c);
 		last = c;
 	}
 
+	/* the header alone can make tiny inputs grow */
+	if ( false != output_size_check && output_i >= input_size )
+	{
+		free (*output);
+		return RLE_RET_TOOBIG;
+	}
+
 	/* trim memory */
 	*output_size = output_i;
 /* {{{2 DEBUG_CODE */
@@ -220,12 +247,9 @@ printf("\nRLE Decompression\n-----\ninput size -> %ld\n", input_size);
 /* }}} */
 
 	/* read in output size */
-	*output_size = (*(input_p)) << 24;
-	*output_size |= (*(input_p+1)) << 16;
-	*output_size |= (*(input_p+2)) << 8;
-	*output_size |= (*(input_p+3));
-	input_p += 4;
-	input_c += 4;
+	*output_size = getSize (input_p);
+	input_p += RLE_HEADERLEN;
+	input_c += RLE_HEADERLEN;
 
 /* {{{2 DEBUG_CODE */
 #ifdef RLE_DEBUG
@@ -243,8 +267,23 @@ printf("output size -> %ld\n", *output_size);
 		input_p += sizeof *input_p;
 		++ input_c;
 
+		/*
+		 * earlier encoders wrote the last character of a run that ended the
+		 * input once more, after the repeat count. it is the only thing that
+		 * can follow a full output
+		 */
+		if ( output_i == *output_size )
+		{
+			if ( input_c == input_size )
+				break;
+
+			free (*output);
+			return RLE_RET_MALFORMED;
+		}
+
 		*output_p = c;
 		output_p += sizeof *output_p;
+		++ output_i;
 
 		if ( input_c == input_size )
 			break;
@@ -266,12 +305,10 @@ puts("repeat");
 #endif
 /* }}} */
 
-			/* get repeat count */
+			/* get repeat count -- the input can end with it */
 			i	= *input_p;
 			input_p += sizeof *input_p;
 			++ input_c;
-			if ( input_c == input_size )
-				break;
 
 /* {{{2 DEBUG_CODE */
 #ifdef RLE_DEBUG_DUMP
@@ -297,11 +334,21 @@ printf("%c\n", c);
 				*output_p = c;
 				output_p += sizeof *output_p;
 			}
+
+			if ( input_c == input_size )
+				break;
 		}
 
 		last = c;
 	}
 
+	/* all of the output, and no more, or the input was cut short */
+	if ( output_i != *output_size )
+	{
+		free (*output);
+		return RLE_RET_MALFORMED;
+	}
+
 	return RLE_RET_SUCCESS;
 }
 /* }}} */
@@ -322,17 +369,15 @@ rle_packbits_compress ( unsigned char *input, unsigned long input_size,
 	unsigned char	* tmp; /* used for realloc() */
 
 
-	max_output_size = input_size;
+	/* always leave room for the size header, however small the input */
+	max_output_size = input_size < RLE_HEADERLEN + 2 ? RLE_HEADERLEN + 2 : input_size;
 	*output = malloc ( max_output_size * sizeof **output );
 	if ( NULL == *output )
 		return RLE_RET_NOMEM;
 
 	/* write input size to output */
-	(*output)[0]= (input_size >> 24) & 0xff;
-	(*output)[1]= (input_size >> 16) & 0xff;
-	(*output)[2]= (input_size >> 8) & 0xff;
-	(*output)[3]= (input_size) & 0xff;
-	output_i += 4;
+	putSize (*output, input_size);
+	output_i += RLE_HEADERLEN;
 
 	/* input loop */
 	for ( i = 0; i < input_size; ++ i )
@@ -396,11 +441,24 @@ rle_packbits_compress ( unsigned char *input, unsigned long input_size,
 		{
 			/* edge case where there is one stray character at end of input stream */
 			(*output)[output_i] = 1;
-			(*output)[output_i+1] = input[i];
-			output_i += 2;
+			++ output_i;
+
+			res = outputSizeCheck (output_size_check, input_size, output, output_i, &max_output_size);
+			if ( RLE_RET_SUCCESS != res )
+				return res;
+
+			(*output)[output_i] = input[i];
+			++ output_i;
 		}
 	}
 
+	/* the header alone can make tiny inputs grow */
+	if ( false != output_size_check && output_i >= input_size )
+	{
+		free (*output);
+		return RLE_RET_TOOBIG;
+	}
+
 	/* trim memory */
 	*output_size = output_i;
 	tmp = realloc (*output, *output_size);
@@ -425,11 +483,8 @@ rle_packbits_decompress ( unsigned char *input, unsigned long input_size,
 	signed char	dup = 0;
 
 	/* read in output size */
-	*output_size = (input[0]) << 24;
-	*output_size |= (input[1]) << 16;
-	*output_size |= (input[2]) << 8;
-	*output_size |= (input[3]);
-	input_i += 4;
+	*output_size = getSize (input);
+	input_i += RLE_HEADERLEN;
 
 /* {{{2 DEBUG_CODE */
 #ifdef RLE_DEBUG
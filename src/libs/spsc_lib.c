@@ -0,0 +1,113 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#include	<stdlib.h>
+
+#include	<types_lib.h>
+#include	"spsc_lib.h"
+
+/*
+ * C99 has no atomics of its own so use the gcc builtins (also understood
+ * by clang)
+ */
+#ifndef __GNUC__
+#error "spsc_lib requires gcc style __atomic builtins"
+#endif
+
+#define load_acquire(p)			__atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define load_relaxed(p)			__atomic_load_n ((p), __ATOMIC_RELAXED)
+#define store_release(p, v)	__atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+
+/* keep the producer and consumer counters on separate cache lines */
+#define CACHE_LINE	64
+
+struct spscQueue
+{
+	void	** items;
+	unsigned long	mask;
+
+	/* next slot to pop -- only written by the consumer */
+	unsigned long	head;
+	char	pad_head[CACHE_LINE - sizeof (unsigned long)];
+
+	/* next slot to push -- only written by the producer */
+	unsigned long	tail;
+	char	pad_tail[CACHE_LINE - sizeof (unsigned long)];
+};
+
+struct spscQueue *
+spsc_newQueue (unsigned long capacity)
+{
+	struct spscQueue	* q;
+	unsigned long	size;
+
+	for ( size = 1; size < capacity; size <<= 1 )
+		;
+
+	q = malloc (sizeof *q);
+	if ( NULL == q )
+		return NULL;
+
+	q->items = malloc (size * sizeof *q->items);
+	if ( NULL == q->items )
+	{
+		free (q);
+		return NULL;
+	}
+
+	q->mask = size - 1;
+	q->head = q->tail = 0;
+
+	return q;
+}
+
+void
+spsc_freeQueue (struct spscQueue * q)
+{
+	if ( NULL == q )
+		return;
+
+	free (q->items);
+	free (q);
+}
+
+bool
+spsc_push (struct spscQueue * q, void * item)
+{
+	unsigned long	tail = load_relaxed (&q->tail);
+
+	/* counters only ever increase so the difference is the queue length */
+	if ( tail - load_acquire (&q->head) > q->mask )
+		return false;
+
+	q->items[tail & q->mask] = item;
+	store_release (&q->tail, tail + 1);
+
+	return true;
+}
+
+bool
+spsc_pop (struct spscQueue * q, void ** item)
+{
+	unsigned long	head = load_relaxed (&q->head);
+
+	if ( head == load_acquire (&q->tail) )
+		return false;
+
+	*item = q->items[head & q->mask];
+	store_release (&q->head, head + 1);
+
+	return true;
+}
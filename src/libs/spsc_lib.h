@@ -0,0 +1,52 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPSCLIB_H
+#define SPSCLIB_H
+
+#include	<types_lib.h>
+
+/*
+ * bounded, lock-free, single-producer/single-consumer queue of pointers
+ *
+ * exactly one thread may call spsc_push() and exactly one (other) thread
+ * may call spsc_pop() on any given queue. neither function blocks -- it is
+ * up to the caller to decide how to wait when the queue is full or empty.
+ */
+
+struct spscQueue;
+
+/*
+ * returns a new queue able to hold at least `capacity` items. capacity
+ * is rounded up to the next power of two.
+ */
+struct spscQueue *	spsc_newQueue (unsigned long capacity);
+
+/*
+ * doesn't free any items still in the queue
+ */
+void spsc_freeQueue (struct spscQueue *);
+
+/*
+ * returns false if the queue is full
+ */
+bool spsc_push (struct spscQueue *, void * item);
+
+/*
+ * returns false if the queue is empty
+ */
+bool spsc_pop (struct spscQueue *, void ** item);
+
+#endif /* SPSCLIB_H */
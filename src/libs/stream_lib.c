@@ -0,0 +1,453 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+#include	<crc32_lib.h>
+#include	<flk_lib.h>
+#include	"stream_lib.h"
+
+struct strmState
+{
+	unsigned long		max_block;
+
+	/* input waiting for a full block */
+	unsigned char	* block;
+	unsigned long		block_used;
+
+	/* records of every block so far, for the trailer */
+	struct flkIndex	* index;
+	bool							header_sent;
+	bool							trailer_sent;
+
+	/*
+	 * output not yet collected by the caller -- the prefix (file header
+	 * and/or block record) then the pending data
+	 */
+	unsigned char		prefix[FLK_HEADER_LEN + FLK_RECORD_LEN];
+	unsigned long		prefix_len;
+	unsigned char	* pending;
+	unsigned long		pending_size;		/* including the prefix */
+	unsigned long		pending_pos;
+
+	/* an error is sticky */
+	int							ret;
+};
+
+
+/* the file header goes in front of whatever is output first */
+static void
+prefixHeader (struct strmState * state)
+{
+	state->prefix_len = 0;
+
+	if ( false == state->header_sent )
+	{
+		flk_writeHeader (state->index, state->prefix);
+		state->prefix_len = FLK_HEADER_LEN;
+		state->header_sent = true;
+	}
+}
+
+static int
+compressPending (struct compStream * strm, unsigned char * input, unsigned long input_size)
+{
+	struct strmState		* state = strm->state;
+	struct compressInfo		info;
+	struct compBlockInfo	block_info;
+
+	memset (&info, 0, sizeof info);
+	info.errorHook = strm->errorHook;
+	info.errorHook_data = strm->errorHook_data;
+
+	state->ret = comp_compressBlock (&info, input, input_size, &state->pending, &state->pending_size);
+	if ( COMP_RET_OKAY != state->ret )
+	{
+		state->pending = NULL;
+		state->pending_size = 0;
+		return state->ret;
+	}
+
+	block_info.uncompressed_size = input_size;
+	block_info.crc = crc_generate (input, input_size);
+	block_info.repeat = false;
+
+	prefixHeader (state);
+
+	state->ret = flk_addBlock (state->index, state->pending_size, &block_info, state->prefix + state->prefix_len);
+	if ( COMP_RET_OKAY != state->ret )
+	{
+		free (state->pending);
+		state->pending = NULL;
+		state->pending_size = 0;
+		return state->ret;
+	}
+
+	state->prefix_len += FLK_RECORD_LEN;
+	state->pending_size += state->prefix_len;
+	state->pending_pos = 0;
+
+	return COMP_RET_OKAY;
+}
+
+static int
+trailerPending (struct compStream * strm)
+{
+	struct strmState	* state = strm->state;
+
+	state->pending = malloc (flk_indexLen (state->index));
+	if ( NULL == state->pending )
+	{
+		state->ret = COMP_RET_NOMEM;
+		return state->ret;
+	}
+
+	flk_writeIndex (state->index, state->pending);
+
+	prefixHeader (state);
+
+	state->pending_size = state->prefix_len + flk_indexLen (state->index);
+	state->pending_pos = 0;
+	state->trailer_sent = true;
+
+	return COMP_RET_OKAY;
+}
+
+/* copy as much of the pending output as will fit. returns true once all of it has gone */
+static bool
+drainPending (struct compStream * strm)
+{
+	struct strmState	* state = strm->state;
+	unsigned long			n;
+
+	while ( state->pending_pos < state->pending_size && strm->avail_out > 0 )
+	{
+		if ( state->pending_pos < state->prefix_len )
+		{
+			n = state->prefix_len - state->pending_pos;
+			if ( n > strm->avail_out )
+				n = strm->avail_out;
+
+			memcpy (strm->next_out, state->prefix + state->pending_pos, n);
+		}
+		else
+		{
+			n = state->pending_size - state->pending_pos;
+			if ( n > strm->avail_out )
+				n = strm->avail_out;
+
+			memcpy (strm->next_out, state->pending + state->pending_pos - state->prefix_len, n);
+		}
+
+		state->pending_pos += n;
+		strm->next_out += n;
+		strm->avail_out -= n;
+		strm->total_out += n;
+	}
+
+	if ( state->pending_pos < state->pending_size )
+		return false;
+
+	free (state->pending);
+	state->pending = NULL;
+	state->pending_size = state->pending_pos = 0;
+
+	return true;
+}
+
+int
+strm_init (struct compStream * strm, unsigned long max_block)
+{
+	struct strmState	* state;
+
+	if ( NULL == strm || 0 == max_block || max_block > COMP_BLOCK_MAX )
+		return COMP_RET_BADARGS;
+
+	strm->total_in = strm->total_out = 0;
+	strm->state = NULL;
+
+	state = malloc (sizeof *state);
+	if ( NULL == state )
+		return COMP_RET_NOMEM;
+
+	state->block = malloc (max_block * sizeof *state->block);
+	if ( NULL == state->block )
+	{
+		free (state);
+		return COMP_RET_NOMEM;
+	}
+
+	state->index = flk_newIndex (max_block, false);
+	if ( NULL == state->index )
+	{
+		free (state->block);
+		free (state);
+		return COMP_RET_NOMEM;
+	}
+
+	state->max_block = max_block;
+	state->block_used = 0;
+	state->header_sent = state->trailer_sent = false;
+	state->prefix_len = 0;
+	state->pending = NULL;
+	state->pending_size = state->pending_pos = 0;
+	state->ret = COMP_RET_OKAY;
+
+	strm->state = state;
+
+	return COMP_RET_OKAY;
+}
+
+int
+strm_update (struct compStream * strm)
+{
+	struct strmState	* state;
+	unsigned long			n;
+
+	if ( NULL == strm || NULL == strm->state )
+		return COMP_RET_BADARGS;
+
+	state = strm->state;
+	if ( COMP_RET_OKAY != state->ret )
+		return state->ret;
+
+	for (;;)
+	{
+		/* the previous block must be collected before another is made */
+		if ( false == drainPending (strm) )
+			return COMP_RET_OKAY;
+
+		if ( 0 == strm->avail_in )
+			return COMP_RET_OKAY;
+
+		/* compress straight from the caller's memory when we can */
+		if ( 0 == state->block_used && strm->avail_in >= state->max_block )
+		{
+			if ( COMP_RET_OKAY != compressPending (strm, strm->next_in, state->max_block) )
+				return state->ret;
+
+			strm->next_in += state->max_block;
+			strm->avail_in -= state->max_block;
+			strm->total_in += state->max_block;
+			continue; /* for loop */
+		}
+
+		/* otherwise accumulate */
+		n = state->max_block - state->block_used;
+		if ( n > strm->avail_in )
+			n = strm->avail_in;
+
+		memcpy (state->block + state->block_used, strm->next_in, n);
+		state->block_used += n;
+		strm->next_in += n;
+		strm->avail_in -= n;
+		strm->total_in += n;
+
+		if ( state->block_used == state->max_block )
+		{
+			if ( COMP_RET_OKAY != compressPending (strm, state->block, state->block_used) )
+				return state->ret;
+
+			state->block_used = 0;
+		}
+	}
+}
+
+int
+strm_finish (struct compStream * strm)
+{
+	struct strmState	* state;
+	int								ret;
+
+	ret = strm_update (strm);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	state = strm->state;
+
+	/* more output space is needed before we can finish */
+	if ( strm->avail_in > 0 || 0 != state->pending_size )
+		return COMP_RET_OKAY;
+
+	/* compress what's left over */
+	if ( state->block_used > 0 )
+	{
+		if ( COMP_RET_OKAY != compressPending (strm, state->block, state->block_used) )
+			return state->ret;
+
+		state->block_used = 0;
+
+		if ( false == drainPending (strm) )
+			return COMP_RET_OKAY;
+	}
+
+	/* then the index */
+	if ( false == state->trailer_sent )
+	{
+		if ( COMP_RET_OKAY != trailerPending (strm) )
+			return state->ret;
+
+		if ( false == drainPending (strm) )
+			return COMP_RET_OKAY;
+	}
+
+	return COMP_RET_STREAMEND;
+}
+
+void
+strm_end (struct compStream * strm)
+{
+	if ( NULL == strm || NULL == strm->state )
+		return;
+
+	free (strm->state->pending);
+	free (strm->state->block);
+	flk_freeIndex (strm->state->index);
+	free (strm->state);
+	strm->state = NULL;
+}
+
+unsigned long
+strm_compressBound (unsigned long input_size, unsigned long max_block)
+{
+	unsigned long	full = input_size / max_block,
+								left = input_size % max_block,
+								bound;
+
+	/* every block has a record in front of it and another in the index */
+	bound = FLK_HEADER_LEN + FLK_FOOTER_LEN;
+	bound += full * (2 * FLK_RECORD_LEN + comp_blockBound (max_block));
+	if ( left > 0 )
+		bound += 2 * FLK_RECORD_LEN + comp_blockBound (left);
+
+	return bound;
+}
+
+int
+strm_compressBuffer (unsigned char * input, unsigned long input_size, unsigned char * output, unsigned long * output_size, unsigned long max_block)
+{
+	struct flkIndex			* index;
+	struct compBlockInfo	block_info;
+	unsigned char				* block;
+	unsigned long					block_size,
+												l,
+												used = FLK_HEADER_LEN;
+
+	int		ret = COMP_RET_OKAY;
+
+	if ( NULL == input || NULL == output || NULL == output_size || 0 == max_block || max_block > COMP_BLOCK_MAX )
+		return COMP_RET_BADARGS;
+
+	index = flk_newIndex (max_block, false);
+	if ( NULL == index )
+		return COMP_RET_NOMEM;
+
+	if ( FLK_HEADER_LEN > *output_size )
+		ret = COMP_RET_BUFFER;
+	else
+		flk_writeHeader (index, output);
+
+	while ( COMP_RET_OKAY == ret && input_size > 0 )
+	{
+		l = input_size < max_block ? input_size : max_block;
+
+		ret = comp_compressBlock (NULL, input, l, &block, &block_size);
+		if ( COMP_RET_OKAY != ret )
+			break; /* while loop */
+
+		if ( used + FLK_RECORD_LEN + block_size > *output_size )
+			ret = COMP_RET_BUFFER;
+		else
+		{
+			block_info.uncompressed_size = l;
+			block_info.crc = crc_generate (input, l);
+			block_info.repeat = false;
+
+			ret = flk_addBlock (index, block_size, &block_info, output + used);
+			if ( COMP_RET_OKAY == ret )
+			{
+				memcpy (output + used + FLK_RECORD_LEN, block, block_size);
+				used += FLK_RECORD_LEN + block_size;
+			}
+		}
+
+		free (block);
+
+		input += l;
+		input_size -= l;
+	}
+
+	if ( COMP_RET_OKAY == ret )
+	{
+		if ( used + flk_indexLen (index) > *output_size )
+			ret = COMP_RET_BUFFER;
+		else
+		{
+			flk_writeIndex (index, output + used);
+			*output_size = used + flk_indexLen (index);
+		}
+	}
+
+	flk_freeIndex (index);
+
+	return ret;
+}
+
+int
+strm_decompressBuffer (unsigned char * input, unsigned long input_size, unsigned char * output, unsigned long * output_size)
+{
+	struct flkIndex	* index;
+	unsigned char		* block;
+	unsigned long			block_size,
+										b,
+										used = 0;
+
+	int		ret;
+
+	if ( NULL == input || NULL == output || NULL == output_size )
+		return COMP_RET_BADARGS;
+
+	ret = flk_parseIndex (input, input_size, &index);
+	if ( COMP_RET_OKAY != ret )
+		return ret;
+
+	for ( b = 0; b < index->num_blocks; ++ b )
+	{
+		ret = flk_decodeBlock (index, b, input + index->blocks[b].offset, &block, &block_size);
+		if ( COMP_RET_OKAY != ret )
+			break; /* for loop */
+
+		if ( used + block_size > *output_size )
+		{
+			free (block);
+			ret = COMP_RET_BUFFER;
+			break; /* for loop */
+		}
+
+		memcpy (output + used, block, block_size);
+		used += block_size;
+		free (block);
+	}
+
+	flk_freeIndex (index);
+
+	if ( COMP_RET_OKAY == ret )
+		*output_size = used;
+
+	return ret;
+}
@@ -0,0 +1,85 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STREAMLIB_H
+#define STREAMLIB_H
+
+#include	<types_lib.h>
+#include	<compress_lib.h>
+
+/*
+ * in-memory compression
+ * ---------------------
+ *
+ * output is a version 2 .flk file (see flk_lib.h) -- exactly what flick
+ * writes. strm_decompressBuffer() also takes version 1 data.
+ *
+ * the stream functions are used in the same way as zlib's. the caller
+ * points next_in/avail_in at whatever input it has and next_out/avail_out
+ * at some space for output, then calls strm_update(). the pointers and
+ * counts are advanced past whatever was consumed and produced. once all
+ * input has been given, strm_finish() is called until it returns
+ * COMP_RET_STREAMEND.
+ *
+ * neither function waits for anything. input is accumulated until there is
+ * a full block to compress and then held back until all the output of the
+ * previous block has been collected -- so if avail_in is left non zero then
+ * more output space is needed before more input can be taken. the block
+ * index is output by strm_finish(), after the last block.
+ *
+ * return values are from COMP_RET_CODES. after an error the stream can only
+ * be passed to strm_end().
+ */
+
+struct strmState;
+
+struct compStream
+{
+	unsigned char	* next_in;
+	unsigned long		avail_in;
+	unsigned long		total_in;
+
+	unsigned char	* next_out;
+	unsigned long		avail_out;
+	unsigned long		total_out;
+
+	/* error hook can be NULL */
+	void * errorHook_data;
+	errorHookT	errorHook;
+
+	/* private */
+	struct strmState	* state;
+};
+
+int		strm_init (struct compStream *, unsigned long max_block);
+int		strm_update (struct compStream *);
+int		strm_finish (struct compStream *);
+void	strm_end (struct compStream *);
+
+/*
+ * the largest output that input_size bytes can compress to
+ */
+unsigned long	strm_compressBound (unsigned long input_size, unsigned long max_block);
+
+/*
+ * one-shot functions. output_size should hold the size of the output
+ * buffer and is updated with the amount actually used. COMP_RET_BUFFER is
+ * returned if the output buffer is too small -- an output buffer of
+ * strm_compressBound() bytes is always big enough for strm_compressBuffer().
+ */
+int		strm_compressBuffer (unsigned char * input, unsigned long input_size, unsigned char * output, unsigned long * output_size, unsigned long max_block);
+int		strm_decompressBuffer (unsigned char * input, unsigned long input_size, unsigned char * output, unsigned long * output_size);
+
+#endif /* STREAMLIB_H */
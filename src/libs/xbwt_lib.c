@@ -0,0 +1,931 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<unistd.h>
+#include	<errno.h>
+
+#include	<types_lib.h>
+#include	"bwt_lib.h"
+#include	"xbwt_lib.h"
+
+/* the index of the original input in front of the block -- as bwt_lib.c */
+#define BWT_HEADERLEN			4
+
+/* a merge reads each run through a buffer of at least this many records */
+#define MIN_RUN_BUFFER		1024
+
+/*
+ * how the memory is shared out -- each sorter has SORTER_SHARE sixteenths
+ * of it and each of the three buffers of names a sixteenth
+ */
+#define SORTER_SHARE			6
+#define NUM_NAME_BUFFERS	3
+
+
+/* {{{1 SCRATCH FILES */
+static int
+openScratch (void)
+{
+	const char	* dir = getenv ("TMPDIR");
+	char				* path;
+	int					fd;
+
+	if ( NULL == dir || '\0' == *dir )
+		dir = "/tmp";
+
+	path = malloc (strlen (dir) + sizeof "/xbwtXXXXXX");
+	if ( NULL == path )
+		return -1;
+
+	strcpy (path, dir);
+	strcat (path, "/xbwtXXXXXX");
+
+	/* nobody else needs to find it */
+	fd = mkstemp (path);
+	if ( -1 != fd )
+		unlink (path);
+
+	free (path);
+
+	return fd;
+}
+
+/* only to give the space back -- the file is rewritten from the start either way */
+static void
+emptyScratch (int fd)
+{
+	if ( -1 != fd && 0 != ftruncate (fd, 0) )
+		return;
+}
+
+static void
+closeScratch (int fd)
+{
+	if ( -1 != fd )
+		close (fd);
+}
+
+/* all of len bytes or false */
+static bool
+writeAt (int fd, void * buffer, unsigned long len, off_t offset)
+{
+	unsigned char	* p = buffer;
+	ssize_t					n;
+
+	while ( len > 0 )
+	{
+		n = pwrite (fd, p, len, offset);
+		if ( n <= 0 )
+		{
+			if ( -1 == n && EINTR == errno )
+				continue; /* while loop */
+
+			return false;
+		}
+
+		p += n;
+		len -= n;
+		offset += n;
+	}
+
+	return true;
+}
+
+static bool
+readAt (int fd, void * buffer, unsigned long len, off_t offset)
+{
+	unsigned char	* p = buffer;
+	ssize_t					n;
+
+	while ( len > 0 )
+	{
+		n = pread (fd, p, len, offset);
+		if ( n <= 0 )
+		{
+			if ( -1 == n && EINTR == errno )
+				continue; /* while loop */
+
+			return false;
+		}
+
+		p += n;
+		len -= n;
+		offset += n;
+	}
+
+	return true;
+}
+/* }}} */
+
+/* {{{1 RECORDS */
+/*
+ * a rotation's position and the two names it is sorted on -- or, sorted
+ * back into the order of the input, its position and new name
+ */
+struct record
+{
+	uint32_t	a;
+	uint32_t	b;
+	uint32_t	c;
+};
+
+typedef int (*compareT) (const void *, const void *);
+
+static int
+compareNames (const void * p, const void * q)
+{
+	const struct record	* r = p,
+											* s = q;
+
+	if ( r->a != s->a )
+		return r->a < s->a ? -1 : 1;
+
+	if ( r->b != s->b )
+		return r->b < s->b ? -1 : 1;
+
+	return 0;
+}
+
+static int
+comparePositions (const void * p, const void * q)
+{
+	const struct record	* r = p,
+											* s = q;
+
+	if ( r->a != s->a )
+		return r->a < s->a ? -1 : 1;
+
+	return 0;
+}
+/* }}} */
+
+/* {{{1 MERGE */
+/* a sorted run in a scratch file, read through a part of the sorter's buffer */
+struct run
+{
+	unsigned long		next;			/* records still in the file */
+	unsigned long		end;
+
+	struct record	* buffer;
+	unsigned long		capacity;
+	unsigned long		used;
+	unsigned long		pos;
+};
+
+struct merge
+{
+	compareT				compare;
+	int							fd;
+
+	struct run		* runs;
+	unsigned long	* heap;			/* of runs, by their next record */
+	unsigned long		heap_size;
+};
+
+static bool
+fillRun (int fd, struct run * run)
+{
+	run->used = run->end - run->next;
+	if ( run->used > run->capacity )
+		run->used = run->capacity;
+
+	if ( false == readAt (fd, run->buffer, run->used * sizeof *run->buffer, (off_t) run->next * sizeof *run->buffer) )
+		return false;
+
+	run->next += run->used;
+	run->pos = 0;
+
+	return true;
+}
+
+static bool
+runBefore (struct merge * merge, unsigned long i, unsigned long j)
+{
+	struct run	* r = merge->runs + i,
+							* s = merge->runs + j;
+
+	return merge->compare (r->buffer + r->pos, s->buffer + s->pos) < 0;
+}
+
+static void
+siftDown (struct merge * merge, unsigned long k)
+{
+	unsigned long	c, t;
+
+	while ( (c = 2 * k + 1) < merge->heap_size )
+	{
+		if ( c + 1 < merge->heap_size && runBefore (merge, merge->heap[c+1], merge->heap[c]) )
+			++ c;
+
+		if ( false == runBefore (merge, merge->heap[c], merge->heap[k]) )
+			break; /* while loop */
+
+		t = merge->heap[c];
+		merge->heap[c] = merge->heap[k];
+		merge->heap[k] = t;
+		k = c;
+	}
+}
+
+static void
+endMerge (struct merge * merge)
+{
+	free (merge->runs);
+	free (merge->heap);
+	merge->runs = NULL;
+	merge->heap = NULL;
+	merge->heap_size = 0;
+}
+
+/* merge runs first to first + count - 1, each read through per_run records of buffer */
+static int
+startMerge (struct merge * merge, int fd, compareT compare, unsigned long * run_ends, unsigned long first, unsigned long count, struct record * buffer, unsigned long per_run)
+{
+	unsigned long	k;
+
+	merge->compare = compare;
+	merge->fd = fd;
+	merge->heap_size = 0;
+
+	merge->runs = malloc (count * sizeof *merge->runs);
+	merge->heap = malloc (count * sizeof *merge->heap);
+	if ( NULL == merge->runs || NULL == merge->heap )
+	{
+		endMerge (merge);
+		return XBWT_RET_NOMEM;
+	}
+
+	for ( k = 0; k < count; ++ k )
+	{
+		merge->runs[k].next = 0 == first + k ? 0 : run_ends[first + k - 1];
+		merge->runs[k].end = run_ends[first + k];
+		merge->runs[k].buffer = buffer + k * per_run;
+		merge->runs[k].capacity = per_run;
+
+		if ( false == fillRun (fd, merge->runs + k) )
+		{
+			endMerge (merge);
+			return XBWT_RET_SCRATCH;
+		}
+
+		if ( merge->runs[k].used > 0 )
+			merge->heap[merge->heap_size ++] = k;
+	}
+
+	for ( k = merge->heap_size / 2; k-- > 0; )
+		siftDown (merge, k);
+
+	return XBWT_RET_SUCCESS;
+}
+
+/* 1 for a record, 0 at the end of the runs and -1 if one can't be read */
+static int
+nextMerged (struct merge * merge, struct record * record)
+{
+	struct run	* run;
+
+	if ( 0 == merge->heap_size )
+		return 0;
+
+	run = merge->runs + merge->heap[0];
+	*record = run->buffer[run->pos ++];
+
+	if ( run->pos == run->used )
+	{
+		if ( run->next < run->end )
+		{
+			if ( false == fillRun (merge->fd, run) )
+				return -1;
+		}
+		else
+			merge->heap[0] = merge->heap[-- merge->heap_size];
+	}
+
+	siftDown (merge, 0);
+
+	return 1;
+}
+/* }}} */
+
+/* {{{1 SORTER */
+/*
+ * an external merge sort. records are added until the buffer is full, when
+ * it is sorted and written out as a run. once every record is in, runs are
+ * merged as many at a time as the buffer can be shared between into a
+ * second file, and back, until they are few enough to be merged as they
+ * are read. if every record fits in the buffer no run is ever written.
+ */
+struct sorter
+{
+	compareT				compare;
+
+	struct record	* buffer;
+	unsigned long		capacity;
+	unsigned long		used;
+	unsigned long		served;		/* of the buffer, when there are no runs */
+
+	/* the runs one after another, by the record each ends before */
+	int							fd;
+	int							merge_fd;
+	unsigned long	* run_ends;
+	unsigned long		num_runs;
+	unsigned long		max_runs;
+
+	struct merge		merge;
+};
+
+static int
+initSorter (struct sorter * sorter, compareT compare, unsigned long memory)
+{
+	memset (sorter, 0, sizeof *sorter);
+	sorter->compare = compare;
+	sorter->fd = sorter->merge_fd = -1;
+
+	sorter->capacity = memory / sizeof *sorter->buffer;
+	sorter->buffer = malloc (sorter->capacity * sizeof *sorter->buffer);
+	if ( NULL == sorter->buffer )
+		return XBWT_RET_NOMEM;
+
+	return XBWT_RET_SUCCESS;
+}
+
+static void
+freeSorter (struct sorter * sorter)
+{
+	endMerge (&sorter->merge);
+	closeScratch (sorter->fd);
+	closeScratch (sorter->merge_fd);
+	free (sorter->run_ends);
+	free (sorter->buffer);
+}
+
+/* ready for another pass. the scratch files are kept but emptied */
+static void
+resetSorter (struct sorter * sorter)
+{
+	endMerge (&sorter->merge);
+
+	emptyScratch (sorter->fd);
+
+	sorter->used = sorter->served = 0;
+	sorter->num_runs = 0;
+}
+
+static int
+addRunEnd (struct sorter * sorter, unsigned long end)
+{
+	unsigned long	* p;
+
+	if ( sorter->num_runs == sorter->max_runs )
+	{
+		p = realloc (sorter->run_ends, (2 * sorter->max_runs + 16) * sizeof *p);
+		if ( NULL == p )
+			return XBWT_RET_NOMEM;
+
+		sorter->run_ends = p;
+		sorter->max_runs = 2 * sorter->max_runs + 16;
+	}
+
+	sorter->run_ends[sorter->num_runs ++] = end;
+
+	return XBWT_RET_SUCCESS;
+}
+
+static int
+writeRun (struct sorter * sorter)
+{
+	unsigned long	start = 0 == sorter->num_runs ? 0 : sorter->run_ends[sorter->num_runs - 1];
+
+	if ( -1 == sorter->fd )
+	{
+		sorter->fd = openScratch ();
+		if ( -1 == sorter->fd )
+			return XBWT_RET_SCRATCH;
+	}
+
+	qsort (sorter->buffer, sorter->used, sizeof *sorter->buffer, sorter->compare);
+
+	if ( false == writeAt (sorter->fd, sorter->buffer, sorter->used * sizeof *sorter->buffer, (off_t) start * sizeof *sorter->buffer) )
+		return XBWT_RET_SCRATCH;
+
+	start += sorter->used;
+	sorter->used = 0;
+
+	return addRunEnd (sorter, start);
+}
+
+static int
+addRecord (struct sorter * sorter, uint32_t a, uint32_t b, uint32_t c)
+{
+	int		ret;
+
+	if ( sorter->used == sorter->capacity )
+	{
+		ret = writeRun (sorter);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+	}
+
+	sorter->buffer[sorter->used].a = a;
+	sorter->buffer[sorter->used].b = b;
+	sorter->buffer[sorter->used].c = c;
+	++ sorter->used;
+
+	return XBWT_RET_SUCCESS;
+}
+
+/* merge the runs fan_in at a time into the merge file, which then becomes the run file */
+static int
+mergePass (struct sorter * sorter, unsigned long fan_in)
+{
+	struct record	* out;
+	struct record		record;
+	unsigned long		per_run = sorter->capacity / (fan_in + 1),
+									old_runs = sorter->num_runs,
+									* old_ends = sorter->run_ends,
+									first, count,
+									written = 0,
+									out_used;
+	int							ret = XBWT_RET_SUCCESS,
+									got,
+									t;
+
+	if ( -1 == sorter->merge_fd )
+	{
+		sorter->merge_fd = openScratch ();
+		if ( -1 == sorter->merge_fd )
+			return XBWT_RET_SCRATCH;
+	}
+
+	/* the merged runs are recorded afresh */
+	sorter->run_ends = NULL;
+	sorter->num_runs = sorter->max_runs = 0;
+
+	out = sorter->buffer + fan_in * per_run;
+
+	for ( first = 0; XBWT_RET_SUCCESS == ret && first < old_runs; first += count )
+	{
+		count = old_runs - first < fan_in ? old_runs - first : fan_in;
+
+		ret = startMerge (&sorter->merge, sorter->fd, sorter->compare, old_ends, first, count, sorter->buffer, per_run);
+		if ( XBWT_RET_SUCCESS != ret )
+			break; /* for loop */
+
+		out_used = 0;
+		while ( 1 == (got = nextMerged (&sorter->merge, &record)) )
+		{
+			out[out_used ++] = record;
+			if ( out_used == per_run )
+			{
+				if ( false == writeAt (sorter->merge_fd, out, out_used * sizeof *out, (off_t) written * sizeof *out) )
+				{
+					got = -1;
+					break; /* while loop */
+				}
+
+				written += out_used;
+				out_used = 0;
+			}
+		}
+
+		if ( -1 != got && false == writeAt (sorter->merge_fd, out, out_used * sizeof *out, (off_t) written * sizeof *out) )
+			got = -1;
+
+		endMerge (&sorter->merge);
+
+		if ( -1 == got )
+			ret = XBWT_RET_SCRATCH;
+		else
+		{
+			written += out_used;
+			ret = addRunEnd (sorter, written);
+		}
+	}
+
+	free (old_ends);
+
+	/* the old run file is emptied to be merged into next */
+	t = sorter->fd;
+	sorter->fd = sorter->merge_fd;
+	sorter->merge_fd = t;
+	emptyScratch (sorter->merge_fd);
+
+	return ret;
+}
+
+/* every record is in -- start giving them back in order */
+static int
+finishSorter (struct sorter * sorter)
+{
+	unsigned long	fan_in = sorter->capacity / MIN_RUN_BUFFER;
+	int						ret;
+
+	if ( 0 == sorter->num_runs )
+	{
+		qsort (sorter->buffer, sorter->used, sizeof *sorter->buffer, sorter->compare);
+		sorter->served = 0;
+		return XBWT_RET_SUCCESS;
+	}
+
+	if ( sorter->used > 0 )
+	{
+		ret = writeRun (sorter);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+	}
+
+	/* leave room for the output buffer of a merge pass */
+	if ( fan_in < 3 )
+		fan_in = 3;
+
+	while ( sorter->num_runs > fan_in )
+	{
+		ret = mergePass (sorter, fan_in - 1);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+	}
+
+	return startMerge (&sorter->merge, sorter->fd, sorter->compare, sorter->run_ends, 0, sorter->num_runs, sorter->buffer, sorter->capacity / sorter->num_runs);
+}
+
+/* 1 for a record, 0 when they're all out and -1 on error */
+static int
+nextRecord (struct sorter * sorter, struct record * record)
+{
+	if ( 0 == sorter->num_runs )
+	{
+		if ( sorter->served == sorter->used )
+			return 0;
+
+		*record = sorter->buffer[sorter->served ++];
+		return 1;
+	}
+
+	return nextMerged (&sorter->merge, record);
+}
+/* }}} */
+
+/* {{{1 NAMES */
+/*
+ * the name of every rotation, in the order of the input, is kept in a
+ * scratch file. the rotations are paired with those h further on by
+ * reading the file from two places at once -- the second wrapping round
+ * to the start.
+ */
+struct names
+{
+	int							fd;
+	unsigned long		n;
+
+	uint32_t			* buffer;
+	unsigned long		capacity;
+	unsigned long		used;
+	unsigned long		pos;
+
+	unsigned long		at;				/* the next name to read or write */
+	unsigned long		left;			/* names still to read */
+};
+
+static void
+startNames (struct names * names, int fd, unsigned long n, uint32_t * buffer, unsigned long capacity, unsigned long from)
+{
+	names->fd = fd;
+	names->n = n;
+	names->buffer = buffer;
+	names->capacity = capacity;
+	names->used = names->pos = 0;
+	names->at = from;
+	names->left = n;
+}
+
+static bool
+nextName (struct names * names, uint32_t * name)
+{
+	unsigned long	l;
+
+	if ( names->pos == names->used )
+	{
+		if ( names->at == names->n )
+			names->at = 0;
+
+		l = names->n - names->at;
+		if ( l > names->left )
+			l = names->left;
+		if ( l > names->capacity )
+			l = names->capacity;
+
+		if ( false == readAt (names->fd, names->buffer, l * sizeof *names->buffer, (off_t) names->at * sizeof *names->buffer) )
+			return false;
+
+		names->at += l;
+		names->left -= l;
+		names->used = l;
+		names->pos = 0;
+	}
+
+	*name = names->buffer[names->pos ++];
+
+	return true;
+}
+
+static bool
+flushNames (struct names * names)
+{
+	if ( false == writeAt (names->fd, names->buffer, names->used * sizeof *names->buffer, (off_t) names->at * sizeof *names->buffer) )
+		return false;
+
+	names->at += names->used;
+	names->used = 0;
+
+	return true;
+}
+
+static bool
+putName (struct names * names, uint32_t name)
+{
+	names->buffer[names->used ++] = name;
+
+	if ( names->used == names->capacity )
+		return flushNames (names);
+
+	return true;
+}
+/* }}} */
+
+/* {{{1 ENCODER */
+struct xbwt
+{
+	unsigned char	* input;
+	unsigned long		n;
+	unsigned char	* output;
+
+	/* the rotations by their names, then by their positions */
+	struct sorter		by_names;
+	struct sorter		by_positions;
+
+	int							names_fd;
+	uint32_t			* name_buffers[NUM_NAME_BUFFERS];
+	unsigned long		name_capacity;
+};
+
+static void
+putIndex (unsigned char * p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+/* the first four bytes of the rotation at i, which is what it is first named by */
+static uint32_t
+firstName (unsigned char * input, unsigned long n, unsigned long i)
+{
+	uint32_t			name = 0;
+	int						k;
+
+	for ( k = 0; k < 4; ++ k )
+	{
+		name = (name << 8) | input[i];
+		if ( ++ i == n )
+			i = 0;
+	}
+
+	return name;
+}
+
+/* pair every rotation's name with the name of the one h on */
+static int
+pairNames (struct xbwt * x, unsigned long h, bool first)
+{
+	struct names	here,
+								on;
+	uint32_t			a, b;
+	unsigned long	i;
+	int						ret;
+
+	if ( true == first )
+	{
+		for ( i = 0; i < x->n; ++ i )
+		{
+			ret = addRecord (&x->by_names, firstName (x->input, x->n, i), firstName (x->input, x->n, (i + h) % x->n), i);
+			if ( XBWT_RET_SUCCESS != ret )
+				return ret;
+		}
+
+		return XBWT_RET_SUCCESS;
+	}
+
+	startNames (&here, x->names_fd, x->n, x->name_buffers[0], x->name_capacity, 0);
+	startNames (&on, x->names_fd, x->n, x->name_buffers[1], x->name_capacity, h);
+
+	for ( i = 0; i < x->n; ++ i )
+	{
+		if ( false == nextName (&here, &a) || false == nextName (&on, &b) )
+			return XBWT_RET_SCRATCH;
+
+		ret = addRecord (&x->by_names, a, b, i);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+	}
+
+	return XBWT_RET_SUCCESS;
+}
+
+/*
+ * take the rotations in order of their pairs of names. each rotation is
+ * renamed by the rank of the first in its group and the last column is
+ * written out as the order stands -- after the last pass it is the bwt
+ */
+static int
+renameRotations (struct xbwt * x, unsigned long * groups)
+{
+	struct record	record,
+								last;
+	unsigned long	j;
+	uint32_t			name = 0;
+	int						got,
+								ret;
+
+	*groups = 0;
+
+	for ( j = 0; 1 == (got = nextRecord (&x->by_names, &record)); ++ j )
+	{
+		if ( 0 == j || record.a != last.a || record.b != last.b )
+		{
+			name = j;
+			++ *groups;
+		}
+
+		last = record;
+
+		if ( 0 == record.c )
+		{
+			putIndex (x->output, j);
+			x->output[BWT_HEADERLEN + j] = x->input[x->n - 1];
+		}
+		else
+			x->output[BWT_HEADERLEN + j] = x->input[record.c - 1];
+
+		ret = addRecord (&x->by_positions, record.c, name, 0);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+	}
+
+	if ( -1 == got )
+		return XBWT_RET_SCRATCH;
+
+	return XBWT_RET_SUCCESS;
+}
+
+/* write the new names out in the order of the input */
+static int
+storeNames (struct xbwt * x)
+{
+	struct names	out;
+	struct record	record;
+	int						got;
+
+	startNames (&out, x->names_fd, x->n, x->name_buffers[2], x->name_capacity, 0);
+
+	while ( 1 == (got = nextRecord (&x->by_positions, &record)) )
+	{
+		if ( false == putName (&out, record.b) )
+			return XBWT_RET_SCRATCH;
+	}
+
+	if ( -1 == got || false == flushNames (&out) )
+		return XBWT_RET_SCRATCH;
+
+	return XBWT_RET_SUCCESS;
+}
+
+static int
+sortRotations (struct xbwt * x)
+{
+	unsigned long	h,
+								groups;
+	int						ret;
+
+	/* the rotations are first named by their first four bytes */
+	for ( h = 4; ; h *= 2 )
+	{
+		ret = pairNames (x, h, 4 == h);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+
+		ret = finishSorter (&x->by_names);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+
+		ret = renameRotations (x, &groups);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+
+		resetSorter (&x->by_names);
+
+		/* every rotation is told apart, or the rest are the same all the way round */
+		if ( groups == x->n || 2 * h >= x->n )
+			return XBWT_RET_SUCCESS;
+
+		ret = finishSorter (&x->by_positions);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+
+		ret = storeNames (x);
+		if ( XBWT_RET_SUCCESS != ret )
+			return ret;
+
+		resetSorter (&x->by_positions);
+	}
+}
+
+int
+xbwt_encode (unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size, unsigned long memory)
+{
+	struct xbwt		x;
+	int						k,
+								ret;
+
+	if ( 0 == input_size || input_size > BWT_MAX_INPUT )
+		return XBWT_RET_TOOBIG;
+
+	if ( memory < XBWT_MIN_MEMORY )
+		memory = XBWT_MIN_MEMORY;
+
+	/* the output isn't counted against the memory */
+	if ( bwt_encodeMemory (input_size) <= memory + BWT_HEADERLEN + input_size )
+	{
+		if ( 0 == bwt_encode (input, input_size, output, output_size) )
+			return XBWT_RET_NOMEM;
+
+		return XBWT_RET_SUCCESS;
+	}
+
+	memset (&x, 0, sizeof x);
+	x.input = input;
+	x.n = input_size;
+	x.names_fd = -1;
+
+	x.output = malloc (BWT_HEADERLEN + input_size);
+	ret = NULL == x.output ? XBWT_RET_NOMEM : XBWT_RET_SUCCESS;
+
+	if ( XBWT_RET_SUCCESS == ret )
+		ret = initSorter (&x.by_names, compareNames, memory / 16 * SORTER_SHARE);
+
+	if ( XBWT_RET_SUCCESS == ret )
+		ret = initSorter (&x.by_positions, comparePositions, memory / 16 * SORTER_SHARE);
+
+	x.name_capacity = memory / 16 / sizeof (uint32_t);
+	for ( k = 0; XBWT_RET_SUCCESS == ret && k < NUM_NAME_BUFFERS; ++ k )
+	{
+		x.name_buffers[k] = malloc (x.name_capacity * sizeof (uint32_t));
+		if ( NULL == x.name_buffers[k] )
+			ret = XBWT_RET_NOMEM;
+	}
+
+	if ( XBWT_RET_SUCCESS == ret )
+	{
+		x.names_fd = openScratch ();
+		if ( -1 == x.names_fd )
+			ret = XBWT_RET_SCRATCH;
+	}
+
+	if ( XBWT_RET_SUCCESS == ret )
+		ret = sortRotations (&x);
+
+	closeScratch (x.names_fd);
+	for ( k = 0; k < NUM_NAME_BUFFERS; ++ k )
+		free (x.name_buffers[k]);
+	freeSorter (&x.by_positions);
+	freeSorter (&x.by_names);
+
+	if ( XBWT_RET_SUCCESS != ret )
+	{
+		free (x.output);
+		return ret;
+	}
+
+	*output = x.output;
+	*output_size = BWT_HEADERLEN + input_size;
+
+	return XBWT_RET_SUCCESS;
+}
+/* }}} */
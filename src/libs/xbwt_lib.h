@@ -0,0 +1,52 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef XBWTLIB_H
+#define XBWTLIB_H
+
+/*
+ * the burrows-wheeler transform on disk
+ * -------------------------------------
+ *
+ * xbwt_encode() makes the same block as bwt_encode(), for bwt_decode() to
+ * decode, but sorts the rotations in scratch files so that it takes no
+ * more than memory bytes beyond the input and output -- however large the
+ * input. a memory under XBWT_MIN_MEMORY is taken as XBWT_MIN_MEMORY. when
+ * bwt_encode() would fit in memory it is used instead.
+ *
+ * the rotations are sorted by prefix doubling. each pass sorts them on
+ * twice as many bytes as the last with an external merge sort, so the
+ * scratch files are only ever read and written from one end to the other
+ * and the time taken is mostly that of the disk. there are as many passes
+ * as the log2 of the longest repeat in the input.
+ *
+ * the scratch files are made in $TMPDIR, or /tmp when that isn't set, and
+ * removed as soon as they are opened so that nothing is left behind. at
+ * their largest they take about 40 bytes for every byte of input.
+ */
+
+#define XBWT_MIN_MEMORY		(256UL * 1024)
+
+enum XBWT_RET_CODES
+{
+	XBWT_RET_SUCCESS,
+	XBWT_RET_NOMEM,
+	XBWT_RET_TOOBIG,		/* input is empty or longer than BWT_MAX_INPUT */
+	XBWT_RET_SCRATCH		/* a scratch file couldn't be made, written or read */
+};
+
+int xbwt_encode (unsigned char * input, unsigned long input_size, unsigned char ** output, unsigned long * output_size, unsigned long memory);
+
+#endif /* XBWTLIB_H */
@@ -13,56 +13,236 @@
 // You should have received a copy of the GNU General Public License
 // along with Lick.  If not, see <https://www.gnu.org/licenses/>.
 
+#define _POSIX_C_SOURCE 200112L
+
 #include	<stdlib.h>
 #include	<stdio.h>
 #include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<sys/mman.h>
 
 #include	<crc32_lib.h>
-#include	<llist_lib.h>
+#include	<compress_lib.h>
 
 #include  "types_lib.h"
 #include	"locale.h"
 #include	"fileformat.h"
 #include	"platform.h"
+#include	"delta.h"
+#include	"walk.h"
 #include	"lick.h"
 
 
+/*
+   files are read, checksummed and compressed by a pool of workers, one
+   file each at a time, while the calling thread writes the finished hunks
+   to the archive in turn. workers don't get more than ADD_WINDOW files a
+   thread ahead of the writer, so that only so many files are ever held in
+   memory. the largest files go first, so that the pool isn't left waiting
+   on one large file at the end while the rest of it has nothing to do.
+   files to be streamed go after all of those, whatever their size -- see
+   ADD_STREAM_SIZE. directories named are walked by walk.c, and everything
+   under them added
+ */
+#define ADD_WINDOW		2
+
+/*
+   with ADD_OPT_SOLID, files smaller than ADD_SOLID_SMALL are sorted by
+   extension and then name, so that alike files sit next to each other,
+   and put together in solid hunks of up to a block's worth. a solid hunk
+   is one job for the workers
+ */
+#define ADD_SOLID_SMALL		(64 * 1024)
+
+/*
+   files of ADD_STREAM_SIZE or more aren't read into memory at all. the
+   writer compresses them itself when their turn comes, a block at a time
+   straight into the archive. the stages of the compression after the pre
+   rle each have as many threads as there are processors, so that a large
+   file has the whole machine and not one thread of it. they are left
+   until the workers have taken every other file, so that the two never
+   compete for the processors or for memory, and a streamed file doesn't
+   take up a place in the workers' window that a file they compress could
+   have had
+ */
+#define ADD_STREAM_SIZE		(16UL * 1024 * 1024)
+
+/*
+   with ADD_OPT_UPDATE, a file already in the archive is left alone if its
+   size and modified time are what its entry says. if only the time has
+   changed, a worker reads the file and compares its check sum instead.
+   the hunks of files left alone are never read or copied -- they stay
+   where they are, and only the files that have changed are compressed.
+   a file added again, changed or not, takes the place of its old entries
+   in the directory. a file modified after adding began may have been
+   modified again within the same second, after it was read, so its time
+   isn't kept and the next update compares its check sum
+ */
+
+/*
+   with ADD_OPT_DELTA, a file that is streamed and already in the archive
+   is written as a delta of the version there, its base, unless that is
+   solid or would make a chain of more than ADD_DELTA_CHAIN deltas. the
+   base is restored to a temporary file, the instructions to make the file
+   from it go to another, and they are what is compressed -- unless more
+   than 1 / ADD_DELTA_WORTH of the file had to be written as it is, when
+   the file is compressed whole after all. see delta.c
+ */
+#define ADD_DELTA_CHAIN		7
+#define ADD_DELTA_WORTH		2
+
+enum ADD_STATUSES
+{
+	ADD_OKAY = 0,
+	ADD_NOT_EXIST,			/* the file is skipped */
+	ADD_READ_ERR,				/* the file is skipped */
+	ADD_OUT_OF_MEM,
+	ADD_PLATFORM_ERR,
+	ADD_COMPRESS_ERR,
+	ADD_STREAM,					/* the file is for the writer to stream */
+	ADD_UNCHANGED				/* the file is as its entry says */
+};
+
+struct addJob
+{
+	struct hunkInfo       hunk;
+	int                   status;
+	bool                  done;
+
+	/* a solid job has members -- hunk.file is its first, for messages */
+	struct solidInfo      solid;
+	int *                 member_status;
+
+	/* with ADD_OPT_UPDATE or ADD_OPT_DELTA, the file's entry in the archive */
+	bool                  has_old;
+	unsigned long         old;
+
+	/* with ADD_OPT_UPDATE, when the entry is of the same size, to compare the file with */
+	bool                  compare;
+	unsigned long         old_size;
+	unsigned long         old_checksum;
+
+	/* of the file, or all of a solid job's members, when the jobs are put in order */
+	unsigned long         size;
+};
+
+struct addStream
+{
+	FILE *                archive_h;
+	struct hunkInfo *     hunk;
+};
+
+struct addSmall
+{
+	char *                file;
+	unsigned long         size;
+};
+
+struct addName
+{
+	char *                file;
+	unsigned long         entry;
+};
+
 struct addInfo
 {
 	struct lickOptions *  options;
 
 	FILE *                archive_h;
 
-	unsigned char *       uncompressed_data;
-	struct hunkInfo       hunk;
+	/* the files named, and those under the directories named */
+	struct walkList       files;
+
+	/* of the files already in the archive, and of those added as they are written */
+	struct lickDirectory  dir;
+
+	/* the entries that were in the archive, sorted by name and then by where they are */
+	struct addName *      by_name;
+	unsigned long         old_entries;
+
+	/* with ADD_OPT_DELTA, the hunks that were in the archive, for restoring bases */
+	unsigned char *       map;
+	unsigned long         map_size;
+	struct deltaSource    source;
+
+	/* one for each file, in the order they go into the archive */
+	struct addJob *       jobs;
+	unsigned long         num_jobs;
+
+	/* for the files that are streamed */
+	unsigned int          stage_threads[COMP_STAGE_COUNT];
+	unsigned long         stream_block;
+
+	/* everything below is under lock */
+	pthread_mutex_t       lock;
+	pthread_cond_t        job_done;
+	pthread_cond_t        job_written;
+	unsigned long         next_job;			/* for a worker */
+	unsigned long         next_write;		/* for the writer */
+	unsigned long         window;
+	bool                  abort;
+
+	/* files modified since are given no time in the directory */
+	unsigned long         started;
 
 	unsigned long         added;
+	unsigned long         unchanged;
 	unsigned long         errors;
 };
 
 
 static bool add_cleanup (struct addInfo *info, bool ret_val);
 static bool add_prepareArchive (struct addInfo *info);
+static bool add_prepareJobs (struct addInfo *info);
 static bool add_eachFile (struct addInfo *info);
-static bool add_compressFile (struct addInfo *info);
+static bool add_finishArchive (struct addInfo *info);
+static void add_compressFile (struct addInfo *info, struct addJob *job);
+static void add_compressSolid (struct addInfo *info, struct addJob *job);
+static void add_putU32BitWord (unsigned char *p, unsigned long i);
+
+
+static void
+add_compressJob (struct addInfo *info, struct addJob *job)
+{
+	if (job->solid.num_members > 0)
+		add_compressSolid (info, job);
+	else
+		add_compressFile (info, job);
+}
 
 
 bool
 add (struct lickOptions *options)
 {
 	struct addInfo info;
+	bool ret_val;
 
 	memset (&info, 0, sizeof info);
+	ff_initDirectory (&info.dir);
 
 	info.options = options;
+	info.started = pl_getTime ();
 
 	if (false == add_prepareArchive (&info))
 		return add_cleanup (&info, false);
 
-	if (false == add_eachFile (&info))
+	if (false == add_prepareJobs (&info))
 		return add_cleanup (&info, false);
 
-	return add_cleanup (&info, true);
+	ret_val = add_eachFile (&info);
+
+	/* the files that did get written go in the directory either way */
+	if (false == add_finishArchive (&info))
+		return add_cleanup (&info, false);
+
+	if (options->options & ADD_OPT_UPDATE)
+		printf (LOC_UPDATE_TOTAL, info.added, info.unchanged, info.errors);
+	else
+		printf (LOC_ADD_TOTAL, info.added, info.errors);
+
+	/* a file that couldn't be added fails the whole, as it does extracting */
+	return add_cleanup (&info, ret_val && 0 == info.errors);
 }
 
 
@@ -70,15 +250,72 @@ add (struct lickOptions *options)
 static bool
 add_cleanup (struct addInfo *info, bool ret_val)
 {
+	unsigned long j;
+
 	if (info->archive_h)
 		fclose (info->archive_h);
-	free (info->uncompressed_data);
-	free (info->hunk.compressed_data);
+
+	for (j = 0; j < info->num_jobs; ++ j)
+	{
+		free (info->jobs[j].hunk.compressed_data);
+		free (info->jobs[j].solid.compressed_data);
+		free (info->jobs[j].solid.members);
+		free (info->jobs[j].member_status);
+	}
+	free (info->jobs);
+
+	walk_freeList (&info->files);
+	free (info->by_name);
+	delta_freeSource (&info->source);
+	if (NULL != info->map)
+		munmap (info->map, info->map_size);
+	ff_freeDirectory (&info->dir);
 
 	return ret_val;
 }
 
 
+static int
+add_compareName (const void *a, const void *b)
+{
+	const struct addName *x = a,
+											 *y = b;
+	int c;
+
+	c = strcmp (x->file, y->file);
+	if (0 != c)
+		return c;
+
+	return x->entry < y->entry ? -1 : x->entry > y->entry;
+}
+
+
+/* the entries that were in the archive for the file, as a range of by_name */
+static bool
+add_findEntry (struct addInfo *info, const char *file, unsigned long *first, unsigned long *last)
+{
+	unsigned long lo = 0,
+								hi = info->old_entries,
+								mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (strcmp (info->by_name[mid].file, file) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = lo;
+	for (hi = lo; hi < info->old_entries && 0 == strcmp (info->by_name[hi].file, file); ++ hi)
+		;
+	*last = hi;
+
+	return *first < *last;
+}
+
+
 /* discover the status of the "archive"
 	 return error if it is not a lick file
 	 other return types don't matter for adding */
@@ -86,6 +323,9 @@ static bool
 add_prepareArchive (struct addInfo *info)
 {
 	ARCHIVE_STATUS s;
+	unsigned long end,
+								i;
+	void *map;
 
 	s = ff_checkFile (info->options->archive);
 	if (s == AS_NOT_LICK_FILE)
@@ -97,12 +337,58 @@ add_prepareArchive (struct addInfo *info)
 	/* open archive according to archive status */
 	if (s == AS_LICK_FILE)
 	{
-		info->archive_h = fopen (info->options->archive, "ab+");
+		info->archive_h = fopen (info->options->archive, "rb+");
 		if (NULL == info->archive_h)
 		{
 			printf (LOC_NOT_OPEN_ARC, info->options->archive);
 			return false;
 		}
+
+		/* new hunks go over the old directory */
+		if (false == ff_readDirectory (info->archive_h, &info->dir, &end) || 0 != fseek (info->archive_h, end, SEEK_SET))
+		{
+			printf (LOC_CANT_READ_ARC, info->options->archive);
+			return false;
+		}
+
+		info->old_entries = info->dir.num_entries;
+		if (info->old_entries > 0)
+		{
+			info->by_name = malloc (info->old_entries * sizeof *info->by_name);
+			if (NULL == info->by_name)
+			{
+				puts (LOC_OUT_OF_MEM);
+				return false;
+			}
+
+			for (i = 0; i < info->old_entries; ++ i)
+			{
+				info->by_name[i].file = info->dir.entries[i].file;
+				info->by_name[i].entry = i;
+			}
+
+			qsort (info->by_name, info->old_entries, sizeof *info->by_name, add_compareName);
+		}
+
+		/* new hunks go after end, so what's mapped stays as it is */
+		if ((info->options->options & ADD_OPT_DELTA) && info->old_entries > 0)
+		{
+			map = mmap (NULL, end, PROT_READ, MAP_SHARED, fileno (info->archive_h), 0);
+			if (MAP_FAILED == map)
+			{
+				printf (LOC_CANT_READ_ARC, info->options->archive);
+				return false;
+			}
+
+			info->map = map;
+			info->map_size = end;
+
+			if (false == delta_initSource (&info->source, info->map, info->map_size, &info->dir))
+			{
+				puts (LOC_OUT_OF_MEM);
+				return false;
+			}
+		}
 	}
 	else if (s == AS_NOT_EXIST)
 	{
@@ -128,103 +414,1044 @@ add_prepareArchive (struct addInfo *info)
 }
 
 
-/* step through the nodes in the file
-	 and add each file to the archive */
+/* what follows the last dot of the file's name, or nothing */
+static const char *
+add_extension (const char *file)
+{
+	const char *base,
+						 *dot;
+
+	base = strrchr (file, '/');
+	base = NULL == base ? file : base + 1;
+
+	dot = strrchr (base, '.');
+	return NULL == dot ? "" : dot + 1;
+}
+
+
+static int
+add_compareSmall (const void *a, const void *b)
+{
+	const struct addSmall *x = a,
+												*y = b;
+	int c;
+
+	c = strcmp (add_extension (x->file), add_extension (y->file));
+	if (0 != c)
+		return c;
+
+	return strcmp (x->file, y->file);
+}
+
+
+/* a solid job for each block's worth of small files, once they are sorted.
+	 a file with no others to share with is a job on its own */
 static bool
-add_eachFile (struct addInfo *info)
+add_prepareSolid (struct addInfo *info, struct addSmall *small, unsigned long num_small)
+{
+	struct addJob *job;
+	unsigned long block_size = comp_levelBlockSize (COMP_LEVEL_DEFAULT),
+								used,
+								i, k, m;
+
+	qsort (small, num_small, sizeof *small, add_compareSmall);
+
+	for (i = 0; i < num_small; i = k)
+	{
+		used = 0;
+		for (k = i; k < num_small && (k == i || used + small[k].size <= block_size); ++ k)
+			used += small[k].size;
+
+		job = &info->jobs[info->num_jobs ++];
+		job->hunk.file = small[i].file;
+		job->size = used;
+
+		if (1 == k - i)
+			continue; /* for loop */
+
+		job->solid.members = calloc (k - i, sizeof *job->solid.members);
+		job->member_status = calloc (k - i, sizeof *job->member_status);
+		if (NULL == job->solid.members || NULL == job->member_status)
+		{
+			puts (LOC_OUT_OF_MEM);
+			return false;
+		}
+
+		job->solid.num_members = k - i;
+		for (m = 0; m < k - i; ++ m)
+		{
+			job->solid.members[m].file = small[i + m].file;
+			job->solid.members[m].uncompressed_size = small[i + m].size;
+		}
+	}
+
+	return true;
+}
+
+
+/* whether the file is the archive itself, as it might be in a directory
+	 being added. only a file of the same name is looked at closely */
+static bool
+add_isArchive (struct addInfo *info, char *file)
+{
+	char *a = strrchr (info->options->archive, '/'),
+			 *f = strrchr (file, '/');
+
+	a = NULL == a ? info->options->archive : a + 1;
+	f = NULL == f ? file : f + 1;
+
+	return 0 == strcmp (a, f) && pl_sameFile (info->options->archive, file);
+}
+
+
+/* the largest jobs first, and then by name, with those that are to be
+	 streamed after the rest. a file may have grown or shrunk since it was
+	 walked, and is then only out of place */
+static int
+add_compareJobs (const void *a, const void *b)
+{
+	const struct addJob *x = a,
+											*y = b;
+	bool x_stream = x->size >= ADD_STREAM_SIZE,
+			 y_stream = y->size >= ADD_STREAM_SIZE;
+
+	if (x_stream != y_stream)
+		return x_stream ? 1 : -1;
+
+	if (x->size != y->size)
+		return x->size > y->size ? -1 : 1;
+
+	return strcmp (x->hunk.file, y->hunk.file);
+}
+
+
+/* a job for every file, or with ADD_OPT_SOLID, for every file that isn't
+	 small and every solid group of those that are. with ADD_OPT_UPDATE,
+	 none for the files that are as their entries say */
+static bool
+add_prepareJobs (struct addInfo *info)
+{
+	struct walkFile *f;
+	struct addSmall *small = NULL;
+	struct addJob *job;
+	struct dirEntry *e;
+	unsigned long num_files,
+								num_small = 0,
+								first,
+								last,
+								i;
+	char *file;
+	bool update = 0 != (info->options->options & ADD_OPT_UPDATE),
+			 delta = 0 != (info->options->options & ADD_OPT_DELTA),
+			 compare,
+			 ret_val = true;
+
+	if (false == walk (info->options->files, &info->files))
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	info->errors += info->files.errors;
+
+	num_files = info->files.num_files;
+	if (0 == num_files)
+		return true;
+
+	/* never more jobs than files */
+	info->jobs = calloc (num_files, sizeof *info->jobs);
+	if (NULL == info->jobs)
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	if (info->options->options & ADD_OPT_SOLID)
+	{
+		small = malloc (num_files * sizeof *small);
+		if (NULL == small)
+		{
+			puts (LOC_OUT_OF_MEM);
+			return false;
+		}
+	}
+
+	/* files that can't be opened are left to be reported in their turn */
+	for (i = 0; i < num_files; ++ i)
+	{
+		f = &info->files.files[i];
+		file = walk_name (&info->files, i);
+
+		if (f->stamped && add_isArchive (info, file))
+		{
+			printf (LOC_SKIP_ARCHIVE, file);
+			continue; /* for loop */
+		}
+
+		/* the latest of the file's entries */
+		e = NULL;
+		if (f->stamped && (update || delta) && add_findEntry (info, file, &first, &last))
+			e = &info->dir.entries[info->by_name[last - 1].entry];
+
+		/* an entry of the same size for the file to be compared with */
+		compare = update && NULL != e && f->size == e->uncompressed_size;
+
+		if (compare && f->mtime == e->mtime && 0 != e->mtime)
+		{
+			++ info->unchanged;
+		}
+		else if (NULL != small && f->stamped && f->size < ADD_SOLID_SMALL && false == compare)
+		{
+			small[num_small].file = file;
+			small[num_small].size = f->size;
+			++ num_small;
+		}
+		else
+		{
+			job = &info->jobs[info->num_jobs ++];
+			job->hunk.file = file;
+			job->size = f->size;
+
+			if (NULL != e)
+			{
+				job->has_old = true;
+				job->old = info->by_name[last - 1].entry;
+			}
+
+			/* only the check sum can tell, so the file is a job of its own */
+			if (compare)
+			{
+				job->compare = true;
+				job->old_size = e->uncompressed_size;
+				job->old_checksum = e->checksum;
+			}
+		}
+	}
+
+	if (num_small > 0)
+		ret_val = add_prepareSolid (info, small, num_small);
+
+	free (small);
+
+	qsort (info->jobs, info->num_jobs, sizeof *info->jobs, add_compareJobs);
+
+	return ret_val;
+}
+
+
+/* take files in turn until there are none left or the writer gives up */
+static void *
+add_worker (void *arg)
+{
+	struct addInfo *info = (struct addInfo *) arg;
+	unsigned long j;
+
+	for (;;)
+	{
+		pthread_mutex_lock (&info->lock);
+
+		while (false == info->abort && info->next_job < info->num_jobs && info->next_job >= info->next_write + info->window)
+			pthread_cond_wait (&info->job_written, &info->lock);
+
+		if (true == info->abort || info->next_job >= info->num_jobs)
+		{
+			pthread_mutex_unlock (&info->lock);
+			break; /* for loop */
+		}
+
+		j = info->next_job ++;
+		pthread_mutex_unlock (&info->lock);
+
+		add_compressJob (info, &info->jobs[j]);
+
+		pthread_mutex_lock (&info->lock);
+		info->jobs[j].done = true;
+		pthread_cond_broadcast (&info->job_done);
+		pthread_mutex_unlock (&info->lock);
+	}
+
+	return NULL;
+}
+
+
+/* a compressed block of a streamed file, straight into the archive */
+static bool
+add_streamBlock (unsigned char *output, unsigned long output_size, struct compBlockInfo *block_info, void *data)
+{
+	struct addStream *stream = (struct addStream *) data;
+	unsigned char size[FF_BLOCK_SIZE_LEN];
+
+	add_putU32BitWord (size, output_size);
+
+	if (FF_BLOCK_SIZE_LEN != fwrite (size, sizeof (char), FF_BLOCK_SIZE_LEN, stream->archive_h))
+		return false;
+
+	if (output_size != fwrite (output, sizeof (char), output_size, stream->archive_h))
+		return false;
+
+	stream->hunk->compressed_size += FF_BLOCK_SIZE_LEN + output_size;
+	stream->hunk->checksum = crc_combine (stream->hunk->checksum, block_info->crc, block_info->uncompressed_size);
+	stream->hunk->uncompressed_size += block_info->uncompressed_size;
+
+	return true;
+}
+
+
+/* the data of a stored file, a block at a time */
+static int
+add_streamStored (struct addStream *stream, FILE *h)
+{
+	unsigned char *buffer;
+	unsigned long block_size = comp_levelBlockSize (COMP_LEVEL_DEFAULT),
+								n;
+	int ret = ADD_OKAY;
+
+	buffer = malloc (block_size * sizeof *buffer);
+	if (NULL == buffer)
+		return ADD_OUT_OF_MEM;
+
+	do
+	{
+		n = fread (buffer, sizeof (char), block_size, h);
+		if (n < block_size && 0 != ferror (h))
+		{
+			ret = ADD_READ_ERR;
+			break; /* do loop */
+		}
+
+		if (n != fwrite (buffer, sizeof (char), n, stream->archive_h))
+		{
+			ret = ADD_COMPRESS_ERR;
+			break; /* do loop */
+		}
+
+		stream->hunk->checksum = crc_update (stream->hunk->checksum, buffer, n);
+		stream->hunk->compressed_size += n;
+		stream->hunk->uncompressed_size += n;
+	}
+	while (n == block_size);
+
+	free (buffer);
+
+	return ret;
+}
+
+
+/* with ADD_OPT_DELTA, the instructions that make the file from the
+	 version in the archive, in a temporary file, or NULL if the file is to
+	 be written whole. its size and check sum are those of what was read */
+static FILE *
+add_deltaFile (struct addInfo *info, struct addJob *job, FILE *h, unsigned long *base_size, unsigned long *base_checksum, unsigned long *size, unsigned long *checksum)
+{
+	struct dirEntry *base;
+	FILE *base_h,
+			 *ops;
+	unsigned long literal;
+	int ret;
+
+	if (false == job->has_old || NULL == info->map || CT_BWT != info->options->compress_mode)
+		return NULL;
+
+	base = &info->dir.entries[job->old];
+	if (base->solid || delta_depth (&info->source, base) >= ADD_DELTA_CHAIN)
+		return NULL;
+
+	*base_size = base->uncompressed_size;
+	*base_checksum = base->checksum;
+
+	base_h = tmpfile ();
+	if (NULL == base_h)
+		return NULL;
+
+	/* a base that can't be restored isn't used */
+	ops = tmpfile ();
+	if (NULL == ops || DELTA_OKAY != delta_restore (&info->source, base, base_h))
+	{
+		if (NULL != ops)
+			fclose (ops);
+		fclose (base_h);
+		return NULL;
+	}
+
+	ret = delta_encode (base_h, *base_size, h, ops, size, checksum, &literal);
+	fclose (base_h);
+
+	/* a file that is mostly new isn't worth a base to restore it from */
+	if (DELTA_OKAY != ret || literal > *size / ADD_DELTA_WORTH)
+	{
+		fclose (ops);
+		rewind (h);
+		return NULL;
+	}
+
+	rewind (ops);
+
+	return ops;
+}
+
+
+/* write a file too large for memory, and its sizes and check sum when
+	 they're known. the file's sizes are what was read, however much it has
+	 changed since a worker looked at it */
+static bool
+add_streamFile (struct addInfo *info, struct addJob *job)
+{
+	struct hunkInfo *hunk = &job->hunk;
+	struct addStream stream;
+	struct compressInfo compress_info;
+	struct dirEntry entry;
+	unsigned char head[FF_DELTA_HEAD_LEN];
+	unsigned long base_size = 0,
+								base_checksum = 0,
+								size = 0,
+								checksum = 0;
+	FILE *h,
+			 *ops;
+	int ret;
+
+	h = fopen (hunk->file, "rb");
+	if (NULL == h)
+	{
+		printf (LOC_FILE_NOT_EXIST, hunk->file);
+		++ info->errors;
+		return true;
+	}
+
+	if (0 == pl_getFileInfo (hunk->file, &hunk->fs_info))
+	{
+		puts (LOC_PLATFORM_ERROR);
+		fclose (h);
+		return false;
+	}
+
+	ops = add_deltaFile (info, job, h, &base_size, &base_checksum, &size, &checksum);
+
+	hunk->mode = NULL == ops ? info->options->compress_mode : CT_DELTA;
+	hunk->compressed_size = 0;
+	hunk->uncompressed_size = 0;
+	hunk->checksum = CRC_INIT;
+
+	if (false == ff_beginFile (info->archive_h, hunk, &entry))
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		if (NULL != ops)
+			fclose (ops);
+		fclose (h);
+		return false;
+	}
+
+	if (NULL != ops)
+	{
+		add_putU32BitWord (head, (base_size >> 16) >> 16);
+		add_putU32BitWord (head + 4, base_size);
+		add_putU32BitWord (head + 8, base_checksum);
+
+		if (FF_DELTA_HEAD_LEN != fwrite (head, sizeof (char), FF_DELTA_HEAD_LEN, info->archive_h))
+		{
+			puts (LOC_CANT_WRITE_ARC);
+			fclose (ops);
+			fclose (h);
+			return false;
+		}
+
+		hunk->compressed_size = FF_DELTA_HEAD_LEN;
+	}
+
+	stream.archive_h = info->archive_h;
+	stream.hunk = hunk;
+
+	if (CT_BWT == hunk->mode || CT_DELTA == hunk->mode)
+	{
+		memset (&compress_info, 0, sizeof compress_info);
+		compress_info.compressHook = add_streamBlock;
+		compress_info.compressHook_data = &stream;
+
+		switch (comp_compressFilePipelined (&compress_info, NULL == ops ? h : ops, info->stream_block, info->stage_threads))
+		{
+			case COMP_RET_OKAY:
+				ret = ADD_OKAY;
+				break;
+
+			case COMP_RET_NOMEM:
+				ret = ADD_OUT_OF_MEM;
+				break;
+
+			case COMP_RET_READ:
+				ret = ADD_READ_ERR;
+				break;
+
+			default:
+				ret = ADD_COMPRESS_ERR;
+				break;
+		}
+	}
+	else
+	{
+		ret = add_streamStored (&stream, h);
+	}
+
+	/* a delta's blocks are of its instructions, not the file */
+	if (NULL != ops)
+	{
+		hunk->uncompressed_size = size;
+		hunk->checksum = checksum;
+		fclose (ops);
+	}
+
+	fclose (h);
+
+	/* part of the file may be in the archive already, so nothing can be skipped */
+	switch (ret)
+	{
+		case ADD_OKAY:
+			break;
+
+		case ADD_OUT_OF_MEM:
+			puts (LOC_OUT_OF_MEM);
+			return false;
+
+		case ADD_READ_ERR:
+			printf (LOC_FILE_READ_ERR, hunk->file);
+			return false;
+
+		default:
+			printf (LOC_COMPRESS_ERR, hunk->file);
+			return false;
+	}
+
+	if (false == ff_endFile (info->archive_h, hunk, &entry, &info->dir))
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		return false;
+	}
+
+	++ info->added;
+
+	return true;
+}
+
+
+/* report on the members that couldn't be read and write a solid hunk of the rest */
+static bool
+add_writeSolid (struct addInfo *info, struct addJob *job)
 {
-	struct lnode *n;
+	struct solidInfo *solid = &job->solid;
+	unsigned long i,
+								k = 0;
+
+	for (i = 0; i < solid->num_members; ++ i)
+	{
+		switch (job->member_status[i])
+		{
+			case ADD_NOT_EXIST:
+				printf (LOC_FILE_NOT_EXIST, solid->members[i].file);
+				++ info->errors;
+				continue; /* for loop */
+
+			case ADD_READ_ERR:
+				printf (LOC_FILE_READ_ERR, solid->members[i].file);
+				++ info->errors;
+				continue; /* for loop */
+		}
+
+		solid->members[k ++] = solid->members[i];
+	}
+
+	solid->num_members = k;
+	if (0 == solid->num_members)
+		return true;
 
-	n = ll_initialiseSearch (info->options->files);
-	while (0 == ll_isEndOfList (info->options->files, n))
+	if (false == ff_writeSolid (info->archive_h, solid, &info->dir))
 	{
-		info->hunk.file = (char *) ll_returnNodeData (n);
+		puts (LOC_CANT_WRITE_ARC);
+		return false;
+	}
+
+	info->added += solid->num_members;
 
-		if (0 == add_compressFile (info))
+	return true;
+}
+
+
+/* report on a finished job and write its hunk. false if adding can't go on */
+static bool
+add_writeJob (struct addInfo *info, struct addJob *job)
+{
+	switch (job->status)
+	{
+		case ADD_OKAY:
+			break;
+
+		case ADD_NOT_EXIST:
+			printf (LOC_FILE_NOT_EXIST, job->hunk.file);
+			++ info->errors;
+			return true;
+
+		case ADD_READ_ERR:
+			printf (LOC_FILE_READ_ERR, job->hunk.file);
+			++ info->errors;
+			return true;
+
+		case ADD_OUT_OF_MEM:
+			puts (LOC_OUT_OF_MEM);
+			return false;
+
+		case ADD_PLATFORM_ERR:
+			puts (LOC_PLATFORM_ERROR);
+			return false;
+
+		case ADD_STREAM:
+			return add_streamFile (info, job);
+
+		case ADD_UNCHANGED:
+			/* so that the next update needn't read it again */
+			info->dir.entries[job->old].mtime = job->hunk.mtime;
+			++ info->unchanged;
+			return true;
+
+		default:
+			printf (LOC_COMPRESS_ERR, job->hunk.file);
 			return false;
+	}
+
+	if (job->solid.num_members > 0)
+		return add_writeSolid (info, job);
+
+	if (false == ff_writeFile (info->archive_h, &job->hunk, &info->dir))
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		return false;
+	}
+
+	++ info->added;
+
+	return true;
+}
+
+
+/* a thread for each processor in every stage of the compression of a
+	 streamed file but the pre rle, which is quick, unless there isn't
+	 memory for that many blocks at once, when each stage has one */
+static void
+add_streamThreads (struct addInfo *info, unsigned long threads)
+{
+	unsigned long blocks = 1;
+	int s;
+
+	for (s = 0; s < COMP_STAGE_COUNT; ++ s)
+	{
+		info->stage_threads[s] = COMP_STAGE_PRERLE == s ? 1 : threads;
+		blocks += info->stage_threads[s];
+	}
+
+	info->stream_block = comp_fitBlockSize (comp_levelBlockSize (COMP_LEVEL_DEFAULT), blocks, 0);
+	if (0 == info->stream_block)
+	{
+		for (s = 0; s < COMP_STAGE_COUNT; ++ s)
+			info->stage_threads[s] = 1;
+
+		info->stream_block = comp_levelBlockSize (COMP_LEVEL_DEFAULT);
+	}
+}
+
+
+/* start the workers and write each file's hunk as it is finished,
+	 in the order the files were given */
+static bool
+add_eachFile (struct addInfo *info)
+{
+	pthread_t *ids;
+	unsigned long threads,
+								started = 0,
+								j;
+	long cpus;
+	bool ret_val = true;
+
+	if (0 == info->num_jobs)
+		return true;
+
+	cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	threads = 0 < cpus ? cpus : 1;
+
+	add_streamThreads (info, threads);
+
+	if (threads > info->num_jobs)
+		threads = info->num_jobs;
+
+	ids = malloc (threads * sizeof *ids);
+	if (NULL == ids)
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	pthread_mutex_init (&info->lock, NULL);
+	pthread_cond_init (&info->job_done, NULL);
+	pthread_cond_init (&info->job_written, NULL);
+	info->window = ADD_WINDOW * threads;
+
+	for (started = 0; started < threads; ++ started)
+		if (0 != pthread_create (&ids[started], NULL, add_worker, info))
+			break; /* for loop */
+
+	/* with no workers at all the files are done here, one at a time */
+	if (0 == started)
+		info->window = 1;
+
+	for (j = 0; j < info->num_jobs; ++ j)
+	{
+		if (0 == started)
+			add_compressJob (info, &info->jobs[j]);
+		else
+		{
+			pthread_mutex_lock (&info->lock);
+			while (false == info->jobs[j].done)
+				pthread_cond_wait (&info->job_done, &info->lock);
+			pthread_mutex_unlock (&info->lock);
+		}
+
+		ret_val = add_writeJob (info, &info->jobs[j]);
+
+		/* free memory before the next file */
+		free (info->jobs[j].hunk.compressed_data);
+		info->jobs[j].hunk.compressed_data = NULL;
+		free (info->jobs[j].solid.compressed_data);
+		info->jobs[j].solid.compressed_data = NULL;
+
+		pthread_mutex_lock (&info->lock);
+		info->next_write = j + 1;
+		if (false == ret_val)
+			info->abort = true;
+		pthread_cond_broadcast (&info->job_written);
+		pthread_mutex_unlock (&info->lock);
+
+		if (false == ret_val)
+			break; /* for loop */
+	}
 
-		n = ll_advancePointer (n);
+	while (started > 0)
+		pthread_join (ids[-- started], NULL);
 
-		/* free memory before next iteration */
-		free (info->uncompressed_data);
-		info->uncompressed_data = NULL;
-		free (info->hunk.compressed_data);
-		info->hunk.compressed_data = NULL;
+	free (ids);
+	pthread_cond_destroy (&info->job_written);
+	pthread_cond_destroy (&info->job_done);
+	pthread_mutex_destroy (&info->lock);
+
+	return ret_val;
+}
+
+
+/* the directory after the last of the hunks, and nothing after that */
+static bool
+add_finishArchive (struct addInfo *info)
+{
+	if (false == ff_dropReplaced (&info->dir, info->old_entries))
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	if (false == ff_writeDirectory (info->archive_h, &info->dir)
+			|| 0 != fflush (info->archive_h)
+			|| 0 != ftruncate (fileno (info->archive_h), ftell (info->archive_h)))
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		return false;
+	}
+
+	return true;
+}
+
+
+static void
+add_putU32BitWord (unsigned char *p, unsigned long i)
+{
+	p[0] = (i >> 24) & 0xff;
+	p[1] = (i >> 16) & 0xff;
+	p[2] = (i >> 8) & 0xff;
+	p[3] = i & 0xff;
+}
+
+
+/* the data in blocks, each compressed block preceded by its size */
+static int
+add_crunchBWT (unsigned char *data, unsigned long size, char **compressed, unsigned long *compressed_size)
+{
+	unsigned char *output;
+	unsigned long block_size = comp_levelBlockSize (COMP_LEVEL_DEFAULT),
+								bound = 0,
+								output_size,
+								n,
+								i;
+
+	for (i = 0; i < size; i += n)
+	{
+		n = size - i < block_size ? size - i : block_size;
+		bound += FF_BLOCK_SIZE_LEN + comp_blockBound (n);
+	}
+
+	*compressed_size = 0;
+	if (0 == bound)
+		return ADD_OKAY;
+
+	*compressed = malloc (bound * sizeof **compressed);
+	if (NULL == *compressed)
+		return ADD_OUT_OF_MEM;
+
+	for (i = 0; i < size; i += n)
+	{
+		n = size - i < block_size ? size - i : block_size;
+
+		switch (comp_compressBlock (NULL, data + i, n, &output, &output_size))
+		{
+			case COMP_RET_OKAY:
+				break;
+
+			case COMP_RET_NOMEM:
+				return ADD_OUT_OF_MEM;
+
+			default:
+				return ADD_COMPRESS_ERR;
+		}
+
+		add_putU32BitWord ((unsigned char *) *compressed + *compressed_size, output_size);
+		memcpy (*compressed + *compressed_size + FF_BLOCK_SIZE_LEN, output, output_size);
+		*compressed_size += FF_BLOCK_SIZE_LEN + output_size;
+
+		free (output);
+	}
+
+	return ADD_OKAY;
+}
+
+
+/* compress depending on the mode selected at the command line. data
+	 that is stored as it is, is handed over and *data left NULL */
+static int
+add_crunch (struct addInfo *info, unsigned char **data, unsigned long size, char **compressed, unsigned long *compressed_size)
+{
+	if (info->options->compress_mode == CT_NONE)
+	{
+		/* simple tar like function -- the data is written as it is */
+		*compressed_size = size;
+		*compressed = (char *) *data;
+		*data = NULL;
+		return ADD_OKAY;
+	}
+	else if (info->options->compress_mode == CT_BWT)
+	{
+		return add_crunchBWT (*data, size, compressed, compressed_size);
 	}
 
+	/* unsupported compression modes should have been
+		 caught during command line parsing */
+	return ADD_COMPRESS_ERR;
+}
+
+
+/* the size and time of a file, as they go in the directory */
+static bool
+add_fileStamp (struct addInfo *info, char *file, unsigned long *size, unsigned long *mtime)
+{
+	if (0 == pl_getFileStamp (file, size, mtime))
+		return false;
+
+	if (*mtime >= info->started)
+		*mtime = 0;
+
 	return true;
 }
 
 
+/* whether the rest of a file has the check sum of the entry it is compared with */
+static bool
+add_sameChecksum (struct addJob *job, FILE *h)
+{
+	unsigned char *buffer;
+	unsigned long block_size = comp_levelBlockSize (COMP_LEVEL_DEFAULT),
+								checksum = CRC_INIT,
+								n;
+	bool ret_val;
+
+	if (job->hunk.uncompressed_size != job->old_size)
+		return false;
+
+	buffer = malloc (block_size * sizeof *buffer);
+	if (NULL == buffer)
+		return false;
+
+	do
+	{
+		n = fread (buffer, sizeof (char), block_size, h);
+		checksum = crc_update (checksum, buffer, n);
+	}
+	while (n == block_size);
+
+	ret_val = 0 == ferror (h) && checksum == job->old_checksum;
+
+	free (buffer);
+
+	return ret_val;
+}
+
+
+/* read a file of a size known beforehand into data */
+static int
+add_readFile (char *file, unsigned char *data, unsigned long size)
+{
+	FILE *h;
+	bool ok;
+
+	h = fopen (file, "rb");
+	if (NULL == h)
+		return ADD_NOT_EXIST;
+
+	/* a file that has changed since is taken as unreadable */
+	fseek (h, 0, SEEK_END);
+	ok = (unsigned long) ftell (h) == size;
+	rewind (h);
+
+	if (ok)
+		ok = fread (data, sizeof (char), size, h) == size;
+	fclose (h);
+
+	return ok ? ADD_OKAY : ADD_READ_ERR;
+}
+
+
 /* Checks for files existance, reads file into memory, checksums file,
 	 gets platform specific info and finally compresses the data according
-	 to the compression mode selected at the command line */
-static bool
-add_compressFile (struct addInfo *info)
+	 to the compression mode selected at the command line. called on the
+	 worker threads -- any message is left to the writer */
+static void
+add_compressFile (struct addInfo *info, struct addJob *job)
 {
+	struct hunkInfo *hunk = &job->hunk;
+	unsigned char *uncompressed_data;
+	unsigned long size;
 	FILE *h;
 
-	h = fopen (info->hunk.file, "rb+");
+	h = fopen (hunk->file, "rb");
 	if (NULL == h)
 	{
-		printf (LOC_FILE_NOT_EXIST, info->hunk.file);
-		return true;
+		job->status = ADD_NOT_EXIST;
+		return;
+	}
+
+	/* the time goes in the directory, for when the archive is updated */
+	if (0 == add_fileStamp (info, hunk->file, &size, &hunk->mtime))
+	{
+		job->status = ADD_PLATFORM_ERR;
+		fclose (h);
+		return;
 	}
 
 	/* find the size of the uncompressed file */
 	fseek (h, 0, SEEK_END);
-	info->hunk.uncompressed_size = ftell (h);
+	hunk->uncompressed_size = ftell (h);
 	rewind (h);
 
+	if (hunk->uncompressed_size >= ADD_STREAM_SIZE)
+	{
+		job->status = job->compare && add_sameChecksum (job, h) ? ADD_UNCHANGED : ADD_STREAM;
+		fclose (h);
+		return;
+	}
+
 	/* allocate memory for file and read in data */
-	info->uncompressed_data = malloc (info->hunk.uncompressed_size * sizeof *info->uncompressed_data);
-	if (NULL == info->uncompressed_data)
+	uncompressed_data = malloc ((hunk->uncompressed_size + 1) * sizeof *uncompressed_data);
+	if (NULL == uncompressed_data)
 	{
-		puts (LOC_OUT_OF_MEM);
+		job->status = ADD_OUT_OF_MEM;
 		fclose (h);
-		return false;
+		return;
 	}
-	if (fread (info->uncompressed_data, sizeof (char), info->hunk.uncompressed_size, h) != info->hunk.uncompressed_size)
+	if (fread (uncompressed_data, sizeof (char), hunk->uncompressed_size, h) != hunk->uncompressed_size)
 	{
-		printf (LOC_FILE_READ_ERR, info->hunk.file);
+		job->status = ADD_READ_ERR;			/* dependent on tolerance level? */
+		free (uncompressed_data);
 		fclose (h);
-		return true;			/* dependent on tolerance level? */
+		return;
 	}
 	fclose (h);
 
 	/* generate checksum */
-	info->hunk.checksum = crc_generate (info->uncompressed_data, info->hunk.uncompressed_size);
+	hunk->checksum = crc_generate (uncompressed_data, hunk->uncompressed_size);
+
+	if (job->compare && hunk->uncompressed_size == job->old_size && hunk->checksum == job->old_checksum)
+	{
+		job->status = ADD_UNCHANGED;
+		free (uncompressed_data);
+		return;
+	}
 
 	/* get platform infomation */
-	if (0 == pl_getFileInfo (info->hunk.file, &info->hunk.fs_info))
+	if (0 == pl_getFileInfo (hunk->file, &hunk->fs_info))
 	{
-		puts (LOC_PLATFORM_ERROR);
-		return false;
+		job->status = ADD_PLATFORM_ERR;
+		free (uncompressed_data);
+		return;
 	}
 
+	hunk->mode = info->options->compress_mode;
+	job->status = add_crunch (info, &uncompressed_data, hunk->uncompressed_size, &hunk->compressed_data, &hunk->compressed_size);
 
-	/* compress depending on selected mode */
-	info->hunk.mode = info->options->compress_mode;
-	if (info->options->compress_mode == CT_NONE)
+	free (uncompressed_data);
+}
+
+
+/* reads each member of a solid job in turn, one after the other into the
+	 one buffer, and compresses them together. a member that can't be read
+	 is left out, for the writer to report */
+static void
+add_compressSolid (struct addInfo *info, struct addJob *job)
+{
+	struct solidInfo *solid = &job->solid;
+	struct hunkInfo *m;
+	unsigned char *uncompressed_data;
+	unsigned long total = 0,
+								size,
+								i;
+
+	for (i = 0; i < solid->num_members; ++ i)
+		total += solid->members[i].uncompressed_size;
+
+	uncompressed_data = malloc ((total + 1) * sizeof *uncompressed_data);
+	if (NULL == uncompressed_data)
 	{
-		/* simple tar like function */
-		info->hunk.compressed_size = info->hunk.uncompressed_size;
-		info->hunk.compressed_data = malloc (info->hunk.compressed_size * sizeof *info->hunk.compressed_data);
-		if (NULL == info->hunk.compressed_data)
-		{
-			puts (LOC_OUT_OF_MEM);
-			fclose (h);
-			return false;
-		}
-		memcpy (info->hunk.compressed_data, info->uncompressed_data, info->hunk.compressed_size);
+		job->status = ADD_OUT_OF_MEM;
+		return;
 	}
-	else
+
+	solid->uncompressed_size = 0;
+	for (i = 0; i < solid->num_members; ++ i)
 	{
-		/* unsupported compression modes should have been
-			 caught during command line parsing */
-		puts (LOC_BAD_COMPRESS);
-		return false;
+		m = &solid->members[i];
+
+		if (0 == add_fileStamp (info, m->file, &size, &m->mtime))
+		{
+			job->member_status[i] = ADD_NOT_EXIST;
+			continue; /* for loop */
+		}
+
+		job->member_status[i] = add_readFile (m->file, uncompressed_data + solid->uncompressed_size, m->uncompressed_size);
+		if (ADD_OKAY != job->member_status[i])
+			continue; /* for loop */
+
+		if (0 == pl_getFileInfo (m->file, &m->fs_info))
+		{
+			job->status = ADD_PLATFORM_ERR;
+			free (uncompressed_data);
+			return;
+		}
+
+		m->offset = solid->uncompressed_size;
+		m->checksum = crc_generate (uncompressed_data + m->offset, m->uncompressed_size);
+		solid->uncompressed_size += m->uncompressed_size;
 	}
 
-	return ff_writeFile (info->archive_h, &info->hunk);
+	solid->mode = info->options->compress_mode;
+	job->status = add_crunch (info, &uncompressed_data, solid->uncompressed_size, &solid->compressed_data, &solid->compressed_size);
+
+	free (uncompressed_data);
 }
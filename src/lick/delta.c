@@ -0,0 +1,801 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdint.h>
+#include	<sys/mman.h>
+
+#include	<crc32_lib.h>
+#include	<compress_lib.h>
+
+#include  "types_lib.h"
+#include	"fileformat.h"
+#include	"platform.h"
+#include	"lick.h"
+#include	"delta.h"
+
+
+/*
+   a delta is the data of a file where it isn't in its base, and copies
+   of the base where it is. the copies are found by sampling the base
+   every DELTA_STRIDE bytes, hashing the DELTA_WINDOW bytes there, and
+   rolling the same hash along the file. a window of the file that is
+   also in the base is then matched as far as it goes either way, so
+   that a change of a few bytes costs not much more than those bytes.
+
+   the instructions are numbers of seven bits to the byte, least first,
+   the top bit set on all but the last. each is
+
+   literal            (number)   -- how much data of the file follows
+   data               (literal bytes)
+   length             (number)   -- how much of the base to copy
+   jump               (number)   -- where from, forward of the end of the
+                                    last copy by jump / 2, or, with the
+                                    bottom bit set, back by jump / 2 + 1
+
+   they are compressed in blocks, as the data of any other hunk, and go
+   on from one block to the next. the base is the whole of the file the
+   delta was made against, restored first -- it can be a delta too, of an
+   older version
+ */
+
+/* deltas of deltas go no deeper than this, whatever an archive says */
+#define DELTA_MAX_DEPTH		64
+
+#define DELTA_WINDOW			32
+#define DELTA_STRIDE			16
+#define DELTA_PRIME				0x100000001b3ULL
+
+/* samples of the base, at eight bytes each. a base of more than
+	 DELTA_STRIDE times as many bytes shares them out */
+#define DELTA_MAX_SLOTS		(1UL << 24)
+
+#define DELTA_BUFFER_SIZE	(1UL << 20)
+
+struct deltaOutput
+{
+	FILE *                out;
+	unsigned long         size;
+	unsigned long         done;
+	unsigned long         crc;
+};
+
+/* the instructions of a delta, a block at a time */
+struct deltaReader
+{
+	struct dirEntry *     e;
+	unsigned char *       hunk;
+	unsigned long         i;
+
+	unsigned char *       block;
+	unsigned long         size;
+	unsigned long         pos;
+};
+
+struct deltaEncoder
+{
+	unsigned char *       base;
+	unsigned long         base_size;
+	unsigned long *       slots;
+	unsigned int          shift;
+
+	FILE *                input;
+	FILE *                ops;
+
+	/* the file, from the first byte not yet written */
+	unsigned char *       buffer;
+	unsigned long         length;
+	unsigned long         literal_start;
+	unsigned long         cursor;
+	bool                  end;
+
+	/* the multiplier of the byte leaving the window */
+	uint64_t              power;
+
+	/* the end of the last copy */
+	unsigned long         offset;
+
+	unsigned long         size;
+	unsigned long         crc;
+	unsigned long         literal;
+};
+
+
+static unsigned long
+delta_getU32 (unsigned char *p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+
+static unsigned long
+delta_getU64 (unsigned char *p)
+{
+	return ((delta_getU32 (p) << 16) << 16) | delta_getU32 (p + 4);
+}
+
+
+static struct lickDirectory *delta_sortDir;
+
+static int
+delta_compareNames (const void *a, const void *b)
+{
+	return strcmp (delta_sortDir->entries[*(const unsigned long *) a].file, delta_sortDir->entries[*(const unsigned long *) b].file);
+}
+
+
+bool
+delta_initSource (struct deltaSource *src, unsigned char *map, unsigned long map_size, struct lickDirectory *dir)
+{
+	unsigned long i;
+
+	src->map = map;
+	src->map_size = map_size;
+	src->dir = dir;
+	src->num = dir->num_entries;
+
+	src->by_name = malloc ((src->num + 1) * sizeof *src->by_name);
+	if (NULL == src->by_name)
+		return false;
+
+	for (i = 0; i < src->num; ++ i)
+		src->by_name[i] = i;
+
+	delta_sortDir = dir;
+	qsort (src->by_name, src->num, sizeof *src->by_name, delta_compareNames);
+
+	return true;
+}
+
+
+void
+delta_freeSource (struct deltaSource *src)
+{
+	free (src->by_name);
+	src->by_name = NULL;
+	src->num = 0;
+}
+
+
+static bool
+delta_inMap (struct deltaSource *src, struct dirEntry *e)
+{
+	return e->data_offset <= src->map_size && e->compressed_size <= src->map_size - e->data_offset;
+}
+
+
+/* the entry of the same name, and of the size and check sum the delta gives */
+static struct dirEntry *
+delta_findBase (struct deltaSource *src, struct dirEntry *e)
+{
+	struct dirEntry *b;
+	unsigned char *head;
+	unsigned long size,
+								checksum,
+								lo = 0,
+								hi = src->num,
+								mid;
+
+	if (CT_DELTA != e->mode || false == delta_inMap (src, e) || e->compressed_size < FF_DELTA_HEAD_LEN)
+		return NULL;
+
+	head = src->map + e->data_offset;
+	size = delta_getU64 (head);
+	checksum = delta_getU32 (head + 8);
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (strcmp (src->dir->entries[src->by_name[mid]].file, e->file) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < src->num; ++ lo)
+	{
+		b = &src->dir->entries[src->by_name[lo]];
+		if (0 != strcmp (b->file, e->file))
+			break; /* for loop */
+
+		if (b != e && false == b->solid && size == b->uncompressed_size && checksum == b->checksum)
+			return b;
+	}
+
+	return NULL;
+}
+
+
+unsigned long
+delta_depth (struct deltaSource *src, struct dirEntry *e)
+{
+	unsigned long depth = 0;
+
+	while (CT_DELTA == e->mode && depth <= DELTA_MAX_DEPTH)
+	{
+		e = delta_findBase (src, e);
+		if (NULL == e)
+			return DELTA_MAX_DEPTH + 1;
+
+		++ depth;
+	}
+
+	return depth;
+}
+
+
+static int
+delta_write (struct deltaOutput *o, unsigned char *data, unsigned long size)
+{
+	if (size > o->size - o->done)
+		return DELTA_CORRUPT;
+
+	if (NULL != o->out && false == pl_writeSparse (o->out, data, size))
+		return DELTA_WRITE_ERR;
+
+	o->crc = crc_update (o->crc, data, size);
+	o->done += size;
+
+	return DELTA_OKAY;
+}
+
+
+/* the next block of instructions, from the hunk */
+static int
+delta_nextBlock (struct deltaReader *r)
+{
+	unsigned long block;
+
+	free (r->block);
+	r->block = NULL;
+	r->size = r->pos = 0;
+
+	if (r->e->compressed_size - r->i < FF_BLOCK_SIZE_LEN)
+		return DELTA_CORRUPT;
+
+	block = delta_getU32 (r->hunk + r->i);
+	r->i += FF_BLOCK_SIZE_LEN;
+
+	if (block > r->e->compressed_size - r->i)
+		return DELTA_CORRUPT;
+
+	switch (comp_decompressBlock (NULL, r->hunk + r->i, block, &r->block, &r->size))
+	{
+		case COMP_RET_OKAY:
+			break;
+
+		case COMP_RET_NOMEM:
+			r->block = NULL;
+			return DELTA_OUT_OF_MEM;
+
+		default:
+			r->block = NULL;
+			return DELTA_CORRUPT;
+	}
+
+	r->i += block;
+
+	return DELTA_OKAY;
+}
+
+
+/* the instructions go on from one block to the next */
+static int
+delta_getByte (struct deltaReader *r, unsigned char *c)
+{
+	int ret;
+
+	while (r->pos == r->size)
+	{
+		ret = delta_nextBlock (r);
+		if (DELTA_OKAY != ret)
+			return ret;
+	}
+
+	*c = r->block[r->pos ++];
+
+	return DELTA_OKAY;
+}
+
+
+static int
+delta_getNumber (struct deltaReader *r, unsigned long *n)
+{
+	unsigned char c;
+	unsigned int shift = 0;
+	int ret;
+
+	*n = 0;
+
+	do
+	{
+		ret = delta_getByte (r, &c);
+		if (DELTA_OKAY != ret)
+			return ret;
+
+		if (shift >= 64 || (shift > 0 && (c & 0x7f) >> (64 - shift) != 0))
+			return DELTA_CORRUPT;
+
+		*n |= (unsigned long) (c & 0x7f) << shift;
+		shift += 7;
+	}
+	while (c & 0x80);
+
+	return DELTA_OKAY;
+}
+
+
+static int
+delta_literal (struct deltaReader *r, struct deltaOutput *o, unsigned long length)
+{
+	unsigned long n;
+	int ret;
+
+	while (length > 0)
+	{
+		while (r->pos == r->size)
+		{
+			ret = delta_nextBlock (r);
+			if (DELTA_OKAY != ret)
+				return ret;
+		}
+
+		n = r->size - r->pos;
+		if (n > length)
+			n = length;
+
+		ret = delta_write (o, r->block + r->pos, n);
+		if (DELTA_OKAY != ret)
+			return ret;
+
+		r->pos += n;
+		length -= n;
+	}
+
+	return DELTA_OKAY;
+}
+
+
+/* the instructions of a delta, with its base in memory */
+static int
+delta_apply (struct deltaReader *r, struct deltaOutput *o, unsigned char *base, unsigned long base_size)
+{
+	unsigned long literal,
+								length,
+								jump,
+								offset = 0;
+	int ret = DELTA_OKAY;
+
+	while (DELTA_OKAY == ret && (r->pos < r->size || r->i < r->e->compressed_size))
+	{
+		ret = delta_getNumber (r, &literal);
+		if (DELTA_OKAY == ret)
+			ret = delta_literal (r, o, literal);
+		if (DELTA_OKAY == ret)
+			ret = delta_getNumber (r, &length);
+		if (DELTA_OKAY == ret)
+			ret = delta_getNumber (r, &jump);
+		if (DELTA_OKAY != ret)
+			break; /* while loop */
+
+		/* where the copy is from, back or forward from the end of the last */
+		if (jump & 1)
+		{
+			if ((jump >> 1) + 1 > offset)
+				return DELTA_CORRUPT;
+			offset -= (jump >> 1) + 1;
+		}
+		else
+		{
+			if ((jump >> 1) > base_size - offset)
+				return DELTA_CORRUPT;
+			offset += jump >> 1;
+		}
+
+		if (length > base_size - offset)
+			return DELTA_CORRUPT;
+
+		if (length > 0)
+			ret = delta_write (o, base + offset, length);
+		offset += length;
+	}
+
+	return ret;
+}
+
+
+static int
+delta_restoreDepth (struct deltaSource *src, struct dirEntry *e, FILE *out, unsigned long depth)
+{
+	struct deltaOutput o;
+	struct deltaReader r;
+	struct dirEntry *b;
+	FILE *base;
+	unsigned char *base_map = NULL;
+	int ret = DELTA_OKAY;
+
+	if (false == delta_inMap (src, e) || e->solid || depth > DELTA_MAX_DEPTH)
+		return DELTA_CORRUPT;
+
+	memset (&o, 0, sizeof o);
+	o.out = out;
+	o.size = e->uncompressed_size;
+	o.crc = CRC_INIT;
+
+	memset (&r, 0, sizeof r);
+	r.e = e;
+	r.hunk = src->map + e->data_offset;
+
+	if (CT_NONE == e->mode)
+	{
+		if (e->uncompressed_size > e->compressed_size)
+			ret = DELTA_CORRUPT;
+		else
+			ret = delta_write (&o, r.hunk, e->uncompressed_size);
+	}
+	else if (CT_BWT == e->mode)
+	{
+		while (DELTA_OKAY == ret && r.i < e->compressed_size)
+		{
+			ret = delta_nextBlock (&r);
+			if (DELTA_OKAY == ret)
+				ret = delta_write (&o, r.block, r.size);
+		}
+	}
+	else if (CT_DELTA == e->mode)
+	{
+		b = delta_findBase (src, e);
+		if (NULL == b)
+			return DELTA_CORRUPT;
+
+		base = tmpfile ();
+		if (NULL == base)
+			return DELTA_WRITE_ERR;
+
+		ret = delta_restoreDepth (src, b, base, depth + 1);
+
+		if (DELTA_OKAY == ret && b->uncompressed_size > 0)
+		{
+			base_map = mmap (NULL, b->uncompressed_size, PROT_READ, MAP_PRIVATE, fileno (base), 0);
+			if (MAP_FAILED == base_map)
+			{
+				base_map = NULL;
+				ret = DELTA_OUT_OF_MEM;
+			}
+		}
+
+		r.i = FF_DELTA_HEAD_LEN;
+
+		if (DELTA_OKAY == ret)
+			ret = delta_apply (&r, &o, base_map, b->uncompressed_size);
+
+		if (NULL != base_map)
+			munmap (base_map, b->uncompressed_size);
+		fclose (base);
+	}
+	else
+	{
+		ret = DELTA_CORRUPT;
+	}
+
+	free (r.block);
+
+	if (DELTA_OKAY == ret && o.done != e->uncompressed_size)
+		ret = DELTA_CORRUPT;
+
+	if (DELTA_OKAY == ret && o.crc != e->checksum)
+		ret = DELTA_BAD_CRC;
+
+	if (DELTA_OKAY == ret && NULL != out && false == pl_endSparse (out))
+		ret = DELTA_WRITE_ERR;
+
+	return ret;
+}
+
+
+int
+delta_restore (struct deltaSource *src, struct dirEntry *e, FILE *out)
+{
+	return delta_restoreDepth (src, e, out, 0);
+}
+
+
+static uint64_t
+delta_hashWindow (unsigned char *p)
+{
+	uint64_t h = 0;
+	unsigned int i;
+
+	for (i = 0; i < DELTA_WINDOW; ++ i)
+		h = h * DELTA_PRIME + p[i] + 1;
+
+	return h;
+}
+
+
+static unsigned long
+delta_slot (struct deltaEncoder *d, uint64_t h)
+{
+	return (unsigned long) ((h * 0x9e3779b97f4a7c15ULL) >> d->shift);
+}
+
+
+/* a sample of the base every DELTA_STRIDE bytes. where two fall in the
+	 same slot, the later is kept. a sample that is the same as the one
+	 before it is part of a run, which is copied from where it starts */
+static bool
+delta_index (struct deltaEncoder *d)
+{
+	unsigned long slots = 1,
+								pos;
+
+	d->shift = 64;
+	while (slots < d->base_size / DELTA_STRIDE && slots < DELTA_MAX_SLOTS)
+	{
+		slots <<= 1;
+		-- d->shift;
+	}
+
+	/* the shift can't be the whole width of the hash */
+	if (64 == d->shift)
+	{
+		slots = 2;
+		d->shift = 63;
+	}
+
+	d->slots = calloc (slots, sizeof *d->slots);
+	if (NULL == d->slots)
+		return false;
+
+	for (pos = 0; d->base_size >= DELTA_WINDOW && pos <= d->base_size - DELTA_WINDOW; pos += DELTA_STRIDE)
+	{
+		if (pos > 0 && 0 == memcmp (d->base + pos, d->base + pos - DELTA_STRIDE, DELTA_WINDOW))
+			continue; /* for loop */
+
+		d->slots[delta_slot (d, delta_hashWindow (d->base + pos))] = pos + 1;
+	}
+
+	return true;
+}
+
+
+static bool
+delta_putNumber (struct deltaEncoder *d, unsigned long n)
+{
+	do
+	{
+		if (EOF == fputc (n > 0x7f ? (int) (n & 0x7f) | 0x80 : (int) n, d->ops))
+			return false;
+
+		n >>= 7;
+	}
+	while (n > 0);
+
+	return true;
+}
+
+
+/* the data of the file since the last copy, and then a copy from the base.
+	 a copy of nothing ends a file that doesn't end with one */
+static bool
+delta_putCopy (struct deltaEncoder *d, unsigned long offset, unsigned long length)
+{
+	unsigned long literal = d->cursor - d->literal_start,
+								jump;
+
+	if (false == delta_putNumber (d, literal)
+			|| literal != fwrite (d->buffer + d->literal_start, sizeof (char), literal, d->ops))
+		return false;
+
+	d->literal += literal;
+
+	if (offset >= d->offset)
+		jump = (offset - d->offset) << 1;
+	else
+		jump = ((d->offset - offset - 1) << 1) | 1;
+
+	if (false == delta_putNumber (d, length) || false == delta_putNumber (d, jump))
+		return false;
+
+	d->offset = offset + length;
+	d->cursor += length;
+	d->literal_start = d->cursor;
+
+	return true;
+}
+
+
+/* more of the file, after what has been dealt with. what has yet to be
+	 written as data is kept */
+static int
+delta_fill (struct deltaEncoder *d)
+{
+	unsigned long size;
+
+	if (d->literal_start > 0)
+	{
+		memmove (d->buffer, d->buffer + d->literal_start, d->length - d->literal_start);
+		d->length -= d->literal_start;
+		d->cursor -= d->literal_start;
+		d->literal_start = 0;
+	}
+
+	size = fread (d->buffer + d->length, sizeof (char), DELTA_BUFFER_SIZE - d->length, d->input);
+	if (size < DELTA_BUFFER_SIZE - d->length)
+	{
+		if (ferror (d->input))
+			return DELTA_READ_ERR;
+
+		d->end = true;
+	}
+
+	d->crc = crc_update (d->crc, d->buffer + d->length, size);
+	d->size += size;
+	d->length += size;
+
+	return DELTA_OKAY;
+}
+
+
+/* the copy that starts with a match of a whole window at the cursor, made
+	 as long as it can be either way */
+static int
+delta_match (struct deltaEncoder *d, unsigned long offset)
+{
+	unsigned long length = 0,
+								start;
+	int ret;
+
+	while (d->cursor > d->literal_start && offset > 0 && d->buffer[d->cursor - 1] == d->base[offset - 1])
+	{
+		-- d->cursor;
+		-- offset;
+	}
+
+	start = offset;
+
+	for (;;)
+	{
+		while (d->cursor + length < d->length && offset + length < d->base_size
+				&& d->buffer[d->cursor + length] == d->base[offset + length])
+			++ length;
+
+		if (d->cursor + length < d->length || offset + length == d->base_size || d->end)
+			break; /* for loop */
+
+		/* what has matched so far is written, and it goes on with more of the file */
+		if (false == delta_putCopy (d, start, length))
+			return DELTA_WRITE_ERR;
+
+		offset += length;
+		start = offset;
+		length = 0;
+
+		ret = delta_fill (d);
+		if (DELTA_OKAY != ret)
+			return ret;
+	}
+
+	return delta_putCopy (d, start, length) ? DELTA_OKAY : DELTA_WRITE_ERR;
+}
+
+
+static int
+delta_scan (struct deltaEncoder *d)
+{
+	unsigned long pos;
+	uint64_t h = 0;
+	bool hashed = false;
+	int ret;
+
+	for (;;)
+	{
+		/* a window's worth of the file at the cursor, unless it has come to the end */
+		if (d->length - d->cursor < DELTA_WINDOW && false == d->end)
+		{
+			/* data that's been waiting too long for a copy is written as it is */
+			if (d->cursor - d->literal_start > DELTA_BUFFER_SIZE / 2 && false == delta_putCopy (d, d->offset, 0))
+				return DELTA_WRITE_ERR;
+
+			ret = delta_fill (d);
+			if (DELTA_OKAY != ret)
+				return ret;
+
+			/* the byte before the cursor may have gone */
+			hashed = false;
+			continue; /* for loop */
+		}
+
+		if (d->length - d->cursor < DELTA_WINDOW)
+			break; /* for loop */
+
+		if (hashed)
+			h = (h - (d->buffer[d->cursor - 1] + 1) * d->power) * DELTA_PRIME + d->buffer[d->cursor + DELTA_WINDOW - 1] + 1;
+		else
+			h = delta_hashWindow (d->buffer + d->cursor);
+		hashed = true;
+
+		pos = d->slots[delta_slot (d, h)];
+		if (0 != pos && 0 == memcmp (d->buffer + d->cursor, d->base + pos - 1, DELTA_WINDOW))
+		{
+			ret = delta_match (d, pos - 1);
+			if (DELTA_OKAY != ret)
+				return ret;
+
+			hashed = false;
+			continue; /* for loop */
+		}
+
+		++ d->cursor;
+	}
+
+	/* the rest of the file, after the last copy */
+	d->cursor = d->length;
+
+	return delta_putCopy (d, d->offset, 0) ? DELTA_OKAY : DELTA_WRITE_ERR;
+}
+
+
+int
+delta_encode (FILE *base, unsigned long base_size, FILE *input, FILE *ops, unsigned long *size, unsigned long *checksum, unsigned long *literal)
+{
+	struct deltaEncoder d;
+	unsigned int i;
+	int ret;
+
+	memset (&d, 0, sizeof d);
+	d.base_size = base_size;
+	d.input = input;
+	d.ops = ops;
+	d.crc = CRC_INIT;
+
+	d.power = 1;
+	for (i = 1; i < DELTA_WINDOW; ++ i)
+		d.power *= DELTA_PRIME;
+
+	if (base_size > 0)
+	{
+		if (0 != fflush (base))
+			return DELTA_READ_ERR;
+
+		d.base = mmap (NULL, base_size, PROT_READ, MAP_PRIVATE, fileno (base), 0);
+		if (MAP_FAILED == d.base)
+			return DELTA_OUT_OF_MEM;
+	}
+
+	d.buffer = malloc (DELTA_BUFFER_SIZE * sizeof *d.buffer);
+	if (NULL == d.buffer || false == delta_index (&d))
+		ret = DELTA_OUT_OF_MEM;
+	else
+		ret = delta_scan (&d);
+
+	if (DELTA_OKAY == ret && 0 != fflush (ops))
+		ret = DELTA_WRITE_ERR;
+
+	*size = d.size;
+	*checksum = d.crc;
+	*literal = d.literal;
+
+	free (d.slots);
+	free (d.buffer);
+	if (base_size > 0)
+		munmap (d.base, base_size);
+
+	return ret;
+}
@@ -0,0 +1,64 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include	<stdio.h>
+
+#include	"types_lib.h"
+#include	"fileformat.h"
+
+enum DELTA_STATUSES
+{
+	DELTA_OKAY = 0,
+	DELTA_CORRUPT,
+	DELTA_BAD_CRC,
+	DELTA_OUT_OF_MEM,
+	DELTA_READ_ERR,
+	DELTA_WRITE_ERR
+};
+
+/* the hunks of an archive, in memory, and its directory by name */
+struct deltaSource
+{
+	unsigned char *       map;
+	unsigned long         map_size;
+	struct lickDirectory *dir;
+
+	/* the entries there were when it was made, sorted by name */
+	unsigned long *       by_name;
+	unsigned long         num;
+};
+
+bool delta_initSource (struct deltaSource *, unsigned char *map, unsigned long map_size, struct lickDirectory *dir);
+void delta_freeSource (struct deltaSource *);
+
+/* how many deltas there are to go through to restore an entry. 0 for one
+	 that isn't a delta, and more than any chain could be for one whose base
+	 can't be found */
+unsigned long delta_depth (struct deltaSource *, struct dirEntry *);
+
+/* the file of an entry with a hunk of its own, into out, or only checked
+	 if out is NULL. its size and check sum are checked either way */
+int delta_restore (struct deltaSource *, struct dirEntry *, FILE *out);
+
+/* the instructions that make the file read from input out of the base,
+	 into ops, which are then compressed as the data of a CT_DELTA hunk.
+	 base is a file of base_size bytes. literal is how much of the file
+	 isn't to be found in the base */
+int delta_encode (FILE *base, unsigned long base_size, FILE *input, FILE *ops, unsigned long *size, unsigned long *checksum, unsigned long *literal);
+
+#endif /* DELTA_H */
@@ -0,0 +1,785 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<sys/mman.h>
+
+#include	<crc32_lib.h>
+#include	<llist_lib.h>
+#include	<compress_lib.h>
+
+#include  "types_lib.h"
+#include	"locale.h"
+#include	"fileformat.h"
+#include	"platform.h"
+#include	"delta.h"
+#include	"lick.h"
+
+
+/*
+   the archive is mapped into memory and its files found from the
+   directory. a job is a hunk -- a file, or all the files wanted of a
+   solid hunk -- which a worker decompresses, checks and writes out
+   without waiting on any other. the messages wait until the workers are
+   done, and are given in the order of the directory
+ */
+
+enum EXTRACT_STATUSES
+{
+	EXT_SKIPPED = 0,		/* not wanted */
+	EXT_OKAY,
+	EXT_EXISTS,
+	EXT_BAD_CRC,
+	EXT_CORRUPT,
+	EXT_OUT_OF_MEM,
+	EXT_WRITE_ERR,
+	EXT_UNSAFE					/* its name leads out of where files are extracted */
+};
+
+struct extractJob
+{
+	unsigned long         first;			/* in order */
+	unsigned long         num;
+};
+
+struct extractInfo
+{
+	struct lickOptions *  options;
+	bool                  test;
+
+	unsigned char *       map;
+	unsigned long         map_size;
+
+	struct lickDirectory  dir;
+	struct deltaSource    source;			/* for finding the bases of deltas */
+	int *                 status;			/* for each entry */
+	unsigned long         missing;		/* files named that aren't in the archive */
+
+	/* the entries in the order of their data, so that a hunk's are together */
+	unsigned long *       order;
+
+	struct extractJob *   jobs;
+	unsigned long         num_jobs;
+
+	/* under lock */
+	pthread_mutex_t       lock;
+	unsigned long         next_job;
+};
+
+
+static bool extract_cleanup (struct extractInfo *info, bool ret_val);
+static bool extract_mapArchive (struct extractInfo *info);
+static bool extract_chooseFiles (struct extractInfo *info);
+static bool extract_prepareJobs (struct extractInfo *info);
+static void extract_eachHunk (struct extractInfo *info);
+static bool extract_report (struct extractInfo *info);
+
+
+bool
+extract (struct lickOptions *options)
+{
+	struct extractInfo info;
+
+	memset (&info, 0, sizeof info);
+	ff_initDirectory (&info.dir);
+
+	info.options = options;
+	info.test = LA_TEST == options->action;
+
+	if (false == extract_mapArchive (&info))
+		return extract_cleanup (&info, false);
+
+	if (false == extract_chooseFiles (&info))
+		return extract_cleanup (&info, false);
+
+	if (false == extract_prepareJobs (&info))
+		return extract_cleanup (&info, false);
+
+	extract_eachHunk (&info);
+
+	return extract_cleanup (&info, extract_report (&info));
+}
+
+
+static bool
+extract_cleanup (struct extractInfo *info, bool ret_val)
+{
+	if (NULL != info->map)
+		munmap (info->map, info->map_size);
+
+	delta_freeSource (&info->source);
+	ff_freeDirectory (&info->dir);
+	free (info->status);
+	free (info->order);
+	free (info->jobs);
+
+	return ret_val;
+}
+
+
+/* the directory, and the whole of the archive in memory */
+static bool
+extract_mapArchive (struct extractInfo *info)
+{
+	FILE *h;
+	unsigned long end;
+	void *map;
+
+	switch (ff_checkFile (info->options->archive))
+	{
+		case AS_NOT_EXIST:
+			printf (LOC_NOT_OPEN_ARC, info->options->archive);
+			return false;
+
+		case AS_NOT_LICK_FILE:
+			printf (LOC_AS_NOT_LICK_FILE, info->options->archive);
+			return false;
+	}
+
+	h = fopen (info->options->archive, "rb");
+	if (NULL == h)
+	{
+		printf (LOC_NOT_OPEN_ARC, info->options->archive);
+		return false;
+	}
+
+	if (false == ff_readDirectory (h, &info->dir, &end))
+	{
+		printf (LOC_CANT_READ_ARC, info->options->archive);
+		fclose (h);
+		return false;
+	}
+
+	fseek (h, 0, SEEK_END);
+	info->map_size = ftell (h);
+
+	map = mmap (NULL, info->map_size, PROT_READ, MAP_PRIVATE, fileno (h), 0);
+	fclose (h);
+
+	if (MAP_FAILED == map)
+	{
+		printf (LOC_CANT_READ_ARC, info->options->archive);
+		return false;
+	}
+
+	info->map = map;
+
+	/* the hunks are read once, from start to end */
+	posix_madvise (info->map, info->map_size, POSIX_MADV_SEQUENTIAL);
+
+	if (false == delta_initSource (&info->source, info->map, info->map_size, &info->dir))
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	return true;
+}
+
+
+static int
+extract_compareNames (const void *a, const void *b)
+{
+	return strcmp ((*(struct dirEntry * const *) a)->file, (*(struct dirEntry * const *) b)->file);
+}
+
+
+/* a file whose name would take it out of where files are extracted to,
+	 tested or not, is an error and never written */
+static void
+extract_checkNames (struct extractInfo *info)
+{
+	unsigned long i;
+
+	for (i = 0; i < info->dir.num_entries; ++ i)
+		if (EXT_OKAY == info->status[i] && false == ff_safeName (info->dir.entries[i].file))
+			info->status[i] = EXT_UNSAFE;
+}
+
+
+/* every file, or the ones named on the command line. a name that isn't
+	 in the archive is reported, and the rest are extracted anyway. an
+	 older version kept as the base of a delta never is */
+static bool
+extract_chooseFiles (struct extractInfo *info)
+{
+	struct dirEntry **by_name,
+									key,
+									*k = &key,
+									**found;
+	struct lnode *n;
+	unsigned long i;
+
+	if (0 == info->dir.num_entries)
+		return true;
+
+	info->status = calloc (info->dir.num_entries, sizeof *info->status);
+	if (NULL == info->status)
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	n = ll_initialiseSearch (info->options->files);
+	if (0 != ll_isEndOfList (info->options->files, n))
+	{
+		for (i = 0; i < info->dir.num_entries; ++ i)
+			if (false == info->dir.entries[i].base_only)
+				info->status[i] = EXT_OKAY;
+
+		extract_checkNames (info);
+		return true;
+	}
+
+	/* a name goes to the entries with it by way of a sorted list of them */
+	by_name = malloc (info->dir.num_entries * sizeof *by_name);
+	if (NULL == by_name)
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	for (i = 0; i < info->dir.num_entries; ++ i)
+		by_name[i] = &info->dir.entries[i];
+	qsort (by_name, info->dir.num_entries, sizeof *by_name, extract_compareNames);
+
+	while (0 == ll_isEndOfList (info->options->files, n))
+	{
+		key.file = (char *) ll_returnNodeData (n);
+
+		found = bsearch (&k, by_name, info->dir.num_entries, sizeof *by_name, extract_compareNames);
+		if (NULL == found)
+		{
+			printf (LOC_NOT_IN_ARC, key.file);
+			++ info->missing;
+		}
+		else
+		{
+			/* the first of the same name, and all those after it */
+			while (found > by_name && 0 == strcmp ((*(found - 1))->file, key.file))
+				-- found;
+
+			for (; found < by_name + info->dir.num_entries && 0 == strcmp ((*found)->file, key.file); ++ found)
+				if (false == (*found)->base_only)
+					info->status[*found - info->dir.entries] = EXT_OKAY;
+		}
+
+		n = ll_advancePointer (n);
+	}
+
+	free (by_name);
+
+	extract_checkNames (info);
+	return true;
+}
+
+
+static struct dirEntry *extract_sortEntries;
+
+static int
+extract_compareData (const void *a, const void *b)
+{
+	const struct dirEntry *x = &extract_sortEntries[*(const unsigned long *) a],
+												*y = &extract_sortEntries[*(const unsigned long *) b];
+
+	if (x->data_offset != y->data_offset)
+		return x->data_offset < y->data_offset ? -1 : 1;
+
+	return x->member_offset < y->member_offset ? -1 : x->member_offset > y->member_offset;
+}
+
+
+/* a job for each hunk with a file wanted from it */
+static bool
+extract_prepareJobs (struct extractInfo *info)
+{
+	unsigned long i,
+								k,
+								wanted,
+								num = info->dir.num_entries;
+
+	if (0 == num)
+		return true;
+
+	info->order = malloc (num * sizeof *info->order);
+	info->jobs = malloc (num * sizeof *info->jobs);
+	if (NULL == info->order || NULL == info->jobs)
+	{
+		puts (LOC_OUT_OF_MEM);
+		return false;
+	}
+
+	for (i = 0; i < num; ++ i)
+		info->order[i] = i;
+
+	extract_sortEntries = info->dir.entries;
+	qsort (info->order, num, sizeof *info->order, extract_compareData);
+
+	for (i = 0; i < num; i = k)
+	{
+		wanted = 0;
+		for (k = i; k < num && info->dir.entries[info->order[k]].data_offset == info->dir.entries[info->order[i]].data_offset; ++ k)
+			if (EXT_OKAY == info->status[info->order[k]])
+				++ wanted;
+
+		if (0 == wanted)
+			continue; /* for loop */
+
+		info->jobs[info->num_jobs].first = i;
+		info->jobs[info->num_jobs].num = k - i;
+		++ info->num_jobs;
+	}
+
+	return true;
+}
+
+
+/* a block of a CT_BWT hunk at i, and the offset of the one after it */
+static int
+extract_block (struct extractInfo *info, struct dirEntry *e, unsigned long *i, unsigned char **output, unsigned long *output_size)
+{
+	unsigned char *hunk = info->map + e->data_offset;
+	unsigned long block;
+	int ret;
+
+	if (e->compressed_size - *i < FF_BLOCK_SIZE_LEN)
+		return EXT_CORRUPT;
+
+	block = ((unsigned long) hunk[*i] << 24) | ((unsigned long) hunk[*i + 1] << 16) | ((unsigned long) hunk[*i + 2] << 8) | hunk[*i + 3];
+	if (block > e->compressed_size - *i - FF_BLOCK_SIZE_LEN)
+		return EXT_CORRUPT;
+
+	ret = comp_decompressBlock (NULL, hunk + *i + FF_BLOCK_SIZE_LEN, block, output, output_size);
+	if (COMP_RET_NOMEM == ret)
+		return EXT_OUT_OF_MEM;
+	if (COMP_RET_OKAY != ret)
+		return EXT_CORRUPT;
+
+	*i += FF_BLOCK_SIZE_LEN + block;
+
+	return EXT_OKAY;
+}
+
+
+/* the first size bytes of a hunk's data, uncompressed */
+static int
+extract_uncrunch (struct extractInfo *info, struct dirEntry *e, unsigned char *data, unsigned long size)
+{
+	unsigned char *output;
+	unsigned long done = 0,
+								output_size,
+								i = 0;
+	int ret;
+
+	if (e->data_offset > info->map_size || e->compressed_size > info->map_size - e->data_offset)
+		return EXT_CORRUPT;
+
+	if (CT_NONE == e->mode)
+	{
+		if (size > e->compressed_size)
+			return EXT_CORRUPT;
+
+		memcpy (data, info->map + e->data_offset, size);
+		return EXT_OKAY;
+	}
+
+	if (CT_BWT != e->mode)
+		return EXT_CORRUPT;
+
+	/* only so many blocks as it takes */
+	while (done < size)
+	{
+		ret = extract_block (info, e, &i, &output, &output_size);
+		if (EXT_OKAY != ret)
+			return ret;
+
+		if (output_size > size - done)
+			output_size = size - done;
+
+		memcpy (data + done, output, output_size);
+		done += output_size;
+		free (output);
+	}
+
+	return EXT_OKAY;
+}
+
+
+/* names are taken to be relative to where the files are extracted, and
+	 one with a ".." in it never gets this far -- see extract_checkNames() */
+static char *
+extract_path (char *file)
+{
+	while ('/' == *file)
+		++ file;
+
+	return file;
+}
+
+
+static int
+extract_openFile (struct extractInfo *info, char *file, FILE **h)
+{
+	file = extract_path (file);
+
+	if (0 == (info->options->options & EXT_OPT_CLOBBER))
+	{
+		*h = fopen (file, "rb");
+		if (NULL != *h)
+		{
+			fclose (*h);
+			return EXT_EXISTS;
+		}
+	}
+
+	if (false == pl_makePath (file))
+		return EXT_WRITE_ERR;
+
+	*h = fopen (file, "wb");
+	if (NULL == *h)
+		return EXT_WRITE_ERR;
+
+	return EXT_OKAY;
+}
+
+
+static int
+extract_writeFile (struct extractInfo *info, char *file, unsigned char *data, unsigned long size)
+{
+	FILE *h;
+	bool ok;
+	int ret;
+
+	ret = extract_openFile (info, file, &h);
+	if (EXT_OKAY != ret)
+		return ret;
+
+	ok = pl_writeSparse (h, data, size) && pl_endSparse (h);
+	if (0 != fclose (h))
+		ok = false;
+
+	return ok ? EXT_OKAY : EXT_WRITE_ERR;
+}
+
+
+/* a delta is restored through its base, and only checked when testing */
+static int
+extract_deltaFile (struct extractInfo *info, struct dirEntry *e)
+{
+	FILE *h = NULL;
+	int ret;
+
+	if (false == info->test)
+	{
+		ret = extract_openFile (info, e->file, &h);
+		if (EXT_OKAY != ret)
+			return ret;
+	}
+
+	switch (delta_restore (&info->source, e, h))
+	{
+		case DELTA_OKAY:
+			ret = EXT_OKAY;
+			break;
+
+		case DELTA_BAD_CRC:
+			ret = EXT_BAD_CRC;
+			break;
+
+		case DELTA_OUT_OF_MEM:
+			ret = EXT_OUT_OF_MEM;
+			break;
+
+		case DELTA_WRITE_ERR:
+			ret = EXT_WRITE_ERR;
+			break;
+
+		default:
+			ret = EXT_CORRUPT;
+			break;
+	}
+
+	if (NULL != h && 0 != fclose (h) && EXT_OKAY == ret)
+		ret = EXT_WRITE_ERR;
+
+	if (false == info->test && EXT_OKAY != ret)
+		remove (extract_path (e->file));
+
+	return ret;
+}
+
+
+/* a file with a hunk of its own is uncompressed a block at a time, straight
+	 to where it's going, so that it needn't fit in memory. a file that fails
+	 its checks is removed again */
+static int
+extract_streamFile (struct extractInfo *info, struct dirEntry *e)
+{
+	FILE *h = NULL;
+	unsigned char *output;
+	unsigned long done = 0,
+								crc = CRC_INIT,
+								output_size,
+								i = 0;
+	int ret = EXT_OKAY;
+
+	if (e->data_offset > info->map_size || e->compressed_size > info->map_size - e->data_offset)
+		return EXT_CORRUPT;
+
+	if (CT_DELTA == e->mode)
+		return extract_deltaFile (info, e);
+
+	if (CT_NONE != e->mode && CT_BWT != e->mode)
+		return EXT_CORRUPT;
+
+	if (false == info->test)
+	{
+		ret = extract_openFile (info, e->file, &h);
+		if (EXT_OKAY != ret)
+			return ret;
+	}
+
+	if (CT_NONE == e->mode)
+	{
+		if (e->uncompressed_size > e->compressed_size)
+			ret = EXT_CORRUPT;
+		else
+		{
+			output = info->map + e->data_offset;
+			crc = crc_update (crc, output, e->uncompressed_size);
+			if (NULL != h && false == pl_writeSparse (h, output, e->uncompressed_size))
+				ret = EXT_WRITE_ERR;
+			done = e->uncompressed_size;
+		}
+	}
+	else
+	{
+		while (EXT_OKAY == ret && i < e->compressed_size)
+		{
+			ret = extract_block (info, e, &i, &output, &output_size);
+			if (EXT_OKAY != ret)
+				break; /* while loop */
+
+			if (output_size > e->uncompressed_size - done)
+				ret = EXT_CORRUPT;
+			else
+			{
+				crc = crc_update (crc, output, output_size);
+				if (NULL != h && false == pl_writeSparse (h, output, output_size))
+					ret = EXT_WRITE_ERR;
+				done += output_size;
+			}
+
+			free (output);
+		}
+	}
+
+	if (EXT_OKAY == ret && done != e->uncompressed_size)
+		ret = EXT_CORRUPT;
+
+	if (EXT_OKAY == ret && crc != e->checksum)
+		ret = EXT_BAD_CRC;
+
+	if (NULL != h)
+	{
+		if (EXT_OKAY == ret && false == pl_endSparse (h))
+			ret = EXT_WRITE_ERR;
+
+		if (0 != fclose (h) && EXT_OKAY == ret)
+			ret = EXT_WRITE_ERR;
+
+		if (EXT_OKAY != ret)
+			remove (extract_path (e->file));
+	}
+
+	return ret;
+}
+
+
+/* uncompress the hunk as far as the wanted files go, and check and write each of them */
+static void
+extract_doJob (struct extractInfo *info, struct extractJob *job)
+{
+	struct dirEntry *e;
+	unsigned char *data;
+	unsigned long size = 0,
+								j;
+	int *status,
+			ret;
+
+	e = &info->dir.entries[info->order[job->first]];
+	if (false == e->solid)
+	{
+		for (j = job->first; j < job->first + job->num; ++ j)
+			if (EXT_OKAY == info->status[info->order[j]])
+				info->status[info->order[j]] = extract_streamFile (info, &info->dir.entries[info->order[j]]);
+
+		return;
+	}
+
+	for (j = job->first; j < job->first + job->num; ++ j)
+	{
+		e = &info->dir.entries[info->order[j]];
+		if (EXT_OKAY == info->status[info->order[j]] && e->member_offset + e->uncompressed_size > size)
+			size = e->member_offset + e->uncompressed_size;
+	}
+
+	e = &info->dir.entries[info->order[job->first]];
+
+	data = malloc ((size + 1) * sizeof *data);
+	ret = NULL == data ? EXT_OUT_OF_MEM : extract_uncrunch (info, e, data, size);
+
+	for (j = job->first; j < job->first + job->num; ++ j)
+	{
+		e = &info->dir.entries[info->order[j]];
+		status = &info->status[info->order[j]];
+
+		if (EXT_OKAY != *status)
+			continue; /* for loop */
+
+		*status = ret;
+		if (EXT_OKAY != ret)
+			continue; /* for loop */
+
+		if (crc_generate (data + e->member_offset, e->uncompressed_size) != e->checksum)
+			*status = EXT_BAD_CRC;
+		else if (false == info->test)
+			*status = extract_writeFile (info, e->file, data + e->member_offset, e->uncompressed_size);
+	}
+
+	free (data);
+}
+
+
+static void *
+extract_worker (void *arg)
+{
+	struct extractInfo *info = (struct extractInfo *) arg;
+	unsigned long j;
+
+	for (;;)
+	{
+		pthread_mutex_lock (&info->lock);
+		j = info->next_job ++;
+		pthread_mutex_unlock (&info->lock);
+
+		if (j >= info->num_jobs)
+			break; /* for loop */
+
+		extract_doJob (info, &info->jobs[j]);
+	}
+
+	return NULL;
+}
+
+
+/* the hunks on a worker for each cpu, or here if there can't be any */
+static void
+extract_eachHunk (struct extractInfo *info)
+{
+	pthread_t *ids;
+	unsigned long threads,
+								started = 0;
+	long cpus;
+
+	if (0 == info->num_jobs)
+		return;
+
+	cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	threads = 0 < cpus ? cpus : 1;
+	if (threads > info->num_jobs)
+		threads = info->num_jobs;
+
+	pthread_mutex_init (&info->lock, NULL);
+
+	ids = malloc (threads * sizeof *ids);
+	if (NULL != ids)
+	{
+		for (started = 0; started < threads; ++ started)
+			if (0 != pthread_create (&ids[started], NULL, extract_worker, info))
+				break; /* for loop */
+	}
+
+	if (0 == started)
+		extract_worker (info);
+
+	while (started > 0)
+		pthread_join (ids[-- started], NULL);
+
+	free (ids);
+	pthread_mutex_destroy (&info->lock);
+}
+
+
+/* a message for each file that didn't go right, and how many did */
+static bool
+extract_report (struct extractInfo *info)
+{
+	unsigned long okay = 0,
+								errors = info->missing,
+								i;
+	char *file;
+
+	for (i = 0; i < info->dir.num_entries; ++ i)
+	{
+		file = info->dir.entries[i].file;
+
+		switch (info->status[i])
+		{
+			case EXT_SKIPPED:
+				continue; /* for loop */
+
+			case EXT_OKAY:
+				++ okay;
+				continue; /* for loop */
+
+			case EXT_EXISTS:
+				printf (LOC_FILE_EXISTS, file);
+				break;
+
+			case EXT_BAD_CRC:
+				printf (LOC_BAD_CRC, file);
+				break;
+
+			case EXT_CORRUPT:
+				printf (LOC_CORRUPT, file);
+				break;
+
+			case EXT_OUT_OF_MEM:
+				puts (LOC_OUT_OF_MEM);
+				break;
+
+			case EXT_UNSAFE:
+				printf (LOC_UNSAFE_NAME, file);
+				break;
+
+			default:
+				printf (LOC_CANT_WRITE_FILE, file);
+				break;
+		}
+
+		++ errors;
+	}
+
+	printf (info->test ? LOC_TEST_TOTAL : LOC_EXTRACT_TOTAL, okay, errors);
+
+	return 0 == errors;
+}
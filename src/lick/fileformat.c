@@ -20,35 +20,123 @@
 #include  "types_lib.h"
 #include	"locale.h"
 #include	"fileformat.h"
+#include	"lick.h"
 
 /*
    overview of file format
    -=-=-=-=-=-=-=-=-=-=-=-
 
    file_name          (var length, NULL terminated)
-   compressed size    (32 bits)
-   uncompressed size  (32 bits)
+   compressed size    (64 bits)
+   uncompressed size  (64 bits)
    check sum          (32 bits)
    crunch mode        (8 bit)
    platform id        (8 bit)
    filesystem id      (8 bit)
 
-   fs info size       (32 bit)
-   fs info            ("fs info size" bits)
-
    compressed data    ("compressed size" bits)
 
    (words are written in big endian order)
+
+   the compressed data of crunch mode 1 (bwt) is the file cut into blocks,
+   each block being
+
+   compressed size    (32 bits)
+   compressed block   (as made by comp_compressBlock())
+
+   a hunk of crunch mode 2 (delta) holds a file as it differs from an
+   earlier version of it, its base, which is the entry of the same name,
+   size and check sum. its data is
+
+   base size          (64 bits)
+   base check sum     (32 bits)
+
+   and then blocks as crunch mode 1's, of the instructions that make the
+   file from its base -- see delta.c
+
+   a file too large to be held in memory is compressed a block at a time
+   straight into the archive, and its sizes and check sum are written once
+   the last block has been
+
+   small files can instead be put together in a solid hunk, their data
+   concatenated and compressed as one
+
+   number of members  (32 bits)
+
+   file_name          (var length, NULL terminated)  -- for each member
+   uncompressed size  (64 bits)
+   check sum          (32 bits)
+   offset             (64 bits)  -- in the uncompressed solid data
+   platform id        (8 bit)
+   filesystem id      (8 bit)
+
+   compressed size    (64 bits)
+   uncompressed size  (64 bits)
+   crunch mode        (8 bit)
+
+   compressed data    ("compressed size" bits)
+
+   after the hunks comes the central directory, an entry for each file in
+   the archive, so that the archive can be listed without going through
+   the hunks and a file's data found with one seek
+
+   number of entries  (32 bits)
+
+   file_name          (var length, NULL terminated)  -- for each entry
+   hunk offset        (64 bits)  -- of the hunk the file is in
+   data offset        (64 bits)  -- of the hunk's compressed data
+   member offset      (64 bits)  -- in the uncompressed solid data
+   compressed size    (64 bits)  -- of the hunk's compressed data
+   uncompressed size  (64 bits)
+   check sum          (32 bits)
+   modified time      (64 bits)  -- of the file as it was added, 0 if not known
+   crunch mode        (8 bit)
+   flags              (8 bit)    -- 1 solid, 2 only kept as the base of a delta
+
+   and the archive ends with the trailer, which points back to it
+
+   directory offset   (64 bits)
+
+   each of the hunks, the directory and the trailer start with a header
+   of their own -- HUNK_HEAD, SOLID_HEAD, DIR_HEAD and TRAILER_HEAD. an
+   archive with no trailer is from before there were directories and is
+   still read, hunk by hunk. its hunks are OLD_HUNK_HEAD hunks, which are
+   as above but with sizes of 32 bits. adding to an archive writes its new
+   hunks over the old directory and a new directory after them. a file
+   added again is given a new hunk, and the directory leaves out the old
+   one, which stays where it is until the archive is rewritten -- unless
+   the new hunk is a delta, when the old entries are kept as bases. an
+   OLD_DIR_HEAD directory is as above but without the modified times
  */
 
 #define	ARCHIVE_HEAD		"LiCKa"
 #define	ARCHIVE_HEAD_LEN	5
-#define	HUNK_HEAD			"LiCKf"
+#define	HUNK_HEAD			"LiCKh"
 #define	HUNK_HEAD_LEN		5
+#define	OLD_HUNK_HEAD		"LiCKf"
+#define	SOLID_HEAD			"LiCKs"
+#define	SOLID_HEAD_LEN		5
+#define	DIR_HEAD				"LiCKe"
+#define	OLD_DIR_HEAD		"LiCKd"
+#define	DIR_HEAD_LEN			5
+#define	TRAILER_HEAD		"LiCKt"
+#define	TRAILER_HEAD_LEN	5
+#define	TRAILER_LEN			(TRAILER_HEAD_LEN + 8)
+
+#define	FF_FLAG_SOLID		0x1
+#define	FF_FLAG_BASE		0x2
+
+/* what comes between a hunk's name and its data -- the sizes, check sum, mode and platform */
+#define	HUNK_SIZES_LEN		(8 + 8 + 4 + 1 + 1 + 1)
 
 static bool ff_writeU8BitWord (FILE * h, unsigned char i);
 //static bool ff_writeU16BitWord (FILE * h, unsigned int i);
 static bool ff_writeU32BitWord (FILE * h, unsigned long i);
+static bool ff_writeU64BitWord (FILE * h, unsigned long i);
+static bool ff_readU8BitWord (FILE * h, unsigned char *i);
+static bool ff_readU32BitWord (FILE * h, unsigned long *i);
+static bool ff_readU64BitWord (FILE * h, unsigned long *i);
+static bool ff_readString (FILE * h, char **s);
 
 /* check whether or not file is a lick archive
    future versions should check the integrity of
@@ -84,11 +172,13 @@ ff_writeArchiveHead (FILE * h)
   return true;
 }
 
-bool
-ff_writeFile (FILE * h, struct hunkInfo *hi)
+static bool
+ff_writeFileHead (FILE * h, struct hunkInfo *hi, struct dirEntry *e)
 {
   size_t s;
 
+  e->hunk_offset = ftell (h);
+
   /* hunk header */
   if (HUNK_HEAD_LEN != fwrite (HUNK_HEAD, sizeof (char), HUNK_HEAD_LEN, h))
        return false;
@@ -99,11 +189,11 @@ ff_writeFile (FILE * h, struct hunkInfo *hi)
        return false;
 
   /* compressed size */
-  if (0 == ff_writeU32BitWord (h, hi->compressed_size))
+  if (0 == ff_writeU64BitWord (h, hi->compressed_size))
     return false;
 
   /* uncompressed size */
-  if (0 == ff_writeU32BitWord (h, hi->uncompressed_size))
+  if (0 == ff_writeU64BitWord (h, hi->uncompressed_size))
     return false;
 
   /* check sum */
@@ -121,10 +211,604 @@ ff_writeFile (FILE * h, struct hunkInfo *hi)
   if (0 == ff_writeU8BitWord (h, FILESYSTEM_ID))
     return false;
 
+  e->data_offset = ftell (h);
+
+  return true;
+}
+
+static bool
+ff_addFileEntry (struct hunkInfo *hi, struct dirEntry *e, struct lickDirectory *dir)
+{
+  if (NULL == dir)
+    return true;
+
+  e->file = hi->file;
+  e->member_offset = 0;
+  e->compressed_size = hi->compressed_size;
+  e->uncompressed_size = hi->uncompressed_size;
+  e->checksum = hi->checksum;
+  e->mtime = hi->mtime;
+  e->mode = hi->mode;
+  e->solid = false;
+  e->base_only = false;
+
+  return ff_addEntry (dir, e);
+}
+
+bool
+ff_writeFile (FILE * h, struct hunkInfo *hi, struct lickDirectory *dir)
+{
+  struct dirEntry e;
+
+  if (false == ff_writeFileHead (h, hi, &e))
+    return false;
+
   /* compressed data */
   if (hi->compressed_size != fwrite (hi->compressed_data, sizeof (char), hi->compressed_size, h))
        return false;
 
+  return ff_addFileEntry (hi, &e, dir);
+}
+
+bool
+ff_beginFile (FILE * h, struct hunkInfo *hi, struct dirEntry *e)
+{
+  return ff_writeFileHead (h, hi, e);
+}
+
+bool
+ff_endFile (FILE * h, struct hunkInfo *hi, struct dirEntry *e, struct lickDirectory *dir)
+{
+  long end;
+
+  end = ftell (h);
+
+  /* back over the sizes and check sum, now that they are known */
+  if (0 != fseek (h, e->data_offset - HUNK_SIZES_LEN, SEEK_SET))
+    return false;
+
+  if (0 == ff_writeU64BitWord (h, hi->compressed_size)
+      || 0 == ff_writeU64BitWord (h, hi->uncompressed_size)
+      || 0 == ff_writeU32BitWord (h, hi->checksum))
+    return false;
+
+  if (0 != fseek (h, end, SEEK_SET))
+    return false;
+
+  return ff_addFileEntry (hi, e, dir);
+}
+
+bool
+ff_writeSolid (FILE * h, struct solidInfo *si, struct lickDirectory *dir)
+{
+  struct hunkInfo *m;
+  struct dirEntry e;
+  unsigned long i;
+  size_t s;
+
+  e.hunk_offset = ftell (h);
+
+  /* solid header */
+  if (SOLID_HEAD_LEN != fwrite (SOLID_HEAD, sizeof (char), SOLID_HEAD_LEN, h))
+       return false;
+
+  if (0 == ff_writeU32BitWord (h, si->num_members))
+    return false;
+
+  /* members */
+  for (i = 0; i < si->num_members; ++ i)
+  {
+    m = &si->members[i];
+
+    s = strlen (m->file) + 1;
+    if (s != fwrite (m->file, sizeof (char), s, h))
+         return false;
+
+    if (0 == ff_writeU64BitWord (h, m->uncompressed_size))
+      return false;
+
+    if (0 == ff_writeU32BitWord (h, m->checksum))
+      return false;
+
+    if (0 == ff_writeU64BitWord (h, m->offset))
+      return false;
+
+    if (0 == ff_writeU8BitWord (h, PLATFORM_ID))
+      return false;
+
+    if (0 == ff_writeU8BitWord (h, FILESYSTEM_ID))
+      return false;
+  }
+
+  /* the data they share */
+  if (0 == ff_writeU64BitWord (h, si->compressed_size))
+    return false;
+
+  if (0 == ff_writeU64BitWord (h, si->uncompressed_size))
+    return false;
+
+  if (0 == ff_writeU8BitWord (h, si->mode))
+    return false;
+
+  e.data_offset = ftell (h);
+
+  if (si->compressed_size != fwrite (si->compressed_data, sizeof (char), si->compressed_size, h))
+       return false;
+
+  if (NULL == dir)
+    return true;
+
+  for (i = 0; i < si->num_members; ++ i)
+  {
+    m = &si->members[i];
+
+    e.file = m->file;
+    e.member_offset = m->offset;
+    e.compressed_size = si->compressed_size;
+    e.uncompressed_size = m->uncompressed_size;
+    e.checksum = m->checksum;
+    e.mtime = m->mtime;
+    e.mode = si->mode;
+    e.solid = true;
+    e.base_only = false;
+
+    if (false == ff_addEntry (dir, &e))
+      return false;
+  }
+
+  return true;
+}
+
+void
+ff_initDirectory (struct lickDirectory *dir)
+{
+  dir->entries = NULL;
+  dir->num_entries = 0;
+  dir->max_entries = 0;
+}
+
+void
+ff_freeDirectory (struct lickDirectory *dir)
+{
+  unsigned long i;
+
+  for (i = 0; i < dir->num_entries; ++ i)
+    free (dir->entries[i].file);
+  free (dir->entries);
+
+  ff_initDirectory (dir);
+}
+
+bool
+ff_addEntry (struct lickDirectory *dir, struct dirEntry *e)
+{
+  struct dirEntry *entries;
+  size_t s;
+
+  if (dir->num_entries == dir->max_entries)
+  {
+    entries = realloc (dir->entries, (2 * dir->max_entries + 16) * sizeof *entries);
+    if (NULL == entries)
+      return false;
+
+    dir->entries = entries;
+    dir->max_entries = 2 * dir->max_entries + 16;
+  }
+
+  s = strlen (e->file) + 1;
+  dir->entries[dir->num_entries] = *e;
+  dir->entries[dir->num_entries].file = malloc (s);
+  if (NULL == dir->entries[dir->num_entries].file)
+    return false;
+  memcpy (dir->entries[dir->num_entries].file, e->file, s);
+
+  ++ dir->num_entries;
+
+  return true;
+}
+
+/* what becomes of an entry of a file added again */
+enum FF_REPLACED
+{
+  FF_KEEP = 0,
+  FF_DROP,
+  FF_KEEP_BASE
+};
+
+struct ffName
+{
+  char *file;
+  unsigned long entry;
+};
+
+static int
+ff_compareName (const void *a, const void *b)
+{
+  const struct ffName *x = a,
+                      *y = b;
+
+  return strcmp (x->file, y->file);
+}
+
+bool
+ff_dropReplaced (struct lickDirectory *dir, unsigned long first_new)
+{
+  struct ffName *by_name,
+                key,
+                *found;
+  unsigned char *dropped;
+  unsigned char mark;
+  unsigned long i,
+                k;
+
+  if (0 == first_new || dir->num_entries == first_new)
+    return true;
+
+  by_name = malloc (first_new * sizeof *by_name);
+  dropped = calloc (first_new, sizeof *dropped);
+  if (NULL == by_name || NULL == dropped)
+  {
+    free (by_name);
+    free (dropped);
+    return false;
+  }
+
+  for (i = 0; i < first_new; ++ i)
+  {
+    by_name[i].file = dir->entries[i].file;
+    by_name[i].entry = i;
+  }
+  qsort (by_name, first_new, sizeof *by_name, ff_compareName);
+
+  /* an entry that is the base of a delta is kept however else it is replaced */
+  for (i = first_new; i < dir->num_entries; ++ i)
+  {
+    key.file = dir->entries[i].file;
+    mark = CT_DELTA == dir->entries[i].mode ? FF_KEEP_BASE : FF_DROP;
+
+    found = bsearch (&key, by_name, first_new, sizeof *by_name, ff_compareName);
+    if (NULL == found)
+      continue; /* for loop */
+
+    /* the first of the same name, and all those after it */
+    while (found > by_name && 0 == strcmp ((found - 1)->file, key.file))
+      -- found;
+
+    for (; found < by_name + first_new && 0 == strcmp (found->file, key.file); ++ found)
+      if (dropped[found->entry] < mark)
+        dropped[found->entry] = mark;
+  }
+
+  for (i = k = 0; i < dir->num_entries; ++ i)
+  {
+    if (i < first_new && FF_DROP == dropped[i])
+    {
+      free (dir->entries[i].file);
+      continue; /* for loop */
+    }
+
+    if (i < first_new && FF_KEEP_BASE == dropped[i])
+      dir->entries[i].base_only = true;
+
+    dir->entries[k ++] = dir->entries[i];
+  }
+  dir->num_entries = k;
+
+  free (by_name);
+  free (dropped);
+
+  return true;
+}
+
+/* compare the next bytes of the archive with a header */
+static bool
+ff_readHead (FILE * h, const char *head, size_t len)
+{
+  char buff[ARCHIVE_HEAD_LEN];
+
+  if (len != fread (buff, sizeof (char), len, h))
+    return false;
+
+  return 0 == strncmp (buff, head, len);
+}
+
+/* the directory, from the offset the trailer gives */
+static bool
+ff_readEntries (FILE * h, unsigned long offset, struct lickDirectory *dir)
+{
+  struct dirEntry e;
+  char buff[DIR_HEAD_LEN];
+  unsigned long n,
+                i;
+  unsigned char b;
+  bool timed;
+
+  if (0 != fseek (h, offset, SEEK_SET))
+    return false;
+
+  if (DIR_HEAD_LEN != fread (buff, sizeof (char), DIR_HEAD_LEN, h))
+    return false;
+
+  timed = 0 == strncmp (buff, DIR_HEAD, DIR_HEAD_LEN);
+  if (false == timed && 0 != strncmp (buff, OLD_DIR_HEAD, DIR_HEAD_LEN))
+    return false;
+
+  e.mtime = 0;
+
+  if (false == ff_readU32BitWord (h, &n))
+    return false;
+
+  for (i = 0; i < n; ++ i)
+  {
+    if (false == ff_readString (h, &e.file))
+      return false;
+
+    if (false == ff_readU64BitWord (h, &e.hunk_offset)
+        || false == ff_readU64BitWord (h, &e.data_offset)
+        || false == ff_readU64BitWord (h, &e.member_offset)
+        || false == ff_readU64BitWord (h, &e.compressed_size)
+        || false == ff_readU64BitWord (h, &e.uncompressed_size)
+        || false == ff_readU32BitWord (h, &e.checksum)
+        || false == (timed ? ff_readU64BitWord (h, &e.mtime) : true)
+        || false == ff_readU8BitWord (h, &e.mode)
+        || false == ff_readU8BitWord (h, &b))
+    {
+      free (e.file);
+      return false;
+    }
+
+    e.solid = 0 != (b & FF_FLAG_SOLID);
+    e.base_only = 0 != (b & FF_FLAG_BASE);
+
+    if (false == ff_addEntry (dir, &e))
+    {
+      free (e.file);
+      return false;
+    }
+
+    free (e.file);
+  }
+
+  return true;
+}
+
+/* an entry for each file in the hunks from the offset to the end of the archive */
+static bool
+ff_scanHunks (FILE * h, unsigned long offset, struct lickDirectory *dir, unsigned long *end)
+{
+  struct dirEntry e;
+  char buff[HUNK_HEAD_LEN];
+  unsigned long first,
+                n,
+                i;
+  unsigned char b;
+  bool wide;
+  size_t r;
+
+  for (;;)
+  {
+    if (0 != fseek (h, offset, SEEK_SET))
+      return false;
+
+    r = fread (buff, sizeof (char), HUNK_HEAD_LEN, h);
+    if (0 == r)
+      break; /* for loop */
+
+    if (HUNK_HEAD_LEN != r)
+      return false;
+
+    e.hunk_offset = offset;
+    e.mtime = 0;
+    e.base_only = false;
+
+    if (0 == strncmp (buff, HUNK_HEAD, HUNK_HEAD_LEN) || 0 == strncmp (buff, OLD_HUNK_HEAD, HUNK_HEAD_LEN))
+    {
+      wide = 0 == strncmp (buff, HUNK_HEAD, HUNK_HEAD_LEN);
+
+      if (false == ff_readString (h, &e.file))
+        return false;
+
+      e.member_offset = 0;
+      e.solid = false;
+
+      if (false == (wide ? ff_readU64BitWord (h, &e.compressed_size) : ff_readU32BitWord (h, &e.compressed_size))
+          || false == (wide ? ff_readU64BitWord (h, &e.uncompressed_size) : ff_readU32BitWord (h, &e.uncompressed_size))
+          || false == ff_readU32BitWord (h, &e.checksum)
+          || false == ff_readU8BitWord (h, &e.mode)
+          || false == ff_readU8BitWord (h, &b)
+          || false == ff_readU8BitWord (h, &b))
+      {
+        free (e.file);
+        return false;
+      }
+
+      e.data_offset = ftell (h);
+
+      if (false == ff_addEntry (dir, &e))
+      {
+        free (e.file);
+        return false;
+      }
+
+      free (e.file);
+    }
+    else if (0 == strncmp (buff, SOLID_HEAD, SOLID_HEAD_LEN))
+    {
+      /* the members come before the sizes they share, so they are gone over twice */
+      first = dir->num_entries;
+
+      if (false == ff_readU32BitWord (h, &n))
+        return false;
+
+      for (i = 0; i < n; ++ i)
+      {
+        if (false == ff_readString (h, &e.file))
+          return false;
+
+        e.solid = true;
+
+        if (false == ff_readU64BitWord (h, &e.uncompressed_size)
+            || false == ff_readU32BitWord (h, &e.checksum)
+            || false == ff_readU64BitWord (h, &e.member_offset)
+            || false == ff_readU8BitWord (h, &b)
+            || false == ff_readU8BitWord (h, &b)
+            || false == ff_addEntry (dir, &e))
+        {
+          free (e.file);
+          return false;
+        }
+
+        free (e.file);
+      }
+
+      if (false == ff_readU64BitWord (h, &e.compressed_size)
+          || false == ff_readU64BitWord (h, &n)
+          || false == ff_readU8BitWord (h, &e.mode))
+        return false;
+
+      e.data_offset = ftell (h);
+
+      for (i = first; i < dir->num_entries; ++ i)
+      {
+        dir->entries[i].data_offset = e.data_offset;
+        dir->entries[i].compressed_size = e.compressed_size;
+        dir->entries[i].mode = e.mode;
+      }
+    }
+    else
+    {
+      /* the directory of an archive whose trailer has been lost is written again */
+      if (0 == strncmp (buff, DIR_HEAD, DIR_HEAD_LEN) || 0 == strncmp (buff, OLD_DIR_HEAD, DIR_HEAD_LEN))
+        break; /* for loop */
+
+      return false;
+    }
+
+    offset = e.data_offset + e.compressed_size;
+  }
+
+  *end = offset;
+
+  return true;
+}
+
+bool
+ff_readDirectory (FILE * h, struct lickDirectory *dir, unsigned long *end)
+{
+  long size;
+
+  if (0 != fseek (h, 0, SEEK_END))
+    return false;
+
+  size = ftell (h);
+
+  /* a trailer that points to a directory inside the archive */
+  if (size >= ARCHIVE_HEAD_LEN + TRAILER_LEN)
+  {
+    if (0 != fseek (h, size - TRAILER_LEN, SEEK_SET))
+      return false;
+
+    if (ff_readHead (h, TRAILER_HEAD, TRAILER_HEAD_LEN) && ff_readU64BitWord (h, end)
+        && *end >= ARCHIVE_HEAD_LEN && *end < (unsigned long) size - TRAILER_LEN)
+    {
+      return ff_readEntries (h, *end, dir);
+    }
+  }
+
+  return ff_scanHunks (h, ARCHIVE_HEAD_LEN, dir, end);
+}
+
+bool
+ff_safeName (const char *file)
+{
+  size_t len;
+
+  while ('/' == *file)
+    ++ file;
+
+  if ('\0' == *file)
+    return false;
+
+  for (;;)
+  {
+    len = strcspn (file, "/");
+    if (2 == len && 0 == strncmp (file, "..", 2))
+      return false;
+
+    file += len;
+    if ('\0' == *file)
+      return true;
+
+    ++ file;
+  }
+}
+
+bool
+ff_countHunks (FILE * h, unsigned long *hunks)
+{
+  struct lickDirectory dir;
+  unsigned long end,
+                i;
+  bool ret_val;
+
+  ff_initDirectory (&dir);
+
+  ret_val = ff_scanHunks (h, ARCHIVE_HEAD_LEN, &dir, &end);
+
+  /* the entries of a solid hunk are one after the other */
+  *hunks = 0;
+  for (i = 0; i < dir.num_entries; ++ i)
+    if (0 == i || dir.entries[i].hunk_offset != dir.entries[i - 1].hunk_offset)
+      ++ *hunks;
+
+  ff_freeDirectory (&dir);
+
+  return ret_val;
+}
+
+bool
+ff_writeDirectory (FILE * h, struct lickDirectory *dir)
+{
+  struct dirEntry *e;
+  unsigned long offset,
+                i;
+  size_t s;
+
+  offset = ftell (h);
+
+  if (DIR_HEAD_LEN != fwrite (DIR_HEAD, sizeof (char), DIR_HEAD_LEN, h))
+       return false;
+
+  if (0 == ff_writeU32BitWord (h, dir->num_entries))
+    return false;
+
+  for (i = 0; i < dir->num_entries; ++ i)
+  {
+    e = &dir->entries[i];
+
+    s = strlen (e->file) + 1;
+    if (s != fwrite (e->file, sizeof (char), s, h))
+         return false;
+
+    if (0 == ff_writeU64BitWord (h, e->hunk_offset)
+        || 0 == ff_writeU64BitWord (h, e->data_offset)
+        || 0 == ff_writeU64BitWord (h, e->member_offset)
+        || 0 == ff_writeU64BitWord (h, e->compressed_size)
+        || 0 == ff_writeU64BitWord (h, e->uncompressed_size)
+        || 0 == ff_writeU32BitWord (h, e->checksum)
+        || 0 == ff_writeU64BitWord (h, e->mtime)
+        || 0 == ff_writeU8BitWord (h, e->mode)
+        || 0 == ff_writeU8BitWord (h, (e->solid ? FF_FLAG_SOLID : 0) | (e->base_only ? FF_FLAG_BASE : 0)))
+      return false;
+  }
+
+  /* trailer */
+  if (TRAILER_HEAD_LEN != fwrite (TRAILER_HEAD, sizeof (char), TRAILER_HEAD_LEN, h))
+       return false;
+
+  if (0 == ff_writeU64BitWord (h, offset))
+    return false;
+
   return true;
 }
 
@@ -168,3 +852,105 @@ ff_writeU32BitWord (FILE * h, unsigned long i)
 
   return true;
 }
+
+/* sizes and offsets, which are no more than 32 bits where a long is */
+static bool
+ff_writeU64BitWord (FILE * h, unsigned long i)
+{
+  unsigned long hi = 0;
+
+  if (sizeof i > 4)
+    hi = (i >> 16) >> 16;
+
+  if (0 == ff_writeU32BitWord (h, hi))
+    return false;
+
+  return ff_writeU32BitWord (h, i & 0xffffffffUL);
+}
+
+static bool
+ff_readU8BitWord (FILE * h, unsigned char *i)
+{
+  int c;
+
+  c = fgetc (h);
+  if (EOF == c)
+    return false;
+
+  *i = c;
+
+  return true;
+}
+
+static bool
+ff_readU32BitWord (FILE * h, unsigned long *i)
+{
+  unsigned char b[4];
+
+  if (4 != fread (b, sizeof (char), 4, h))
+    return false;
+
+  *i = ((unsigned long) b[0] << 24) | ((unsigned long) b[1] << 16) | ((unsigned long) b[2] << 8) | b[3];
+
+  return true;
+}
+
+/* a NULL terminated string of any length, in memory of its own */
+static bool
+ff_readString (FILE * h, char **s)
+{
+  char *t;
+  size_t len = 0,
+         max = 64;
+  int c;
+
+  *s = malloc (max);
+  if (NULL == *s)
+    return false;
+
+  do
+  {
+    c = fgetc (h);
+    if (EOF == c)
+    {
+      free (*s);
+      return false;
+    }
+
+    if (len == max)
+    {
+      t = realloc (*s, 2 * max);
+      if (NULL == t)
+      {
+        free (*s);
+        return false;
+      }
+
+      *s = t;
+      max *= 2;
+    }
+
+    (*s)[len ++] = c;
+  }
+  while ('\0' != c);
+
+  return true;
+}
+
+static bool
+ff_readU64BitWord (FILE * h, unsigned long *i)
+{
+  unsigned long hi,
+                lo;
+
+  if (false == ff_readU32BitWord (h, &hi) || false == ff_readU32BitWord (h, &lo))
+    return false;
+
+  /* too large to be held */
+  if (sizeof *i == 4 && 0 != hi)
+    return false;
+
+  *i = ((hi << 16) << 16) | lo;
+
+  return true;
+}
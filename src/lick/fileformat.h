@@ -28,6 +28,21 @@ struct hunkInfo
   unsigned long uncompressed_size;
   char *compressed_data;
   struct fsInfo fs_info;
+  unsigned long offset;		/* of a solid member, in the solid data */
+  unsigned long mtime;		/* of the file, as it was read */
+};
+
+/* small files sharing their compressed data. the members' compressed
+   size and data are unused -- each member is the uncompressed_size bytes
+   at its offset in the uncompressed solid data */
+struct solidInfo
+{
+  struct hunkInfo *members;
+  unsigned long num_members;
+  unsigned char mode;
+  unsigned long compressed_size;
+  unsigned long uncompressed_size;
+  char *compressed_data;
 };
 
 enum ARCHIVE_STATUSES
@@ -38,8 +53,72 @@ enum ARCHIVE_STATUSES
 };
 typedef int ARCHIVE_STATUS;
 
+/* an archive's central directory -- an entry for every file in it */
+struct dirEntry
+{
+  char *file;
+  unsigned long hunk_offset;			/* of the file's hunk in the archive */
+  unsigned long data_offset;			/* of the hunk's compressed data */
+  unsigned long member_offset;		/* in the uncompressed data of a solid hunk */
+  unsigned long compressed_size;	/* of the hunk's data, all of it for a solid member */
+  unsigned long uncompressed_size;
+  unsigned long checksum;
+  unsigned long mtime;						/* 0 where it isn't known */
+  unsigned char mode;
+  bool solid;
+  bool base_only;									/* an older version, kept as the base of a delta */
+};
+
+struct lickDirectory
+{
+  struct dirEntry *entries;
+  unsigned long num_entries;
+  unsigned long max_entries;
+};
+
+/* the data of a CT_BWT hunk is a run of blocks, each preceded by its compressed size */
+#define FF_BLOCK_SIZE_LEN		4
+
+/* a CT_DELTA hunk's data starts with the size and check sum of its base */
+#define FF_DELTA_HEAD_LEN		12
+
 ARCHIVE_STATUS ff_checkFile (char *file);
 bool ff_writeArchiveHead (FILE *);
-bool ff_writeFile (FILE *, struct hunkInfo *);
+
+/* with a directory, each file written is given an entry in it */
+bool ff_writeFile (FILE *, struct hunkInfo *, struct lickDirectory *);
+
+/* a file written a piece at a time -- its hunk header, then its compressed
+   data by the caller, then its sizes and check sum, which are written back
+   into the header. the entry is for ff_endFile() */
+bool ff_beginFile (FILE *, struct hunkInfo *, struct dirEntry *);
+bool ff_endFile (FILE *, struct hunkInfo *, struct dirEntry *, struct lickDirectory *);
+bool ff_writeSolid (FILE *, struct solidInfo *, struct lickDirectory *);
+
+void ff_initDirectory (struct lickDirectory *);
+void ff_freeDirectory (struct lickDirectory *);
+
+/* a copy of the entry, name and all, on the end of the directory */
+bool ff_addEntry (struct lickDirectory *, struct dirEntry *);
+
+/* leave out the entries before first_new of files that have an entry
+   from first_new on -- files that have been added to the archive again.
+   those replaced by a delta are kept, as bases only */
+bool ff_dropReplaced (struct lickDirectory *, unsigned long first_new);
+
+/* the directory of an archive, from the end of it or, for an archive
+   written before there were directories, by going through its hunks.
+   end is where the hunks end, and where the next hunk should go */
+bool ff_readDirectory (FILE *, struct lickDirectory *, unsigned long *end);
+
+/* whether a name, with any leading slashes taken off, stays where it is
+   extracted to -- none of the directories in it are ".." */
+bool ff_safeName (const char *file);
+
+/* how many hunks there are in the archive, whether any entry is of them or not */
+bool ff_countHunks (FILE *, unsigned long *hunks);
+
+/* the directory and the trailer after it, which must end the archive */
+bool ff_writeDirectory (FILE *, struct lickDirectory *);
 
 #endif /* FILEFORMAT_H */
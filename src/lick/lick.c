@@ -23,6 +23,9 @@
 
 #include	"locale.h"
 #include	"add.h"
+#include	"view.h"
+#include	"extract.h"
+#include	"rewrite.h"
 #include	"lick.h"
 
 
@@ -65,6 +68,22 @@ handleArgs (struct lickOptions *options, int argc, char **argv)
 				options->action = LA_EXTRACT;
 				break;
 
+			case 't':
+				options->action = LA_TEST;
+				break;
+
+			case 'd':
+				options->action = LA_DELETE;
+				break;
+
+			case 'm':
+				options->action = LA_MERGE;
+				break;
+
+			case 'c':
+				options->action = LA_COMPACT;
+				break;
+
 			default:
 				return ARGS_UNKNOWN_COMMAND;
 		}
@@ -82,6 +101,10 @@ handleArgs (struct lickOptions *options, int argc, char **argv)
 						options->compress_mode = CT_NONE;
 						break;
 
+					case '1':
+						options->compress_mode = CT_BWT;
+						break;
+
 					default:
 						return ARGS_UNKNOWN_CRUNCH_MODE;
 				}
@@ -101,6 +124,27 @@ handleArgs (struct lickOptions *options, int argc, char **argv)
 				options->options |= EXT_OPT_CLOBBER;
 				break;
 
+			case 's':
+				if (strlen(argv[i]) != 2)
+					return ARGS_UNKNOWN_OPTION;
+
+				options->options |= ADD_OPT_SOLID;
+				break;
+
+			case 'u':
+				if (strlen(argv[i]) != 2)
+					return ARGS_UNKNOWN_OPTION;
+
+				options->options |= ADD_OPT_UPDATE;
+				break;
+
+			case 'd':
+				if (strlen(argv[i]) != 2)
+					return ARGS_UNKNOWN_OPTION;
+
+				options->options |= ADD_OPT_DELTA;
+				break;
+
 			default:
 				return ARGS_UNKNOWN_OPTION;
 		}
@@ -109,7 +153,7 @@ handleArgs (struct lickOptions *options, int argc, char **argv)
 	// get archive name
 	if (i >= argc)
 		return ARGS_ARCHIVE_NOT_SPECIFIED;
-	options->archive = malloc(strlen(argv[i]) * sizeof *options->archive);
+	options->archive = malloc((strlen(argv[i]) + 1) * sizeof *options->archive);
 	strcpy(options->archive, argv[i]);
 	++i;
 
@@ -151,10 +195,12 @@ printUsage (char *prog_name)
 
 	printf ("Usage: %s <command> [-options] <archive> [<file>...] [<dest_dir>]\n\n", prog_name);
 
-	puts ("<command>:\na  Add file(s)\nv  View archive contents");
-	puts ("x  Extract files from archive\n");
+	puts ("<command>:\na  Add file(s), and everything in directories\nv  View archive contents");
+	puts ("x  Extract files from archive\nt  Test files in archive");
+	puts ("d  Delete files from archive\nm  Merge other archives into archive\nc  Compact archive\n");
 
-	puts ("<extract options>:\n-e  Set crunch mode\n-t  Touch files\n-c  Clobber files (without prompting)\n");
+	puts ("<add options>:\n-e  Set crunch mode (-e0 store, -e1 bwt)\n-s  Solid (small files share their blocks)\n-u  Update (only files that are new or have changed)\n-d  Delta (large files as changes to the versions in the archive)\n");
+	puts ("<extract options>:\n-t  Touch files\n-c  Clobber files (without prompting)\n");
 }
 
 int
@@ -203,11 +249,18 @@ main (int argc, char **argv)
 			break;
 
 		case LA_VIEW:
-			puts("TODO: viewing archive");
+			ret_val = view(&options);
 			break;
 
 		case LA_EXTRACT:
-			puts("TODO: extracting files");
+		case LA_TEST:
+			ret_val = extract(&options);
+			break;
+
+		case LA_DELETE:
+		case LA_MERGE:
+		case LA_COMPACT:
+			ret_val = rewrite(&options);
 			break;
 
 		default:
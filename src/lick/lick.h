@@ -24,12 +24,18 @@ enum LICK_ACTIONS
   LA_USAGE,
   LA_ADD,
   LA_VIEW,
-  LA_EXTRACT
+  LA_EXTRACT,
+  LA_TEST,
+  LA_DELETE,
+  LA_MERGE,
+  LA_COMPACT
 };
 
 enum COMPRESS_TYPES
 {
-  CT_NONE = 0
+  CT_NONE = 0,
+  CT_BWT = 1,
+  CT_DELTA = 2			/* made by adding with ADD_OPT_DELTA, not chosen with -e */
 };
 
 enum EXTRACT_OPTIONS
@@ -39,6 +45,13 @@ enum EXTRACT_OPTIONS
   EXT_OPT_TOUCH = 0x2
 };
 
+enum ADD_OPTIONS
+{
+  ADD_OPT_SOLID = 0x4,
+  ADD_OPT_UPDATE = 0x8,
+  ADD_OPT_DELTA = 0x10
+};
+
 struct lickOptions
 {
   char *archive;
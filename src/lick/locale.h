@@ -29,11 +29,48 @@
 #define LOC_AS_NOT_LICK_FILE	LOC_ERROR_FLAG "%s is not a lick archive\n"
 #define	LOC_NOT_OPEN_ARC			LOC_ERROR_FLAG "could not open %s\n"
 #define LOC_CANT_WRITE_ARC		LOC_ERROR_FLAG "could not write data to archive"
+#define LOC_CANT_READ_ARC			LOC_ERROR_FLAG "could not read %s\n"
 
 #define LOC_FILE_NOT_EXIST		"%s doesn't exist\n"
 #define LOC_FILE_READ_ERR			"error reading %s\n"
 
 #define LOC_PLATFORM_ERROR		LOC_ERROR_FLAG "error in platform specific code"
+#define LOC_COMPRESS_ERR			LOC_ERROR_FLAG "error compressing %s\n"
+
+/* add.c */
+#define LOC_ADD_TOTAL			"%lu files added, %lu errors\n"
+#define LOC_UPDATE_TOTAL		"%lu files added, %lu unchanged, %lu errors\n"
+#define LOC_SKIP_ARCHIVE		"%s is the archive, not added\n"
+
+/* walk.c */
+#define LOC_DIR_READ_ERR		"error reading directory %s\n"
+#define LOC_UNSAFE_ADD			"%s has a .. in it, not added\n"
+
+/* view.c */
+#define LOC_VIEW_HEAD				"  original   crunched  mode   name"
+#define LOC_VIEW_ENTRY			"%10lu %10lu  %-5s  %s\n"
+#define LOC_VIEW_SOLID			"%10lu      solid  %-5s  %s\n"
+#define LOC_VIEW_TOTAL			"%10lu in %lu files, %lu bytes of hunks\n"
+#define LOC_VIEW_STORE			"store"
+#define LOC_VIEW_BWT				"bwt"
+#define LOC_VIEW_DELTA			"delta"
+
+/* extract.c */
+#define LOC_NOT_IN_ARC			"%s isn't in the archive\n"
+#define LOC_FILE_EXISTS			"%s exists, not overwritten\n"
+#define LOC_BAD_CRC					LOC_ERROR_FLAG "%s fails its checksum\n"
+#define LOC_CORRUPT					LOC_ERROR_FLAG "%s is corrupt\n"
+#define LOC_UNSAFE_NAME			LOC_ERROR_FLAG "%s leads out of the directory it is extracted to\n"
+#define LOC_CANT_WRITE_FILE	LOC_ERROR_FLAG "could not write %s\n"
+#define LOC_EXTRACT_TOTAL		"%lu files extracted, %lu errors\n"
+#define LOC_TEST_TOTAL			"%lu files okay, %lu errors\n"
+
+/* rewrite.c */
+#define LOC_CANT_REPLACE_ARC	LOC_ERROR_FLAG "could not replace %s\n"
+#define LOC_MERGE_SELF			LOC_ERROR_FLAG "%s can't be merged into itself\n"
+#define LOC_DELETE_TOTAL		"%lu files deleted, %lu kept, %lu bytes freed\n"
+#define LOC_COMPACT_TOTAL		"%lu hunks dropped, %lu kept, %lu bytes freed\n"
+#define LOC_MERGE_TOTAL			"%lu files merged, %lu errors\n"
 
 
 #endif /* LOCAL_H */
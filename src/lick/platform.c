@@ -13,8 +13,17 @@
 // You should have received a copy of the GNU General Public License
 // along with Lick.  If not, see <https://www.gnu.org/licenses/>.
 
+#ifdef UNIX
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+#define _GNU_SOURCE		/* copy_file_range() */
+#endif
+#endif
+
 #include	<stdlib.h>
+#include	<stdio.h>
 #include	<string.h>
+#include	<time.h>
 
 #include  "types_lib.h"
 #include	"platform.h"
@@ -25,6 +34,22 @@
 #include	<proto/dos.h>
 #endif
 
+#ifdef UNIX
+#include	<errno.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<dirent.h>
+#include	<sys/stat.h>
+#include	<sys/types.h>
+#endif
+
+#ifdef __linux__
+#include	<sys/sendfile.h>
+#endif
+
+#define COPY_BUFFER_LEN		(64 * 1024)
+#define HOLE_LEN					4096
+
 bool
 pl_getFileInfo (char *file, struct fsInfo *fs)
 {
@@ -63,3 +88,411 @@ pl_getFileInfo (char *file, struct fsInfo *fs)
 
   return true;
 }
+
+bool
+pl_getFileStamp (char *file, unsigned long *size, unsigned long *mtime)
+{
+#ifdef AMIGA
+  BPTR h;
+  struct FileInfoBlock *fib;
+  bool ret_val;
+
+
+  h = Lock (file, ACCESS_READ);
+  if (NULL == h)
+    return false;
+
+  fib = AllocDosObject (DOS_FIB, NULL);
+  if (NULL == fib)
+  {
+    UnLock (h);
+    return false;
+  }
+
+  ret_val = FALSE != Examine (h, fib);
+  if (ret_val)
+  {
+    *size = fib->fib_Size;
+    *mtime = fib->fib_Date.ds_Days * 86400 + fib->fib_Date.ds_Minute * 60 + fib->fib_Date.ds_Tick / TICKS_PER_SECOND;
+  }
+
+  FreeDosObject (DOS_FIB, fib);
+  UnLock (h);
+
+  return ret_val;
+#elif UNIX
+  struct stat st;
+
+  if (0 != stat (file, &st))
+    return false;
+
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+unsigned long
+pl_getTime (void)
+{
+#ifdef AMIGA
+  struct DateStamp ds;
+
+  DateStamp (&ds);
+
+  return ds.ds_Days * 86400 + ds.ds_Minute * 60 + ds.ds_Tick / TICKS_PER_SECOND;
+#else
+  return time (NULL);
+#endif
+}
+
+bool
+pl_copyData (FILE *from, unsigned long offset, unsigned long size, FILE *to)
+{
+  unsigned char *buffer;
+  unsigned long to_offset,
+                n;
+  bool ret_val = true;
+
+  if (0 != fflush (to))
+    return false;
+
+  to_offset = ftell (to);
+
+#ifdef __linux__
+  {
+    loff_t in = offset,
+           out = to_offset;
+    off_t sent;
+    ssize_t r;
+
+    /* within the one filesystem the data may not even be read */
+    while (size > 0)
+    {
+      r = copy_file_range (fileno (from), &in, fileno (to), &out, size, 0);
+      if (r <= 0)
+        break; /* while loop */
+
+      size -= r;
+    }
+
+    /* otherwise it is still copied in the kernel */
+    if (size > 0 && (off_t) out == lseek (fileno (to), out, SEEK_SET))
+    {
+      sent = in;
+      while (size > 0)
+      {
+        r = sendfile (fileno (to), fileno (from), &sent, size);
+        if (r <= 0)
+          break; /* while loop */
+
+        size -= r;
+        out += r;
+      }
+      in = sent;
+    }
+
+    offset = in;
+    to_offset = out;
+  }
+#endif
+
+  if (0 != fseek (to, to_offset, SEEK_SET))
+    return false;
+
+  if (0 == size)
+    return true;
+
+  /* what is left, by way of a buffer */
+  if (0 != fseek (from, offset, SEEK_SET))
+    return false;
+
+  buffer = malloc (COPY_BUFFER_LEN);
+  if (NULL == buffer)
+    return false;
+
+  while (size > 0 && ret_val)
+  {
+    n = size < COPY_BUFFER_LEN ? size : COPY_BUFFER_LEN;
+
+    ret_val = n == fread (buffer, sizeof (char), n, from) && n == fwrite (buffer, sizeof (char), n, to);
+    size -= n;
+  }
+
+  free (buffer);
+
+  return ret_val;
+}
+
+static bool
+pl_isZero (unsigned char *data, unsigned long size)
+{
+  return 0 == data[0] && 0 == memcmp (data, data + 1, size - 1);
+}
+
+bool
+pl_writeSparse (FILE *to, unsigned char *data, unsigned long size)
+{
+#ifdef UNIX
+  unsigned long at,
+                i = 0,
+                j,
+                n;
+  bool zero;
+  long pos;
+
+  pos = ftell (to);
+  if (pos < 0)
+    return false;
+
+  at = pos;
+
+  while (i < size)
+  {
+    /* as far as the next hole's worth from the start of the file */
+    n = HOLE_LEN - (at + i) % HOLE_LEN;
+    if (n > size - i)
+      n = size - i;
+
+    zero = HOLE_LEN == n && pl_isZero (data + i, n);
+
+    /* and on through as many after it that are the same */
+    for (j = i + n; j < size; j += n)
+    {
+      n = size - j < HOLE_LEN ? size - j : HOLE_LEN;
+      if (zero != (HOLE_LEN == n && pl_isZero (data + j, n)))
+        break; /* for loop */
+    }
+
+    if (zero)
+    {
+      if (0 != fseek (to, j - i, SEEK_CUR))
+        return false;
+    }
+    else if (j - i != fwrite (data + i, sizeof (char), j - i, to))
+    {
+      return false;
+    }
+
+    i = j;
+  }
+
+  return true;
+#else
+  return size == fwrite (data, sizeof (char), size, to);
+#endif
+}
+
+bool
+pl_endSparse (FILE *to)
+{
+#ifdef UNIX
+  long pos;
+
+  /* a hole at the end is only a seek until the file is made that long */
+  pos = ftell (to);
+
+  return pos >= 0 && 0 == fflush (to) && 0 == ftruncate (fileno (to), pos);
+#else
+  return 0 == fflush (to);
+#endif
+}
+
+bool
+pl_makePath (char *file)
+{
+  char *path,
+       *p;
+  bool ret_val = true;
+
+  path = malloc (strlen (file) + 1);
+  if (NULL == path)
+    return false;
+  strcpy (path, file);
+
+  /* each directory in turn, the leading one of an absolute path aside */
+  for (p = strchr (path + 1, '/'); NULL != p && ret_val; p = strchr (p + 1, '/'))
+  {
+    *p = '\0';
+
+#ifdef AMIGA
+    {
+      BPTR l;
+
+      l = Lock (path, ACCESS_READ);
+      if (NULL == l)
+        l = CreateDir (path);
+
+      if (NULL == l)
+        ret_val = false;
+      else
+        UnLock (l);
+    }
+#elif UNIX
+    /* another thread may just have made it */
+    if (0 != mkdir (path, 0777) && EEXIST != errno)
+      ret_val = false;
+#endif
+
+    *p = '/';
+  }
+
+  free (path);
+
+  return ret_val;
+}
+
+bool
+pl_isDir (char *file)
+{
+#ifdef AMIGA
+  BPTR l;
+  struct FileInfoBlock *fib;
+  bool ret_val;
+
+
+  l = Lock (file, ACCESS_READ);
+  if (NULL == l)
+    return false;
+
+  fib = AllocDosObject (DOS_FIB, NULL);
+  if (NULL == fib)
+  {
+    UnLock (l);
+    return false;
+  }
+
+  ret_val = FALSE != Examine (l, fib) && fib->fib_DirEntryType > 0 && ST_SOFTLINK != fib->fib_DirEntryType;
+
+  FreeDosObject (DOS_FIB, fib);
+  UnLock (l);
+
+  return ret_val;
+#elif UNIX
+  struct stat st;
+
+  return 0 == lstat (file, &st) && S_ISDIR (st.st_mode);
+#else
+  return false;
+#endif
+}
+
+bool
+pl_sameFile (char *a, char *b)
+{
+#ifdef AMIGA
+  BPTR la,
+       lb;
+  bool ret_val;
+
+
+  la = Lock (a, ACCESS_READ);
+  lb = Lock (b, ACCESS_READ);
+
+  ret_val = NULL != la && NULL != lb && LOCK_SAME == SameLock (la, lb);
+
+  if (NULL != la)
+    UnLock (la);
+  if (NULL != lb)
+    UnLock (lb);
+
+  return ret_val;
+#elif UNIX
+  struct stat sa,
+              sb;
+
+  return 0 == stat (a, &sa) && 0 == stat (b, &sb) && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#else
+  return 0 == strcmp (a, b);
+#endif
+}
+
+bool
+pl_readDir (char *dir, plDirFunc func, void *data)
+{
+#ifdef AMIGA
+  BPTR l;
+  struct FileInfoBlock *fib;
+  bool ret_val = true;
+
+
+  l = Lock (dir, ACCESS_READ);
+  if (NULL == l)
+    return false;
+
+  fib = AllocDosObject (DOS_FIB, NULL);
+  if (NULL == fib || FALSE == Examine (l, fib))
+  {
+    if (NULL != fib)
+      FreeDosObject (DOS_FIB, fib);
+    UnLock (l);
+    return false;
+  }
+
+  while (ret_val && FALSE != ExNext (l, fib))
+  {
+    if (ST_SOFTLINK == fib->fib_DirEntryType)
+      continue; /* while loop */
+
+    ret_val = func (data, fib->fib_FileName, fib->fib_DirEntryType > 0, fib->fib_Size,
+        fib->fib_Date.ds_Days * 86400 + fib->fib_Date.ds_Minute * 60 + fib->fib_Date.ds_Tick / TICKS_PER_SECOND);
+  }
+
+  if (ret_val && ERROR_NO_MORE_ENTRIES != IoErr ())
+    ret_val = false;
+
+  FreeDosObject (DOS_FIB, fib);
+  UnLock (l);
+
+  return ret_val;
+#elif UNIX
+  DIR *d;
+  struct dirent *de;
+  struct stat st;
+  bool is_link,
+       ret_val = true;
+
+  d = opendir (dir);
+  if (NULL == d)
+    return false;
+
+  for (;;)
+  {
+    errno = 0;
+    de = readdir (d);
+    if (NULL == de)
+    {
+      ret_val = 0 == errno;
+      break; /* for loop */
+    }
+
+    if (0 == strcmp (de->d_name, ".") || 0 == strcmp (de->d_name, ".."))
+      continue; /* for loop */
+
+    /* a link is to what it links to, unless that is a directory */
+    if (0 != fstatat (dirfd (d), de->d_name, &st, AT_SYMLINK_NOFOLLOW))
+      continue; /* for loop */
+
+    is_link = S_ISLNK (st.st_mode);
+    if (is_link && 0 != fstatat (dirfd (d), de->d_name, &st, 0))
+      continue; /* for loop */
+
+    if (S_ISDIR (st.st_mode) && false == is_link)
+      ret_val = func (data, de->d_name, true, 0, 0);
+    else if (S_ISREG (st.st_mode))
+      ret_val = func (data, de->d_name, false, st.st_size, st.st_mtime);
+
+    if (false == ret_val)
+      break; /* for loop */
+  }
+
+  closedir (d);
+
+  return ret_val;
+#else
+  return false;
+#endif
+}
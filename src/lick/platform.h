@@ -16,6 +16,8 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+#include	<stdio.h>
+
 #include  "types_lib.h"
 
 #ifdef AMIGA
@@ -46,4 +48,38 @@ struct fsInfo
 
 bool pl_getFileInfo (char *file, struct fsInfo *fs);
 
+/* the size of a file and when it was last modified, in seconds, without opening it */
+bool pl_getFileStamp (char *file, unsigned long *size, unsigned long *mtime);
+
+/* the time now, in the seconds of pl_getFileStamp() */
+unsigned long pl_getTime (void);
+
+/* size bytes from the offset in one file to where the other is, and
+   leaves the other after them. the data isn't read into memory where
+   the system can copy it by itself */
+bool pl_copyData (FILE *from, unsigned long offset, unsigned long size, FILE *to);
+
+/* size bytes to the end of a file being written. a block of zeros that
+   lines up with the file system's blocks is seeked over rather than
+   written, so that the file is left with a hole there. pl_endSparse()
+   then gives the file its whole size, once everything is written */
+bool pl_writeSparse (FILE *to, unsigned char *data, unsigned long size);
+bool pl_endSparse (FILE *to);
+
+/* make the directories leading up to file, where they don't exist */
+bool pl_makePath (char *file);
+
+/* whether the name is of a directory, and not a link to one */
+bool pl_isDir (char *file);
+
+/* whether the two names are of the one file */
+bool pl_sameFile (char *a, char *b);
+
+/* each entry of the directory in turn, to the function given with its
+   name and, unless it is a directory, its size and modified time. what
+   is neither a file nor a directory -- and a link to a directory -- is
+   left out. stops when the function returns false */
+typedef bool (*plDirFunc) (void *data, char *name, bool is_dir, unsigned long size, unsigned long mtime);
+bool pl_readDir (char *dir, plDirFunc func, void *data);
+
 #endif /* PLATFORM_H */
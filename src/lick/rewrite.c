@@ -0,0 +1,482 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+
+#include	<llist_lib.h>
+
+#include  "types_lib.h"
+#include	"locale.h"
+#include	"fileformat.h"
+#include	"platform.h"
+#include	"lick.h"
+
+
+/*
+   hunks go from one archive to another as they are, and are never
+   decompressed. a hunk runs from its header to the end of its compressed
+   data, which is all in the directory. the members of a solid hunk share
+   it, and it is copied whole if any of them is kept -- the others stay
+   in its data, but not in the directory.
+
+   deleting and compacting write a new archive beside the old one, which
+   it takes the place of once it is complete. merging puts the hunks of
+   the other archives on the end of the first, as adding files does, and
+   a file in more than one of them is left with its last entry
+ */
+#define REWRITE_SUFFIX		".tmp"
+
+struct rewriteHunk
+{
+	unsigned long         hunk_offset;
+	unsigned long         entry;
+};
+
+
+static int
+rewrite_compareHunks (const void *a, const void *b)
+{
+	const struct rewriteHunk *x = a,
+													 *y = b;
+
+	if (x->hunk_offset != y->hunk_offset)
+		return x->hunk_offset < y->hunk_offset ? -1 : 1;
+
+	return x->entry < y->entry ? -1 : x->entry > y->entry;
+}
+
+
+/* the hunks of the entries kept, or of all of them, onto the end of the
+	 other archive, each with its entries in the other's directory */
+static bool
+rewrite_copyHunks (FILE *from, struct lickDirectory *dir, bool *keep, FILE *to, struct lickDirectory *to_dir)
+{
+	struct rewriteHunk *order;
+	struct dirEntry *first,
+									e;
+	unsigned long num = 0,
+								start,
+								i,
+								k;
+	bool ret_val = true;
+
+	order = malloc ((dir->num_entries + 1) * sizeof *order);
+	if (NULL == order)
+		return false;
+
+	for (i = 0; i < dir->num_entries; ++ i)
+	{
+		if (NULL != keep && false == keep[i])
+			continue; /* for loop */
+
+		order[num].hunk_offset = dir->entries[i].hunk_offset;
+		order[num].entry = i;
+		++ num;
+	}
+
+	qsort (order, num, sizeof *order, rewrite_compareHunks);
+
+	for (i = 0; i < num && ret_val; i = k)
+	{
+		first = &dir->entries[order[i].entry];
+		start = ftell (to);
+
+		if (false == pl_copyData (from, first->hunk_offset, first->data_offset + first->compressed_size - first->hunk_offset, to))
+		{
+			ret_val = false;
+			break; /* for loop */
+		}
+
+		for (k = i; k < num && order[k].hunk_offset == order[i].hunk_offset && ret_val; ++ k)
+		{
+			e = dir->entries[order[k].entry];
+			e.data_offset = e.data_offset - e.hunk_offset + start;
+			e.hunk_offset = start;
+
+			ret_val = ff_addEntry (to_dir, &e);
+		}
+	}
+
+	free (order);
+
+	return ret_val;
+}
+
+
+/* an archive and its directory, for reading */
+static FILE *
+rewrite_openArchive (char *archive, struct lickDirectory *dir, unsigned long *end)
+{
+	FILE *h;
+
+	switch (ff_checkFile (archive))
+	{
+		case AS_NOT_EXIST:
+			printf (LOC_NOT_OPEN_ARC, archive);
+			return NULL;
+
+		case AS_NOT_LICK_FILE:
+			printf (LOC_AS_NOT_LICK_FILE, archive);
+			return NULL;
+	}
+
+	h = fopen (archive, "rb");
+	if (NULL == h)
+	{
+		printf (LOC_NOT_OPEN_ARC, archive);
+		return NULL;
+	}
+
+	if (false == ff_readDirectory (h, dir, end))
+	{
+		printf (LOC_CANT_READ_ARC, archive);
+		fclose (h);
+		return NULL;
+	}
+
+	return h;
+}
+
+
+static int
+rewrite_compareNames (const void *a, const void *b)
+{
+	return strcmp ((*(struct dirEntry * const *) a)->file, (*(struct dirEntry * const *) b)->file);
+}
+
+
+/* every entry but those of the files named. a name that isn't in the
+	 archive is reported, and the rest are deleted anyway */
+static bool
+rewrite_chooseFiles (struct lickOptions *options, struct lickDirectory *dir, bool *keep, unsigned long *deleted, unsigned long *missing)
+{
+	struct dirEntry **by_name,
+									key,
+									*k = &key,
+									**found;
+	struct lnode *n;
+	unsigned long i;
+
+	for (i = 0; i < dir->num_entries; ++ i)
+		keep[i] = true;
+
+	by_name = malloc ((dir->num_entries + 1) * sizeof *by_name);
+	if (NULL == by_name)
+		return false;
+
+	for (i = 0; i < dir->num_entries; ++ i)
+		by_name[i] = &dir->entries[i];
+	qsort (by_name, dir->num_entries, sizeof *by_name, rewrite_compareNames);
+
+	n = ll_initialiseSearch (options->files);
+	while (0 == ll_isEndOfList (options->files, n))
+	{
+		key.file = (char *) ll_returnNodeData (n);
+
+		found = bsearch (&k, by_name, dir->num_entries, sizeof *by_name, rewrite_compareNames);
+		if (NULL == found)
+		{
+			printf (LOC_NOT_IN_ARC, key.file);
+			++ *missing;
+		}
+		else
+		{
+			/* the first of the same name, and all those after it */
+			while (found > by_name && 0 == strcmp ((*(found - 1))->file, key.file))
+				-- found;
+
+			for (; found < by_name + dir->num_entries && 0 == strcmp ((*found)->file, key.file); ++ found)
+			{
+				if (keep[*found - dir->entries])
+					++ *deleted;
+
+				keep[*found - dir->entries] = false;
+			}
+		}
+
+		n = ll_advancePointer (n);
+	}
+
+	free (by_name);
+
+	return true;
+}
+
+
+/* with LA_DELETE, the archive without the files named, and with
+	 LA_COMPACT, without the hunks that no entry uses */
+static bool
+rewrite_archive (struct lickOptions *options)
+{
+	struct lickDirectory dir,
+											 new_dir;
+	FILE *from,
+			 *to;
+	char *temp;
+	bool *keep = NULL;
+	unsigned long end,
+								old_size,
+								new_size = 0,
+								old_hunks = 0,
+								new_hunks = 0,
+								deleted = 0,
+								missing = 0,
+								i;
+	bool ret_val;
+
+	ff_initDirectory (&dir);
+	ff_initDirectory (&new_dir);
+
+	from = rewrite_openArchive (options->archive, &dir, &end);
+	if (NULL == from)
+	{
+		ff_freeDirectory (&dir);
+		return false;
+	}
+
+	if (LA_DELETE == options->action)
+	{
+		keep = malloc ((dir.num_entries + 1) * sizeof *keep);
+		if (NULL == keep || false == rewrite_chooseFiles (options, &dir, keep, &deleted, &missing))
+		{
+			puts (LOC_OUT_OF_MEM);
+			free (keep);
+			ff_freeDirectory (&dir);
+			fclose (from);
+			return false;
+		}
+
+		/* nothing to rewrite the archive for */
+		if (0 == deleted)
+		{
+			free (keep);
+			ff_freeDirectory (&dir);
+			fclose (from);
+			return 0 == missing;
+		}
+	}
+
+	/* what compacting drops is what no entry is of, so the hunks are counted */
+	if (LA_COMPACT == options->action && false == ff_countHunks (from, &old_hunks))
+	{
+		printf (LOC_CANT_READ_ARC, options->archive);
+		ff_freeDirectory (&dir);
+		fclose (from);
+		return false;
+	}
+
+	fseek (from, 0, SEEK_END);
+	old_size = ftell (from);
+
+	temp = malloc (strlen (options->archive) + strlen (REWRITE_SUFFIX) + 1);
+	if (NULL == temp)
+	{
+		puts (LOC_OUT_OF_MEM);
+		free (keep);
+		ff_freeDirectory (&dir);
+		fclose (from);
+		return false;
+	}
+	strcpy (temp, options->archive);
+	strcat (temp, REWRITE_SUFFIX);
+
+	to = fopen (temp, "wb");
+	if (NULL == to)
+	{
+		printf (LOC_NOT_OPEN_ARC, temp);
+		free (temp);
+		free (keep);
+		ff_freeDirectory (&dir);
+		fclose (from);
+		return false;
+	}
+
+	ret_val = ff_writeArchiveHead (to)
+		&& rewrite_copyHunks (from, &dir, keep, to, &new_dir)
+		&& ff_writeDirectory (to, &new_dir);
+
+	if (ret_val)
+		new_size = ftell (to);
+
+	if (0 != fclose (to))
+		ret_val = false;
+	fclose (from);
+
+	if (false == ret_val)
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		remove (temp);
+	}
+	else if (0 != rename (temp, options->archive))
+	{
+		printf (LOC_CANT_REPLACE_ARC, options->archive);
+		remove (temp);
+		ret_val = false;
+	}
+	else if (LA_COMPACT == options->action)
+	{
+		for (i = 0; i < new_dir.num_entries; ++ i)
+			if (0 == i || new_dir.entries[i].hunk_offset != new_dir.entries[i - 1].hunk_offset)
+				++ new_hunks;
+
+		printf (LOC_COMPACT_TOTAL, old_hunks - new_hunks, new_hunks, old_size - new_size);
+	}
+	else
+	{
+		printf (LOC_DELETE_TOTAL, deleted, new_dir.num_entries, old_size - new_size);
+	}
+
+	free (temp);
+	free (keep);
+	ff_freeDirectory (&new_dir);
+	ff_freeDirectory (&dir);
+
+	return ret_val && 0 == missing;
+}
+
+
+/* the archives named, one after the other onto the end of this one */
+static bool
+rewrite_merge (struct lickOptions *options)
+{
+	struct lickDirectory dir,
+											 other;
+	struct lnode *n;
+	FILE *to,
+			 *from;
+	char *file;
+	unsigned long end,
+								first_new,
+								merged = 0,
+								errors = 0;
+	bool ret_val = true;
+
+	ff_initDirectory (&dir);
+
+	switch (ff_checkFile (options->archive))
+	{
+		case AS_NOT_LICK_FILE:
+			printf (LOC_AS_NOT_LICK_FILE, options->archive);
+			return false;
+
+		case AS_LICK_FILE:
+			to = fopen (options->archive, "rb+");
+			if (NULL == to)
+			{
+				printf (LOC_NOT_OPEN_ARC, options->archive);
+				return false;
+			}
+
+			/* the other archives' hunks go over the old directory */
+			if (false == ff_readDirectory (to, &dir, &end) || 0 != fseek (to, end, SEEK_SET))
+			{
+				printf (LOC_CANT_READ_ARC, options->archive);
+				ff_freeDirectory (&dir);
+				fclose (to);
+				return false;
+			}
+			break;
+
+		default:
+			to = fopen (options->archive, "wb+");
+			if (NULL == to)
+			{
+				printf (LOC_NOT_OPEN_ARC, options->archive);
+				return false;
+			}
+
+			if (false == ff_writeArchiveHead (to))
+			{
+				puts (LOC_CANT_WRITE_ARC);
+				fclose (to);
+				return false;
+			}
+			break;
+	}
+
+	n = ll_initialiseSearch (options->files);
+	while (0 == ll_isEndOfList (options->files, n) && ret_val)
+	{
+		file = (char *) ll_returnNodeData (n);
+		n = ll_advancePointer (n);
+
+		if (0 == strcmp (file, options->archive))
+		{
+			printf (LOC_MERGE_SELF, file);
+			++ errors;
+			continue; /* while loop */
+		}
+
+		ff_initDirectory (&other);
+
+		from = rewrite_openArchive (file, &other, &end);
+		if (NULL == from)
+		{
+			++ errors;
+			ff_freeDirectory (&other);
+			continue; /* while loop */
+		}
+
+		/* a file in this archive and one before it is left with this one's entry */
+		first_new = dir.num_entries;
+
+		if (false == rewrite_copyHunks (from, &other, NULL, to, &dir)
+				|| false == ff_dropReplaced (&dir, first_new))
+		{
+			puts (LOC_CANT_WRITE_ARC);
+			ret_val = false;
+		}
+		else
+		{
+			merged += other.num_entries;
+		}
+
+		fclose (from);
+		ff_freeDirectory (&other);
+	}
+
+	/* the archives that did get copied go in the directory either way */
+	if (false == ff_writeDirectory (to, &dir)
+			|| 0 != fflush (to)
+			|| 0 != ftruncate (fileno (to), ftell (to)))
+	{
+		puts (LOC_CANT_WRITE_ARC);
+		ret_val = false;
+	}
+
+	if (0 != fclose (to))
+		ret_val = false;
+
+	printf (LOC_MERGE_TOTAL, merged, errors);
+
+	ff_freeDirectory (&dir);
+
+	return ret_val && 0 == errors;
+}
+
+
+bool
+rewrite (struct lickOptions *options)
+{
+	if (LA_MERGE == options->action)
+		return rewrite_merge (options);
+
+	return rewrite_archive (options);
+}
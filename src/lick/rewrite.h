@@ -0,0 +1,25 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef REWRITE_H
+#define REWRITE_H
+
+#include	"lick.h"
+
+/* delete files from the archive (LA_DELETE), leave out what nothing is
+   using any more (LA_COMPACT) or add other archives to it (LA_MERGE) */
+bool rewrite (struct lickOptions *);
+
+#endif /* REWRITE_H */
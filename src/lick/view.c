@@ -0,0 +1,106 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#include	<stdlib.h>
+#include	<stdio.h>
+
+#include  "types_lib.h"
+#include	"locale.h"
+#include	"fileformat.h"
+#include	"lick.h"
+
+
+static const char *
+view_mode (unsigned char mode)
+{
+	switch (mode)
+	{
+		case CT_BWT:
+			return LOC_VIEW_BWT;
+
+		case CT_DELTA:
+			return LOC_VIEW_DELTA;
+
+		default:
+			return LOC_VIEW_STORE;
+	}
+}
+
+
+/* list the files in the archive -- only the directory is read. older
+	 versions kept as the bases of deltas aren't files in it any more */
+bool
+view (struct lickOptions *options)
+{
+	struct lickDirectory dir;
+	struct dirEntry *e;
+	FILE *h;
+	unsigned long end,
+								total = 0,
+								files = 0,
+								i;
+
+	switch (ff_checkFile (options->archive))
+	{
+		case AS_NOT_EXIST:
+			printf (LOC_NOT_OPEN_ARC, options->archive);
+			return false;
+
+		case AS_NOT_LICK_FILE:
+			printf (LOC_AS_NOT_LICK_FILE, options->archive);
+			return false;
+	}
+
+	h = fopen (options->archive, "rb");
+	if (NULL == h)
+	{
+		printf (LOC_NOT_OPEN_ARC, options->archive);
+		return false;
+	}
+
+	ff_initDirectory (&dir);
+	if (false == ff_readDirectory (h, &dir, &end))
+	{
+		printf (LOC_CANT_READ_ARC, options->archive);
+		ff_freeDirectory (&dir);
+		fclose (h);
+		return false;
+	}
+	fclose (h);
+
+	puts (LOC_VIEW_HEAD);
+
+	for (i = 0; i < dir.num_entries; ++ i)
+	{
+		e = &dir.entries[i];
+		if (e->base_only)
+			continue; /* for loop */
+
+		/* the members of a solid hunk share its compressed size */
+		if (e->solid)
+			printf (LOC_VIEW_SOLID, e->uncompressed_size, view_mode (e->mode), e->file);
+		else
+			printf (LOC_VIEW_ENTRY, e->uncompressed_size, e->compressed_size, view_mode (e->mode), e->file);
+
+		total += e->uncompressed_size;
+		++ files;
+	}
+
+	printf (LOC_VIEW_TOTAL, total, files, end);
+
+	ff_freeDirectory (&dir);
+
+	return true;
+}
@@ -0,0 +1,469 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include	<stdlib.h>
+#include	<stdio.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+
+#include	<llist_lib.h>
+
+#include  "types_lib.h"
+#include	"locale.h"
+#include	"platform.h"
+#include	"fileformat.h"
+#include	"walk.h"
+
+
+/*
+   directories are read by a pool of threads, as many as there are
+   processors, each taking the next directory waiting to be read and
+   leaving behind those it finds in it for whichever thread is free. the
+   walk is over when none are waiting and none are being read. each
+   thread keeps a list of the files it finds, and they are put together
+   and sorted at the end, so that the same tree always gives the same list
+ */
+#define WALK_NAMES_SIZE		(64 * 1024)
+#define WALK_FILES				1024
+
+struct walkDir
+{
+	char *                path;
+	unsigned long         arg;
+};
+
+struct walkShared
+{
+	pthread_mutex_t       lock;
+	pthread_cond_t        more;
+
+	/* everything below is under lock */
+	struct walkDir *      dirs;
+	unsigned long         num_dirs;
+	unsigned long         max_dirs;
+	unsigned long         busy;
+	bool                  abort;
+};
+
+struct walkThread
+{
+	struct walkShared *   shared;
+	struct walkList       list;
+
+	/* the directory being read, and those found in it */
+	struct walkDir        dir;
+	struct walkDir *      found;
+	unsigned long         num_found;
+	unsigned long         max_found;
+
+	bool                  out_of_mem;
+};
+
+
+void
+walk_initList (struct walkList *list)
+{
+	memset (list, 0, sizeof *list);
+}
+
+
+void
+walk_freeList (struct walkList *list)
+{
+	free (list->names);
+	free (list->files);
+	walk_initList (list);
+}
+
+
+/* the memory, doubled in size until there is as much as is needed, or
+	 NULL if there isn't that much -- when it is left as it was */
+static void *
+walk_grow (void *p, unsigned long *max, unsigned long need, unsigned long least, size_t size)
+{
+	unsigned long n = *max;
+
+	if (need <= n && NULL != p)
+		return p;
+
+	if (n < least)
+		n = least;
+	while (n < need)
+		n *= 2;
+
+	p = realloc (p, n * size);
+	if (NULL != p)
+		*max = n;
+
+	return p;
+}
+
+
+/* the directory's path and the name, with a slash between them if there isn't one */
+static char *
+walk_join (char *path, char *name, char *to)
+{
+	size_t len = strlen (path);
+
+	memcpy (to, path, len);
+	if (len > 0 && '/' != path[len - 1] && ':' != path[len - 1])
+		to[len ++] = '/';
+	strcpy (to + len, name);
+
+	return to;
+}
+
+
+static bool
+walk_addFile (struct walkList *list, char *path, char *name, unsigned long arg, bool stamped, unsigned long size, unsigned long mtime)
+{
+	struct walkFile *f;
+	unsigned long len = (NULL == path ? 0 : strlen (path) + 1) + strlen (name) + 1;
+	char *names;
+
+	names = walk_grow (list->names, &list->names_size, list->names_used + len, WALK_NAMES_SIZE, sizeof *list->names);
+	if (NULL == names)
+		return false;
+	list->names = names;
+
+	f = walk_grow (list->files, &list->max_files, list->num_files + 1, WALK_FILES, sizeof *list->files);
+	if (NULL == f)
+		return false;
+	list->files = f;
+
+	if (NULL == path)
+		strcpy (list->names + list->names_used, name);
+	else
+		walk_join (path, name, list->names + list->names_used);
+
+	f = &list->files[list->num_files ++];
+	f->name = list->names_used;
+	f->arg = arg;
+	f->stamped = stamped;
+	f->size = size;
+	f->mtime = mtime;
+
+	list->names_used += strlen (list->names + list->names_used) + 1;
+
+	return true;
+}
+
+
+static bool
+walk_entry (void *data, char *name, bool is_dir, unsigned long size, unsigned long mtime)
+{
+	struct walkThread *t = (struct walkThread *) data;
+	struct walkDir *found,
+								 *d;
+
+	if (false == is_dir)
+	{
+		if (walk_addFile (&t->list, t->dir.path, name, t->dir.arg, true, size, mtime))
+			return true;
+
+		t->out_of_mem = true;
+		return false;
+	}
+
+	found = walk_grow (t->found, &t->max_found, t->num_found + 1, 16, sizeof *t->found);
+	if (NULL == found)
+	{
+		t->out_of_mem = true;
+		return false;
+	}
+	t->found = found;
+
+	d = &t->found[t->num_found];
+	d->arg = t->dir.arg;
+	d->path = malloc (strlen (t->dir.path) + strlen (name) + 2);
+	if (NULL == d->path)
+	{
+		t->out_of_mem = true;
+		return false;
+	}
+
+	walk_join (t->dir.path, name, d->path);
+	++ t->num_found;
+
+	return true;
+}
+
+
+/* directories waiting to be read, onto the stack of them */
+static bool
+walk_pushDirs (struct walkShared *shared, struct walkDir *dirs, unsigned long num)
+{
+	struct walkDir *d;
+
+	if (0 == num)
+		return true;
+
+	d = walk_grow (shared->dirs, &shared->max_dirs, shared->num_dirs + num, 64, sizeof *shared->dirs);
+	if (NULL == d)
+		return false;
+	shared->dirs = d;
+
+	memcpy (shared->dirs + shared->num_dirs, dirs, num * sizeof *dirs);
+	shared->num_dirs += num;
+
+	return true;
+}
+
+
+/* read directories until there are none left to read */
+static void *
+walk_thread (void *arg)
+{
+	struct walkThread *t = (struct walkThread *) arg;
+	struct walkShared *shared = t->shared;
+	unsigned long i;
+
+	for (;;)
+	{
+		pthread_mutex_lock (&shared->lock);
+
+		while (false == shared->abort && 0 == shared->num_dirs && shared->busy > 0)
+			pthread_cond_wait (&shared->more, &shared->lock);
+
+		if (shared->abort || 0 == shared->num_dirs)
+		{
+			pthread_cond_broadcast (&shared->more);
+			pthread_mutex_unlock (&shared->lock);
+			break; /* for loop */
+		}
+
+		t->dir = shared->dirs[-- shared->num_dirs];
+		++ shared->busy;
+		pthread_mutex_unlock (&shared->lock);
+
+		t->num_found = 0;
+		if (false == pl_readDir (t->dir.path, walk_entry, t) && false == t->out_of_mem)
+		{
+			printf (LOC_DIR_READ_ERR, t->dir.path);
+			++ t->list.errors;
+		}
+
+		free (t->dir.path);
+
+		pthread_mutex_lock (&shared->lock);
+
+		/* what was found of a directory that couldn't be read is still read */
+		if (t->out_of_mem || false == walk_pushDirs (shared, t->found, t->num_found))
+		{
+			t->out_of_mem = true;
+			shared->abort = true;
+
+			for (i = 0; i < t->num_found; ++ i)
+				free (t->found[i].path);
+		}
+
+		-- shared->busy;
+		pthread_cond_broadcast (&shared->more);
+		pthread_mutex_unlock (&shared->lock);
+	}
+
+	return NULL;
+}
+
+
+/* one thread's files onto the end of the list */
+static bool
+walk_mergeList (struct walkList *list, struct walkList *from)
+{
+	struct walkFile *files;
+	char *names;
+	unsigned long i;
+
+	list->errors += from->errors;
+
+	if (0 == from->num_files)
+		return true;
+
+	names = walk_grow (list->names, &list->names_size, list->names_used + from->names_used, WALK_NAMES_SIZE, sizeof *list->names);
+	if (NULL == names)
+		return false;
+	list->names = names;
+
+	files = walk_grow (list->files, &list->max_files, list->num_files + from->num_files, WALK_FILES, sizeof *list->files);
+	if (NULL == files)
+		return false;
+	list->files = files;
+
+	memcpy (list->names + list->names_used, from->names, from->names_used);
+
+	for (i = 0; i < from->num_files; ++ i)
+	{
+		list->files[list->num_files] = from->files[i];
+		list->files[list->num_files].name += list->names_used;
+		++ list->num_files;
+	}
+
+	list->names_used += from->names_used;
+
+	return true;
+}
+
+
+static struct walkList *walk_sortList;
+
+static int
+walk_compareFiles (const void *a, const void *b)
+{
+	const struct walkFile *x = a,
+												*y = b;
+
+	if (x->arg != y->arg)
+		return x->arg < y->arg ? -1 : 1;
+
+	return strcmp (walk_sortList->names + x->name, walk_sortList->names + y->name);
+}
+
+
+/* the directories waiting to be read, by threads of their own unless
+	 none can be started */
+static bool
+walk_dirs (struct walkShared *shared, struct walkList *list)
+{
+	struct walkThread *threads;
+	pthread_t *ids;
+	unsigned long num,
+								started,
+								i;
+	long cpus;
+	bool ret_val = true;
+
+	cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	num = 0 < cpus ? cpus : 1;
+
+	threads = calloc (num, sizeof *threads);
+	ids = malloc (num * sizeof *ids);
+	if (NULL == threads || NULL == ids)
+	{
+		for (i = 0; i < shared->num_dirs; ++ i)
+			free (shared->dirs[i].path);
+
+		free (threads);
+		free (ids);
+		return false;
+	}
+
+	pthread_mutex_init (&shared->lock, NULL);
+	pthread_cond_init (&shared->more, NULL);
+
+	for (i = 0; i < num; ++ i)
+		threads[i].shared = shared;
+
+	for (started = 0; started < num; ++ started)
+		if (0 != pthread_create (&ids[started], NULL, walk_thread, &threads[started]))
+			break; /* for loop */
+
+	if (0 == started)
+		walk_thread (&threads[0]);
+
+	for (i = 0; i < started; ++ i)
+		pthread_join (ids[i], NULL);
+
+	for (i = 0; i < num; ++ i)
+	{
+		if (threads[i].out_of_mem || false == walk_mergeList (list, &threads[i].list))
+			ret_val = false;
+
+		walk_freeList (&threads[i].list);
+		free (threads[i].found);
+	}
+
+	/* left by an abort */
+	for (i = 0; i < shared->num_dirs; ++ i)
+		free (shared->dirs[i].path);
+
+	pthread_cond_destroy (&shared->more);
+	pthread_mutex_destroy (&shared->lock);
+
+	free (threads);
+	free (ids);
+
+	return ret_val;
+}
+
+
+bool
+walk (struct llist *names, struct walkList *list)
+{
+	struct walkShared shared;
+	struct walkDir d;
+	struct lnode *n;
+	unsigned long size,
+								mtime;
+	char *name;
+	bool stamped,
+			 ret_val = true;
+
+	memset (&shared, 0, sizeof shared);
+
+	d.arg = 0;
+	n = ll_initialiseSearch (names);
+	while (0 == ll_isEndOfList (names, n) && ret_val)
+	{
+		name = (char *) ll_returnNodeData (n);
+
+		/* it could never be extracted where it was added from */
+		if (false == ff_safeName (name))
+		{
+			printf (LOC_UNSAFE_ADD, name);
+			++ list->errors;
+		}
+		else if (pl_isDir (name))
+		{
+			d.path = malloc (strlen (name) + 1);
+			if (NULL == d.path)
+				ret_val = false;
+			else if (false == walk_pushDirs (&shared, &d, 1))
+			{
+				free (d.path);
+				ret_val = false;
+			}
+			else
+				strcpy (d.path, name);
+		}
+		else
+		{
+			size = mtime = 0;
+			stamped = pl_getFileStamp (name, &size, &mtime);
+			ret_val = walk_addFile (list, NULL, name, d.arg, stamped, size, mtime);
+		}
+
+		++ d.arg;
+		n = ll_advancePointer (n);
+	}
+
+	if (shared.num_dirs > 0)
+	{
+		if (false == ret_val)
+			shared.abort = true;
+
+		if (false == walk_dirs (&shared, list))
+			ret_val = false;
+
+		walk_sortList = list;
+		qsort (list->files, list->num_files, sizeof *list->files, walk_compareFiles);
+	}
+
+	free (shared.dirs);
+
+	return ret_val;
+}
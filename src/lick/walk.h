@@ -0,0 +1,59 @@
+// This file is part of the Lick project
+//
+// Lick is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Lick is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lick.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef WALK_H
+#define WALK_H
+
+#include	"types_lib.h"
+#include	"llist_lib.h"
+
+/* a file, and where its name is in the list's names */
+struct walkFile
+{
+	unsigned long         name;
+	unsigned long         arg;			/* of the names given, the one it was found by */
+	unsigned long         size;
+	unsigned long         mtime;
+	bool                  stamped;	/* whether its size and time are known */
+};
+
+/* however many files there are, their names are in one block of memory
+	 and everything else in another */
+struct walkList
+{
+	char *                names;
+	unsigned long         names_used;
+	unsigned long         names_size;
+
+	struct walkFile *     files;
+	unsigned long         num_files;
+	unsigned long         max_files;
+
+	/* directories that couldn't be read */
+	unsigned long         errors;
+};
+
+#define walk_name(list, i)		((list)->names + (list)->files[i].name)
+
+void walk_initList (struct walkList *);
+void walk_freeList (struct walkList *);
+
+/* every file named, and every file under each directory named, in the
+	 order they were named and then by name. a file named that doesn't
+	 exist is in the list, unstamped, for whoever uses it to report. a name
+	 with a ".." in it is reported here, and left out */
+bool walk (struct llist *names, struct walkList *list);
+
+#endif /* WALK_H */